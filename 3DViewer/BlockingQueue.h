@@ -0,0 +1,57 @@
+#ifndef BLOCKING_QUEUE_H
+#define BLOCKING_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Bounded multi-producer/multi-consumer queue used to hand work between pipeline threads.
+// Push blocks while the queue is full, Pop blocks while it is empty. After Close() pushes are
+// rejected and Pop drains the remaining items before returning false.
+template <typename T>
+class BlockingQueue
+{
+public:
+	explicit BlockingQueue(size_t capacity) : m_capacity(capacity) {}
+
+	bool Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_not_full.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+		if (m_closed)
+			return false;
+		m_items.push_back(std::move(item));
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_not_empty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+		if (m_items.empty())
+			return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return true;
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+private:
+	size_t m_capacity;
+	bool m_closed = false;
+	std::deque<T> m_items;
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+};
+
+#endif
@@ -15,6 +15,22 @@ glm::mat4 Camera::GetProjectionMatrix()
 	return glm::perspective(glm::radians(m_fov), (float)width / (float)height, 0.1f, 100.0f);
 }
 
+void Camera::SetViewportSize(unsigned int viewport_width, unsigned int viewport_height)
+{
+	if (viewport_width == 0 || viewport_height == 0)
+	{
+		return;
+	}
+
+	if (viewport_width != width || viewport_height != height)
+	{
+		m_dirty = true;
+	}
+
+	width = viewport_width;
+	height = viewport_height;
+}
+
 void Camera::Orbit(float x_offset, float y_offset)
 {
 	m_position_xangle += x_offset * m_mouse_sensitivity;
@@ -55,6 +71,10 @@ void Camera::Zoom(double y_offset)
 void Camera::ProcessKeyboard(Camera_Movement direction, float deltaTime)
 {
 	float velocity = MovementSpeed * deltaTime;
+	if (velocity == 0.0f)
+		return;
+
+	m_dirty = true;
 	if (direction == FORWARD)
 		m_position_coords += Front * velocity;
 	if (direction == BACKWARD)
@@ -81,5 +101,7 @@ void Camera::updateCameraVectors()
 	glm::vec3 front_vec = glm::normalize(m_position_coords) * glm::vec3(-1.0);
 	glm::vec3 right_vec = glm::normalize(glm::cross(front_vec, m_WORLD_UP_VEC));
 	m_up_vec = glm::normalize(glm::cross(right_vec, front_vec));
+
+	m_dirty = true;
 }
 
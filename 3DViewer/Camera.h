@@ -45,12 +45,12 @@ public:
 
     Camera();
 
-    // camera Attributes
-    glm::vec3 Front;
-    glm::vec3 Right;
+    // camera Attributes, zero initialized like the global camera of the viewer so every instance behaves the same
+    glm::vec3 Front = glm::vec3(0.0f);
+    glm::vec3 Right = glm::vec3(0.0f);
 
     // camera options
-    float MovementSpeed;
+    float MovementSpeed = 0.0f;
 
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
     glm::mat4 GetViewMatrix();
@@ -59,6 +59,15 @@ public:
 
     glm::vec3 GetPosition(void) { return m_position_coords; }
 
+    float GetDistance(void) { return m_distance; }
+
+    float GetFov(void) { return m_fov; }
+
+    float GetMouseSensitivity(void) { return m_mouse_sensitivity; }
+
+    // Updates the aspect ratio used by the projection matrix
+    void SetViewportSize(unsigned int viewport_width, unsigned int viewport_height);
+
     void Orbit(float x_offset, float y_offset);
 
     void Zoom(double y_offset);
@@ -66,6 +75,11 @@ public:
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime);
 
+    // true when the view or projection changed since the last ClearDirty(), the viewer only redraws then
+    bool IsDirty(void) { return m_dirty; }
+
+    void ClearDirty(void) { m_dirty = false; }
+
 private:
 
     float m_fov = 45.0f;
@@ -80,6 +94,9 @@ private:
     unsigned int width = 800;
     unsigned int height = 800;
 
+    // set by everything that moves the camera or changes the projection
+    bool m_dirty = true;
+
     // Sensitivities
     float m_mouse_sensitivity = 0.3;
     float m_zoom_sensitivity = 0.5;
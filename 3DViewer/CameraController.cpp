@@ -0,0 +1,88 @@
+#include "CameraController.h"
+#include "Logger.h"
+
+CameraController::CameraController(Camera& camera, double cursor_x, double cursor_y)
+	: m_camera(camera), m_last_x(cursor_x), m_last_y(cursor_y)
+{
+}
+
+void CameraController::MouseButton(int button, int action, double cursor_x, double cursor_y)
+{
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+	{
+		m_dragging = true;
+		m_left_button_down = true;
+		m_last_x = cursor_x;
+		m_last_y = cursor_y;
+		LOG_DEBUG(LogCategory::Input, "Left Button Down Pressed");
+	}
+
+	else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
+	{
+		m_right_button_down = true;
+		m_last_x = cursor_x;
+		m_last_y = cursor_y;
+		LOG_DEBUG(LogCategory::Input, "Right Button Down Pressed");
+	}
+
+	else if (button == GLFW_MOUSE_BUTTON_LEFT || (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE))
+	{
+		m_dragging = false;
+		m_left_button_down = false;
+		m_right_button_down = false;
+	}
+}
+
+void CameraController::CursorPosition(double x, double y)
+{
+	float x_offset = x - m_last_x;
+	float y_offset = m_last_y - y; // reversed since y-coordinates go from bottom to top
+	LOG_TRACE(LogCategory::Input, "%f : %f", x_offset, y_offset);
+
+	m_last_x = x;
+	m_last_y = y;
+
+	if (m_dragging && m_left_button_down)
+	{
+		m_camera.Orbit(x_offset, y_offset);
+	}
+
+	if (m_first_mouse)
+	{
+		m_last_x = x;
+		m_last_y = y;
+		m_first_mouse = false;
+	}
+}
+
+void CameraController::Scroll(double /*x_offset*/, double y_offset)
+{
+	// horizontal scroll has no camera binding, it is only kept so recordings hold the full event
+	m_camera.Zoom(y_offset);
+	LOG_DEBUG(LogCategory::Input, "SCROLLING MOUSE %f", y_offset);
+}
+
+void CameraController::Keys(unsigned int keys, float delta_time)
+{
+	// Process WASD Movements of the camera
+	if (keys & KEY_FORWARD)
+	{
+		m_camera.ProcessKeyboard(FORWARD, delta_time);
+		LOG_DEBUG(LogCategory::Input, "FORWARD PRESSED");
+	}
+	if (keys & KEY_BACKWARD)
+	{
+		m_camera.ProcessKeyboard(BACKWARD, delta_time);
+		LOG_DEBUG(LogCategory::Input, "BACKWARD PRESSED");
+	}
+	if (keys & KEY_LEFT)
+	{
+		m_camera.ProcessKeyboard(LEFT, delta_time);
+		LOG_DEBUG(LogCategory::Input, "LEFT PRESSED");
+	}
+	if (keys & KEY_RIGHT)
+	{
+		m_camera.ProcessKeyboard(RIGHT, delta_time);
+		LOG_DEBUG(LogCategory::Input, "RIGHT PRESSED");
+	}
+}
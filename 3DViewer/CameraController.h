@@ -0,0 +1,45 @@
+#ifndef CAMERA_CONTROLLER_H
+#define CAMERA_CONTROLLER_H
+
+#include "Camera.h"
+
+// Movement keys held down during a frame, as sampled by processInput
+enum InputKeys {
+	KEY_FORWARD = 1 << 0,
+	KEY_BACKWARD = 1 << 1,
+	KEY_LEFT = 1 << 2,
+	KEY_RIGHT = 1 << 3
+};
+
+// Mouse and keyboard handling of the viewer camera. It only sees plain values, never the GLFW
+// window, so events from the GLFW callbacks and events read back from a recording behave the same.
+class CameraController
+{
+public:
+	CameraController(Camera& camera, double cursor_x, double cursor_y);
+
+	// cursor_x/y is the cursor position at the time of the click
+	void MouseButton(int button, int action, double cursor_x, double cursor_y);
+
+	// Left dragging orbits the camera
+	void CursorPosition(double x, double y);
+
+	// Vertical scrolling zooms, x_offset is ignored
+	void Scroll(double x_offset, double y_offset);
+
+	// keys is a combination of InputKeys
+	void Keys(unsigned int keys, float delta_time);
+
+private:
+	Camera& m_camera;
+
+	double m_last_x;
+	double m_last_y;
+	bool m_first_mouse = true;
+
+	bool m_left_button_down = false;
+	bool m_right_button_down = false;
+	bool m_dragging = false;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "Culling.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+// below this many boxes a range isn't worth a job
+static const size_t PARALLEL_GRAIN = 4096;
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+	// Gribb/Hartmann: each plane is the fourth row plus or minus one of the other rows
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;	// left
+	frustum.planes[1] = row3 - row0;	// right
+	frustum.planes[2] = row3 + row1;	// bottom
+	frustum.planes[3] = row3 - row1;	// top
+	frustum.planes[4] = row3 + row2;	// near
+	frustum.planes[5] = row3 - row2;	// far
+
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(frustum.planes[i]));
+		if (length > 0.0f)
+			frustum.planes[i] /= length;
+	}
+	return frustum;
+}
+
+bool IsBoxVisible(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+
+	for (int i = 0; i < 6; i++)
+	{
+		const glm::vec4& plane = frustum.planes[i];
+		// Distance of the box corner furthest along the plane normal
+		float radius = extent.x * glm::abs(plane.x) + extent.y * glm::abs(plane.y) + extent.z * glm::abs(plane.z);
+		if (glm::dot(glm::vec3(plane), center) + plane.w + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+size_t CullBoxes(const Frustum& frustum, const glm::vec3* boundsMin, const glm::vec3* boundsMax, size_t count, unsigned int* visible)
+{
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		// Branch free append, the slot is overwritten when the box is culled
+		visible[visibleCount] = (unsigned int)i;
+		visibleCount += IsBoxVisible(frustum, boundsMin[i], boundsMax[i]) ? 1 : 0;
+	}
+	return visibleCount;
+}
+
+size_t CullBoxes(const Frustum& frustum, const glm::vec3* boundsMin, const glm::vec3* boundsMax, size_t count, unsigned int* visible, JobSystem& jobs)
+{
+	int ranges = (int)((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+	if (ranges <= 1 || jobs.GetThreadCount() == 1)
+		return CullBoxes(frustum, boundsMin, boundsMax, count, visible);
+
+	// each range compacts in place at its own start, visible has room for all of them
+	std::vector<size_t> rangeCounts(ranges);
+	jobs.ParallelFor(ranges, 1, [&](int begin, int end)
+	{
+		for (int range = begin; range < end; range++)
+		{
+			size_t first = range * PARALLEL_GRAIN;
+			size_t last = std::min(count, first + PARALLEL_GRAIN);
+			size_t visibleCount = 0;
+			for (size_t i = first; i < last; i++)
+			{
+				visible[first + visibleCount] = (unsigned int)i;
+				visibleCount += IsBoxVisible(frustum, boundsMin[i], boundsMax[i]) ? 1 : 0;
+			}
+			rangeCounts[range] = visibleCount;
+		}
+	});
+
+	// range r starts at r * PARALLEL_GRAIN and moves down to the sum of the counts before it, never past its own start
+	size_t visibleCount = rangeCounts[0];
+	for (int range = 1; range < ranges; range++)
+	{
+		memmove(visible + visibleCount, visible + range * PARALLEL_GRAIN, rangeCounts[range] * sizeof(unsigned int));
+		visibleCount += rangeCounts[range];
+	}
+	return visibleCount;
+}
+
+// Maps a float to an unsigned key with the same ordering, negative values included
+static unsigned int FloatToSortKey(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+void SortFrontToBack(const glm::mat4& view, const glm::vec3* centers, unsigned int* indices, size_t count, std::vector<unsigned long long>& scratch)
+{
+	// The camera looks down -z, so the distance in front of it is -z in view space
+	glm::vec4 depthRow(view[0][2], view[1][2], view[2][2], view[3][2]);
+
+	scratch.resize(count * 2);
+	unsigned long long* keys = scratch.data();
+	unsigned long long* temp = keys + count;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const glm::vec3& center = centers[indices[i]];
+		float depth = -(depthRow.x * center.x + depthRow.y * center.y + depthRow.z * center.z + depthRow.w);
+		keys[i] = ((unsigned long long)FloatToSortKey(depth) << 32) | indices[i];
+	}
+
+	// LSD radix sort of the depth half of the keys, 4 passes of 8 bits
+	for (int shift = 32; shift < 64; shift += 8)
+	{
+		size_t offsets[256] = {};
+		for (size_t i = 0; i < count; i++)
+			offsets[(keys[i] >> shift) & 0xff]++;
+
+		size_t sum = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t digitCount = offsets[digit];
+			offsets[digit] = sum;
+			sum += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			temp[offsets[(keys[i] >> shift) & 0xff]++] = keys[i];
+
+		unsigned long long* swap = keys;
+		keys = temp;
+		temp = swap;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		indices[i] = (unsigned int)keys[i];
+}
+
+void SortFrontToBack(const glm::mat4& view, const glm::vec3* centers, unsigned int* indices, size_t count, std::vector<unsigned long long>& scratch, JobSystem& jobs)
+{
+	int ranges = (int)((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+	if (ranges <= 1 || jobs.GetThreadCount() == 1)
+	{
+		SortFrontToBack(view, centers, indices, count, scratch);
+		return;
+	}
+
+	glm::vec4 depthRow(view[0][2], view[1][2], view[2][2], view[3][2]);
+
+	scratch.resize(count * 2);
+	unsigned long long* keys = scratch.data();
+	unsigned long long* temp = keys + count;
+
+	jobs.ParallelFor((int)count, (int)PARALLEL_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			const glm::vec3& center = centers[indices[i]];
+			float depth = -(depthRow.x * center.x + depthRow.y * center.y + depthRow.z * center.z + depthRow.w);
+			keys[i] = ((unsigned long long)FloatToSortKey(depth) << 32) | indices[i];
+		}
+	});
+
+	// one histogram of 256 digits per range
+	std::vector<size_t> offsets(ranges * 256);
+	for (int shift = 32; shift < 64; shift += 8)
+	{
+		std::fill(offsets.begin(), offsets.end(), 0);
+		jobs.ParallelFor(ranges, 1, [&](int begin, int end)
+		{
+			for (int range = begin; range < end; range++)
+			{
+				size_t* rangeOffsets = offsets.data() + range * 256;
+				size_t last = std::min(count, (range + 1) * PARALLEL_GRAIN);
+				for (size_t i = range * PARALLEL_GRAIN; i < last; i++)
+					rangeOffsets[(keys[i] >> shift) & 0xff]++;
+			}
+		});
+
+		// equal digits keep their order: earlier ranges write before later ones
+		size_t sum = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			for (int range = 0; range < ranges; range++)
+			{
+				size_t digitCount = offsets[range * 256 + digit];
+				offsets[range * 256 + digit] = sum;
+				sum += digitCount;
+			}
+		}
+
+		jobs.ParallelFor(ranges, 1, [&](int begin, int end)
+		{
+			for (int range = begin; range < end; range++)
+			{
+				size_t* rangeOffsets = offsets.data() + range * 256;
+				size_t last = std::min(count, (range + 1) * PARALLEL_GRAIN);
+				for (size_t i = range * PARALLEL_GRAIN; i < last; i++)
+					temp[rangeOffsets[(keys[i] >> shift) & 0xff]++] = keys[i];
+			}
+		});
+
+		unsigned long long* swap = keys;
+		keys = temp;
+		temp = swap;
+	}
+
+	jobs.ParallelFor((int)count, (int)PARALLEL_GRAIN, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			indices[i] = (unsigned int)keys[i];
+	});
+}
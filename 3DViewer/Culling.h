@@ -0,0 +1,38 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+// Planes of a view frustum as (normal, distance), normals point inwards and are normalized
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Extracts the frustum planes from a projection * view (* model) matrix
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+// True if the axis aligned box is at least partly inside the frustum. Conservative: boxes near a
+// frustum corner may be reported visible although they are outside.
+bool IsBoxVisible(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+// Tests count boxes against the frustum and writes the indices of the visible ones to visible,
+// which must have room for count entries. Returns the number of visible boxes.
+size_t CullBoxes(const Frustum& frustum, const glm::vec3* boundsMin, const glm::vec3* boundsMax, size_t count, unsigned int* visible);
+// Same result on the workers of jobs: every range compacts its own visible indices, then the ranges
+// are concatenated in order.
+size_t CullBoxes(const Frustum& frustum, const glm::vec3* boundsMin, const glm::vec3* boundsMax, size_t count, unsigned int* visible, JobSystem& jobs);
+
+// Reorders indices so the boxes they refer to go from nearest to farthest along the view direction,
+// using the box centers. Radix sort on the depth, stable for equal depths. scratch is reused between calls.
+void SortFrontToBack(const glm::mat4& view, const glm::vec3* centers, unsigned int* indices, size_t count, std::vector<unsigned long long>& scratch);
+// Same order on the workers of jobs: every range counts its own digits, and the offsets go digit major,
+// range minor, so the scatter stays stable.
+void SortFrontToBack(const glm::mat4& view, const glm::vec3* centers, unsigned int* indices, size_t count, std::vector<unsigned long long>& scratch, JobSystem& jobs);
+
+#endif
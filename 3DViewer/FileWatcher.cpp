@@ -0,0 +1,111 @@
+#include "FileWatcher.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+	m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_fd < 0)
+		LOG_ERROR(LogCategory::General, "ERROR::FILE_WATCHER::INOTIFY_INIT_FAILED");
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	if (m_fd >= 0)
+		close(m_fd);
+#endif
+}
+
+bool FileWatcher::Watch(const std::string& path)
+{
+	std::error_code error;
+	fs::path absolute = fs::absolute(path, error).lexically_normal();
+
+	WatchedFile file;
+	file.path = path;
+	file.directory = absolute.parent_path();
+	file.name = absolute.filename();
+	file.writeTime = fs::last_write_time(absolute, error);
+
+#ifdef __linux__
+	if (m_fd < 0)
+		return false;
+
+	// Watching the directory sees files replaced by rename, a watch on the file itself would be lost with the old inode.
+	// Adding the same directory twice returns the existing watch.
+	file.watch = inotify_add_watch(m_fd, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (file.watch < 0)
+	{
+		LOG_ERROR(LogCategory::General, "ERROR::FILE_WATCHER::CANNOT_WATCH: %s", file.directory.string());
+		return false;
+	}
+#endif
+
+	m_files.push_back(file);
+	return true;
+}
+
+std::vector<std::string> FileWatcher::Poll()
+{
+	std::vector<std::string> changed;
+	auto add = [&changed](const std::string& path) {
+		if (std::find(changed.begin(), changed.end(), path) == changed.end())
+			changed.push_back(path);
+	};
+
+#ifdef __linux__
+	if (m_fd < 0)
+		return changed;
+
+	alignas(inotify_event) char buffer[4096];
+	for (;;)
+	{
+		ssize_t length = read(m_fd, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (char* cursor = buffer; cursor < buffer + length;)
+		{
+			const inotify_event* event = (const inotify_event*)cursor;
+			cursor += sizeof(inotify_event) + event->len;
+			if (event->len == 0)
+				continue;
+
+			for (const WatchedFile& file : m_files)
+			{
+				if (file.watch == event->wd && file.name == event->name)
+					add(file.path);
+			}
+		}
+	}
+#else
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - m_last_poll < POLL_INTERVAL)
+		return changed;
+	m_last_poll = now;
+
+	for (WatchedFile& file : m_files)
+	{
+		std::error_code error;
+		fs::file_time_type write_time = fs::last_write_time(file.directory / file.name, error);
+		if (!error && write_time != file.writeTime)
+		{
+			file.writeTime = write_time;
+			add(file.path);
+		}
+	}
+#endif
+
+	return changed;
+}
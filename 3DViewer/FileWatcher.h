@@ -0,0 +1,48 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Reports changes to a set of files without blocking.
+// On Linux the directories of the files are watched with inotify, which also catches editors that
+// save by writing a new file and renaming it over the old one. Other platforms compare the last
+// write times of the files, at most every POLL_INTERVAL.
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Starts watching a file, returns false if its directory can't be watched
+	bool Watch(const std::string& path);
+
+	// Returns the watched files (as passed to Watch) that changed since the last call
+	std::vector<std::string> Poll();
+
+private:
+	struct WatchedFile
+	{
+		std::string path;
+		std::filesystem::path directory;
+		std::filesystem::path name;
+		std::filesystem::file_time_type writeTime;
+		int watch = -1;
+	};
+
+	std::vector<WatchedFile> m_files;
+
+#ifdef __linux__
+	int m_fd = -1;
+#else
+	static constexpr std::chrono::milliseconds POLL_INTERVAL = std::chrono::milliseconds(250);
+	std::chrono::steady_clock::time_point m_last_poll;
+#endif
+};
+
+#endif
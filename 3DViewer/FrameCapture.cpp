@@ -0,0 +1,286 @@
+#include "FrameCapture.h"
+#include "ImageWriter.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+void FrameCapture::Create(int slots)
+{
+	m_slots.resize(slots > 1 ? slots : 2);
+	for (Slot& slot : m_slots)
+		glGenBuffers(1, &slot.pbo);
+	m_next = 0;
+}
+
+void FrameCapture::Delete()
+{
+	Flush();
+	for (Slot& slot : m_slots)
+		glDeleteBuffers(1, &slot.pbo);
+	m_slots.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_free_buffers.clear();
+}
+
+bool FrameCapture::StartSequence(const std::string& directory, const std::string& prefix, CaptureFormat format)
+{
+	std::error_code error;
+	fs::create_directories(directory, error);
+	if (error)
+	{
+		LOG_ERROR(LogCategory::Render, "ERROR::CAPTURE::CANNOT_CREATE_DIRECTORY: %s", directory);
+		return false;
+	}
+
+	m_recording = true;
+	m_directory = directory;
+	m_prefix = prefix;
+	m_format = format;
+	m_sequence_frame = 0;
+	return true;
+}
+
+void FrameCapture::StopSequence()
+{
+	m_recording = false;
+}
+
+void FrameCapture::RequestScreenshot(const std::string& path, CaptureFormat format)
+{
+	m_screenshot = path;
+	m_screenshot_format = format;
+}
+
+void FrameCapture::CaptureFrame(int width, int height)
+{
+	if (!HasRequest() || width <= 0 || height <= 0 || m_slots.empty())
+		return;
+
+	Clock::time_point start = Clock::now();
+	Slot& slot = m_slots[m_next];
+
+	// the buffer still holds an older frame the GPU hasn't finished, or the encoders are behind
+	bool full = slot.fence != 0;
+	if (full || m_backlog.load() >= m_max_backlog)
+	{
+		if (m_recording)
+		{
+			m_sequence_frame++;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.dropped++;
+		}
+		AddFrameTime(start);
+		return;
+	}
+
+	// a screenshot goes first, the sequence frame it replaces counts as dropped
+	if (!m_screenshot.empty())
+	{
+		slot.path = m_screenshot;
+		slot.format = m_screenshot_format;
+		m_screenshot.clear();
+		if (m_recording)
+		{
+			m_sequence_frame++;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.dropped++;
+		}
+	}
+	else
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "_%06llu", m_sequence_frame++);
+		slot.path = (fs::path(m_directory) / (m_prefix + name + GetExtension(m_format))).string();
+		slot.format = m_format;
+	}
+
+	size_t bytes = (size_t)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if (bytes > slot.capacity)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_READ);
+		slot.capacity = bytes;
+	}
+	// RGBA rows are 4 byte aligned whatever the pack alignment, and the format drivers copy without conversion
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width = width;
+	slot.height = height;
+	slot.requested = start;
+
+	m_next = (m_next + 1) % m_slots.size();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.captured++;
+	}
+	AddFrameTime(start);
+}
+
+void FrameCapture::Update()
+{
+	Clock::time_point start = Clock::now();
+	bool work = false;
+
+	// oldest first, the files of a sequence are queued in order
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		Slot& slot = m_slots[(m_next + i) % m_slots.size()];
+		if (!slot.fence)
+			continue;
+		if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+			break;
+		Retire(slot);
+		work = true;
+	}
+
+	m_encodes.erase(std::remove_if(m_encodes.begin(), m_encodes.end(), [](const JobHandle& job) { return job.IsDone(); }), m_encodes.end());
+
+	if (work)
+		AddFrameTime(start);
+
+	// one frame's capture work: the read of the last CaptureFrame and the copies of this Update
+	if (m_frame_ms > 0.0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.lastFrameMs = m_frame_ms;
+		m_stats.maxFrameMs = std::max(m_stats.maxFrameMs, m_frame_ms);
+		m_stats.totalFrameMs += m_frame_ms;
+		m_stats.frames++;
+		m_frame_ms = 0.0;
+	}
+}
+
+void FrameCapture::Retire(Slot& slot)
+{
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	std::shared_ptr<std::vector<unsigned char>> pixels;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_free_buffers.empty())
+		{
+			pixels = std::move(m_free_buffers.back());
+			m_free_buffers.pop_back();
+		}
+	}
+	if (!pixels)
+		pixels = std::make_shared<std::vector<unsigned char>>();
+	pixels->resize((size_t)slot.width * slot.height * 4);
+
+	// the copy out of the mapping is the only thing the GL thread does with the pixels
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)pixels->size(), GL_MAP_READ_BIT);
+	bool mapped_ok = mapped != NULL;
+	if (mapped_ok)
+	{
+		memcpy(pixels->data(), mapped, pixels->size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (!mapped_ok)
+	{
+		LOG_ERROR(LogCategory::Render, "ERROR::CAPTURE::MAP_FAILED: %s", slot.path);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.failed++;
+		m_free_buffers.push_back(std::move(pixels));
+		return;
+	}
+
+	m_backlog++;
+	int width = slot.width;
+	int height = slot.height;
+	std::string path = slot.path;
+	CaptureFormat format = slot.format;
+	Clock::time_point requested = slot.requested;
+	m_encodes.push_back(JobSystem::Get().Submit([this, pixels, width, height, path, format, requested]() {
+		Encode(pixels, width, height, path, format, requested);
+	}));
+}
+
+void FrameCapture::Encode(std::shared_ptr<std::vector<unsigned char>> pixels, int width, int height, const std::string& path,
+	CaptureFormat format, Clock::time_point requested)
+{
+	// the back buffer's alpha is whatever the shaders wrote, the images are opaque
+	unsigned char* data = pixels->data();
+	for (size_t i = 3; i < pixels->size(); i += 4)
+		data[i] = 255;
+
+	// rows come bottom up from glReadPixels
+	bool ok = format == CAPTURE_FORMAT_EXR
+		? WriteEXR(path.c_str(), width, height, 4, data, width * 4, true)
+		: WritePNG(path.c_str(), width, height, 4, data, width * 4, true);
+	if (!ok)
+		LOG_ERROR(LogCategory::Render, "ERROR::CAPTURE::WRITE_FAILED: %s", path);
+
+	double latency = std::chrono::duration<double, std::milli>(Clock::now() - requested).count();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (ok)
+		m_stats.written++;
+	else
+		m_stats.failed++;
+	m_stats.lastLatencyMs = latency;
+	m_stats.maxLatencyMs = std::max(m_stats.maxLatencyMs, latency);
+	m_stats.totalLatencyMs += latency;
+	m_free_buffers.push_back(std::move(pixels));
+	m_backlog--;
+}
+
+void FrameCapture::AddFrameTime(Clock::time_point start)
+{
+	m_frame_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool FrameCapture::IsBusy() const
+{
+	if (m_backlog.load() > 0)
+		return true;
+	for (const Slot& slot : m_slots)
+	{
+		if (slot.fence)
+			return true;
+	}
+	return false;
+}
+
+void FrameCapture::Flush()
+{
+	// oldest first, blocking on each fence
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		Slot& slot = m_slots[(m_next + i) % m_slots.size()];
+		if (!slot.fence)
+			continue;
+		while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		Retire(slot);
+	}
+
+	JobSystem& jobs = JobSystem::Get();
+	for (const JobHandle& job : m_encodes)
+		jobs.Wait(job);
+	m_encodes.clear();
+}
+
+CaptureStats FrameCapture::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	CaptureStats stats = m_stats;
+	stats.encodeBacklog = m_backlog.load();
+	stats.pendingReadbacks = 0;
+	for (const Slot& slot : m_slots)
+	{
+		if (slot.fence)
+			stats.pendingReadbacks++;
+	}
+	return stats;
+}
@@ -0,0 +1,142 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include "JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum CaptureFormat
+{
+	CAPTURE_FORMAT_PNG,
+	CAPTURE_FORMAT_EXR
+};
+
+struct CaptureStats
+{
+	// frames read back, files written, sequence frames dropped and files that failed to write
+	unsigned long long captured = 0;
+	unsigned long long written = 0;
+	unsigned long long dropped = 0;
+	unsigned long long failed = 0;
+	// from the CaptureFrame call to the file on disk
+	double lastLatencyMs = 0.0;
+	double maxLatencyMs = 0.0;
+	double totalLatencyMs = 0.0;
+	// time CaptureFrame and Update cost the GL thread, per frame that did any capture work
+	double lastFrameMs = 0.0;
+	double maxFrameMs = 0.0;
+	double totalFrameMs = 0.0;
+	unsigned long long frames = 0;
+	// reads the GPU hasn't finished and images waiting for or being encoded, when the stats were taken
+	size_t pendingReadbacks = 0;
+	size_t encodeBacklog = 0;
+
+	double GetAverageLatencyMs() const { return written + failed > 0 ? totalLatencyMs / (written + failed) : 0.0; }
+	double GetAverageFrameMs() const { return frames > 0 ? totalFrameMs / frames : 0.0; }
+};
+
+// Screenshots and image sequences of the rendered frames without stalling the GL thread.
+//   - CaptureFrame queues a glReadPixels of the bound read framebuffer into the next of a ring of pixel
+//     pack buffers and fences it. The GPU copies the pixels while the CPU goes on with the next frames.
+//   - Update, once per frame, maps the buffers whose fence signaled (a few frames later), copies the
+//     pixels out and hands them to JobSystem::Get(), where PNG or EXR encoding and the file writes run.
+//   - Neither ever waits. A sequence frame that finds its buffer still in flight or too many images
+//     waiting for the encoders is dropped: it keeps its number, so the gap shows in the file names. A
+//     screenshot that doesn't fit waits for the next frame instead.
+// GL thread only, the encoding runs on the job system.
+class FrameCapture
+{
+public:
+	// slots pixel pack buffers, sized on first use and whenever the frame gets larger
+	void Create(int slots = 4);
+	// Writes what is still in flight first
+	void Delete();
+
+	// Writes every captured frame to directory as prefix_000000.png (.exr), creating directory. Returns
+	// false if it can't be created.
+	bool StartSequence(const std::string& directory, const std::string& prefix, CaptureFormat format);
+	void StopSequence();
+	bool IsRecording() const { return m_recording; }
+	const std::string& GetSequenceDirectory() const { return m_directory; }
+
+	// Writes the next captured frame to path
+	void RequestScreenshot(const std::string& path, CaptureFormat format);
+	bool HasRequest() const { return m_recording || !m_screenshot.empty(); }
+
+	// Sequence frames are dropped while this many images wait for the encoders, 8 by default
+	void SetMaxBacklog(size_t images) { m_max_backlog = images; }
+
+	// After the frame is drawn: reads width x height pixels of the bound read framebuffer if a sequence
+	// or a screenshot wants them
+	void CaptureFrame(int width, int height);
+
+	// Once per frame: hands the finished reads to the encoders
+	void Update();
+
+	// Reads or encodes in flight, Update has work to do
+	bool IsBusy() const;
+
+	// Waits for every read and every file, at exit or before the context goes away
+	void Flush();
+
+	CaptureStats GetStats() const;
+
+	static const char* GetExtension(CaptureFormat format) { return format == CAPTURE_FORMAT_EXR ? ".exr" : ".png"; }
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// A read in flight: the pixels of one frame on their way into pbo
+	struct Slot
+	{
+		GLuint pbo = 0;
+		size_t capacity = 0;
+		GLsync fence = 0;
+		int width = 0;
+		int height = 0;
+		std::string path;
+		CaptureFormat format = CAPTURE_FORMAT_PNG;
+		Clock::time_point requested;
+	};
+
+	// maps the pixels of slot and queues their encoding
+	void Retire(Slot& slot);
+	void Encode(std::shared_ptr<std::vector<unsigned char>> pixels, int width, int height, const std::string& path,
+		CaptureFormat format, Clock::time_point requested);
+	// adds the time since start to the capture cost of this frame
+	void AddFrameTime(Clock::time_point start);
+
+	std::vector<Slot> m_slots;
+	// next slot to read into, the oldest read in flight is the first one after it with a fence
+	size_t m_next = 0;
+
+	bool m_recording = false;
+	std::string m_directory;
+	std::string m_prefix;
+	CaptureFormat m_format = CAPTURE_FORMAT_PNG;
+	unsigned long long m_sequence_frame = 0;
+
+	std::string m_screenshot;
+	CaptureFormat m_screenshot_format = CAPTURE_FORMAT_PNG;
+
+	size_t m_max_backlog = 8;
+	std::atomic<size_t> m_backlog{ 0 };
+	std::vector<JobHandle> m_encodes;
+	// capture cost of the frame so far, Update closes it
+	double m_frame_ms = 0.0;
+
+	// pixel buffers handed back by the encoders, reused for the next reads
+	mutable std::mutex m_mutex;
+	std::vector<std::shared_ptr<std::vector<unsigned char>>> m_free_buffers;
+	CaptureStats m_stats;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+
+FrameStats::FrameStats(bool gpu_timing) : m_gpu_timing(gpu_timing)
+{
+	for (int i = 0; i < GPU_QUERIES; i++)
+		m_query_frames[i] = -1;
+
+	if (m_gpu_timing)
+		glGenQueries(GPU_QUERIES, m_queries);
+}
+
+void FrameStats::BeginFrame()
+{
+	if (m_gpu_timing)
+	{
+		int slot = (int)(m_frames.size() % GPU_QUERIES);
+		if (m_query_frames[slot] >= 0)
+			ResolveQuery(slot);
+
+		m_query_frames[slot] = (long long)m_frames.size();
+		glBeginQuery(GL_TIME_ELAPSED, m_queries[slot]);
+	}
+
+	m_frame_start = std::chrono::steady_clock::now();
+}
+
+void FrameStats::EndFrame(const DrawStats& draws)
+{
+	FrameRecord record;
+	record.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_frame_start).count();
+	record.drawCalls = draws.drawCalls;
+	record.triangles = draws.triangles;
+
+	if (m_gpu_timing)
+		glEndQuery(GL_TIME_ELAPSED);
+
+	m_frames.push_back(record);
+}
+
+void FrameStats::ResolveQuery(int slot)
+{
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(m_queries[slot], GL_QUERY_RESULT, &elapsed);
+	m_frames[m_query_frames[slot]].gpuMs = elapsed / 1.0e6;
+	m_query_frames[slot] = -1;
+}
+
+void FrameStats::Finish()
+{
+	if (!m_gpu_timing)
+		return;
+
+	for (int i = 0; i < GPU_QUERIES; i++)
+	{
+		if (m_query_frames[i] >= 0)
+			ResolveQuery(i);
+	}
+}
+
+void FrameStats::Delete()
+{
+	if (!m_gpu_timing)
+		return;
+
+	glDeleteQueries(GPU_QUERIES, m_queries);
+	m_gpu_timing = false;
+}
+
+FrameStats::Summary FrameStats::Summarize(bool gpu, size_t skip_frames) const
+{
+	std::vector<double> samples;
+	for (size_t i = skip_frames; i < m_frames.size(); i++)
+	{
+		double value = gpu ? m_frames[i].gpuMs : m_frames[i].cpuMs;
+		if (value >= 0.0)
+			samples.push_back(value);
+	}
+
+	Summary summary;
+	summary.count = samples.size();
+	if (samples.empty())
+		return summary;
+
+	std::sort(samples.begin(), samples.end());
+	// Nearest rank percentiles
+	auto percentile = [&samples](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))]; };
+	for (double sample : samples)
+		summary.mean += sample;
+	summary.mean /= samples.size();
+	summary.p50 = percentile(0.50);
+	summary.p95 = percentile(0.95);
+	summary.p99 = percentile(0.99);
+	summary.max = samples.back();
+	return summary;
+}
+
+void FrameStats::PrintSummary(FILE* file, size_t skip_frames) const
+{
+	skip_frames = std::min(skip_frames, m_frames.size());
+	fprintf(file, "Frames: %zu (%zu warm up frames skipped)\n", m_frames.size() - skip_frames, skip_frames);
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		if (pass == 1 && !m_gpu_timing)
+			break;
+
+		Summary summary = Summarize(pass == 1, skip_frames);
+		fprintf(file, "  %s ms: mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", pass == 0 ? "cpu" : "gpu",
+			summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
+	}
+
+	if (m_frames.size() > skip_frames)
+	{
+		double drawCalls = 0.0, triangles = 0.0;
+		for (size_t i = skip_frames; i < m_frames.size(); i++)
+		{
+			drawCalls += m_frames[i].drawCalls;
+			triangles += (double)m_frames[i].triangles;
+		}
+		size_t count = m_frames.size() - skip_frames;
+		fprintf(file, "  draws per frame: %.1f  triangles per frame: %.0f\n", drawCalls / count, triangles / count);
+	}
+}
+
+bool FrameStats::WriteCsv(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		printf("ERROR::FRAME_STATS::CANNOT_WRITE: %s\n", path.c_str());
+		return false;
+	}
+
+	fprintf(file, "frame,cpu_ms,gpu_ms,draw_calls,triangles\n");
+	for (size_t i = 0; i < m_frames.size(); i++)
+	{
+		const FrameRecord& frame = m_frames[i];
+		fprintf(file, "%zu,%.4f,%.4f,%u,%zu\n", i, frame.cpuMs, frame.gpuMs, frame.drawCalls, frame.triangles);
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool FrameStats::WriteJson(const std::string& path, const std::string& label, size_t skip_frames) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		printf("ERROR::FRAME_STATS::CANNOT_WRITE: %s\n", path.c_str());
+		return false;
+	}
+
+	skip_frames = std::min(skip_frames, m_frames.size());
+	std::string escaped;
+	for (char c : label)
+	{
+		if (c == '"' || c == '\\')
+			escaped.push_back('\\');
+		if ((unsigned char)c >= 0x20)
+			escaped.push_back(c);
+	}
+
+	fprintf(file, "{\n  \"label\": \"%s\",\n  \"frames\": %zu,\n  \"warmup_frames\": %zu,\n", escaped.c_str(), m_frames.size(), skip_frames);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		Summary summary = Summarize(pass == 1, skip_frames);
+		fprintf(file, "  \"%s\": {\"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, \"samples\": %zu},\n",
+			pass == 0 ? "cpu" : "gpu", summary.mean, summary.p50, summary.p95, summary.p99, summary.max, summary.count);
+	}
+
+	const char* arrays[] = { "cpu_ms", "gpu_ms", "draw_calls", "triangles" };
+	for (int a = 0; a < 4; a++)
+	{
+		fprintf(file, "  \"%s\": [", arrays[a]);
+		for (size_t i = 0; i < m_frames.size(); i++)
+		{
+			const FrameRecord& frame = m_frames[i];
+			const char* separator = i > 0 ? ", " : "";
+			if (a == 0)
+				fprintf(file, "%s%.4f", separator, frame.cpuMs);
+			else if (a == 1)
+				fprintf(file, "%s%.4f", separator, frame.gpuMs);
+			else if (a == 2)
+				fprintf(file, "%s%u", separator, frame.drawCalls);
+			else
+				fprintf(file, "%s%zu", separator, frame.triangles);
+		}
+		fprintf(file, "]%s\n", a < 3 ? "," : "");
+	}
+	fprintf(file, "}\n");
+
+	fclose(file);
+	return true;
+}
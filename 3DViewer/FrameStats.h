@@ -0,0 +1,77 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <glad/glad.h>
+
+#include "Mesh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Per-frame timings and draw statistics of a benchmark run (e.g. an input replay).
+// CPU time is wall time between BeginFrame and EndFrame. GPU time comes from a GL_TIME_ELAPSED
+// query per frame; queries are recycled after GPU_QUERIES frames, so results are normally read
+// long after the GPU finished and reading them does not stall.
+class FrameStats
+{
+public:
+	static constexpr int GPU_QUERIES = 16;
+
+	// With gpu_timing a GL context must be current for every call except the reports
+	explicit FrameStats(bool gpu_timing);
+
+	void BeginFrame();
+	void EndFrame(const DrawStats& draws);
+
+	// Waits for the outstanding GPU results
+	void Finish();
+
+	// Deletes the GL queries
+	void Delete();
+
+	size_t GetFrameCount() const { return m_frames.size(); }
+
+	// Percentiles and averages of all frames after skip_frames (warm up)
+	void PrintSummary(FILE* file, size_t skip_frames = 0) const;
+
+	// One line per frame: frame, cpu_ms, gpu_ms, draw_calls, triangles
+	bool WriteCsv(const std::string& path) const;
+
+	// Summary plus the per-frame arrays, label identifies the run (e.g. commit or model)
+	bool WriteJson(const std::string& path, const std::string& label, size_t skip_frames = 0) const;
+
+private:
+	struct FrameRecord
+	{
+		double cpuMs = 0.0;
+		// negative until the query result has been read
+		double gpuMs = -1.0;
+		unsigned int drawCalls = 0;
+		size_t triangles = 0;
+	};
+
+	struct Summary
+	{
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+		size_t count = 0;
+	};
+
+	void ResolveQuery(int slot);
+	Summary Summarize(bool gpu, size_t skip_frames) const;
+
+	bool m_gpu_timing;
+	GLuint m_queries[GPU_QUERIES] = {};
+	// frame index waiting on each query, -1 if the query is free
+	long long m_query_frames[GPU_QUERIES];
+
+	std::chrono::steady_clock::time_point m_frame_start;
+	std::vector<FrameRecord> m_frames;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "Framebuffer.h"
+
+// Constructor that generates the framebuffer and its attachments
+Framebuffer::Framebuffer(int width, int height) : width(width), height(height)
+{
+	glGenRenderbuffers(1, &colorRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &depthRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &ID);
+	glBindFramebuffer(GL_FRAMEBUFFER, ID);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Returns true if the driver accepted the attachment combination
+bool Framebuffer::IsComplete()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, ID);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+// Binds the framebuffer for drawing and reading
+void Framebuffer::Bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, ID);
+}
+
+// Binds the default framebuffer
+void Framebuffer::Unbind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Deletes the framebuffer and its attachments
+void Framebuffer::Delete()
+{
+	glDeleteFramebuffers(1, &ID);
+	glDeleteRenderbuffers(1, &colorRBO);
+	glDeleteRenderbuffers(1, &depthRBO);
+}
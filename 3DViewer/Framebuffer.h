@@ -0,0 +1,30 @@
+#ifndef FRAMEBUFFER_CLASS_H
+#define FRAMEBUFFER_CLASS_H
+
+#include <glad/glad.h>
+
+// Offscreen render target with an RGBA8 color and a 24 bit depth attachment
+class Framebuffer
+{
+public:
+	// ID reference of the Framebuffer Object
+	GLuint ID;
+	// Renderbuffers attached to the framebuffer
+	GLuint colorRBO, depthRBO;
+	// Size of both attachments in pixels
+	int width, height;
+
+	// Constructor that generates the framebuffer and its attachments
+	Framebuffer(int width, int height);
+
+	// Returns true if the driver accepted the attachment combination
+	bool IsComplete();
+	// Binds the framebuffer for drawing and reading
+	void Bind();
+	// Binds the default framebuffer
+	void Unbind();
+	// Deletes the framebuffer and its attachments
+	void Delete();
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef GL_OBJECT_H
+#define GL_OBJECT_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+
+struct GLBufferTraits
+{
+	static void Create(GLuint* id) { glGenBuffers(1, id); }
+	static void Destroy(GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct GLTextureTraits
+{
+	static void Create(GLuint* id) { glGenTextures(1, id); }
+	static void Destroy(GLuint id) { glDeleteTextures(1, &id); }
+};
+
+struct GLVertexArrayTraits
+{
+	static void Create(GLuint* id) { glGenVertexArrays(1, id); }
+	static void Destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+// Owns one GL object name and deletes it when destroyed or reset. It moves but never copies, so a
+// name can't be deleted twice or be left behind by a copy of its owner.
+// The destructor is a GL call like any other and needs the context current. Owners that can outlive
+// the context (e.g. a Model destroyed after the window) are emptied with their Delete() first.
+template <typename Traits>
+class GLObject
+{
+public:
+	GLObject() = default;
+	explicit GLObject(GLuint id) : m_id(id)
+	{
+		if (m_id)
+			s_live++;
+	}
+	~GLObject() { Reset(); }
+
+	GLObject(const GLObject&) = delete;
+	GLObject& operator=(const GLObject&) = delete;
+
+	GLObject(GLObject&& other) noexcept : m_id(other.m_id) { other.m_id = 0; }
+	GLObject& operator=(GLObject&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_id = other.m_id;
+			other.m_id = 0;
+		}
+		return *this;
+	}
+
+	// Generates a new name
+	static GLObject Create()
+	{
+		GLuint id = 0;
+		Traits::Create(&id);
+		return GLObject(id);
+	}
+
+	GLuint Get() const { return m_id; }
+	explicit operator bool() const { return m_id != 0; }
+
+	// Deletes the object, if any
+	void Reset()
+	{
+		if (m_id)
+		{
+			Traits::Destroy(m_id);
+			s_live--;
+		}
+		m_id = 0;
+	}
+
+	// Gives up ownership without deleting, the caller is responsible for the name
+	GLuint Release()
+	{
+		GLuint id = m_id;
+		if (m_id)
+			s_live--;
+		m_id = 0;
+		return id;
+	}
+
+	// Names of this type currently owned by a GLObject, for leak checks
+	static long long GetLiveCount() { return s_live; }
+
+private:
+	GLuint m_id = 0;
+
+	inline static std::atomic<long long> s_live{ 0 };
+};
+
+typedef GLObject<GLBufferTraits> GLBuffer;
+typedef GLObject<GLTextureTraits> GLTexture;
+typedef GLObject<GLVertexArrayTraits> GLVertexArray;
+
+#endif
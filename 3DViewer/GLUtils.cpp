@@ -0,0 +1,53 @@
+#include "GLUtils.h"
+
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+bool HasGLExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	}
+	return false;
+}
+
+BufferStorageProc LoadBufferStorage(GLADloadproc loader)
+{
+	bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) || HasGLExtension("GL_ARB_buffer_storage");
+	return supported && loader ? (BufferStorageProc)loader("glBufferStorage") : nullptr;
+}
+
+GLuint CreateMappedBuffer(GLenum target, GLsizeiptr size, BufferStorageProc buffer_storage, GLenum usage, unsigned char** mapped)
+{
+	*mapped = nullptr;
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+	if (buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		buffer_storage(target, size, NULL, flags);
+		*mapped = (unsigned char*)glMapBufferRange(target, 0, size, flags);
+		if (!*mapped)
+		{
+			// immutable storage can't be respecified, start over with a regular buffer
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(target, buffer);
+		}
+	}
+	if (!*mapped)
+		glBufferData(target, size, NULL, usage);
+	glBindBuffer(target, 0);
+	return buffer;
+}
@@ -0,0 +1,20 @@
+#ifndef GL_UTILS_H
+#define GL_UTILS_H
+
+#include <glad/glad.h>
+
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// Whether the current context lists extension name (GL_ARB_..., GL_KHR_...)
+bool HasGLExtension(const char* name);
+
+// glBufferStorage when GL 4.4 or ARB_buffer_storage provides it, nullptr otherwise
+BufferStorageProc LoadBufferStorage(GLADloadproc loader);
+
+// A new buffer of size bytes for writing from the CPU. With buffer_storage it is immutable and
+// persistently, coherently mapped, the mapping is returned in mapped. Without it, or when the driver
+// refuses the mapping, it is a regular glBufferData(usage) buffer and mapped is nullptr. Uses target
+// to set the buffer up and leaves it unbound.
+GLuint CreateMappedBuffer(GLenum target, GLsizeiptr size, BufferStorageProc buffer_storage, GLenum usage, unsigned char** mapped);
+
+#endif
@@ -0,0 +1,193 @@
+#include "GeometryStore.h"
+#include "GpuResourcePool.h"
+#include "MemoryTracker.h"
+
+#include <cstring>
+
+static const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+// seed of GeometryKey::check, any constant unrelated to the primes
+static const uint64_t CHECK_SEED = 0x6A09E667F3BCC908ULL;
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t Read64(const unsigned char* data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint64_t Round(uint64_t lane, uint64_t input)
+{
+	lane += input * PRIME_2;
+	lane = RotateLeft(lane, 31);
+	return lane * PRIME_1;
+}
+
+static inline uint64_t MergeRound(uint64_t hash, uint64_t lane)
+{
+	hash ^= Round(0, lane);
+	return hash * PRIME_1 + PRIME_4;
+}
+
+void GeometryRef::Reset()
+{
+	if (m_entry)
+		GeometryStore::Get().Release(m_entry);
+	m_entry = nullptr;
+}
+
+GeometryStore& GeometryStore::Get()
+{
+	static GeometryStore store;
+	return store;
+}
+
+GeometryStore::GeometryStore()
+{
+	m_memory_owner = MemoryTracker::Get().AddOwner("Geometry store");
+}
+
+uint64_t GeometryStore::Hash(const void* data, size_t bytes, uint64_t seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + bytes;
+	uint64_t hash;
+
+	if (bytes >= 32)
+	{
+		// four independent lanes keep the multiplier busy instead of waiting on one chain
+		uint64_t lane0 = seed + PRIME_1 + PRIME_2;
+		uint64_t lane1 = seed + PRIME_2;
+		uint64_t lane2 = seed;
+		uint64_t lane3 = seed - PRIME_1;
+		const unsigned char* limit = end - 32;
+		do
+		{
+			lane0 = Round(lane0, Read64(p));
+			lane1 = Round(lane1, Read64(p + 8));
+			lane2 = Round(lane2, Read64(p + 16));
+			lane3 = Round(lane3, Read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		hash = RotateLeft(lane0, 1) + RotateLeft(lane1, 7) + RotateLeft(lane2, 12) + RotateLeft(lane3, 18);
+		hash = MergeRound(hash, lane0);
+		hash = MergeRound(hash, lane1);
+		hash = MergeRound(hash, lane2);
+		hash = MergeRound(hash, lane3);
+	}
+	else
+		hash = seed + PRIME_5;
+
+	hash += (uint64_t)bytes;
+	for (; p + 8 <= end; p += 8)
+		hash = RotateLeft(hash ^ Round(0, Read64(p)), 27) * PRIME_1 + PRIME_4;
+	for (; p < end; p++)
+		hash = RotateLeft(hash ^ (*p * PRIME_5), 11) * PRIME_1;
+
+	// final avalanche, every input bit reaches every output bit
+	hash ^= hash >> 33;
+	hash *= PRIME_2;
+	hash ^= hash >> 29;
+	hash *= PRIME_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+GeometryKey GeometryStore::MakeKey(const void* vertices, size_t vertexCount, size_t vertexSize, const unsigned int* indices, size_t indexCount)
+{
+	size_t vertex_bytes = vertexCount * vertexSize;
+	size_t index_bytes = indexCount * sizeof(unsigned int);
+	GeometryKey key;
+	key.hash = Hash(indices, index_bytes, Hash(vertices, vertex_bytes));
+	key.check = Hash(indices, index_bytes, Hash(vertices, vertex_bytes, CHECK_SEED) ^ CHECK_SEED);
+	key.vertexCount = vertexCount;
+	key.indexCount = indexCount;
+	return key;
+}
+
+GeometryRef GeometryStore::Find(const GeometryKey& key)
+{
+	auto it = m_published.find(key);
+	if (it == m_published.end())
+	{
+		m_stats.misses++;
+		return GeometryRef();
+	}
+
+	m_stats.hits++;
+	AddReference(it->second);
+	return GeometryRef(it->second);
+}
+
+GeometryRef GeometryStore::Create(const GeometryKey& key, size_t vertexBytes, size_t indexBytes)
+{
+	GpuResourcePool& pool = GpuResourcePool::Get();
+	GeometryEntry* entry = new GeometryEntry();
+	entry->key = key;
+	entry->vertexArray = GLVertexArray::Create();
+	entry->vertexBuffer = pool.AcquireBuffer(vertexBytes);
+	entry->indexBuffer = pool.AcquireBuffer(indexBytes);
+	entry->vertexBytes = vertexBytes;
+	entry->indexBytes = indexBytes;
+	entry->vertexCapacity = GpuResourcePool::GetBufferBucket(vertexBytes);
+	entry->indexCapacity = GpuResourcePool::GetBufferBucket(indexBytes);
+
+	m_stats.entries++;
+	m_stats.storedBytes += vertexBytes + indexBytes;
+	m_stats.uploadedBytes += vertexBytes + indexBytes;
+	m_buffer_bytes += entry->vertexCapacity + entry->indexCapacity;
+	AddReference(entry);
+	ReportMemory();
+	return GeometryRef(entry);
+}
+
+void GeometryStore::Publish(const GeometryRef& ref)
+{
+	GeometryEntry* entry = ref.m_entry;
+	if (!entry || entry->published)
+		return;
+	if (m_published.emplace(entry->key, entry).second)
+		entry->published = true;
+}
+
+void GeometryStore::AddReference(GeometryEntry* entry)
+{
+	entry->references++;
+	m_stats.references++;
+	m_stats.referencedBytes += entry->vertexBytes + entry->indexBytes;
+}
+
+void GeometryStore::Release(GeometryEntry* entry)
+{
+	m_stats.references--;
+	m_stats.referencedBytes -= entry->vertexBytes + entry->indexBytes;
+	if (--entry->references > 0)
+		return;
+
+	if (entry->published)
+		m_published.erase(entry->key);
+	entry->vertexArray.Reset();
+	GpuResourcePool& pool = GpuResourcePool::Get();
+	pool.ReleaseBuffer(std::move(entry->vertexBuffer), entry->vertexCapacity);
+	pool.ReleaseBuffer(std::move(entry->indexBuffer), entry->indexCapacity);
+
+	m_stats.entries--;
+	m_stats.storedBytes -= entry->vertexBytes + entry->indexBytes;
+	m_buffer_bytes -= entry->vertexCapacity + entry->indexCapacity;
+	delete entry;
+	ReportMemory();
+}
+
+void GeometryStore::ReportMemory()
+{
+	MemoryTracker::Get().Set(m_memory_owner, MEMORY_GPU_BUFFER, m_buffer_bytes);
+}
@@ -0,0 +1,153 @@
+#ifndef GEOMETRY_STORE_H
+#define GEOMETRY_STORE_H
+
+#include "GLObject.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// Content of a vertex and index array: two hashes of their bytes with unrelated seeds plus the counts.
+// Arrays of different sizes never compare equal, and equal sizes only when both 64 bit hashes collide
+// at once, as unlikely as a collision of one 128 bit hash. The store never sees the bytes themselves
+// (meshes may drop their CPU copy after the upload), so the key has to be strong enough on its own.
+struct GeometryKey
+{
+	uint64_t hash = 0;
+	uint64_t check = 0;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+
+	bool operator==(const GeometryKey& other) const
+	{
+		return hash == other.hash && check == other.check && vertexCount == other.vertexCount && indexCount == other.indexCount;
+	}
+};
+
+struct GeometryStoreStats
+{
+	// distinct geometries held and the references to them (one per mesh using one)
+	size_t entries = 0;
+	size_t references = 0;
+	// vertex and index bytes held once, and what the references would hold without sharing
+	size_t storedBytes = 0;
+	size_t referencedBytes = 0;
+	// lookups that found uploaded geometry and ones that had to upload it
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+	unsigned long long uploadedBytes = 0;
+
+	// referenced / stored bytes, 1 when nothing is shared
+	double GetSharingRatio() const { return storedBytes > 0 ? (double)referencedBytes / storedBytes : 1.0; }
+};
+
+// Vertex array with its vertex and index buffers, shared by every mesh with the same content
+struct GeometryEntry
+{
+	GeometryKey key;
+	GLVertexArray vertexArray;
+	GLBuffer vertexBuffer;
+	GLBuffer indexBuffer;
+	// data sizes, and what the GpuResourcePool allocated for them
+	size_t vertexBytes = 0;
+	size_t indexBytes = 0;
+	size_t vertexCapacity = 0;
+	size_t indexCapacity = 0;
+	unsigned int references = 0;
+	// filled and findable, see GeometryStore::Publish
+	bool published = false;
+};
+
+// One reference to a GeometryEntry, moves but never copies. Dropping the last reference hands the
+// buffers back to the GpuResourcePool.
+class GeometryRef
+{
+public:
+	GeometryRef() = default;
+	~GeometryRef() { Reset(); }
+
+	GeometryRef(const GeometryRef&) = delete;
+	GeometryRef& operator=(const GeometryRef&) = delete;
+
+	GeometryRef(GeometryRef&& other) noexcept : m_entry(other.m_entry) { other.m_entry = nullptr; }
+	GeometryRef& operator=(GeometryRef&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_entry = other.m_entry;
+			other.m_entry = nullptr;
+		}
+		return *this;
+	}
+
+	explicit operator bool() const { return m_entry != nullptr; }
+
+	GLuint GetVertexArray() const { return m_entry->vertexArray.Get(); }
+	GLuint GetVertexBuffer() const { return m_entry->vertexBuffer.Get(); }
+	GLuint GetIndexBuffer() const { return m_entry->indexBuffer.Get(); }
+
+	// Drops the reference, if any
+	void Reset();
+
+private:
+	friend class GeometryStore;
+	explicit GeometryRef(GeometryEntry* entry) : m_entry(entry) {}
+
+	GeometryEntry* m_entry = nullptr;
+};
+
+// Content addressed storage of mesh geometry on the GPU. Meshes look their vertex and index data up by
+// GeometryKey before uploading it, and identical meshes, within a model or across all loaded ones, draw
+// from one vertex array and one pair of buffers. Loading a new revision of a model while the old one is
+// still loaded only uploads the meshes that changed.
+//   - An entry is only found once its data is complete (Publish), so a mesh never draws from buffers
+//     whose upload is still queued. Two models streaming the same mesh at once both upload it.
+//   - The buffers are tracked under "Geometry store" in the MemoryTracker, not under the meshes using them.
+// GL thread only, except Hash.
+class GeometryStore
+{
+public:
+	static GeometryStore& Get();
+
+	// 64 bit hash of bytes, four lanes of 8 bytes at a time (xxHash64 style) so it runs at memory speed
+	static uint64_t Hash(const void* data, size_t bytes, uint64_t seed = 0);
+
+	// Key of vertexCount vertices of vertexSize bytes and indexCount 32 bit indices
+	static GeometryKey MakeKey(const void* vertices, size_t vertexCount, size_t vertexSize, const unsigned int* indices, size_t indexCount);
+
+	// A new reference to the published geometry with key, empty when there is none
+	GeometryRef Find(const GeometryKey& key);
+
+	// New unpublished geometry: an empty vertex array and buffers from the GpuResourcePool with room for
+	// vertexBytes and indexBytes. The caller sets up the vertex array and fills the buffers.
+	GeometryRef Create(const GeometryKey& key, size_t vertexBytes, size_t indexBytes);
+
+	// Makes the geometry of ref findable once its buffers are filled. Stays private to its references
+	// when published geometry with the same key turned up in the meantime.
+	void Publish(const GeometryRef& ref);
+
+	const GeometryStoreStats& GetStats() const { return m_stats; }
+
+private:
+	friend class GeometryRef;
+
+	struct KeyHash
+	{
+		size_t operator()(const GeometryKey& key) const { return (size_t)key.hash; }
+	};
+
+	GeometryStore();
+
+	void AddReference(GeometryEntry* entry);
+	void Release(GeometryEntry* entry);
+	void ReportMemory();
+
+	// published entries, the store deletes an entry with its last reference whether published or not
+	std::unordered_map<GeometryKey, GeometryEntry*, KeyHash> m_published;
+	GeometryStoreStats m_stats;
+	size_t m_buffer_bytes = 0;
+	unsigned int m_memory_owner = 0;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "GpuResourcePool.h"
+#include "MemoryTracker.h"
+
+static const size_t MIN_BUFFER_BUCKET = 4096;
+
+GpuResourcePool& GpuResourcePool::Get()
+{
+	static GpuResourcePool pool;
+	return pool;
+}
+
+GpuResourcePool::GpuResourcePool()
+{
+	m_memory_owner = MemoryTracker::Get().AddOwner("GPU resource pool");
+}
+
+void GpuResourcePool::SetCapacity(size_t bytes)
+{
+	m_capacity = bytes;
+	Trim(m_capacity);
+}
+
+size_t GpuResourcePool::GetBufferBucket(size_t size)
+{
+	if (size <= MIN_BUFFER_BUCKET)
+		return MIN_BUFFER_BUCKET;
+
+	size_t power = MIN_BUFFER_BUCKET;
+	while (power * 2 <= size)
+		power *= 2;
+	size_t step = power / 4;
+	return (size + step - 1) / step * step;
+}
+
+GLBuffer GpuResourcePool::AcquireBuffer(size_t size)
+{
+	Key key;
+	key.bufferSize = GetBufferBucket(size);
+	GLuint id = Take(key);
+	if (id)
+		return GLBuffer(id);
+
+	// bound to the copy target so the element buffer of the bound VAO stays as it is
+	GLBuffer buffer = GLBuffer::Create();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.Get());
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)key.bufferSize, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+void GpuResourcePool::ReleaseBuffer(GLBuffer buffer, size_t capacity)
+{
+	if (!buffer)
+		return;
+	Key key;
+	key.bufferSize = capacity;
+	Put(key, buffer.Release(), capacity, false);
+}
+
+GLTexture GpuResourcePool::AcquireTexture(const TextureStorage& storage)
+{
+	Key key;
+	key.storage = storage;
+	return GLTexture(Take(key));
+}
+
+void GpuResourcePool::ReleaseTexture(GLTexture texture, const TextureStorage& storage, size_t bytes)
+{
+	if (!texture)
+		return;
+	Key key;
+	key.storage = storage;
+	Put(key, texture.Release(), bytes, true);
+}
+
+void GpuResourcePool::Clear()
+{
+	Trim(0);
+}
+
+GLuint GpuResourcePool::Take(const Key& key)
+{
+	// the most recently released of the key, its memory is the most likely to still be resident
+	auto range = m_free.equal_range(key);
+	auto newest = m_free.end();
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (newest == m_free.end() || it->second.serial > newest->second.serial)
+			newest = it;
+	}
+	if (newest == m_free.end())
+	{
+		m_stats.misses++;
+		return 0;
+	}
+
+	GLuint id = newest->second.id;
+	m_stats.hits++;
+	Remove(newest);
+	ReportMemory();
+	return id;
+}
+
+void GpuResourcePool::Put(const Key& key, GLuint id, size_t bytes, bool texture)
+{
+	// objects larger than the whole pool would only push everything else out
+	if (bytes > m_capacity)
+	{
+		if (texture)
+			glDeleteTextures(1, &id);
+		else
+			glDeleteBuffers(1, &id);
+		return;
+	}
+
+	Trim(m_capacity - bytes);
+	Entry entry;
+	entry.id = id;
+	entry.bytes = bytes;
+	entry.texture = texture;
+	entry.serial = m_serial++;
+	m_free.emplace(key, entry);
+	m_stats.freeObjects++;
+	m_stats.freeBytes += bytes;
+	(texture ? m_free_texture_bytes : m_free_buffer_bytes) += bytes;
+	ReportMemory();
+}
+
+void GpuResourcePool::Trim(size_t bytes)
+{
+	bool trimmed = false;
+	while (m_stats.freeBytes > bytes)
+	{
+		auto oldest = m_free.begin();
+		for (auto it = m_free.begin(); it != m_free.end(); ++it)
+		{
+			if (it->second.serial < oldest->second.serial)
+				oldest = it;
+		}
+
+		Entry& entry = oldest->second;
+		if (entry.texture)
+			glDeleteTextures(1, &entry.id);
+		else
+			glDeleteBuffers(1, &entry.id);
+		m_stats.evictions++;
+		Remove(oldest);
+		trimmed = true;
+	}
+	if (trimmed)
+		ReportMemory();
+}
+
+void GpuResourcePool::Remove(std::multimap<Key, Entry>::iterator it)
+{
+	const Entry& entry = it->second;
+	m_stats.freeObjects--;
+	m_stats.freeBytes -= entry.bytes;
+	(entry.texture ? m_free_texture_bytes : m_free_buffer_bytes) -= entry.bytes;
+	m_free.erase(it);
+}
+
+void GpuResourcePool::ReportMemory()
+{
+	MemoryTracker& tracker = MemoryTracker::Get();
+	tracker.Set(m_memory_owner, MEMORY_GPU_BUFFER, m_free_buffer_bytes);
+	tracker.Set(m_memory_owner, MEMORY_GPU_TEXTURE, m_free_texture_bytes);
+}
@@ -0,0 +1,121 @@
+#ifndef GPU_RESOURCE_POOL_H
+#define GPU_RESOURCE_POOL_H
+
+#include "GLObject.h"
+
+#include <cstddef>
+#include <map>
+
+// Storage of a GL_TEXTURE_2D, a pooled texture is only handed out again for the same storage
+struct TextureStorage
+{
+	GLenum internalFormat = 0;
+	int width = 0;
+	int height = 0;
+	int levels = 0;
+
+	bool operator<(const TextureStorage& other) const
+	{
+		if (internalFormat != other.internalFormat)
+			return internalFormat < other.internalFormat;
+		if (width != other.width)
+			return width < other.width;
+		if (height != other.height)
+			return height < other.height;
+		return levels < other.levels;
+	}
+};
+
+struct GpuPoolStats
+{
+	// acquires served from the pool and ones that had to allocate
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+	// free objects deleted to stay within the capacity
+	unsigned long long evictions = 0;
+	size_t freeObjects = 0;
+	size_t freeBytes = 0;
+};
+
+// Keeps the buffers and textures of unloaded models for the next ones instead of deleting them, so
+// switching through many models doesn't reallocate (and fragment) GPU memory every time.
+//   - Buffers are bucketed by size, four buckets per power of two from 4 KB, so any buffer of a bucket
+//     fits every request rounded into it and at most a quarter of a buffer is wasted.
+//   - Textures are only reused for the same format, size and level count, immutable storage can't change.
+// Free objects are kept up to the capacity, the ones released first are deleted first.
+// GL thread only, the free objects are tracked under "GPU resource pool" in the MemoryTracker.
+class GpuResourcePool
+{
+public:
+	static const size_t DEFAULT_CAPACITY = 256 * 1024 * 1024;
+
+	static GpuResourcePool& Get();
+
+	// Bytes of free objects kept, 0 turns pooling off and releases delete right away
+	void SetCapacity(size_t bytes);
+	size_t GetCapacity() const { return m_capacity; }
+
+	// Size of the buffer AcquireBuffer returns for size bytes
+	static size_t GetBufferBucket(size_t size);
+
+	// A buffer with GetBufferBucket(size) bytes of GL_STATIC_DRAW storage and undefined contents
+	GLBuffer AcquireBuffer(size_t size);
+
+	// Hands buffer back, capacity is what AcquireBuffer allocated
+	void ReleaseBuffer(GLBuffer buffer, size_t capacity);
+
+	// A free texture with exactly this storage, empty when there is none and the caller allocates it
+	GLTexture AcquireTexture(const TextureStorage& storage);
+
+	// Hands texture back, bytes is the size of its storage
+	void ReleaseTexture(GLTexture texture, const TextureStorage& storage, size_t bytes);
+
+	// Deletes the free objects, call before the context goes away
+	void Clear();
+
+	const GpuPoolStats& GetStats() const { return m_stats; }
+
+private:
+	GpuResourcePool();
+
+	struct Key
+	{
+		// 0 for buffers, their bucket size in bufferSize
+		TextureStorage storage;
+		size_t bufferSize = 0;
+
+		bool operator<(const Key& other) const
+		{
+			if (bufferSize != other.bufferSize)
+				return bufferSize < other.bufferSize;
+			return storage < other.storage;
+		}
+	};
+
+	struct Entry
+	{
+		// raw names, a static pool must not call into the GL after the context is gone
+		GLuint id = 0;
+		size_t bytes = 0;
+		bool texture = false;
+		unsigned long long serial = 0;
+	};
+
+	GLuint Take(const Key& key);
+	void Put(const Key& key, GLuint id, size_t bytes, bool texture);
+	// deletes the oldest free objects until at most bytes are left
+	void Trim(size_t bytes);
+	// drops the entry from m_free and the counters, the name is the caller's
+	void Remove(std::multimap<Key, Entry>::iterator it);
+	void ReportMemory();
+
+	std::multimap<Key, Entry> m_free;
+	size_t m_capacity = DEFAULT_CAPACITY;
+	unsigned long long m_serial = 0;
+	GpuPoolStats m_stats;
+	size_t m_free_buffer_bytes = 0;
+	size_t m_free_texture_bytes = 0;
+	unsigned int m_memory_owner = 0;
+};
+
+#endif
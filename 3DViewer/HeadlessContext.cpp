@@ -0,0 +1,180 @@
+#include "HeadlessContext.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef VIEWER_HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext()
+{
+}
+
+#ifdef VIEWER_HEADLESS_OSMESA
+
+bool HeadlessContext::Create(int major, int minor)
+{
+	const int attribs[] = {
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 24,
+		OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+		OSMESA_CONTEXT_MAJOR_VERSION, major,
+		OSMESA_CONTEXT_MINOR_VERSION, minor,
+		0
+	};
+
+	OSMesaContext context = OSMesaCreateContextAttribs(attribs, NULL);
+	if (!context)
+	{
+		std::cout << "ERROR::HEADLESS::OSMESA_CONTEXT_CREATION_FAILED" << std::endl;
+		return false;
+	}
+
+	// OSMesa needs a color buffer to make the context current, the real targets are FBOs
+	m_osmesa_buffer = new unsigned char[4];
+	if (!OSMesaMakeCurrent(context, m_osmesa_buffer, GL_UNSIGNED_BYTE, 1, 1))
+	{
+		std::cout << "ERROR::HEADLESS::OSMESA_MAKE_CURRENT_FAILED" << std::endl;
+		OSMesaDestroyContext(context);
+		return false;
+	}
+
+	m_context = context;
+	m_backend_name = "OSMesa";
+	return true;
+}
+
+void HeadlessContext::Delete()
+{
+	if (m_context)
+		OSMesaDestroyContext((OSMesaContext)m_context);
+	delete[] m_osmesa_buffer;
+	m_osmesa_buffer = nullptr;
+	m_context = nullptr;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return (void*)OSMesaGetProcAddress(name);
+}
+
+#else
+
+bool HeadlessContext::Create(int major, int minor)
+{
+	// Prefer the surfaceless platform, it does not need a display server or a GPU device node
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	bool surfaceless = false;
+
+	if (client_extensions && getPlatformDisplay && strstr(client_extensions, "EGL_MESA_platform_surfaceless"))
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		surfaceless = display != EGL_NO_DISPLAY;
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint egl_major, egl_minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &egl_major, &egl_minor))
+	{
+		std::cout << "ERROR::HEADLESS::EGL_INITIALIZE_FAILED: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "ERROR::HEADLESS::EGL_OPENGL_API_UNAVAILABLE" << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+
+	EGLConfig config = NULL;
+	EGLint num_configs = 0;
+	if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0)
+	{
+		std::cout << "ERROR::HEADLESS::EGL_NO_MATCHING_CONFIG" << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		std::cout << "ERROR::HEADLESS::EGL_CONTEXT_CREATION_FAILED: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+		eglTerminate(display);
+		return false;
+	}
+
+	// Without the surfaceless platform a tiny pbuffer keeps drivers happy that refuse EGL_NO_SURFACE
+	EGLSurface surface = EGL_NO_SURFACE;
+	if (!surfaceless)
+	{
+		const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+	}
+
+	if (!eglMakeCurrent(display, surface, surface, context))
+	{
+		std::cout << "ERROR::HEADLESS::EGL_MAKE_CURRENT_FAILED: 0x" << std::hex << eglGetError() << std::dec << std::endl;
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+		return false;
+	}
+
+	m_display = display;
+	m_context = context;
+	m_surface = surface;
+	m_backend_name = surfaceless ? "EGL (surfaceless)" : "EGL (pbuffer)";
+	return true;
+}
+
+void HeadlessContext::Delete()
+{
+	if (!m_display)
+		return;
+
+	eglMakeCurrent((EGLDisplay)m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (m_surface != EGL_NO_SURFACE)
+		eglDestroySurface((EGLDisplay)m_display, (EGLSurface)m_surface);
+	if (m_context)
+		eglDestroyContext((EGLDisplay)m_display, (EGLContext)m_context);
+	eglTerminate((EGLDisplay)m_display);
+
+	m_display = nullptr;
+	m_context = nullptr;
+	m_surface = nullptr;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+#endif
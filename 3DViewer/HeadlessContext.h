@@ -0,0 +1,40 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+
+// Creates an OpenGL context without a window or display server, for batch rendering on servers.
+// Uses an EGL surfaceless context (Mesa llvmpipe works fine) and falls back to a 1x1 pbuffer when
+// EGL_MESA_platform_surfaceless is missing. Builds with VIEWER_HEADLESS_OSMESA use OSMesa instead.
+// All rendering is expected to go to a framebuffer object, the context has no default framebuffer.
+class HeadlessContext
+{
+public:
+	HeadlessContext();
+
+	// Creates the context and makes it current on the calling thread, returns false on failure
+	bool Create(int major, int minor);
+
+	// Destroys the context and releases the display
+	void Delete();
+
+	// Name of the platform used to create the context, for logging
+	const char* GetBackendName() { return m_backend_name; }
+
+	// Loader passed to gladLoadGLLoader
+	static void* GetProcAddress(const char* name);
+
+private:
+	const char* m_backend_name = "none";
+
+	void* m_display = nullptr;
+	void* m_context = nullptr;
+	void* m_surface = nullptr;
+
+#ifdef VIEWER_HEADLESS_OSMESA
+	// OSMesa always renders into client memory, even if we only use FBOs
+	unsigned char* m_osmesa_buffer = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,488 @@
+#include "ImageWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// Writes deflate bits least significant bit first
+	struct BitWriter
+	{
+		std::vector<unsigned char>& out;
+		unsigned int buffer = 0;
+		int count = 0;
+
+		BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+		void Write(unsigned int bits, int num_bits)
+		{
+			buffer |= bits << count;
+			count += num_bits;
+			while (count >= 8)
+			{
+				out.push_back((unsigned char)(buffer & 0xff));
+				buffer >>= 8;
+				count -= 8;
+			}
+		}
+
+		// Huffman codes are stored most significant bit first
+		void WriteCode(unsigned int code, int num_bits)
+		{
+			unsigned int reversed = 0;
+			for (int i = 0; i < num_bits; i++)
+				reversed |= ((code >> i) & 1) << (num_bits - 1 - i);
+			Write(reversed, num_bits);
+		}
+
+		void Flush()
+		{
+			if (count > 0)
+				out.push_back((unsigned char)(buffer & 0xff));
+			buffer = 0;
+			count = 0;
+		}
+	};
+
+	const unsigned short LENGTH_BASE[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const unsigned char LENGTH_EXTRA[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const unsigned short DIST_BASE[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const unsigned char DIST_EXTRA[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	const int WINDOW_SIZE = 32768;
+	const int HASH_BITS = 15;
+	const int MAX_CHAIN = 32;
+	const int MIN_MATCH = 3;
+	const int MAX_MATCH = 258;
+
+	void WriteLiteralLength(BitWriter& bits, int symbol)
+	{
+		// Fixed Huffman table from RFC 1951 section 3.2.6
+		if (symbol < 144)
+			bits.WriteCode(0x30 + symbol, 8);
+		else if (symbol < 256)
+			bits.WriteCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			bits.WriteCode(symbol - 256, 7);
+		else
+			bits.WriteCode(0xc0 + symbol - 280, 8);
+	}
+
+	void WriteMatch(BitWriter& bits, int length, int distance)
+	{
+		int code = 0;
+		while (code < 28 && LENGTH_BASE[code + 1] <= length)
+			code++;
+		WriteLiteralLength(bits, 257 + code);
+		bits.Write(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+
+		int dist_code = 0;
+		while (dist_code < 29 && DIST_BASE[dist_code + 1] <= distance)
+			dist_code++;
+		bits.WriteCode(dist_code, 5);
+		bits.Write(distance - DIST_BASE[dist_code], DIST_EXTRA[dist_code]);
+	}
+
+	unsigned int Hash3(const unsigned char* p)
+	{
+		unsigned int v = (p[0] << 16) | (p[1] << 8) | p[2];
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// zlib stream with a single fixed Huffman block and greedy LZ77 matching
+	std::vector<unsigned char> ZlibCompress(const std::vector<unsigned char>& data)
+	{
+		std::vector<unsigned char> out;
+		out.reserve(data.size() / 2 + 64);
+		out.push_back(0x78);
+		out.push_back(0x01);
+
+		BitWriter bits(out);
+		bits.Write(1, 1); // final block
+		bits.Write(1, 2); // fixed Huffman codes
+
+		const int size = (int)data.size();
+		std::vector<int> head(1 << HASH_BITS, -1);
+		std::vector<int> prev(WINDOW_SIZE, -1);
+
+		int pos = 0;
+		while (pos < size)
+		{
+			int best_length = 0;
+			int best_distance = 0;
+
+			if (pos + MIN_MATCH <= size)
+			{
+				unsigned int h = Hash3(&data[pos]);
+				int candidate = head[h];
+				int chain = 0;
+				int max_length = size - pos < MAX_MATCH ? size - pos : MAX_MATCH;
+
+				while (candidate >= 0 && pos - candidate <= WINDOW_SIZE && chain++ < MAX_CHAIN)
+				{
+					int length = 0;
+					while (length < max_length && data[candidate + length] == data[pos + length])
+						length++;
+					if (length > best_length)
+					{
+						best_length = length;
+						best_distance = pos - candidate;
+						if (length == max_length)
+							break;
+					}
+					candidate = prev[candidate & (WINDOW_SIZE - 1)];
+				}
+			}
+
+			int advance = 1;
+			if (best_length >= MIN_MATCH)
+			{
+				WriteMatch(bits, best_length, best_distance);
+				advance = best_length;
+			}
+			else
+			{
+				WriteLiteralLength(bits, data[pos]);
+			}
+
+			// insert every position we step over so later matches can find them
+			for (int i = 0; i < advance; i++, pos++)
+			{
+				if (pos + MIN_MATCH <= size)
+				{
+					unsigned int h = Hash3(&data[pos]);
+					prev[pos & (WINDOW_SIZE - 1)] = head[h];
+					head[h] = pos;
+				}
+			}
+		}
+
+		WriteLiteralLength(bits, 256); // end of block
+		bits.Flush();
+
+		unsigned int a = 1, b = 0;
+		for (int i = 0; i < size; i++)
+		{
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		unsigned int adler = (b << 16) | a;
+		out.push_back((unsigned char)(adler >> 24));
+		out.push_back((unsigned char)(adler >> 16));
+		out.push_back((unsigned char)(adler >> 8));
+		out.push_back((unsigned char)adler);
+		return out;
+	}
+
+	struct CrcTable
+	{
+		unsigned int values[256];
+
+		CrcTable()
+		{
+			for (unsigned int n = 0; n < 256; n++)
+			{
+				unsigned int c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				values[n] = c;
+			}
+		}
+	};
+
+	unsigned int Crc32(const unsigned char* data, size_t length)
+	{
+		// function local static so encoder threads can share the table safely
+		static const CrcTable table;
+
+		unsigned int crc = 0xffffffffu;
+		for (size_t i = 0; i < length; i++)
+			crc = table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	void WriteU32(std::vector<unsigned char>& out, unsigned int v)
+	{
+		out.push_back((unsigned char)(v >> 24));
+		out.push_back((unsigned char)(v >> 16));
+		out.push_back((unsigned char)(v >> 8));
+		out.push_back((unsigned char)v);
+	}
+
+	void WriteChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& payload)
+	{
+		WriteU32(out, (unsigned int)payload.size());
+		size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), payload.begin(), payload.end());
+		WriteU32(out, Crc32(&out[start], out.size() - start));
+	}
+
+	int Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		if (pa <= pb && pa <= pc)
+			return a;
+		if (pb <= pc)
+			return b;
+		return c;
+	}
+
+	// IEEE 754 half from a float, rounded to nearest even. Only finite values in [0, 1] come in here.
+	unsigned short FloatToHalf(float value)
+	{
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+		unsigned int sign = (bits >> 16) & 0x8000;
+		int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+		unsigned int mantissa = bits & 0x7fffff;
+
+		if (exponent <= 0)
+		{
+			// subnormal half, or zero
+			if (exponent < -10)
+				return (unsigned short)sign;
+			mantissa |= 0x800000;
+			int shift = 14 - exponent;
+			unsigned int half = mantissa >> shift;
+			unsigned int rest = mantissa & ((1u << shift) - 1);
+			unsigned int halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1)))
+				half++;
+			return (unsigned short)(sign | half);
+		}
+		if (exponent >= 31)
+			return (unsigned short)(sign | 0x7c00);
+
+		unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13);
+		unsigned int rest = mantissa & 0x1fff;
+		// a carry into the exponent is still the correctly rounded value
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+			half++;
+		return (unsigned short)(sign | half);
+	}
+
+	// Linear half of every 8 bit sRGB value, and of every 8 bit alpha value
+	struct HalfTable
+	{
+		unsigned short srgb[256];
+		unsigned short linear[256];
+
+		HalfTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				srgb[i] = FloatToHalf(c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f));
+				linear[i] = FloatToHalf(c);
+			}
+		}
+	};
+
+	void WriteLE32(std::vector<unsigned char>& out, unsigned int v)
+	{
+		out.push_back((unsigned char)v);
+		out.push_back((unsigned char)(v >> 8));
+		out.push_back((unsigned char)(v >> 16));
+		out.push_back((unsigned char)(v >> 24));
+	}
+
+	void WriteLE64(std::vector<unsigned char>& out, unsigned long long v)
+	{
+		WriteLE32(out, (unsigned int)v);
+		WriteLE32(out, (unsigned int)(v >> 32));
+	}
+
+	void WriteFloat(std::vector<unsigned char>& out, float v)
+	{
+		unsigned int bits;
+		memcpy(&bits, &v, sizeof(bits));
+		WriteLE32(out, bits);
+	}
+
+	// Header attribute: name, type name, value size, then the caller appends the value
+	void WriteAttribute(std::vector<unsigned char>& out, const char* name, const char* type, unsigned int size)
+	{
+		out.insert(out.end(), name, name + strlen(name) + 1);
+		out.insert(out.end(), type, type + strlen(type) + 1);
+		WriteLE32(out, size);
+	}
+
+	void WriteBox(std::vector<unsigned char>& out, const char* name, int width, int height)
+	{
+		WriteAttribute(out, name, "box2i", 16);
+		WriteLE32(out, 0);
+		WriteLE32(out, 0);
+		WriteLE32(out, (unsigned int)(width - 1));
+		WriteLE32(out, (unsigned int)(height - 1));
+	}
+}
+
+std::vector<unsigned char> EncodePNG(int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically)
+{
+	static const unsigned char COLOR_TYPE[] = { 0, 0, 4, 2, 6 };
+	if (width <= 0 || height <= 0 || components < 1 || components > 4 || !pixels)
+		return std::vector<unsigned char>();
+
+	// filter each scanline with the type that gives the smallest absolute sum, same heuristic as stb
+	const int row_bytes = width * components;
+	std::vector<unsigned char> filtered((size_t)(row_bytes + 1) * height);
+	std::vector<unsigned char> candidate(row_bytes);
+	std::vector<unsigned char> zero_row(row_bytes, 0);
+
+	for (int y = 0; y < height; y++)
+	{
+		int src_y = flip_vertically ? height - 1 - y : y;
+		const unsigned char* row = pixels + (size_t)src_y * stride_in_bytes;
+		const unsigned char* up = y == 0 ? zero_row.data() : pixels + (size_t)(flip_vertically ? src_y + 1 : src_y - 1) * stride_in_bytes;
+		unsigned char* dst = &filtered[(size_t)y * (row_bytes + 1)];
+
+		int best_filter = 0;
+		long best_sum = -1;
+		for (int filter = 0; filter < 5; filter++)
+		{
+			long sum = 0;
+			for (int i = 0; i < row_bytes; i++)
+			{
+				int a = i >= components ? row[i - components] : 0;
+				int b = up[i];
+				int c = i >= components ? up[i - components] : 0;
+				int predicted = 0;
+				if (filter == 1)
+					predicted = a;
+				else if (filter == 2)
+					predicted = b;
+				else if (filter == 3)
+					predicted = (a + b) >> 1;
+				else if (filter == 4)
+					predicted = Paeth(a, b, c);
+				candidate[i] = (unsigned char)(row[i] - predicted);
+				sum += abs((signed char)candidate[i]);
+			}
+			if (best_sum < 0 || sum < best_sum)
+			{
+				best_sum = sum;
+				best_filter = filter;
+				memcpy(dst + 1, candidate.data(), row_bytes);
+			}
+		}
+		dst[0] = (unsigned char)best_filter;
+	}
+
+	std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	std::vector<unsigned char> header;
+	WriteU32(header, (unsigned int)width);
+	WriteU32(header, (unsigned int)height);
+	header.push_back(8); // bit depth
+	header.push_back(COLOR_TYPE[components]);
+	header.push_back(0); // compression
+	header.push_back(0); // filter
+	header.push_back(0); // interlace
+	WriteChunk(png, "IHDR", header);
+	WriteChunk(png, "IDAT", ZlibCompress(filtered));
+	WriteChunk(png, "IEND", std::vector<unsigned char>());
+	return png;
+}
+
+bool WritePNG(const char* filename, int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically)
+{
+	std::vector<unsigned char> png = EncodePNG(width, height, components, pixels, stride_in_bytes, flip_vertically);
+	if (png.empty())
+		return false;
+
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+	size_t written = fwrite(png.data(), 1, png.size(), file);
+	fclose(file);
+	return written == png.size();
+}
+
+std::vector<unsigned char> EncodeEXR(int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically)
+{
+	if (width <= 0 || height <= 0 || components < 3 || components > 4 || !pixels)
+		return std::vector<unsigned char>();
+
+	// function local static so encoder threads can share the table safely
+	static const HalfTable table;
+
+	// channels are stored in alphabetical order, each scanline holds all of one channel, then the next
+	static const char* const NAMES[] = { "A", "B", "G", "R" };
+	static const int SOURCE[] = { 3, 2, 1, 0 };
+	const int first = components == 4 ? 0 : 1;
+	const int channels = 4 - first;
+
+	std::vector<unsigned char> exr;
+	exr.reserve(400 + (size_t)height * (8 + 8 + (size_t)width * channels * 2));
+	WriteLE32(exr, 20000630); // magic
+	WriteLE32(exr, 2); // version 2, single part scanline
+
+	WriteAttribute(exr, "channels", "chlist", (unsigned int)(channels * 18 + 1));
+	for (int c = first; c < 4; c++)
+	{
+		exr.push_back((unsigned char)NAMES[c][0]);
+		exr.push_back(0);
+		WriteLE32(exr, 1); // HALF
+		WriteLE32(exr, 0); // pLinear and reserved
+		WriteLE32(exr, 1); // x sampling
+		WriteLE32(exr, 1); // y sampling
+	}
+	exr.push_back(0);
+	WriteAttribute(exr, "compression", "compression", 1);
+	exr.push_back(0); // NO_COMPRESSION
+	WriteBox(exr, "dataWindow", width, height);
+	WriteBox(exr, "displayWindow", width, height);
+	WriteAttribute(exr, "lineOrder", "lineOrder", 1);
+	exr.push_back(0); // INCREASING_Y
+	WriteAttribute(exr, "pixelAspectRatio", "float", 4);
+	WriteFloat(exr, 1.0f);
+	WriteAttribute(exr, "screenWindowCenter", "v2f", 8);
+	WriteFloat(exr, 0.0f);
+	WriteFloat(exr, 0.0f);
+	WriteAttribute(exr, "screenWindowWidth", "float", 4);
+	WriteFloat(exr, 1.0f);
+	exr.push_back(0); // end of header
+
+	// offset table, one block per scanline
+	const unsigned int row_bytes = (unsigned int)width * channels * 2;
+	unsigned long long offset = exr.size() + (size_t)height * 8;
+	for (int y = 0; y < height; y++, offset += 8 + row_bytes)
+		WriteLE64(exr, offset);
+
+	for (int y = 0; y < height; y++)
+	{
+		int src_y = flip_vertically ? height - 1 - y : y;
+		const unsigned char* row = pixels + (size_t)src_y * stride_in_bytes;
+		WriteLE32(exr, (unsigned int)y);
+		WriteLE32(exr, row_bytes);
+		for (int c = first; c < 4; c++)
+		{
+			const unsigned short* halves = c == 0 ? table.linear : table.srgb;
+			for (int x = 0; x < width; x++)
+			{
+				unsigned short half = halves[row[x * components + SOURCE[c]]];
+				exr.push_back((unsigned char)half);
+				exr.push_back((unsigned char)(half >> 8));
+			}
+		}
+	}
+	return exr;
+}
+
+bool WriteEXR(const char* filename, int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically)
+{
+	std::vector<unsigned char> exr = EncodeEXR(width, height, components, pixels, stride_in_bytes, flip_vertically);
+	if (exr.empty())
+		return false;
+
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+	size_t written = fwrite(exr.data(), 1, exr.size(), file);
+	fclose(file);
+	return written == exr.size();
+}
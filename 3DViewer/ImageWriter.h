@@ -0,0 +1,28 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <vector>
+
+// Small PNG encoder modeled after stbi_write_png (stb_image_write is not part of the vendored stb).
+// Rows are filtered per scanline and compressed with fixed Huffman deflate, which is plenty for
+// thumbnails and turntable frames. components is 1 (grey), 2 (grey+alpha), 3 (RGB) or 4 (RGBA).
+// stride_in_bytes is the distance between rows, flip_vertically writes the rows bottom up as
+// needed for pixels read back from OpenGL.
+
+// Encodes the image into PNG bytes, returns an empty vector on invalid input
+std::vector<unsigned char> EncodePNG(int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically = false);
+
+// Encodes the image and writes it to filename, returns false if the file could not be written
+bool WritePNG(const char* filename, int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically = false);
+
+// Minimal OpenEXR writer: a single part, uncompressed scanline file with HALF channels, readable by
+// every EXR tool. The 8 bit color is taken as sRGB and stored linear, alpha as is. components is 3
+// (RGB) or 4 (RGBA), stride and flip as for PNG.
+
+// Encodes the image into EXR bytes, returns an empty vector on invalid input
+std::vector<unsigned char> EncodeEXR(int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically = false);
+
+// Encodes the image and writes it to filename, returns false if the file could not be written
+bool WriteEXR(const char* filename, int width, int height, int components, const unsigned char* pixels, int stride_in_bytes, bool flip_vertically = false);
+
+#endif
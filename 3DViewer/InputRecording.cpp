@@ -0,0 +1,205 @@
+#include "InputRecording.h"
+#include "Logger.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+void InputRecorder::Start(int window_width, int window_height)
+{
+	m_recording = true;
+	m_width = window_width;
+	m_height = window_height;
+	m_frames.clear();
+	m_frames.reserve(60 * 60);
+	m_pending.clear();
+}
+
+void InputRecorder::BeginFrame(double delta_time)
+{
+	if (!m_recording)
+		return;
+
+	m_frames.emplace_back();
+	m_frames.back().deltaTime = delta_time;
+	m_frames.back().events.swap(m_pending);
+	m_pending.clear();
+}
+
+void InputRecorder::MouseButton(int button, int action, int mods, double cursor_x, double cursor_y)
+{
+	InputEvent event;
+	event.type = InputEvent::MOUSE_BUTTON;
+	event.button = button;
+	event.action = action;
+	event.mods = mods;
+	event.x = cursor_x;
+	event.y = cursor_y;
+	if (m_recording)
+		m_pending.push_back(event);
+}
+
+void InputRecorder::CursorPosition(double x, double y)
+{
+	InputEvent event;
+	event.type = InputEvent::CURSOR_POSITION;
+	event.x = x;
+	event.y = y;
+	if (m_recording)
+		m_pending.push_back(event);
+}
+
+void InputRecorder::Scroll(double x_offset, double y_offset)
+{
+	InputEvent event;
+	event.type = InputEvent::SCROLL;
+	event.x = x_offset;
+	event.y = y_offset;
+	if (m_recording)
+		m_pending.push_back(event);
+}
+
+void InputRecorder::Keys(unsigned int keys)
+{
+	// Idle frames are common, only record frames where something is held down
+	if (!m_recording || keys == 0 || m_frames.empty())
+		return;
+
+	// Keys are sampled after the events were polled, during the frame they move
+	InputEvent event;
+	event.type = InputEvent::KEYS;
+	event.keys = keys;
+	m_frames.back().events.push_back(event);
+}
+
+bool InputRecorder::Save(const std::string& path)
+{
+	m_recording = false;
+
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		LOG_ERROR(LogCategory::Input, "ERROR::RECORDING::CANNOT_WRITE: %s", path);
+		return false;
+	}
+
+	fprintf(file, "3dviewer-input 1 %d %d\n", m_width, m_height);
+	for (const InputFrame& frame : m_frames)
+	{
+		fprintf(file, "frame %.17g\n", frame.deltaTime);
+		for (const InputEvent& event : frame.events)
+		{
+			switch (event.type)
+			{
+			case InputEvent::MOUSE_BUTTON:
+				fprintf(file, "button %d %d %d %.17g %.17g\n", event.button, event.action, event.mods, event.x, event.y);
+				break;
+			case InputEvent::CURSOR_POSITION:
+				fprintf(file, "cursor %.17g %.17g\n", event.x, event.y);
+				break;
+			case InputEvent::SCROLL:
+				fprintf(file, "scroll %.17g %.17g\n", event.x, event.y);
+				break;
+			case InputEvent::KEYS:
+				fprintf(file, "keys %u\n", event.keys);
+				break;
+			}
+		}
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	LOG_INFO(LogCategory::Input, "Recorded %zu frames to %s", m_frames.size(), path);
+	return ok;
+}
+
+bool LoadInputRecording(const std::string& path, InputRecording& recording)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		LOG_ERROR(LogCategory::Input, "ERROR::RECORDING::CANNOT_OPEN: %s", path);
+		return false;
+	}
+
+	std::string line;
+	int version = 0;
+	if (!std::getline(file, line) || sscanf(line.c_str(), "3dviewer-input %d %d %d", &version, &recording.width, &recording.height) != 3 || version != 1)
+	{
+		LOG_ERROR(LogCategory::Input, "ERROR::RECORDING::UNSUPPORTED_FORMAT: %s", path);
+		return false;
+	}
+
+	recording.frames.clear();
+	int line_number = 1;
+	while (std::getline(file, line))
+	{
+		line_number++;
+		std::istringstream fields(line);
+		std::string type;
+		if (!(fields >> type))
+			continue;
+
+		if (type == "frame")
+		{
+			recording.frames.emplace_back();
+			fields >> recording.frames.back().deltaTime;
+			continue;
+		}
+
+		InputEvent event;
+		if (type == "button")
+		{
+			event.type = InputEvent::MOUSE_BUTTON;
+			fields >> event.button >> event.action >> event.mods >> event.x >> event.y;
+		}
+		else if (type == "cursor")
+		{
+			event.type = InputEvent::CURSOR_POSITION;
+			fields >> event.x >> event.y;
+		}
+		else if (type == "scroll")
+		{
+			event.type = InputEvent::SCROLL;
+			fields >> event.x >> event.y;
+		}
+		else if (type == "keys")
+		{
+			event.type = InputEvent::KEYS;
+			fields >> event.keys;
+		}
+		else
+			fields.setstate(std::ios::failbit);
+
+		if (fields.fail() || recording.frames.empty())
+		{
+			LOG_ERROR(LogCategory::Input, "ERROR::RECORDING::INVALID_LINE: %s:%d", path, line_number);
+			return false;
+		}
+		recording.frames.back().events.push_back(event);
+	}
+
+	return true;
+}
+
+void ReplayInputFrame(const InputFrame& frame, CameraController& controller, float delta_time)
+{
+	for (const InputEvent& event : frame.events)
+	{
+		switch (event.type)
+		{
+		case InputEvent::MOUSE_BUTTON:
+			controller.MouseButton(event.button, event.action, event.x, event.y);
+			break;
+		case InputEvent::CURSOR_POSITION:
+			controller.CursorPosition(event.x, event.y);
+			break;
+		case InputEvent::SCROLL:
+			controller.Scroll(event.x, event.y);
+			break;
+		case InputEvent::KEYS:
+			controller.Keys(event.keys, delta_time);
+			break;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include "CameraController.h"
+
+#include <string>
+#include <vector>
+
+// One input event as received by the viewer callbacks
+struct InputEvent
+{
+	enum Type
+	{
+		MOUSE_BUTTON,
+		CURSOR_POSITION,
+		SCROLL,
+		KEYS
+	};
+
+	Type type;
+	int button = 0;
+	int action = 0;
+	int mods = 0;
+	// cursor position for MOUSE_BUTTON and CURSOR_POSITION, offsets for SCROLL
+	double x = 0.0;
+	double y = 0.0;
+	unsigned int keys = 0;
+};
+
+// Events that affected one frame in the order they arrived, with the frame time the viewer measured
+struct InputFrame
+{
+	double deltaTime = 0.0;
+	std::vector<InputEvent> events;
+};
+
+// Captures the input of a viewer session in memory and writes it as a text file on Save().
+// Nothing touches the disk while recording, so the input callbacks stay cheap. A frame is one batch
+// of events handled by the viewer's event thread: the callbacks' events are stored with the frame the
+// next BeginFrame opens, cursor movement and scrolling already coalesced to one event per batch.
+// Replaying a frame's events before drawing it reproduces the session.
+//
+// File format, one record per line, numbers printed with full precision:
+//   3dviewer-input 1 <window width> <window height>
+//   frame <delta time>
+//   button <button> <action> <mods> <cursor x> <cursor y>
+//   cursor <x> <y>
+//   scroll <x offset> <y offset>
+//   keys <InputKeys mask>
+class InputRecorder
+{
+public:
+	void Start(int window_width, int window_height);
+	bool IsRecording() const { return m_recording; }
+
+	void BeginFrame(double delta_time);
+	void MouseButton(int button, int action, int mods, double cursor_x, double cursor_y);
+	void CursorPosition(double x, double y);
+	void Scroll(double x_offset, double y_offset);
+	void Keys(unsigned int keys);
+
+	// Stops recording and writes the file
+	bool Save(const std::string& path);
+
+private:
+	bool m_recording = false;
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<InputFrame> m_frames;
+	// callback events waiting for the next BeginFrame
+	std::vector<InputEvent> m_pending;
+};
+
+struct InputRecording
+{
+	int width = 0;
+	int height = 0;
+	std::vector<InputFrame> frames;
+};
+
+bool LoadInputRecording(const std::string& path, InputRecording& recording);
+
+// Feeds the events of a frame to the controller. Key events move the camera by delta_time
+// instead of the recorded frame time, so a replay with a fixed timestep is deterministic.
+void ReplayInputFrame(const InputFrame& frame, CameraController& controller, float delta_time);
+
+#endif
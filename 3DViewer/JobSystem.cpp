@@ -0,0 +1,273 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// the system whose worker the current thread is, and its deque
+static thread_local const JobSystem* t_system = nullptr;
+static thread_local int t_queue = 0;
+
+JobSystem& JobSystem::Get()
+{
+	// at least one worker, so submitted jobs run in the background on a single core too
+	static JobSystem system(std::max(2, (int)std::thread::hardware_concurrency()));
+	return system;
+}
+
+JobSystem::JobSystem(int threads)
+{
+	if (threads <= 0)
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	m_main_thread = std::this_thread::get_id();
+
+	// deque 0 belongs to the threads that aren't workers
+	for (int i = 0; i < threads; i++)
+		m_queues.push_back(std::make_unique<WorkQueue>());
+	for (int i = 1; i < threads; i++)
+		m_threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+	// a single threaded system has nobody else to run them
+	while (RunOne(0))
+	{
+	}
+}
+
+JobHandle JobSystem::Submit(JobFunction job, std::initializer_list<JobHandle> dependencies)
+{
+	return Submit(std::move(job), dependencies.begin(), dependencies.size());
+}
+
+JobHandle JobSystem::Submit(JobFunction job, const JobHandle* dependencies, size_t dependencyCount)
+{
+	std::shared_ptr<JobState> state = std::make_shared<JobState>();
+	state->function = std::move(job);
+	return SubmitState(std::move(state), dependencies, dependencyCount);
+}
+
+JobHandle JobSystem::SubmitMainThread(JobFunction job, std::initializer_list<JobHandle> dependencies)
+{
+	std::shared_ptr<JobState> state = std::make_shared<JobState>();
+	state->function = std::move(job);
+	state->mainThread = true;
+	return SubmitState(std::move(state), dependencies.begin(), dependencies.size());
+}
+
+JobHandle JobSystem::SubmitState(std::shared_ptr<JobState> state, const JobHandle* dependencies, size_t dependencyCount)
+{
+	// the extra pending count keeps a dependency finishing meanwhile from queueing the job half registered
+	for (size_t i = 0; i < dependencyCount; i++)
+	{
+		JobState* dependency = dependencies[i].m_state.get();
+		if (!dependency)
+			continue;
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (!dependency->done.load())
+		{
+			state->pending++;
+			dependency->continuations.push_back(state);
+		}
+	}
+
+	JobHandle handle(state);
+	if (--state->pending == 0)
+		Push(std::move(state));
+	return handle;
+}
+
+void JobSystem::Push(std::shared_ptr<JobState> state)
+{
+	if (state->mainThread)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_main_mutex);
+			m_main_jobs.push_back(std::move(state));
+			m_main_queued++;
+		}
+		// the main thread may be blocked in Wait
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wake.notify_all();
+		return;
+	}
+
+	{
+		WorkQueue& queue = *m_queues[GetQueueIndex()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		// counted under the deque lock, so a thief can't take the job before it is counted
+		queue.jobs.push_back(std::move(state));
+		m_queued++;
+	}
+	// taking the lock orders the count before the check of a thread about to sleep
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_wake.notify_one();
+}
+
+bool JobSystem::PopOrSteal(int self, std::shared_ptr<JobState>& state)
+{
+	if (m_queued.load() == 0)
+		return false;
+
+	{
+		WorkQueue& own = *m_queues[self];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			state = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			m_queued--;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < m_queues.size(); i++)
+	{
+		WorkQueue& victim = *m_queues[(self + i) % m_queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			state = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			m_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool JobSystem::RunOne(int self)
+{
+	std::shared_ptr<JobState> state;
+	if (!PopOrSteal(self, state))
+		return false;
+	Run(state);
+	return true;
+}
+
+void JobSystem::Run(std::shared_ptr<JobState>& state)
+{
+	state->function();
+	// the captures go now, not whenever the last handle does
+	state->function = nullptr;
+	Finish(*state);
+}
+
+void JobSystem::Finish(JobState& state)
+{
+	std::vector<std::shared_ptr<JobState>> continuations;
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.done = true;
+		continuations.swap(state.continuations);
+	}
+	for (std::shared_ptr<JobState>& continuation : continuations)
+	{
+		if (--continuation->pending == 0)
+			Push(std::move(continuation));
+	}
+
+	// done is set before waiters is read and Wait counts itself before it checks done, so one of the two sees the other
+	if (state.waiters.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wake.notify_all();
+	}
+}
+
+void JobSystem::Wait(const JobHandle& job)
+{
+	JobState* state = job.m_state.get();
+	if (!state)
+		return;
+
+	int self = GetQueueIndex();
+	bool main = IsMainThread();
+	while (!state->done.load())
+	{
+		if (RunOne(self) || (main && RunMainThreadJobs() > 0))
+			continue;
+
+		state->waiters++;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return state->done.load() || m_queued.load() > 0 || (main && m_main_queued.load() > 0); });
+		}
+		state->waiters--;
+	}
+}
+
+void JobSystem::ParallelFor(int count, int grain, const std::function<void(int, int)>& body)
+{
+	if (count <= 0)
+		return;
+	grain = std::max(1, grain);
+
+	int range_count = (count + grain - 1) / grain;
+	if (range_count == 1 || m_queues.size() == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	// one job per range in the deque of the calling thread, the others steal them from the front
+	std::vector<JobHandle> ranges;
+	ranges.reserve(range_count - 1);
+	for (int i = 1; i < range_count; i++)
+	{
+		int begin = i * grain;
+		int end = std::min(count, begin + grain);
+		ranges.push_back(Submit([&body, begin, end]() { body(begin, end); }));
+	}
+	body(0, std::min(count, grain));
+	for (const JobHandle& range : ranges)
+		Wait(range);
+}
+
+size_t JobSystem::RunMainThreadJobs()
+{
+	// only what is queued now, jobs queued by these run next time
+	size_t count = m_main_queued.load();
+	size_t ran = 0;
+	for (; ran < count; ran++)
+	{
+		std::shared_ptr<JobState> state;
+		{
+			std::lock_guard<std::mutex> lock(m_main_mutex);
+			if (m_main_jobs.empty())
+				break;
+			state = std::move(m_main_jobs.front());
+			m_main_jobs.pop_front();
+			m_main_queued--;
+		}
+		Run(state);
+	}
+	return ran;
+}
+
+int JobSystem::GetQueueIndex() const
+{
+	return t_system == this ? t_queue : 0;
+}
+
+void JobSystem::WorkerLoop(int self)
+{
+	t_system = this;
+	t_queue = self;
+	while (true)
+	{
+		if (RunOne(self))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake.wait(lock, [this] { return m_stop || m_queued.load() > 0; });
+		if (m_stop && m_queued.load() == 0)
+			return;
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> JobFunction;
+
+// A job submitted to a JobSystem, shared between the submitter, the jobs depending on it and the queue
+struct JobState
+{
+	JobFunction function;
+	// unfinished dependencies, plus one while Submit is still registering them
+	std::atomic<int> pending{ 1 };
+	std::atomic<bool> done{ false };
+	// threads blocked in Wait on this job
+	std::atomic<int> waiters{ 0 };
+	// runs on the thread calling JobSystem::RunMainThreadJobs instead of a worker
+	bool mainThread = false;
+
+	// jobs to release when this one finishes, guarded by mutex together with done
+	std::mutex mutex;
+	std::vector<std::shared_ptr<JobState>> continuations;
+};
+
+// Refers to a submitted job, empty handles count as finished
+class JobHandle
+{
+public:
+	JobHandle() = default;
+
+	bool IsValid() const { return m_state != nullptr; }
+	bool IsDone() const { return !m_state || m_state->done.load(); }
+
+private:
+	friend class JobSystem;
+	explicit JobHandle(std::shared_ptr<JobState> state) : m_state(std::move(state)) {}
+
+	std::shared_ptr<JobState> m_state;
+};
+
+// Work stealing job system. Every worker owns a deque of jobs, pops from its back (the most recently
+// pushed, still in cache) and steals from the front of the other deques once it runs dry, so uneven
+// work balances out. Threads that aren't workers share deque 0.
+//   - Jobs may depend on other jobs: Submit holds a job back until all of its dependencies are done,
+//     the last one to finish queues it.
+//   - Wait and ParallelFor run queued jobs while they wait instead of blocking, so they can be nested
+//     and called from inside jobs. A thread waiting for something small may pick up something large.
+//   - Main thread jobs (GL uploads, anything touching the context) go to a separate queue that only
+//     RunMainThreadJobs empties, once a frame on the thread that created the system.
+// JobSystem::Get() is the shared instance for import, decoding, culling and sorting. Code that needs a
+// fixed thread count (the scaling benchmarks, the software renderer) creates its own.
+class JobSystem
+{
+public:
+	// The shared system with all hardware threads (two at least), create it from the main thread first
+	static JobSystem& Get();
+
+	// threads counts the thread creating the system, 0 uses all hardware threads
+	explicit JobSystem(int threads = 0);
+	// runs the jobs still queued on the workers, then joins them
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	int GetThreadCount() const { return (int)m_queues.size(); }
+
+	// Queues job to run once every job in dependencies is done, empty handles are ignored
+	JobHandle Submit(JobFunction job, std::initializer_list<JobHandle> dependencies = {});
+	JobHandle Submit(JobFunction job, const JobHandle* dependencies, size_t dependencyCount);
+
+	// Like Submit, but the job runs in RunMainThreadJobs
+	JobHandle SubmitMainThread(JobFunction job, std::initializer_list<JobHandle> dependencies = {});
+
+	// Returns once job is done, running other jobs meanwhile. On the main thread main thread jobs run too.
+	void Wait(const JobHandle& job);
+
+	// Runs body(begin, end) over [0, count) split into ranges of at most grain indices and returns when
+	// all of them are done. The calling thread takes part.
+	void ParallelFor(int count, int grain, const std::function<void(int, int)>& body);
+
+	// Runs the main thread jobs that are ready, returns how many ran. Only call it on the main thread.
+	size_t RunMainThreadJobs();
+
+	// Jobs queued and not started yet, main thread jobs included
+	size_t GetQueuedCount() const { return m_queued.load() + m_main_queued.load(); }
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<std::shared_ptr<JobState>> jobs;
+	};
+
+	JobHandle SubmitState(std::shared_ptr<JobState> state, const JobHandle* dependencies, size_t dependencyCount);
+	// queues a job whose dependencies are done
+	void Push(std::shared_ptr<JobState> state);
+	bool PopOrSteal(int self, std::shared_ptr<JobState>& state);
+	// runs one queued job if there is one
+	bool RunOne(int self);
+	void Run(std::shared_ptr<JobState>& state);
+	void Finish(JobState& state);
+	// deque of the calling thread, 0 for threads that aren't workers of this system
+	int GetQueueIndex() const;
+	bool IsMainThread() const { return std::this_thread::get_id() == m_main_thread; }
+	void WorkerLoop(int self);
+
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::thread::id m_main_thread;
+
+	// m_wake wakes idle workers and waiting threads when jobs are queued or a waited for job finishes
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::atomic<size_t> m_queued{ 0 };
+	bool m_stop = false;
+
+	std::mutex m_main_mutex;
+	std::deque<std::shared_ptr<JobState>> m_main_jobs;
+	std::atomic<size_t> m_main_queued{ 0 };
+};
+
+#endif
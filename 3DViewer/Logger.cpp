@@ -0,0 +1,355 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdarg>
+
+#ifdef _DEBUG
+#define LOG_DEFAULT_LEVEL (int)LogLevel::Debug
+#else
+#define LOG_DEFAULT_LEVEL (int)LogLevel::Info
+#endif
+
+std::atomic<int> Logger::s_levels[(int)LogCategory::Count] = { LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL };
+
+static const char* const levelNames[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+static const char* const categoryNames[] = { "General", "Input", "Model", "Render" };
+
+thread_local Logger::RingLease Logger::s_thread_ring;
+
+Logger& Logger::Get()
+{
+	static Logger logger;
+	return logger;
+}
+
+Logger::Logger()
+{
+	m_start = std::chrono::steady_clock::now();
+	m_writer = std::thread(&Logger::WriterLoop, this);
+}
+
+Logger::~Logger()
+{
+	Shutdown();
+	if (m_file)
+		fclose(m_file);
+}
+
+void Logger::SetLevel(LogCategory category, LogLevel level)
+{
+	s_levels[(int)category].store((int)level, std::memory_order_relaxed);
+}
+
+void Logger::SetLevel(LogLevel level)
+{
+	for (int i = 0; i < (int)LogCategory::Count; i++)
+		SetLevel((LogCategory)i, level);
+}
+
+bool Logger::SetOutputFile(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(m_drain_mutex);
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = nullptr;
+	}
+	if (path.empty())
+		return true;
+
+	m_file = fopen(path.c_str(), "a");
+	return m_file != nullptr;
+}
+
+Logger::RingLease::~RingLease()
+{
+	if (ring)
+		ring->inUse.store(false, std::memory_order_release);
+}
+
+// Ring of the calling thread, taken over from an exited thread or created on its first log statement
+Logger::Ring* Logger::GetThreadRing()
+{
+	if (s_thread_ring.ring)
+		return s_thread_ring.ring;
+
+	std::lock_guard<std::mutex> lock(m_rings_mutex);
+	for (const std::unique_ptr<Ring>& ring : m_rings)
+	{
+		// Only take over rings the writer has emptied, so the new thread starts with full capacity
+		if (ring->inUse.load(std::memory_order_relaxed) || ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_relaxed))
+			continue;
+
+		bool expected = false;
+		if (ring->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+		{
+			s_thread_ring.ring = ring.get();
+			return s_thread_ring.ring;
+		}
+	}
+
+	m_rings.emplace_back(new Ring());
+	s_thread_ring.ring = m_rings.back().get();
+	return s_thread_ring.ring;
+}
+
+LogRecord* Logger::BeginRecord()
+{
+	Ring* ring = GetThreadRing();
+	size_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) == Ring::CAPACITY)
+	{
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	LogRecord* record = &ring->records[head % Ring::CAPACITY];
+	record->timeNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+	return record;
+}
+
+void Logger::CommitRecord()
+{
+	Ring* ring = s_thread_ring.ring;
+	size_t head = ring->head.load(std::memory_order_relaxed) + 1;
+	ring->head.store(head, std::memory_order_release);
+
+	// Wake the writer early when a burst fills half the ring
+	if (head - ring->tail.load(std::memory_order_relaxed) == Ring::CAPACITY / 2)
+		m_wake.notify_one();
+}
+
+void Logger::Capture(LogRecord& record, long long value)
+{
+	if (record.argCount == LogRecord::MAX_ARGS)
+		return;
+	record.argTypes[record.argCount] = LogRecord::ARG_INT;
+	record.args[record.argCount++].i = value;
+}
+
+void Logger::Capture(LogRecord& record, unsigned long long value)
+{
+	if (record.argCount == LogRecord::MAX_ARGS)
+		return;
+	record.argTypes[record.argCount] = LogRecord::ARG_UINT;
+	record.args[record.argCount++].u = value;
+}
+
+void Logger::Capture(LogRecord& record, double value)
+{
+	if (record.argCount == LogRecord::MAX_ARGS)
+		return;
+	record.argTypes[record.argCount] = LogRecord::ARG_DOUBLE;
+	record.args[record.argCount++].d = value;
+}
+
+void Logger::Capture(LogRecord& record, const void* value)
+{
+	if (record.argCount == LogRecord::MAX_ARGS)
+		return;
+	record.argTypes[record.argCount] = LogRecord::ARG_POINTER;
+	record.args[record.argCount++].p = value;
+}
+
+void Logger::Capture(LogRecord& record, const char* value)
+{
+	if (record.argCount == LogRecord::MAX_ARGS)
+		return;
+	if (!value)
+		value = "(null)";
+
+	size_t length = std::min(strlen(value), (size_t)(LogRecord::STRING_BYTES - record.stringBytes));
+	memcpy(record.strings + record.stringBytes, value, length);
+
+	LogRecord::ArgValue& arg = record.args[record.argCount];
+	arg.s.offset = record.stringBytes;
+	arg.s.length = (unsigned short)length;
+	record.argTypes[record.argCount++] = LogRecord::ARG_STRING;
+	record.stringBytes += (unsigned short)length;
+}
+
+static void AppendFormat(std::string& out, const char* format, ...)
+{
+	char buffer[256];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if (length < 0)
+		return;
+
+	if (length < (int)sizeof(buffer))
+	{
+		out.append(buffer, length);
+		return;
+	}
+
+	std::vector<char> large(length + 1);
+	va_start(args, format);
+	vsnprintf(large.data(), large.size(), format, args);
+	va_end(args);
+	out.append(large.data(), length);
+}
+
+// Replays the printf conversions of the format string against the captured arguments. Length
+// modifiers of the format are ignored, every integer was widened to 64 bits when captured.
+std::string FormatLogRecord(const LogRecord& record)
+{
+	std::string out;
+	int next = 0;
+
+	for (const char* c = record.format; *c; c++)
+	{
+		if (*c != '%')
+		{
+			out.push_back(*c);
+			continue;
+		}
+		if (c[1] == '%')
+		{
+			out.push_back('%');
+			c++;
+			continue;
+		}
+
+		// Flags, width and precision are passed through to snprintf
+		std::string spec = "%";
+		c++;
+		while (*c && strchr("-+ #0123456789.", *c))
+			spec.push_back(*c++);
+		while (*c && strchr("hljztL", *c))
+			c++;
+		if (!*c)
+			break;
+
+		char conversion = *c;
+		if (next >= record.argCount)
+		{
+			out += "<missing>";
+			continue;
+		}
+
+		LogRecord::ArgType type = record.argTypes[next];
+		const LogRecord::ArgValue& arg = record.args[next++];
+
+		if (type == LogRecord::ARG_STRING)
+		{
+			std::string value(record.strings + arg.s.offset, arg.s.length);
+			AppendFormat(out, (spec + "s").c_str(), value.c_str());
+			continue;
+		}
+
+		long long asInt = type == LogRecord::ARG_INT ? arg.i : type == LogRecord::ARG_UINT ? (long long)arg.u : type == LogRecord::ARG_DOUBLE ? (long long)arg.d : (long long)(uintptr_t)arg.p;
+		double asDouble = type == LogRecord::ARG_DOUBLE ? arg.d : type == LogRecord::ARG_UINT ? (double)arg.u : (double)asInt;
+
+		switch (conversion)
+		{
+		case 'd':
+		case 'i':
+			AppendFormat(out, (spec + "lld").c_str(), asInt);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			AppendFormat(out, (spec + "ll" + conversion).c_str(), type == LogRecord::ARG_UINT ? arg.u : (unsigned long long)asInt);
+			break;
+		case 'c':
+			AppendFormat(out, (spec + "c").c_str(), (int)asInt);
+			break;
+		case 'p':
+			AppendFormat(out, (spec + "p").c_str(), type == LogRecord::ARG_POINTER ? arg.p : (const void*)(uintptr_t)asInt);
+			break;
+		case 's':
+			// Number passed for %s, print it in its natural form
+			if (type == LogRecord::ARG_DOUBLE)
+				AppendFormat(out, "%g", arg.d);
+			else
+				AppendFormat(out, type == LogRecord::ARG_UINT ? "%llu" : "%lld", asInt);
+			break;
+		default:
+			AppendFormat(out, (spec + conversion).c_str(), asDouble);
+			break;
+		}
+	}
+
+	return out;
+}
+
+void Logger::Drain()
+{
+	std::lock_guard<std::mutex> drainLock(m_drain_mutex);
+
+	std::vector<Ring*> rings;
+	{
+		std::lock_guard<std::mutex> lock(m_rings_mutex);
+		for (const std::unique_ptr<Ring>& ring : m_rings)
+			rings.push_back(ring.get());
+	}
+
+	m_batch.clear();
+	unsigned int dropped = 0;
+	for (Ring* ring : rings)
+	{
+		size_t tail = ring->tail.load(std::memory_order_relaxed);
+		size_t head = ring->head.load(std::memory_order_acquire);
+		for (size_t i = tail; i != head; i++)
+			m_batch.push_back(ring->records[i % Ring::CAPACITY]);
+		ring->tail.store(head, std::memory_order_release);
+		dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+	}
+
+	if (m_batch.empty() && dropped == 0)
+		return;
+
+	// Interleave the threads by time, each ring is already in order
+	std::stable_sort(m_batch.begin(), m_batch.end(), [](const LogRecord& a, const LogRecord& b) { return a.timeNs < b.timeNs; });
+
+	m_text.clear();
+	for (const LogRecord& record : m_batch)
+	{
+		AppendFormat(m_text, "[%10.4f] %-5s %s: ", record.timeNs / 1.0e9, levelNames[(int)record.level], categoryNames[(int)record.category]);
+		m_text += FormatLogRecord(record);
+		m_text.push_back('\n');
+	}
+	if (dropped > 0)
+		AppendFormat(m_text, "[LOGGER] %u messages dropped, ring buffer full\n", dropped);
+
+	fwrite(m_text.data(), 1, m_text.size(), stdout);
+	fflush(stdout);
+	if (m_file)
+	{
+		fwrite(m_text.data(), 1, m_text.size(), m_file);
+		fflush(m_file);
+	}
+}
+
+void Logger::WriterLoop()
+{
+	std::unique_lock<std::mutex> lock(m_wake_mutex);
+	while (!m_stop)
+	{
+		m_wake.wait_for(lock, std::chrono::milliseconds(5));
+		lock.unlock();
+		Drain();
+		lock.lock();
+	}
+}
+
+void Logger::Flush()
+{
+	Drain();
+}
+
+void Logger::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wake_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_one();
+	if (m_writer.joinable())
+		m_writer.join();
+
+	Drain();
+}
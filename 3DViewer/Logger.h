@@ -0,0 +1,208 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Messages below this level are removed at compile time, call sites included.
+// 0 = Trace ... 4 = Error, 5 compiles out every log statement.
+#ifndef VIEWER_LOG_MIN_LEVEL
+#define VIEWER_LOG_MIN_LEVEL 0
+#endif
+
+enum class LogLevel
+{
+	Trace,
+	Debug,
+	Info,
+	Warning,
+	Error,
+	Off
+};
+
+enum class LogCategory
+{
+	General,
+	Input,
+	Model,
+	Render,
+	Count
+};
+
+// One log statement as captured by the calling thread. The printf style format string is kept
+// by pointer and must be a string literal, arguments are copied so formatting can happen later
+// on the writer thread. Strings longer than the inline storage are truncated.
+struct LogRecord
+{
+	static constexpr int MAX_ARGS = 8;
+	static constexpr int STRING_BYTES = 192;
+
+	enum ArgType : unsigned char
+	{
+		ARG_INT,
+		ARG_UINT,
+		ARG_DOUBLE,
+		ARG_STRING,
+		ARG_POINTER
+	};
+
+	union ArgValue
+	{
+		long long i;
+		unsigned long long u;
+		double d;
+		const void* p;
+		struct
+		{
+			unsigned short offset;
+			unsigned short length;
+		} s;
+	};
+
+	uint64_t timeNs;
+	const char* format;
+	LogLevel level;
+	LogCategory category;
+	unsigned char argCount;
+	ArgType argTypes[MAX_ARGS];
+	ArgValue args[MAX_ARGS];
+	unsigned short stringBytes;
+	char strings[STRING_BYTES];
+};
+
+// Asynchronous logger. Every thread writes records into its own single producer ring without
+// taking a lock, a background thread drains the rings every few milliseconds, formats the records
+// and writes them out. A full ring drops the record instead of blocking the caller, drops are
+// reported with the next flush.
+class Logger
+{
+public:
+	static Logger& Get();
+
+	~Logger();
+
+	// Runtime filter per category, checked at the call site before any argument is captured
+	static bool IsEnabled(LogLevel level, LogCategory category)
+	{
+		return (int)level >= s_levels[(int)category].load(std::memory_order_relaxed);
+	}
+	static void SetLevel(LogCategory category, LogLevel level);
+	static void SetLevel(LogLevel level);
+
+	// Also append formatted lines to a file, an empty path closes it
+	bool SetOutputFile(const std::string& path);
+
+	template<typename... Args>
+	void Write(LogLevel level, LogCategory category, const char* format, const Args&... args)
+	{
+		static_assert(sizeof...(Args) <= LogRecord::MAX_ARGS, "too many log arguments");
+
+		LogRecord* record = BeginRecord();
+		if (!record)
+			return;
+
+		record->level = level;
+		record->category = category;
+		record->format = format;
+		record->argCount = 0;
+		record->stringBytes = 0;
+		int unpack[] = { 0, (Capture(*record, args), 0)... };
+		(void)unpack;
+		CommitRecord();
+	}
+
+	// Blocks until everything logged before the call is written
+	void Flush();
+
+	// Flushes and stops the writer thread, later records are written synchronously by Flush()
+	void Shutdown();
+
+private:
+	struct Ring
+	{
+		static constexpr size_t CAPACITY = 512;
+
+		LogRecord records[CAPACITY];
+		std::atomic<size_t> head{ 0 };
+		std::atomic<size_t> tail{ 0 };
+		std::atomic<unsigned int> dropped{ 0 };
+		std::atomic<bool> inUse{ true };
+	};
+
+	// Hands the ring back for reuse when its thread exits
+	struct RingLease
+	{
+		Ring* ring = nullptr;
+		~RingLease();
+	};
+
+	Logger();
+	Ring* GetThreadRing();
+	LogRecord* BeginRecord();
+	void CommitRecord();
+	void WriterLoop();
+	void Drain();
+
+	static void Capture(LogRecord& record, long long value);
+	static void Capture(LogRecord& record, unsigned long long value);
+	static void Capture(LogRecord& record, double value);
+	static void Capture(LogRecord& record, const void* value);
+	static void Capture(LogRecord& record, const char* value);
+	static void Capture(LogRecord& record, const std::string& value) { Capture(record, value.c_str()); }
+	static void Capture(LogRecord& record, char* value) { Capture(record, (const char*)value); }
+	static void Capture(LogRecord& record, const unsigned char* value) { Capture(record, (const char*)value); }
+	static void Capture(LogRecord& record, bool value) { Capture(record, (long long)value); }
+	static void Capture(LogRecord& record, char value) { Capture(record, (long long)value); }
+	static void Capture(LogRecord& record, short value) { Capture(record, (long long)value); }
+	static void Capture(LogRecord& record, unsigned short value) { Capture(record, (unsigned long long)value); }
+	static void Capture(LogRecord& record, unsigned char value) { Capture(record, (unsigned long long)value); }
+	static void Capture(LogRecord& record, int value) { Capture(record, (long long)value); }
+	static void Capture(LogRecord& record, long value) { Capture(record, (long long)value); }
+	static void Capture(LogRecord& record, unsigned int value) { Capture(record, (unsigned long long)value); }
+	static void Capture(LogRecord& record, unsigned long value) { Capture(record, (unsigned long long)value); }
+	static void Capture(LogRecord& record, float value) { Capture(record, (double)value); }
+
+	static std::atomic<int> s_levels[(int)LogCategory::Count];
+	static thread_local RingLease s_thread_ring;
+
+	std::mutex m_rings_mutex;
+	std::vector<std::unique_ptr<Ring>> m_rings;
+
+	// Serializes draining, the writer thread and Flush() may both drain
+	std::mutex m_drain_mutex;
+	std::vector<LogRecord> m_batch;
+	std::string m_text;
+	FILE* m_file = nullptr;
+	std::chrono::steady_clock::time_point m_start;
+
+	std::mutex m_wake_mutex;
+	std::condition_variable m_wake;
+	bool m_stop = false;
+	std::thread m_writer;
+};
+
+// Formats a record the way printf would, used by the writer thread
+std::string FormatLogRecord(const LogRecord& record);
+
+#define VIEWER_LOG(level, category, ...) \
+	do { \
+		if ((int)(level) >= VIEWER_LOG_MIN_LEVEL && Logger::IsEnabled(level, category)) \
+			Logger::Get().Write(level, category, __VA_ARGS__); \
+	} while (0)
+
+#define LOG_TRACE(category, ...) VIEWER_LOG(LogLevel::Trace, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) VIEWER_LOG(LogLevel::Debug, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) VIEWER_LOG(LogLevel::Info, category, __VA_ARGS__)
+#define LOG_WARNING(category, ...) VIEWER_LOG(LogLevel::Warning, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) VIEWER_LOG(LogLevel::Error, category, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef MATERIAL_FEATURES_H
+#define MATERIAL_FEATURES_H
+
+#include <string>
+
+// What a mesh and its material provide to the shaders. Every set bit becomes a #define in front of
+// the shader sources (see ShaderVariants), so each mesh is drawn by a program that only does the
+// work its material needs instead of branching at runtime.
+enum MaterialFeature
+{
+	FEATURE_DIFFUSE_MAP = 1 << 0,	// texture_diffuse1
+	FEATURE_SPECULAR_MAP = 1 << 1,	// texture_specular1
+	FEATURE_NORMAL_MAP = 1 << 2,	// texture_normal1
+	FEATURE_HEIGHT_MAP = 1 << 3,	// texture_height1
+	FEATURE_TEXCOORDS = 1 << 4,		// the vertices have texture coordinates
+	FEATURE_TANGENTS = 1 << 5,		// the vertices have tangents and bitangents
+	FEATURE_SKINNING = 1 << 6,		// the vertices have bone ids and weights
+	FEATURE_VIRTUAL_TEXTURE = 1 << 7,	// the diffuse map is a VirtualTexture
+	FEATURE_SRGB_DIFFUSE = 1 << 8,	// texture_diffuse1 is an sRGB texture and samples linear color
+	FEATURE_INSTANCED = 1 << 9,		// drawn instanced, the model matrices come from InstanceUniforms
+
+	MATERIAL_FEATURE_COUNT = 10
+};
+
+// Names of the defines, indexed by bit
+static const char* const MATERIAL_FEATURE_DEFINES[MATERIAL_FEATURE_COUNT] = {
+	"HAS_DIFFUSE_MAP",
+	"HAS_SPECULAR_MAP",
+	"HAS_NORMAL_MAP",
+	"HAS_HEIGHT_MAP",
+	"HAS_TEXCOORDS",
+	"HAS_TANGENTS",
+	"HAS_SKINNING",
+	"HAS_VIRTUAL_TEXTURE",
+	"HAS_SRGB_DIFFUSE",
+	"HAS_INSTANCES"
+};
+
+// "#define HAS_X\n" for every feature in features, in bit order so equal masks give equal strings
+inline std::string MakeFeatureDefines(unsigned int features)
+{
+	std::string defines;
+	for (int i = 0; i < MATERIAL_FEATURE_COUNT; i++)
+	{
+		if (features & (1u << i))
+			defines += std::string("#define ") + MATERIAL_FEATURE_DEFINES[i] + "\n";
+	}
+	return defines;
+}
+
+// Short readable form for logs and the shader panel, e.g. "DIFFUSE_MAP|TEXCOORDS"
+inline std::string DescribeFeatures(unsigned int features)
+{
+	std::string names;
+	for (int i = 0; i < MATERIAL_FEATURE_COUNT; i++)
+	{
+		if (features & (1u << i))
+			names += (names.empty() ? "" : "|") + std::string(MATERIAL_FEATURE_DEFINES[i] + 4);
+	}
+	return names.empty() ? "none" : names;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "MemoryTracker.h"
+
+#include <algorithm>
+
+MemoryTracker& MemoryTracker::Get()
+{
+	static MemoryTracker tracker;
+	return tracker;
+}
+
+const char* MemoryTracker::GetCategoryName(MemoryCategory category)
+{
+	static const char* names[MEMORY_CATEGORY_COUNT] = { "CPU geometry", "CPU textures", "GPU buffers", "GPU textures" };
+	return category < MEMORY_CATEGORY_COUNT ? names[category] : "unknown";
+}
+
+unsigned int MemoryTracker::AddOwner(const std::string& name, unsigned int parent)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	MemoryOwnerInfo info;
+	info.id = m_next_id++;
+	info.parent = parent;
+	info.name = name;
+	// ids only grow, so m_owners stays sorted and a parent comes before its children
+	m_owners.push_back(info);
+	return info.id;
+}
+
+int MemoryTracker::Find(unsigned int owner) const
+{
+	auto it = std::lower_bound(m_owners.begin(), m_owners.end(), owner,
+		[](const MemoryOwnerInfo& info, unsigned int id) { return info.id < id; });
+	if (it == m_owners.end() || it->id != owner)
+		return -1;
+	return (int)(it - m_owners.begin());
+}
+
+// Marks the owners of the subtree starting at index first, children always come after their parent
+static std::vector<char> GetSubtree(const std::vector<MemoryOwnerInfo>& owners, int first)
+{
+	std::vector<char> subtree(owners.size(), 0);
+	subtree[first] = 1;
+	std::vector<unsigned int> ids(1, owners[first].id);
+	for (size_t i = first + 1; i < owners.size(); i++)
+	{
+		if (std::binary_search(ids.begin(), ids.end(), owners[i].parent))
+		{
+			subtree[i] = 1;
+			ids.push_back(owners[i].id);
+		}
+	}
+	return subtree;
+}
+
+void MemoryTracker::RemoveOwner(unsigned int owner)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int index = Find(owner);
+	if (index < 0)
+		return;
+
+	std::vector<char> subtree = GetSubtree(m_owners, index);
+	size_t kept = 0;
+	for (size_t i = 0; i < m_owners.size(); i++)
+	{
+		if (subtree[i])
+		{
+			for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+				m_totals[c] -= m_owners[i].bytes[c];
+			continue;
+		}
+		if (kept != i)
+			m_owners[kept] = std::move(m_owners[i]);
+		kept++;
+	}
+	m_owners.resize(kept);
+}
+
+void MemoryTracker::Set(unsigned int owner, MemoryCategory category, size_t bytes)
+{
+	if (owner == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int index = Find(owner);
+	if (index < 0)
+		return;
+	size_t& current = m_owners[index].bytes[category];
+	m_totals[category] = m_totals[category] - current + bytes;
+	current = bytes;
+}
+
+size_t MemoryTracker::GetTotal(MemoryCategory category) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_totals[category];
+}
+
+size_t MemoryTracker::GetOwnerBytes(unsigned int owner, MemoryCategory category, bool children) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int index = Find(owner);
+	if (index < 0)
+		return 0;
+	if (!children)
+		return m_owners[index].bytes[category];
+
+	std::vector<char> subtree = GetSubtree(m_owners, index);
+	size_t bytes = 0;
+	for (size_t i = index; i < m_owners.size(); i++)
+	{
+		if (subtree[i])
+			bytes += m_owners[i].bytes[category];
+	}
+	return bytes;
+}
+
+std::vector<MemoryOwnerInfo> MemoryTracker::GetOwners() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_owners;
+}
@@ -0,0 +1,70 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum MemoryCategory
+{
+	MEMORY_CPU_GEOMETRY,	// vertex and index arrays kept in RAM
+	MEMORY_CPU_TEXTURE,		// decoded images waiting for their upload
+	MEMORY_GPU_BUFFER,		// vertex, index, uniform and staging buffers
+	MEMORY_GPU_TEXTURE,		// textures and renderbuffers
+	MEMORY_CATEGORY_COUNT
+};
+
+// Bytes of one owner in every category, see MemoryTracker::GetOwners
+struct MemoryOwnerInfo
+{
+	unsigned int id = 0;
+	unsigned int parent = 0;
+	std::string name;
+	size_t bytes[MEMORY_CATEGORY_COUNT] = {};
+};
+
+// Accounts the memory of models, meshes, textures and GL objects, so the cost of a scan can be looked up
+// instead of guessed. Whoever allocates reports the size under an owner handle; owners form a tree (a model
+// with its meshes and textures) and totals are kept per category.
+// GPU sizes are the bytes handed to the GL, the driver may pad or convert them (e.g. RGB8 stored as RGBA8).
+// All calls are thread safe, models are imported on loader threads.
+class MemoryTracker
+{
+public:
+	static MemoryTracker& Get();
+
+	static const char* GetCategoryName(MemoryCategory category);
+
+	// New owner under parent (0 for a root), returns its handle. Never returns 0.
+	unsigned int AddOwner(const std::string& name, unsigned int parent = 0);
+
+	// Forgets owner and all owners under it, their bytes leave the totals
+	void RemoveOwner(unsigned int owner);
+
+	// Sets what owner uses in category, replacing the previous value. Owner 0 is ignored, so objects
+	// that were never registered can report unconditionally.
+	void Set(unsigned int owner, MemoryCategory category, size_t bytes);
+
+	// All owners
+	size_t GetTotal(MemoryCategory category) const;
+
+	// owner alone, or with everything under it
+	size_t GetOwnerBytes(unsigned int owner, MemoryCategory category, bool children = true) const;
+
+	// Copy of all owners, parents before their children
+	std::vector<MemoryOwnerInfo> GetOwners() const;
+
+private:
+	MemoryTracker() = default;
+
+	// index into m_owners, -1 if owner was removed
+	int Find(unsigned int owner) const;
+
+	mutable std::mutex m_mutex;
+	std::vector<MemoryOwnerInfo> m_owners;
+	size_t m_totals[MEMORY_CATEGORY_COUNT] = {};
+	unsigned int m_next_id = 1;
+};
+
+#endif
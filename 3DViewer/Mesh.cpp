@@ -1,16 +1,44 @@
 #include "Mesh.h"
+#include "SoftwareRenderer.h"
+#include "UploadScheduler.h"
+#include "MemoryTracker.h"
+#include "GeometryStore.h"
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+DrawStats Mesh::drawStats;
+
+Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload)
 {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+    // taken over, not copied: callers hand in their arrays with std::move
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+    this->textures = std::move(textures);
+    vertexCount = this->vertices.size();
+    indexCount = this->indices.size();
+    geometryKey = GeometryStore::MakeKey(this->vertices.data(), vertexCount, sizeof(Vertex), this->indices.data(), indexCount);
+
+    for (unsigned int i = 0; i < this->textures.size(); i++)
+    {
+        const Texture& texture = this->textures[i];
+        if (texture.type == "texture_diffuse")
+        {
+            features |= FEATURE_DIFFUSE_MAP;
+            if (texture.srgb)
+                features |= FEATURE_SRGB_DIFFUSE;
+        }
+        else if (texture.type == "texture_specular")
+            features |= FEATURE_SPECULAR_MAP;
+        else if (texture.type == "texture_normal")
+            features |= FEATURE_NORMAL_MAP;
+        else if (texture.type == "texture_height")
+            features |= FEATURE_HEIGHT_MAP;
+    }
 
     // now that we have all the required data, set the vertex buffers and its attribute pointers.
-    setupMesh();
+    if (upload)
+        setupMesh();
 }
 
-void Mesh::Draw(Shader& shader)
+void Mesh::Draw(Shader& shader, unsigned int instances)
 {
     // bind appropriate textures
     unsigned int diffuseNr = 1;
@@ -40,31 +68,96 @@ void Mesh::Draw(Shader& shader)
     }
 
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(geometry.GetVertexArray());
+    if (instances > 1)
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indexCount), GL_UNSIGNED_INT, 0, instances);
+    else
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indexCount), GL_UNSIGNED_INT, 0);
+    drawStats.drawCalls++;
+    drawStats.triangles += indexCount / 3 * instances;
     glBindVertexArray(0);
 
     // always good practice to set everything back to defaults once configured.
     glActiveTexture(GL_TEXTURE0);
 }
 
-void Mesh::setupMesh()
+void Mesh::Draw(SoftwareRenderer& renderer)
+{
+    renderer.DrawMesh(*this);
+}
+
+void Mesh::Upload()
+{
+    if (!geometry)
+        setupMesh();
+}
+
+void Mesh::Upload(UploadScheduler& scheduler, const void* owner, std::function<void()> done)
+{
+    if (geometry || !setupMesh(false))
+    {
+        if (done)
+            done();
+        return;
+    }
+
+    scheduler.UploadBuffer(owner, geometry.GetVertexBuffer(), vertices.data(), vertices.size() * sizeof(Vertex));
+    // requests complete in order, the vertices are in once the indices are. Only then other meshes may
+    // find the geometry; a cancelled upload never publishes it.
+    scheduler.UploadBuffer(owner, geometry.GetIndexBuffer(), indices.data(), indices.size() * sizeof(unsigned int),
+        [this, done = std::move(done)]() {
+            GeometryStore::Get().Publish(geometry);
+            if (done)
+                done();
+        });
+}
+
+void Mesh::ReleaseGeometry()
+{
+    // swapping with empty vectors gives the capacity back, clear() would keep it
+    vector<Vertex>().swap(vertices);
+    vector<unsigned int>().swap(indices);
+    MemoryTracker::Get().Set(memoryOwner, MEMORY_CPU_GEOMETRY, 0);
+}
+
+void Mesh::SetMemoryOwner(unsigned int owner)
 {
-    // create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    memoryOwner = owner;
+    MemoryTracker& tracker = MemoryTracker::Get();
+    tracker.Set(memoryOwner, MEMORY_CPU_GEOMETRY, vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int));
+}
+
+void Mesh::Delete()
+{
+    // nothing when never uploaded, e.g. only drawn by the CPU backend
+    geometry.Reset();
+}
 
-    glBindVertexArray(VAO);
+bool Mesh::setupMesh(bool fill)
+{
+    // the same vertices and indices are on the GPU already, from this model or another one
+    GeometryStore& store = GeometryStore::Get();
+    geometry = store.Find(geometryKey);
+    if (geometry)
+        return false;
+
+    // create buffers/arrays, the buffers are recycled from earlier models when the pool has them
+    size_t vertexBytes = vertices.size() * sizeof(Vertex);
+    size_t indexBytes = indices.size() * sizeof(unsigned int);
+    geometry = store.Create(geometryKey, vertexBytes, indexBytes);
+
+    glBindVertexArray(geometry.GetVertexArray());
     // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.GetVertexBuffer());
     // A great thing about structs is that their memory layout is sequential for all its items.
     // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
     // again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    if (fill)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, vertices.data());
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.GetIndexBuffer());
+    if (fill)
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes, indices.data());
 
     // set the vertex attribute pointers
     // vertex Positions
@@ -95,4 +188,8 @@ void Mesh::setupMesh()
     glEnableVertexAttribArray(6);
     glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
     glBindVertexArray(0);
+
+    if (fill)
+        store.Publish(geometry);
+    return true;
 }
\ No newline at end of file
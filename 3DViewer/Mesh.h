@@ -7,11 +7,18 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "MaterialFeatures.h"
+#include "GLObject.h"
+#include "GeometryStore.h"
 
+#include <functional>
 #include <string>
 #include <vector>
 using namespace std;
 
+class SoftwareRenderer;
+class UploadScheduler;
+
 #define MAX_BONE_INFLUENCE 4
 
 struct Vertex {
@@ -37,31 +44,100 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// draw calls and triangles submitted through Mesh::Draw, reset by the caller at the start of a frame
+struct DrawStats {
+    unsigned int drawCalls = 0;
+    size_t triangles = 0;
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    bool srgb = false;  // sampled as linear color, see FEATURE_SRGB_DIFFUSE
 };
 
+// Draws from GL buffers in the GeometryStore, shared with every mesh of the same content. A mesh moves but
+// doesn't copy and holds one reference to its geometry; Delete() or destroying the mesh drops it, and the
+// last one hands the buffers to the GpuResourcePool for the meshes of the next model.
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures);
+    // MaterialFeature bits, selects the shader variant drawing the mesh. The texture bits are set by the
+    // constructor, the vertex format bits by whoever fills the vertices (e.g. Model)
+    unsigned int features = 0;
+
+    // index into the virtual textures of the owning Model when FEATURE_VIRTUAL_TEXTURE is set
+    int virtualTexture = -1;
+
+    // range of Model::parts, the aiMeshes merged into the mesh
+    unsigned int firstPart = 0;
+    unsigned int partCount = 0;
+
+    // content of vertices and indices, computed by the constructor so the hash runs where the mesh is built
+    GeometryKey geometryKey;
+
+    // axis aligned bounds of the vertices, in the space of the nodes placing the mesh (see Model::instances)
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
+    // totals of all GL draws since the last reset
+    static DrawStats drawStats;
+
+    // constructor, uploads the buffers right away unless upload is false (e.g. when built off the GL thread)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true);
+
+    // render the mesh, more than one instance draws instanced (the shader reads InstanceUniforms)
+    void Draw(Shader& shader, unsigned int instances = 1);
 
-    // render the mesh
-    void Draw(Shader& shader);
+    // render the mesh with the CPU backend
+    void Draw(SoftwareRenderer& renderer);
+
+    // creates the GL buffers for a mesh that was constructed without uploading, or shares the ones of
+    // identical geometry already in the GeometryStore
+    void Upload();
+
+    // creates the GL buffers and leaves filling them to scheduler, done runs on the GL thread once the
+    // vertex and index data are submitted (right away when the GeometryStore already has them). The
+    // vertices and indices must not change until then.
+    void Upload(UploadScheduler& scheduler, const void* owner, std::function<void()> done);
+
+    // frees the CPU copies of vertices and indices, the mesh keeps drawing from its GL buffers.
+    // The CPU backend and anything else reading vertices/indices sees an empty mesh afterwards.
+    void ReleaseGeometry();
+
+    // whether vertices and indices are still in CPU memory
+    bool HasGeometry() const { return !indices.empty() || indexCount == 0; }
+
+    // sizes of the GL buffers, stay valid after ReleaseGeometry
+    size_t GetVertexCount() const { return vertexCount; }
+    size_t GetIndexCount() const { return indexCount; }
+
+    // registers the mesh with the MemoryTracker under owner and reports what it holds so far
+    void SetMemoryOwner(unsigned int owner);
+
+    // drops the reference to the shared geometry
+    void Delete();
+
+    // uploaded or shared, Draw can be called
+    bool IsUploaded() const { return (bool)geometry; }
 
 private:
     // render data 
-    unsigned int VBO, EBO;
+    GeometryRef geometry;
+
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+
+    // MemoryTracker handle, 0 when not tracked
+    unsigned int memoryOwner = 0;
 
-    // initializes all the buffer objects/arrays
-    void setupMesh();
+    // initializes all the buffer objects/arrays, only allocates the buffers without fill. Returns false
+    // when the GeometryStore had the geometry already and there is nothing to fill.
+    bool setupMesh(bool fill = true);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "MipGenerator.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_USE_SSE2 1
+#else
+#define MIP_USE_SSE2 0
+#endif
+
+// Entries of the linear to sRGB table, fine enough that even the steep dark end rounds like the exact curve
+static const int LINEAR_TO_SRGB_SIZE = 16384;
+
+struct SrgbTables
+{
+	float toLinear[256];
+	unsigned char toSrgb[LINEAR_TO_SRGB_SIZE + 1];
+
+	SrgbTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			double s = i / 255.0;
+			toLinear[i] = (float)(s <= 0.04045 ? s / 12.92 : std::pow((s + 0.055) / 1.055, 2.4));
+		}
+		for (int i = 0; i <= LINEAR_TO_SRGB_SIZE; i++)
+		{
+			double l = (double)i / LINEAR_TO_SRGB_SIZE;
+			double s = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+			toSrgb[i] = (unsigned char)std::min(255.0, s * 255.0 + 0.5);
+		}
+	}
+};
+
+static const SrgbTables& GetSrgbTables()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+// Weights of the source texels 2x + first ... 2x + first + taps - 1 for target texel x
+struct MipKernel
+{
+	int first;
+	int taps;
+	float weights[8];
+};
+
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static MipKernel MakeKernel(MipFilter filter)
+{
+	MipKernel kernel = {};
+	if (filter == MIP_FILTER_BOX)
+	{
+		kernel.first = 0;
+		kernel.taps = 2;
+		kernel.weights[0] = 0.5f;
+		kernel.weights[1] = 0.5f;
+		return kernel;
+	}
+
+	// Source texel 2x + k is (k - 0.5) / 2 target texels away from the center of target texel x.
+	// sinc windowed by a Kaiser window of alpha 4 reaching 2 target texels out.
+	const double alpha = 4.0;
+	const double radius = 2.0;
+	const double pi = 3.14159265358979323846;
+	kernel.first = -3;
+	kernel.taps = 8;
+	double sum = 0.0;
+	double weights[8];
+	for (int i = 0; i < kernel.taps; i++)
+	{
+		double t = (kernel.first + i - 0.5) / 2.0;
+		double sinc = t == 0.0 ? 1.0 : std::sin(pi * t) / (pi * t);
+		double window = BesselI0(alpha * std::sqrt(std::max(0.0, 1.0 - (t / radius) * (t / radius)))) / BesselI0(alpha);
+		weights[i] = sinc * window;
+		sum += weights[i];
+	}
+	for (int i = 0; i < kernel.taps; i++)
+		kernel.weights[i] = (float)(weights[i] / sum);
+	return kernel;
+}
+
+int GetMipLevelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		levels++;
+	}
+	return levels;
+}
+
+// One row of the 8 bit image as RGBA floats in linear light
+static void ConvertRow(const unsigned char* pixels, int width, int components, bool srgb, float* out)
+{
+	const SrgbTables& tables = GetSrgbTables();
+	for (int x = 0; x < width; x++)
+	{
+		float texel[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		for (int c = 0; c < components; c++)
+		{
+			unsigned char value = pixels[(size_t)x * components + c];
+			texel[c] = srgb && c < 3 ? tables.toLinear[value] : value / 255.0f;
+		}
+		memcpy(&out[(size_t)x * 4], texel, sizeof(texel));
+	}
+}
+
+// Halves the width: target row y is the filtered source row y. Reads either the float level or,
+// for level 1, the rows of the 8 bit image converted one at a time, so level 0 is never kept as floats.
+static void FilterRows(const float* source, const unsigned char* pixels, int components, bool srgb, int width, int height,
+	float* target, int target_width, const MipKernel& kernel, JobSystem& jobs)
+{
+	jobs.ParallelFor(height, 16, [&](int begin, int end) {
+		std::vector<float> converted;
+		if (pixels)
+			converted.resize((size_t)width * 4);
+		for (int y = begin; y < end; y++)
+		{
+			const float* row = source + (size_t)y * width * 4;
+			if (pixels)
+			{
+				ConvertRow(pixels + (size_t)y * width * components, width, components, srgb, converted.data());
+				row = converted.data();
+			}
+
+			float* out = target + (size_t)y * target_width * 4;
+			for (int x = 0; x < target_width; x++)
+			{
+#if MIP_USE_SSE2
+				__m128 sum = _mm_setzero_ps();
+				for (int i = 0; i < kernel.taps; i++)
+				{
+					int sx = std::min(std::max(2 * x + kernel.first + i, 0), width - 1);
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + (size_t)sx * 4), _mm_set1_ps(kernel.weights[i])));
+				}
+				_mm_storeu_ps(out + (size_t)x * 4, sum);
+#else
+				float sum[4] = {};
+				for (int i = 0; i < kernel.taps; i++)
+				{
+					int sx = std::min(std::max(2 * x + kernel.first + i, 0), width - 1);
+					for (int c = 0; c < 4; c++)
+						sum[c] += row[(size_t)sx * 4 + c] * kernel.weights[i];
+				}
+				memcpy(out + (size_t)x * 4, sum, sizeof(sum));
+#endif
+			}
+		}
+	});
+}
+
+// Halves the height: every target row is a weighted sum of whole source rows
+static void FilterColumns(const float* source, int width, int height, float* target, int target_height, const MipKernel& kernel, JobSystem& jobs)
+{
+	size_t row_floats = (size_t)width * 4;
+	jobs.ParallelFor(target_height, 8, [&](int begin, int end) {
+		const float* rows[8];
+		for (int y = begin; y < end; y++)
+		{
+			for (int i = 0; i < kernel.taps; i++)
+				rows[i] = source + (size_t)std::min(std::max(2 * y + kernel.first + i, 0), height - 1) * row_floats;
+
+			float* out = target + (size_t)y * row_floats;
+#if MIP_USE_SSE2
+			for (size_t j = 0; j < row_floats; j += 4)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int i = 0; i < kernel.taps; i++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[i] + j), _mm_set1_ps(kernel.weights[i])));
+				_mm_storeu_ps(out + j, sum);
+			}
+#else
+			for (size_t j = 0; j < row_floats; j++)
+			{
+				float sum = 0.0f;
+				for (int i = 0; i < kernel.taps; i++)
+					sum += rows[i][j] * kernel.weights[i];
+				out[j] = sum;
+			}
+#endif
+		}
+	});
+}
+
+// Clamps away the ringing of the Kaiser kernel, renormalizes normals and writes the 8 bit level.
+// The clamped floats stay the source of the next level.
+static void FinishLevel(float* texels, int width, int height, int components, const MipOptions& options, MipLevel& level, JobSystem& jobs)
+{
+	const SrgbTables& tables = GetSrgbTables();
+	bool srgb = options.srgb && components >= 3;
+	bool normalMap = options.normalMap && components >= 3;
+	level.width = width;
+	level.height = height;
+	level.data.resize((size_t)width * height * components);
+
+	jobs.ParallelFor(height, 16, [&](int begin, int end) {
+		for (int y = begin; y < end; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				size_t index = (size_t)y * width + x;
+				float* texel = texels + index * 4;
+#if MIP_USE_SSE2
+				_mm_storeu_ps(texel, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(texel), _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+#else
+				for (int c = 0; c < 4; c++)
+					texel[c] = std::min(std::max(texel[c], 0.0f), 1.0f);
+#endif
+				if (normalMap)
+				{
+					float nx = texel[0] * 2.0f - 1.0f;
+					float ny = texel[1] * 2.0f - 1.0f;
+					float nz = texel[2] * 2.0f - 1.0f;
+					float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+					if (length > 1e-6f)
+					{
+						texel[0] = nx / length * 0.5f + 0.5f;
+						texel[1] = ny / length * 0.5f + 0.5f;
+						texel[2] = nz / length * 0.5f + 0.5f;
+					}
+				}
+
+				unsigned char* out = &level.data[index * components];
+				for (int c = 0; c < components; c++)
+				{
+					if (srgb && c < 3)
+						out[c] = tables.toSrgb[(int)(texel[c] * LINEAR_TO_SRGB_SIZE + 0.5f)];
+					else
+						out[c] = (unsigned char)(texel[c] * 255.0f + 0.5f);
+				}
+			}
+		}
+	});
+}
+
+void GenerateMipChain(const unsigned char* pixels, int width, int height, int components, const MipOptions& options,
+	std::vector<MipLevel>& levels, int threads)
+{
+	levels.clear();
+	if (!pixels || width <= 0 || height <= 0 || components < 1 || components > 4 || (width == 1 && height == 1))
+		return;
+
+	MipKernel kernel = MakeKernel(options.filter);
+	bool srgb = options.srgb && components >= 3;
+	// a texture decoded by an import job runs its rows on the workers of that import
+	std::unique_ptr<JobSystem> own_jobs;
+	if (threads > 0)
+		own_jobs = std::make_unique<JobSystem>(threads);
+	JobSystem& jobs = own_jobs ? *own_jobs : JobSystem::Get();
+
+	std::vector<float> current, rows;
+	int level_width = width;
+	int level_height = height;
+	while (level_width > 1 || level_height > 1)
+	{
+		int next_width = std::max(1, level_width / 2);
+		int next_height = std::max(1, level_height / 2);
+
+		rows.resize((size_t)next_width * level_height * 4);
+		FilterRows(current.data(), levels.empty() ? pixels : nullptr, components, srgb, level_width, level_height, rows.data(), next_width, kernel, jobs);
+		current.resize((size_t)next_width * next_height * 4);
+		FilterColumns(rows.data(), next_width, level_height, current.data(), next_height, kernel, jobs);
+
+		levels.emplace_back();
+		FinishLevel(current.data(), next_width, next_height, components, options, levels.back(), jobs);
+		level_width = next_width;
+		level_height = next_height;
+	}
+}
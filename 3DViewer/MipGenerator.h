@@ -0,0 +1,42 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <vector>
+
+// CPU mip chain generation, so textures arrive at the GL thread with every level filtered and
+// glGenerateMipmap is never needed. Levels are filtered from the previous one in float, with SSE2
+// where available, and split over threads by rows.
+enum MipFilter
+{
+	// 2x2 average, what glGenerateMipmap does
+	MIP_FILTER_BOX,
+	// 8 tap Kaiser windowed sinc, keeps distant levels sharper than the box
+	MIP_FILTER_KAISER
+};
+
+struct MipOptions
+{
+	MipFilter filter = MIP_FILTER_KAISER;
+	// RGB is sRGB encoded and filtered in linear light, alpha is always linear. Only used with 3-4 components.
+	bool srgb = false;
+	// RGB is a tangent space normal, renormalized on every level. Only used with 3-4 components.
+	bool normalMap = false;
+};
+
+struct MipLevel
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> data;
+};
+
+// Number of levels of a full chain down to 1x1, level 0 included
+int GetMipLevelCount(int width, int height);
+
+// Generates levels 1 and up of an 8 bit image with 1-4 components, each halving the size rounded
+// down like GL. The levels keep the component count of the image.
+// threads counts the calling thread, 0 runs on the shared JobSystem::Get().
+void GenerateMipChain(const unsigned char* pixels, int width, int height, int components, const MipOptions& options,
+	std::vector<MipLevel>& levels, int threads = 0);
+
+#endif
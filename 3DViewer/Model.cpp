@@ -1,118 +1,719 @@
 #include "Model.h"
+#include "SoftwareRenderer.h"
+#include "Logger.h"
+#include "GLUtils.h"
+#include "TextureCache.h"
+#include "JobSystem.h"
+#include "UploadScheduler.h"
+#include "MemoryTracker.h"
+#include "UniformBlocks.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <filesystem>
-#include <iostream>
 
 namespace fs = std::filesystem;
 
-Model::Model(string const& path, bool gamma) : gammaCorrection(gamma)
+// the import scratch of a typical model fits here, only bigger scenes make the arena go to the heap
+static const size_t IMPORT_ARENA_STACK_SIZE = 16 * 1024;
+
+Model::Model(string const& path, bool gamma, bool deferUpload) : gammaCorrection(gamma), deferUpload(deferUpload)
 {
-    gamma = false;
+    memoryOwner = MemoryTracker::Get().AddOwner(path);
     loadModel(path);
 }
 
+Model::Model(const aiScene* scene, string const& directory, bool gamma, bool deferUpload) : directory(directory), gammaCorrection(gamma), deferUpload(deferUpload)
+{
+    memoryOwner = MemoryTracker::Get().AddOwner(string("scene in ") + directory);
+    loadScene(scene);
+}
+
+Model::~Model()
+{
+    if (pendingUploads > 0)
+        uploadScheduler->Cancel(this);
+    for (unsigned int i = 0; i < pendingTextures.size(); i++)
+        FreeTextureData(pendingTextures[i]);
+    MemoryTracker::Get().RemoveOwner(memoryOwner);
+}
+
 void Model::Draw(Shader& shader)
 {
+    if (IsUploading())
+        return;
     for (unsigned int i = 0; i < meshes.size(); i++)
         meshes[i].Draw(shader);
 }
 
+void Model::Draw(ShaderVariants& variants, UniformRing& ring, const glm::mat4& transform)
+{
+    if (IsUploading())
+        return;
+    sceneGraph.Update();
+
+    // meshes with the same features share a program, only switch when it changes
+    GLuint current = 0;
+    const glm::mat4* bound = nullptr;
+    for (size_t first = 0; first < instances.size(); )
+    {
+        size_t count = getInstanceCount(first);
+        Mesh& mesh = meshes[instances[first].mesh];
+        Shader& shader = variants.Get(count > 1 ? mesh.features | FEATURE_INSTANCED : mesh.features);
+        if (shader.ID != current)
+        {
+            shader.use();
+            current = shader.ID;
+        }
+        if (mesh.virtualTexture >= 0)
+            virtualTextures[mesh.virtualTexture]->Bind(shader);
+        if (count > 1)
+            drawInstanced(shader, ring, transform, first, count);
+        else
+        {
+            bindNodeTransform(ring, transform, instances[first].node, bound);
+            mesh.Draw(shader);
+        }
+        first += count;
+    }
+}
+
+void Model::DrawVirtualTextureFeedback(Shader& shader, int viewportWidth, int viewportHeight, UniformRing& ring, const glm::mat4& transform)
+{
+    if (IsUploading())
+        return;
+    sceneGraph.Update();
+    for (unsigned int v = 0; v < virtualTextures.size(); v++)
+    {
+        virtualTextures[v]->BeginFeedback(shader, viewportWidth, viewportHeight);
+        // one draw per instance, the feedback pass is a quarter of the resolution and has no instanced variant
+        const glm::mat4* bound = nullptr;
+        for (const MeshInstance& instance : instances)
+        {
+            if (meshes[instance.mesh].virtualTexture != (int)v)
+                continue;
+            bindNodeTransform(ring, transform, instance.node, bound);
+            meshes[instance.mesh].Draw(shader);
+        }
+        virtualTextures[v]->EndFeedback();
+    }
+}
+
+bool Model::UpdateVirtualTextures()
+{
+    bool changed = false;
+    for (unsigned int i = 0; i < virtualTextures.size(); i++)
+        changed = virtualTextures[i]->Update() || changed;
+    return changed;
+}
+
+bool Model::IsVirtualTextureBusy() const
+{
+    for (unsigned int i = 0; i < virtualTextures.size(); i++)
+    {
+        if (virtualTextures[i]->IsBusy())
+            return true;
+    }
+    return false;
+}
+
+const MeshPart* Model::FindPart(unsigned int mesh, size_t triangle) const
+{
+    if (mesh >= meshes.size())
+        return nullptr;
+    const Mesh& target = meshes[mesh];
+    size_t index = triangle * 3;
+    // the parts are in index order, the last one starting at or before index holds it
+    auto first = parts.begin() + target.firstPart;
+    auto last = first + target.partCount;
+    auto it = std::upper_bound(first, last, index, [](size_t value, const MeshPart& part) { return value < part.firstIndex; });
+    if (it == first)
+        return nullptr;
+    --it;
+    return index < (size_t)it->firstIndex + it->indexCount ? &*it : nullptr;
+}
+
+vector<unsigned int> Model::GetMaterialFeatures() const
+{
+    vector<unsigned int> features;
+    for (size_t first = 0; first < instances.size(); )
+    {
+        size_t count = getInstanceCount(first);
+        unsigned int mask = meshes[instances[first].mesh].features | (count > 1 ? FEATURE_INSTANCED : 0);
+        if (std::find(features.begin(), features.end(), mask) == features.end())
+            features.push_back(mask);
+        first += count;
+    }
+    return features;
+}
+
+void Model::Draw(SoftwareRenderer& renderer)
+{
+    sceneGraph.Update();
+    renderer.SetTextureDirectory(directory);
+    glm::mat4 transform = renderer.GetModelMatrix();
+    for (const MeshInstance& instance : instances)
+    {
+        renderer.SetModelMatrix(transform * sceneGraph.GetWorld(instance.node));
+        meshes[instance.mesh].Draw(renderer);
+    }
+    renderer.SetModelMatrix(transform);
+}
+
+size_t Model::getInstanceCount(size_t first) const
+{
+    size_t last = first + 1;
+    while (last < instances.size() && instances[last].mesh == instances[first].mesh)
+        last++;
+    return last - first;
+}
+
+void Model::bindNodeTransform(UniformRing& ring, const glm::mat4& transform, int node, const glm::mat4*& bound)
+{
+    // meshes of the same node, or of nodes with the same matrix (e.g. all identity in an OBJ), share one push
+    const glm::mat4& world = sceneGraph.GetWorld(node);
+    if (bound && (bound == &world || *bound == world))
+        return;
+    ObjectUniforms uniforms;
+    uniforms.model = transform * world;
+    ring.PushAndBind(OBJECT_UNIFORMS_BINDING, uniforms);
+    bound = &world;
+}
+
+void Model::drawInstanced(Shader& shader, UniformRing& ring, const glm::mat4& transform, size_t first, size_t count)
+{
+    Mesh& mesh = meshes[instances[first].mesh];
+    InstanceUniforms uniforms;
+    for (size_t done = 0; done < count; done += MAX_INSTANCES_PER_DRAW)
+    {
+        unsigned int batch = (unsigned int)std::min<size_t>(count - done, MAX_INSTANCES_PER_DRAW);
+        for (unsigned int i = 0; i < batch; i++)
+            uniforms.models[i] = transform * sceneGraph.GetWorld(instances[first + done + i].node);
+        ring.PushAndBind(INSTANCE_UNIFORMS_BINDING, uniforms);
+        mesh.Draw(shader, batch);
+    }
+}
+
+void Model::Upload()
+{
+    // upload the decoded textures first so the meshes can pick up the new ids
+    for (unsigned int i = 0; i < pendingTextures.size(); i++)
+    {
+        TextureStorage storage;
+        GLTexture texture = UploadTexture(pendingTextures[i], &storage);
+        setTextureObject(i, std::move(texture), storage, pendingTextures[i]);
+    }
+    freePendingTextures();
+
+    updateMeshTextureIds();
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].Upload();
+
+    createVirtualTextures();
+    deferUpload = false;
+    applyGeometryPolicy();
+}
+
+void Model::Upload(UploadScheduler& scheduler)
+{
+    // every request counts until its callback, the decoded images are freed after the last one.
+    // The count starts at one so callbacks running right away can't finish early.
+    uploadScheduler = &scheduler;
+    pendingUploads = 1;
+    std::function<void()> done = [this]() {
+        if (--pendingUploads > 0)
+            return;
+        freePendingTextures();
+        applyGeometryPolicy();
+    };
+
+    for (unsigned int i = 0; i < pendingTextures.size(); i++)
+    {
+        pendingUploads++;
+        // the storage is allocated right away, only its contents arrive later
+        TextureStorage storage;
+        GLTexture texture = UploadTexture(pendingTextures[i], scheduler, this, done, &storage);
+        setTextureObject(i, std::move(texture), storage, pendingTextures[i]);
+    }
+
+    updateMeshTextureIds();
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        pendingUploads++;
+        meshes[i].Upload(scheduler, this, done);
+    }
+
+    createVirtualTextures();
+    deferUpload = false;
+    done();
+}
+
+void Model::updateMeshTextureIds()
+{
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        for (unsigned int j = 0; j < meshes[i].textures.size(); j++)
+        {
+            for (unsigned int k = 0; k < textures_loaded.size(); k++)
+            {
+                if (textures_loaded[k].path == meshes[i].textures[j].path)
+                {
+                    meshes[i].textures[j].id = textures_loaded[k].id;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void Model::freePendingTextures()
+{
+    for (unsigned int i = 0; i < pendingTextures.size(); i++)
+    {
+        FreeTextureData(pendingTextures[i]);
+        MemoryTracker::Get().Set(textureObjects[i].memoryOwner, MEMORY_CPU_TEXTURE, 0);
+    }
+    pendingTextures.clear();
+}
+
+void Model::setTextureObject(unsigned int index, GLTexture texture, const TextureStorage& storage, const TextureData& data)
+{
+    TextureObject& object = textureObjects[index];
+    textures_loaded[index].id = texture.Get();
+    object.texture = std::move(texture);
+    object.storage = storage;
+    object.bytes = GetTextureGpuSize(data);
+    MemoryTracker::Get().Set(object.memoryOwner, MEMORY_GPU_TEXTURE, object.bytes);
+}
+
+void Model::applyGeometryPolicy()
+{
+    if (geometryPolicy == GEOMETRY_DROP_AFTER_UPLOAD)
+        ReleaseGeometry();
+}
+
+void Model::ReleaseGeometry()
+{
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].ReleaseGeometry();
+}
+
+void Model::createVirtualTextures()
+{
+    for (unsigned int i = 0; i < virtualTextures.size(); i++)
+    {
+        if (!virtualTextures[i]->Create())
+            LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::CREATE_FAILED");
+    }
+}
+
+void Model::Delete()
+{
+    // copies still waiting would write into deleted objects
+    if (pendingUploads > 0)
+        uploadScheduler->Cancel(this);
+    pendingUploads = 0;
+
+    for (unsigned int i = 0; i < meshes.size(); i++)
+        meshes[i].Delete();
+
+    GpuResourcePool& pool = GpuResourcePool::Get();
+    for (unsigned int i = 0; i < textureObjects.size(); i++)
+    {
+        // textures of images that failed to load have no storage worth keeping
+        TextureObject& object = textureObjects[i];
+        if (object.storage.levels > 0)
+            pool.ReleaseTexture(std::move(object.texture), object.storage, object.bytes);
+        else
+            object.texture.Reset();
+        textures_loaded[i].id = 0;
+        MemoryTracker::Get().Set(object.memoryOwner, MEMORY_GPU_TEXTURE, 0);
+    }
+
+    freePendingTextures();
+
+    for (unsigned int i = 0; i < virtualTextures.size(); i++)
+        virtualTextures[i]->Delete();
+    virtualTextures.clear();
+}
+
 void Model::loadModel(string const& path)
 {
-    std::cout << "Current path: " << fs::current_path() << '\n';
+    LOG_DEBUG(LogCategory::Model, "Current path: %s", fs::current_path().string());
 
     // read file via ASSIMP
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    const aiScene* scene = importer.ReadFile(path, ImportFlags);
     // check for errors
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
-        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        LOG_ERROR(LogCategory::Model, "ERROR::ASSIMP:: %s", importer.GetErrorString());
         return;
     }
     // retrieve the directory path of the filepath
     directory = path.substr(0, path.find_last_of('/'));
 
+    loadScene(scene);
+}
+
+// aiMatrix4x4 is row major, glm column major
+static glm::mat4 ToMat4(const aiMatrix4x4& m)
+{
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+                     m.a2, m.b2, m.c2, m.d2,
+                     m.a3, m.b3, m.c3, m.d3,
+                     m.a4, m.b4, m.c4, m.d4);
+}
+
+void Model::loadScene(const aiScene* scene)
+{
+    // everything the conversion needs only until it is done comes from this arena, released as a whole on return
+    char arenaBuffer[IMPORT_ARENA_STACK_SIZE];
+    std::pmr::monotonic_buffer_resource arena(arenaBuffer, sizeof(arenaBuffer));
+    ImportScratch scratch(&arena);
+    scratch.materials.resize(scene->mNumMaterials);
+    scratch.meshIndices.assign(scene->mNumMeshes, -1);
+    scratch.meshBatches.assign(scene->mNumMeshes, -1);
+
+    // at most one Mesh per aiMesh, fewer when nodes leave some unreferenced
+    meshes.reserve(meshes.size() + scene->mNumMeshes);
+
+    // image decoding dominates the import, it runs up front on all cores instead of material by material
+    decodeTextures(scene, scratch);
+
+    // the world matrices are needed for the bounds while the meshes are converted
+    loadSceneGraph(scene, scratch);
+    sceneGraph.Update();
+    planBatches(scene, scratch);
+
     // process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    processNode(scene->mRootNode, 0, scene, scratch);
+    // the instances of a mesh next to each other, the order of the meshes stays the order they were found in
+    std::stable_sort(instances.begin(), instances.end(), [](const MeshInstance& a, const MeshInstance& b) { return a.mesh < b.mesh; });
+    if (meshes.empty())
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+    }
+    if (meshes.size() < scene->mNumMeshes)
+        LOG_INFO(LogCategory::Model, "Static batching: %u meshes with %zu distinct materials drawn as %zu", scene->mNumMeshes,
+            scratch.canonicalMaterials.size(), meshes.size());
+
+    // images of maps only found under another type, see loadMaterialTextures
+    for (auto& decoded : scratch.decodedTextures)
+        FreeTextureData(decoded.second.data);
+}
+
+void Model::decodeTextures(const aiScene* scene, ImportScratch& scratch)
+{
+    static const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+    static const char* const typeNames[] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+
+    // the materials meshes use, in the order loadMaterial would find them. A path keeps the type it is
+    // found as first, like textures_loaded does.
+    std::pmr::vector<char> used(scene->mNumMaterials, 0, scratch.arena);
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+        used[scene->mMeshes[i]->mMaterialIndex] = 1;
+
+    std::pmr::vector<std::pair<const char*, ImportScratch::DecodedTexture*>> work(scratch.arena);
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        if (!used[m])
+            continue;
+        aiMaterial* material = scene->mMaterials[m];
+        for (int t = 0; t < 4; t++)
+        {
+            aiTextureType type = types[t];
+            // diffuse maps with a page file are streamed, loadVirtualTexture decodes nothing
+            if (type == aiTextureType_DIFFUSE && material->GetTextureCount(type) > 0)
+            {
+                aiString str;
+                material->GetTexture(type, 0, &str);
+                if (fs::exists(fs::path(directory + '/' + str.C_Str()).replace_extension(".vtex")))
+                    continue;
+            }
+            for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+            {
+                aiString str;
+                material->GetTexture(type, i, &str);
+                auto inserted = scratch.decodedTextures.emplace(std::pmr::string(str.C_Str(), scratch.arena), ImportScratch::DecodedTexture());
+                if (!inserted.second)
+                    continue;
+                inserted.first->second.typeName = typeNames[t];
+                work.emplace_back(inserted.first->first.c_str(), &inserted.first->second);
+            }
+        }
+    }
+
+    // the map is complete, the jobs only write into their own entries
+    JobSystem::Get().ParallelFor((int)work.size(), 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+            LoadTextureData(work[i].first, directory, work[i].second->data, work[i].second->typeName, gammaCorrection);
+    });
+}
+
+void Model::loadSceneGraph(const aiScene* scene, ImportScratch& scratch)
+{
+    sceneGraph.Clear();
+    std::pmr::vector<const aiNode*>& queue = scratch.nodes;
+    queue.push_back(scene->mRootNode);
+    sceneGraph.AddNode(SceneGraph::NO_PARENT, ToMat4(scene->mRootNode->mTransformation), scene->mRootNode->mName.C_Str());
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        const aiNode* node = queue[i];
+        scratch.firstChild.push_back((unsigned int)queue.size());
+        for (unsigned int c = 0; c < node->mNumChildren; c++)
+        {
+            queue.push_back(node->mChildren[c]);
+            sceneGraph.AddNode((int)i, ToMat4(node->mChildren[c]->mTransformation), node->mChildren[c]->mName.C_Str());
+        }
+    }
+}
+
+// the vertex attributes processMesh fills for mesh
+static unsigned int GetVertexFormat(const aiMesh* mesh)
+{
+    unsigned int format = 0;
+    if (mesh->mTextureCoords[0])
+        format |= FEATURE_TEXCOORDS;
+    if (mesh->mTextureCoords[0] && mesh->HasTangentsAndBitangents())
+        format |= FEATURE_TANGENTS;
+    if (mesh->HasBones())
+        format |= FEATURE_SKINNING;
+    return format;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::planBatches(const aiScene* scene, ImportScratch& scratch)
 {
+    // a mesh placed by several nodes stays a Mesh of its own and is drawn instanced
+    std::pmr::vector<unsigned int> references(scene->mNumMeshes, 0, scratch.arena);
+    for (const aiNode* node : scratch.nodes)
+    {
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+            references[node->mMeshes[i]]++;
+    }
+
+    // the nodes of OBJ groups and CAD parts often all have the same matrix, so meshes of different
+    // nodes end up in one batch too. The batch is placed by the node of its first part: static batching
+    // assumes the nodes don't move independently afterwards.
+    std::pmr::unordered_map<ImportScratch::BatchKey, unsigned int, ImportScratch::BatchKeyHash> batchIndices(scratch.arena);
+    for (size_t n = 0; n < scratch.nodes.size(); n++)
+    {
+        const aiNode* node = scratch.nodes[n];
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            unsigned int source = node->mMeshes[i];
+            const aiMesh* mesh = scene->mMeshes[source];
+            // bone indices are per mesh and can't be merged
+            if (references[source] != 1 || mesh->HasBones())
+                continue;
+
+            ImportScratch::BatchKey key;
+            key.world = sceneGraph.GetWorld((int)n);
+            key.material = loadMaterial(scene, mesh->mMaterialIndex, scratch).canonical;
+            key.format = GetVertexFormat(mesh);
+            auto inserted = batchIndices.emplace(key, (unsigned int)scratch.batches.size());
+            if (inserted.second)
+                scratch.batches.push_back(ImportScratch::Batch());
+            scratch.meshBatches[source] = (int)inserted.first->second;
+            scratch.batches[inserted.first->second].sourceCount++;
+        }
+    }
+
+    // the sources of every batch next to each other, in the order of the aiMeshes
+    unsigned int offset = 0;
+    for (ImportScratch::Batch& batch : scratch.batches)
+    {
+        batch.firstSource = offset;
+        offset += batch.sourceCount;
+        batch.sourceCount = 0;
+    }
+    scratch.batchSources.resize(offset);
+    for (unsigned int source = 0; source < scene->mNumMeshes; source++)
+    {
+        int batch = scratch.meshBatches[source];
+        if (batch >= 0)
+        {
+            ImportScratch::Batch& entry = scratch.batches[batch];
+            scratch.batchSources[entry.firstSource + entry.sourceCount++] = source;
+        }
+    }
+}
+
+void Model::processNode(aiNode* node, unsigned int index, const aiScene* scene, ImportScratch& scratch)
+{
+    const glm::mat4& world = sceneGraph.GetWorld(index);
+    bool identity = world == glm::mat4(1.0f);
     // process each mesh located at the current node
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         // the node object only contains indices to index the actual objects in the scene. 
         // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        // a mesh referenced by several nodes (bolts of a CAD export, instanced furniture) is converted once,
+        // the meshes of a batch are converted together the first time one of them comes up
+        unsigned int source = node->mMeshes[i];
+        int batch = scratch.meshBatches[source];
+        int& converted = batch >= 0 ? scratch.batches[batch].mesh : scratch.meshIndices[source];
+        if (converted >= 0 && batch >= 0)
+            continue;
+        if (converted < 0)
+        {
+            const unsigned int* sources = batch >= 0 ? &scratch.batchSources[scratch.batches[batch].firstSource] : &source;
+            unsigned int count = batch >= 0 ? scratch.batches[batch].sourceCount : 1;
+            aiMesh* mesh = scene->mMeshes[sources[0]];
+            meshes.push_back(processMesh(sources, count, scene, scratch));
+            converted = (int)meshes.size() - 1;
+            // registered once it has its place in meshes, the copies made on the way there aren't tracked
+            string name = mesh->mName.length > 0 ? mesh->mName.C_Str() : "mesh " + std::to_string(meshes.size() - 1);
+            if (count > 1)
+                name += " (+" + std::to_string(count - 1) + " merged)";
+            meshes.back().SetMemoryOwner(MemoryTracker::Get().AddOwner(name, memoryOwner));
+        }
+        instances.push_back({ (unsigned int)converted, (int)index });
+
+        // the model bounds enclose the node space bounds of the mesh moved by the node
+        const Mesh& placed = meshes[converted];
+        if (identity)
+        {
+            boundsMin = glm::min(boundsMin, placed.boundsMin);
+            boundsMax = glm::max(boundsMax, placed.boundsMax);
+        }
+        else if (placed.boundsMin.x <= placed.boundsMax.x)
+        {
+            for (int corner = 0; corner < 8; corner++)
+            {
+                glm::vec3 local((corner & 1) ? placed.boundsMax.x : placed.boundsMin.x,
+                                (corner & 2) ? placed.boundsMax.y : placed.boundsMin.y,
+                                (corner & 4) ? placed.boundsMax.z : placed.boundsMin.z);
+                glm::vec3 position = glm::vec3(world * glm::vec4(local, 1.0f));
+                boundsMin = glm::min(boundsMin, position);
+                boundsMax = glm::max(boundsMax, position);
+            }
+        }
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scratch.firstChild[index] + i, scene, scratch);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+Mesh Model::processMesh(const unsigned int* sources, unsigned int count, const aiScene* scene, ImportScratch& scratch)
 {
-    // data to fill
+    // data to fill, sized up front: the arrays move into the Mesh and are never reallocated
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (unsigned int s = 0; s < count; s++)
+    {
+        vertexCount += scene->mMeshes[sources[s]]->mNumVertices;
+        indexCount += (size_t)scene->mMeshes[sources[s]]->mNumFaces * 3;
+    }
+    vertices.reserve(vertexCount);
+    indices.reserve(indexCount);
+    glm::vec3 meshMin(FLT_MAX);
+    glm::vec3 meshMax(-FLT_MAX);
+    unsigned int firstPart = (unsigned int)parts.size();
 
-    // walk through each of the mesh's vertices
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-    {
-        Vertex vertex;
-        glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-        // positions
-        vector.x = mesh->mVertices[i].x;
-        vector.y = mesh->mVertices[i].y;
-        vector.z = mesh->mVertices[i].z;
-        vertex.Position = vector;
-        // normals
-        if (mesh->HasNormals())
+    // the meshes of a batch one after the other, each one's indices shifted past the vertices before it
+    for (unsigned int s = 0; s < count; s++)
+    {
+        const aiMesh* mesh = scene->mMeshes[sources[s]];
+        unsigned int baseVertex = (unsigned int)vertices.size();
+        size_t firstIndex = indices.size();
+
+        // walk through each of the mesh's vertices
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
+            // zeroed, attributes the file lacks (and the bone slots) upload and hash the same every time
+            Vertex vertex = {};
+            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+            // positions
+            vector.x = mesh->mVertices[i].x;
+            vector.y = mesh->mVertices[i].y;
+            vector.z = mesh->mVertices[i].z;
+            vertex.Position = vector;
+            meshMin = glm::min(meshMin, vector);
+            meshMax = glm::max(meshMax, vector);
+            // normals
+            if (mesh->HasNormals())
+            {
+                vector.x = mesh->mNormals[i].x;
+                vector.y = mesh->mNormals[i].y;
+                vector.z = mesh->mNormals[i].z;
+                vertex.Normal = vector;
+            }
+            // texture coordinates
+            if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            {
+                glm::vec2 vec;
+                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+                vec.x = mesh->mTextureCoords[0][i].x;
+                vec.y = mesh->mTextureCoords[0][i].y;
+                vertex.TexCoords = vec;
+                // tangent
+                vector.x = mesh->mTangents[i].x;
+                vector.y = mesh->mTangents[i].y;
+                vector.z = mesh->mTangents[i].z;
+                vertex.Tangent = vector;
+                // bitangent
+                vector.x = mesh->mBitangents[i].x;
+                vector.y = mesh->mBitangents[i].y;
+                vector.z = mesh->mBitangents[i].z;
+                vertex.Bitangent = vector;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+
+            vertices.push_back(vertex);
         }
-        // texture coordinates
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            glm::vec2 vec;
-            // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-            vec.x = mesh->mTextureCoords[0][i].x;
-            vec.y = mesh->mTextureCoords[0][i].y;
-            vertex.TexCoords = vec;
-            // tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
+            const aiFace& face = mesh->mFaces[i];
+            // retrieve all indices of the face and store them in the indices vector
+            for (unsigned int j = 0; j < face.mNumIndices; j++)
+                indices.push_back(baseVertex + face.mIndices[j]);
         }
-        else
-            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-        vertices.push_back(vertex);
+        parts.push_back({ sources[s], (unsigned int)firstIndex, (unsigned int)(indices.size() - firstIndex) });
     }
-    // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    // process materials, the same canonical material for all meshes of a batch
+    const aiMesh* mesh = scene->mMeshes[sources[0]];
+    const ImportScratch::Material& material = loadMaterial(scene, mesh->mMaterialIndex, scratch);
+    int virtualTexture = material.virtualTexture;
+    textures.reserve(material.textureCount);
+    for (unsigned int i = 0; i < material.textureCount; i++)
+        textures.push_back(textures_loaded[scratch.materialTextures[material.firstTexture + i]]);
+
+    // return a mesh object created from the extracted mesh data
+    Mesh result(std::move(vertices), std::move(indices), std::move(textures), !deferUpload);
+    result.boundsMin = meshMin;
+    result.boundsMax = meshMax;
+    result.features |= GetVertexFormat(mesh);
+    result.firstPart = firstPart;
+    result.partCount = count;
+    if (virtualTexture >= 0)
     {
-        aiFace face = mesh->mFaces[i];
-        // retrieve all indices of the face and store them in the indices vector
-        for (unsigned int j = 0; j < face.mNumIndices; j++)
-            indices.push_back(face.mIndices[j]);
+        result.features |= FEATURE_VIRTUAL_TEXTURE;
+        result.virtualTexture = virtualTexture;
     }
-    // process materials
-    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+    return result;
+}
+
+const Model::ImportScratch::Material& Model::loadMaterial(const aiScene* scene, unsigned int index, ImportScratch& scratch)
+{
+    ImportScratch::Material& converted = scratch.materials[index];
+    if (converted.loaded)
+        return converted;
+
+    aiMaterial* material = scene->mMaterials[index];
+    converted.firstTexture = (unsigned int)scratch.materialTextures.size();
     // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
     // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
     // Same applies to other texture as the following list summarizes:
@@ -120,96 +721,420 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     // specular: texture_specularN
     // normal: texture_normalN
 
-    // 1. diffuse maps
-    vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+    // 1. diffuse maps, streamed as a virtual texture when the tiler wrote a page file for them
+    converted.virtualTexture = loadVirtualTexture(material);
+    if (converted.virtualTexture < 0)
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", scratch);
 
     // 2. specular maps
-    vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+    loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", scratch);
 
     // 3. normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+    loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", scratch);
 
     // 4. height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", scratch);
 
-    // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    converted.textureCount = (unsigned int)scratch.materialTextures.size() - converted.firstTexture;
+
+    // 5. the values, exporters write one material per shading group even when the values repeat
+    //    (lambert3SG and lambert4SG of pen.mtl). Keys the file lacks stay 0 on both sides.
+    aiColor3D colors[4];
+    material->Get(AI_MATKEY_COLOR_DIFFUSE, colors[0]);
+    material->Get(AI_MATKEY_COLOR_AMBIENT, colors[1]);
+    material->Get(AI_MATKEY_COLOR_SPECULAR, colors[2]);
+    material->Get(AI_MATKEY_COLOR_EMISSIVE, colors[3]);
+    for (int i = 0; i < 4; i++)
+    {
+        converted.values[i * 3] = colors[i].r;
+        converted.values[i * 3 + 1] = colors[i].g;
+        converted.values[i * 3 + 2] = colors[i].b;
+    }
+    material->Get(AI_MATKEY_SHININESS, converted.values[12]);
+    material->Get(AI_MATKEY_OPACITY, converted.values[13]);
+    material->Get(AI_MATKEY_REFRACTI, converted.values[14]);
+
+    // the first earlier material with the same values and maps is the canonical one
+    converted.canonical = index;
+    for (unsigned int other : scratch.canonicalMaterials)
+    {
+        const ImportScratch::Material& candidate = scratch.materials[other];
+        if (candidate.virtualTexture == converted.virtualTexture && candidate.textureCount == converted.textureCount &&
+            memcmp(candidate.values, converted.values, sizeof(converted.values)) == 0 &&
+            std::equal(scratch.materialTextures.begin() + candidate.firstTexture, scratch.materialTextures.begin() + candidate.firstTexture + candidate.textureCount,
+                scratch.materialTextures.begin() + converted.firstTexture))
+        {
+            converted.canonical = other;
+            break;
+        }
+    }
+    if (converted.canonical == index)
+        scratch.canonicalMaterials.push_back(index);
+
+    converted.loaded = true;
+    return converted;
 }
 
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+int Model::loadVirtualTexture(aiMaterial* mat)
+{
+    if (mat->GetTextureCount(aiTextureType_DIFFUSE) == 0)
+        return -1;
+    aiString str;
+    mat->GetTexture(aiTextureType_DIFFUSE, 0, &str);
+    string path = fs::path(directory + '/' + str.C_Str()).replace_extension(".vtex").string();
+    if (!fs::exists(path))
+        return -1;
+
+    for (unsigned int i = 0; i < virtualTextures.size(); i++)
+    {
+        if (virtualTextures[i]->GetPath() == path)
+            return (int)i;
+    }
+
+    unique_ptr<VirtualTexture> texture = std::make_unique<VirtualTexture>();
+    if (!texture->Open(path))
+    {
+        LOG_WARNING(LogCategory::Model, "Virtual texture failed to open, using the image: %s", path);
+        return -1;
+    }
+    // with deferUpload the GL side is created in Upload()
+    if (!deferUpload && !texture->Create())
+        LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::CREATE_FAILED: %s", path);
+    texture->SetMemoryOwner(MemoryTracker::Get().AddOwner(path, memoryOwner));
+    virtualTextures.push_back(std::move(texture));
+    return (int)virtualTextures.size() - 1;
+}
+
+void Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, const char* typeName, ImportScratch& scratch)
 {
-    vector<Texture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
 
         // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++)
-        {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                break;
-            }
-        }
-        if (!skip)
+        std::pmr::string path(str.C_Str(), scratch.arena);
+        auto loaded = scratch.textureIndices.find(path);
+        if (loaded != scratch.textureIndices.end())
+            scratch.materialTextures.push_back(loaded->second); // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+        else
         {   // if texture hasn't been loaded already, load it
             Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
+            TextureData data;
+            auto decoded = scratch.decodedTextures.find(path);
+            if (decoded != scratch.decodedTextures.end() && strcmp(decoded->second.typeName, typeName) == 0)
+            {
+                data = std::move(decoded->second.data);
+                scratch.decodedTextures.erase(decoded);
+            }
+            else
+                LoadTextureData(str.C_Str(), this->directory, data, typeName, gammaCorrection);
+            texture.srgb = data.srgb;
+            MemoryTracker& tracker = MemoryTracker::Get();
+            TextureObject object;
+            object.memoryOwner = tracker.AddOwner(str.C_Str(), memoryOwner);
+            if (deferUpload)
+            {
+                // only decode for now, the GL texture is created in Upload()
+                tracker.Set(object.memoryOwner, MEMORY_CPU_TEXTURE, GetTextureDataSize(data));
+                pendingTextures.push_back(std::move(data));
+                texture.id = 0;
+            }
+            else
+            {
+                object.texture = UploadTexture(data, &object.storage);
+                object.bytes = GetTextureGpuSize(data);
+                tracker.Set(object.memoryOwner, MEMORY_GPU_TEXTURE, object.bytes);
+                texture.id = object.texture.Get();
+                FreeTextureData(data);
+            }
+            textureObjects.push_back(std::move(object));
             texture.type = typeName;
             texture.path = str.C_Str();
-            textures.push_back(texture);
+            scratch.textureIndices.emplace(std::move(path), (unsigned int)textures_loaded.size());
+            scratch.materialTextures.push_back((unsigned int)textures_loaded.size());
             textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
         }
     }
-    return textures;
 }
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
+bool LoadTextureData(const char* path, const string& directory, TextureData& data, const string& typeName, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    // color maps hold sRGB encoded color, filtered in linear light when the model asks for gamma correction
+    MipOptions mipOptions;
+    mipOptions.srgb = gamma && typeName == "texture_diffuse";
+    mipOptions.normalMap = typeName == "texture_normal";
+
+    // textures encoded by an earlier run skip decoding entirely
+    TextureCache& cache = TextureCache::Get();
+    bool compress = cache.IsEnabled() && !typeName.empty();
+    if (compress && cache.Load(filename, mipOptions, data.compressed))
+    {
+        data.width = data.compressed.levels[0].width;
+        data.height = data.compressed.levels[0].height;
+        data.srgb = data.compressed.srgb;
+        LOG_INFO(LogCategory::Model, "Texture loaded from cache: %s", path);
+        return true;
+    }
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+    data.pixels = stbi_load(filename.c_str(), &data.width, &data.height, &data.components, 0);
+    if (!data.pixels)
+    {
+        LOG_WARNING(LogCategory::Model, "Texture failed to load at path: %s", path);
+        return false;
+    }
 
-    if (data)
+    TextureCodec codec = compress ? cache.ChooseCodec(data.components, mipOptions.normalMap) : TEXTURE_CODEC_NONE;
+    if (codec != TEXTURE_CODEC_NONE)
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        CompressImage(data.pixels, data.width, data.height, data.components, codec, data.compressed, 0, mipOptions);
+        cache.Store(filename, mipOptions, data.compressed);
+        stbi_image_free(data.pixels);
+        data.pixels = nullptr;
+        data.srgb = data.compressed.srgb;
+        LOG_INFO(LogCategory::Model, "Texture loaded and compressed at path: %s", path);
+        return true;
+    }
+
+    // material textures arrive at the GL thread with their mips, others (the software renderer) don't need them
+    data.srgb = mipOptions.srgb && data.components >= 3;
+    if (!typeName.empty())
+        GenerateMipChain(data.pixels, data.width, data.height, data.components, mipOptions, data.mips);
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    LOG_INFO(LogCategory::Model, "Texture loaded at path: %s", path);
+    return true;
+}
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+typedef void (APIENTRYP TexStorage2DProc)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+static TexStorage2DProc texStorage2D = nullptr;
+
+void InitTextureStorage(GLADloadproc loader)
+{
+    bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2) || HasGLExtension("GL_ARB_texture_storage");
+    texStorage2D = supported ? (TexStorage2DProc)loader("glTexStorage2D") : nullptr;
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// GL formats of a decoded or block compressed texture
+struct TextureFormat
+{
+    GLenum internalFormat;
+    // pixel format of uncompressed levels
+    GLenum format;
+    bool compressed;
+};
 
-        std::cout << "Texture loaded at path: " << path << std::endl;
-        stbi_image_free(data);
+// One level of a TextureData, pointing into its pixels, mips or compressed levels
+struct TextureLevel
+{
+    int width;
+    int height;
+    const unsigned char* data;
+    size_t size;
+};
+
+static TextureFormat GetTextureFormat(const TextureData& data)
+{
+    if (!data.compressed.levels.empty())
+    {
+        TextureCodec codec = data.compressed.codec;
+        if (codec == TEXTURE_CODEC_BC7)
+            return { data.compressed.srgb ? (GLenum)GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : (GLenum)GL_COMPRESSED_RGBA_BPTC_UNORM, 0, true };
+        if (codec == TEXTURE_CODEC_BC5)
+            return { GL_COMPRESSED_RG_RGTC2, 0, true };
+        return { GL_COMPRESSED_RED_RGTC1, 0, true };
+    }
+
+    if (data.components == 1)
+        return { GL_R8, GL_RED, false };
+    if (data.components == 2)
+        return { GL_RG8, GL_RG, false };
+    if (data.components == 3)
+        return { (GLenum)(data.srgb ? GL_SRGB8 : GL_RGB8), GL_RGB, false };
+    return { (GLenum)(data.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8), GL_RGBA, false };
+}
+
+static void GetTextureLevels(const TextureData& data, const vector<MipLevel>& mips, vector<TextureLevel>& levels)
+{
+    if (!data.compressed.levels.empty())
+    {
+        for (const CompressedLevel& level : data.compressed.levels)
+            levels.push_back({ level.width, level.height, level.data.data(), level.data.size() });
+        return;
     }
+    if (!data.pixels)
+        return;
+
+    levels.push_back({ data.width, data.height, data.pixels, (size_t)data.width * data.height * data.components });
+    for (const MipLevel& level : mips)
+        levels.push_back({ level.width, level.height, level.data.data(), level.data.size() });
+}
+
+// Creates a GL_TEXTURE_2D with storage for every level, left bound. A pooled texture with the same storage
+// is taken when there is one. Otherwise immutable storage when the context has it, or every level is specified
+// without data. The levels are filled with glTex(Compressed)SubImage2D.
+static GLTexture CreateTexture(const TextureFormat& format, const vector<TextureLevel>& levels, TextureStorage* storageOut)
+{
+    TextureStorage storage;
+    if (!levels.empty())
+    {
+        storage.internalFormat = format.internalFormat;
+        storage.width = levels[0].width;
+        storage.height = levels[0].height;
+        storage.levels = (int)levels.size();
+    }
+    if (storageOut)
+        *storageOut = storage;
+
+    GLTexture texture = levels.empty() ? GLTexture() : GpuResourcePool::Get().AcquireTexture(storage);
+    if (texture)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture.Get());
+        return texture;
+    }
+
+    texture = GLTexture::Create();
+    glBindTexture(GL_TEXTURE_2D, texture.Get());
+    if (levels.empty())
+        return texture;
+
+    if (texStorage2D)
+        texStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), format.internalFormat, levels[0].width, levels[0].height);
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        for (size_t i = 0; i < levels.size(); i++)
+        {
+            const TextureLevel& level = levels[i];
+            if (format.compressed)
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format.internalFormat, level.width, level.height, 0, (GLsizei)level.size, NULL);
+            else
+                glTexImage2D(GL_TEXTURE_2D, (GLint)i, format.internalFormat, level.width, level.height, 0, format.format, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+GLTexture UploadTexture(const TextureData& data, TextureStorage* storage)
+{
+    // textures loaded without a typeName come without mips, filter them here
+    vector<MipLevel> generated;
+    if (data.pixels && data.compressed.levels.empty() && data.mips.empty() && (data.width > 1 || data.height > 1))
+    {
+        MipOptions options;
+        options.srgb = data.srgb;
+        GenerateMipChain(data.pixels, data.width, data.height, data.components, options, generated);
+    }
+
+    TextureFormat format = GetTextureFormat(data);
+    vector<TextureLevel> levels;
+    GetTextureLevels(data, data.mips.empty() ? generated : data.mips, levels);
+    GLTexture texture = CreateTexture(format, levels, storage);
+
+    // rows of 1-3 component images aren't 4 byte aligned
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const TextureLevel& level = levels[i];
+        if (format.compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, format.internalFormat, (GLsizei)level.size, level.data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, format.format, GL_UNSIGNED_BYTE, level.data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    return texture;
+}
+
+GLTexture UploadTexture(const TextureData& data, UploadScheduler& scheduler, const void* owner, std::function<void()> done, TextureStorage* storage)
+{
+    TextureFormat format = GetTextureFormat(data);
+    vector<TextureLevel> levels;
+    GetTextureLevels(data, data.mips, levels);
+    GLTexture texture = CreateTexture(format, levels, storage);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (levels.empty() && done)
+        done();
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        // the texture is complete once its last level is in
+        std::function<void()> levelDone = i + 1 == levels.size() ? std::move(done) : nullptr;
+        const TextureLevel& level = levels[i];
+        if (format.compressed)
+            scheduler.UploadCompressedTexture(owner, texture.Get(), (int)i, level.width, level.height, format.internalFormat,
+                GetBlockBytes(data.compressed.codec), level.data, std::move(levelDone));
+        else
+            scheduler.UploadTexture(owner, texture.Get(), (int)i, level.width, level.height, format.format, data.components, level.data, std::move(levelDone));
     }
+    return texture;
+}
+
+size_t GetTextureDataSize(const TextureData& data)
+{
+    size_t size = 0;
+    for (const CompressedLevel& level : data.compressed.levels)
+        size += level.data.size();
+    if (data.pixels)
+        size += (size_t)data.width * data.height * data.components;
+    for (const MipLevel& level : data.mips)
+        size += level.data.size();
+    return size;
+}
+
+size_t GetTextureGpuSize(const TextureData& data)
+{
+    if (!data.compressed.levels.empty() || !data.mips.empty())
+        return GetTextureDataSize(data);
+    if (!data.pixels)
+        return 0;
+
+    // UploadTexture generates the chain, each level halves both sizes down to 1x1
+    size_t size = 0;
+    int width = data.width;
+    int height = data.height;
+    while (true)
+    {
+        size += (size_t)width * height * data.components;
+        if (width == 1 && height == 1)
+            break;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return size;
+}
+
+void FreeTextureData(TextureData& data)
+{
+    stbi_image_free(data.pixels);
+    data.pixels = nullptr;
+    data.mips.clear();
+    data.compressed = CompressedTexture();
+}
+
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma, const string& typeName)
+{
+    TextureData data;
+    LoadTextureData(path, directory, data, typeName, gamma);
+    // the caller owns the name
+    unsigned int textureID = UploadTexture(data).Release();
+    FreeTextureData(data);
 
     return textureID;
-}
\ No newline at end of file
+}
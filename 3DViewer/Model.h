@@ -11,46 +11,321 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "GeometryStore.h"
+#include "GpuResourcePool.h"
 #include "Shader_M.h"
+#include "ShaderVariants.h"
+#include "MipGenerator.h"
+#include "SceneGraph.h"
+#include "TextureCompressor.h"
+#include "UniformRing.h"
+#include "UploadScheduler.h"
+#include "VirtualTexture.h"
 
+#include <cstring>
+#include <memory>
 #include <string>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory_resource>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
 
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+// decoded image data waiting to be uploaded to a GL texture
+struct TextureData {
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    // levels 1 and up of pixels
+    vector<MipLevel> mips;
+    // the color channels are sRGB encoded and uploaded as GL_SRGB8(_ALPHA8)
+    bool srgb = false;
+    // block compressed mip chain, used instead of pixels when it has levels
+    CompressedTexture compressed;
+};
+
+// decodes an image file into memory, safe to call off the GL thread.
+// With the typeName of a material texture the mip chain is generated here too, or the texture is block
+// compressed instead when the TextureCache is enabled. gamma marks diffuse maps as sRGB, their mips are
+// filtered in linear light.
+bool LoadTextureData(const char* path, const string& directory, TextureData& data, const string& typeName = "", bool gamma = false);
+
+// Loads glTexStorage2D when the context has it (GL 4.2 or ARB_texture_storage), UploadTexture
+// falls back to glTexImage2D per level without it
+void InitTextureStorage(GLADloadproc loader);
+
+// creates a GL texture from decoded image data, must be called on the GL thread. The storage is recycled
+// from the GpuResourcePool when it has a texture of the same size and format; storage receives what to
+// pass to GpuResourcePool::ReleaseTexture (no levels when the image failed to load).
+GLTexture UploadTexture(const TextureData& data, TextureStorage* storage = nullptr);
+
+// creates the GL texture with storage for its levels and leaves filling them to scheduler, data must stay
+// valid until done runs
+GLTexture UploadTexture(const TextureData& data, UploadScheduler& scheduler, const void* owner, std::function<void()> done,
+    TextureStorage* storage = nullptr);
+
+void FreeTextureData(TextureData& data);
+
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false, const string& typeName = "");
+
+// bytes of the decoded image with its mips or compressed levels, what TextureData holds in CPU memory
+size_t GetTextureDataSize(const TextureData& data);
+
+// bytes of the GL texture UploadTexture creates from data, including the mips it generates itself
+size_t GetTextureGpuSize(const TextureData& data);
+
+// what happens to the vertices and indices of the meshes once they are in GL buffers
+enum GeometryPolicy {
+    GEOMETRY_KEEP,              // kept for CPU-side users: the software renderer, picking, BVH builds
+    GEOMETRY_DROP_AFTER_UPLOAD  // freed by Upload, the model only draws through the GL afterwards
+};
+
+// a placement of a mesh by a scene graph node, many nodes can place the same mesh
+struct MeshInstance {
+    unsigned int mesh;  // index into Model::meshes
+    int node;           // index into Model::sceneGraph
+};
+
+// the aiMesh a range of indices of a Mesh was converted from. Static batching merges several aiMeshes into
+// one Mesh, Model::FindPart maps a triangle back to its aiMesh (e.g. for picking).
+struct MeshPart {
+    unsigned int sourceMesh;    // index into aiScene::mMeshes
+    unsigned int firstIndex;    // range of Mesh::indices
+    unsigned int indexCount;
+};
 
 class Model
 {
 public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-    vector<Mesh>    meshes;
+    vector<Mesh>    meshes;	// one per aiMesh or batch of aiMeshes, however many nodes reference it
+    vector<MeshPart> parts;	// the aiMeshes of every mesh, see Mesh::firstPart
+    vector<MeshInstance> instances;	// grouped by mesh, meshes placed more than once are drawn instanced
+    vector<unique_ptr<VirtualTexture>> virtualTextures;	// diffuse maps the tiler wrote a page file for, see Mesh::virtualTexture
+    SceneGraph sceneGraph;	// the aiNode hierarchy with its transforms, see Mesh::node. Draws pick up SetLocal changes.
     string directory;
     bool gammaCorrection;
 
+    // applied by Upload() and Upload(UploadScheduler&), set it before calling them
+    GeometryPolicy geometryPolicy = GEOMETRY_KEEP;
+
+    // post-processing steps applied to every file import
+    static const unsigned int ImportFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    // axis aligned bounds of all meshes placed by their nodes, in model space
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+
     // constructor, expects a filepath to a 3D model.
-    Model(string const& path, bool gamma);
+    // With deferUpload the import only does CPU work, so it can run on a loader thread. Upload() must then be called on the GL thread before drawing.
+    Model(string const& path, bool gamma, bool deferUpload = false);
+
+    // builds the model from a scene that was already imported or generated in memory, the caller keeps ownership of the scene.
+    // directory is where texture paths of the materials are looked up.
+    Model(const aiScene* scene, string const& directory, bool gamma, bool deferUpload = false);
 
-    // draws the model, and thus all its meshes
+    // cancels the uploads still waiting in the UploadScheduler, their callbacks point at the model, and
+    // removes the model from the MemoryTracker. GL objects still owned are deleted, so without an
+    // earlier Delete() the context has to be current.
+    ~Model();
+
+    // draws the model, and thus all its meshes, with the ObjectUniforms the caller bound. Node transforms are not applied.
     void Draw(Shader& shader);
 
+    // draws every mesh with the variant matching its material features. transform places the model in the world,
+    // the ObjectUniforms of each mesh (transform * its node's world matrix) are pushed to ring.
+    void Draw(ShaderVariants& variants, UniformRing& ring, const glm::mat4& transform);
+
+    // the part of meshes[mesh] that triangle (counted from the start of its indices) belongs to, null if out of range
+    const MeshPart* FindPart(unsigned int mesh, size_t triangle) const;
+
+    // the distinct feature masks of the meshes, to build all needed variants up front
+    vector<unsigned int> GetMaterialFeatures() const;
+
+    // renders the virtual texture feedback of the meshes using one, the frame uniforms must be bound.
+    // Object uniforms are pushed like Draw does.
+    void DrawVirtualTextureFeedback(Shader& shader, int viewportWidth, int viewportHeight, UniformRing& ring, const glm::mat4& transform);
+
+    // streams in the pages the feedback asked for, returns true when the model looks different
+    bool UpdateVirtualTextures();
+
+    // feedback or virtual texture pages still on their way
+    bool IsVirtualTextureBusy() const;
+
+    // draws the model with the CPU backend, works without a GL context when imported with deferUpload.
+    // The renderer's model matrix places the model, the node transforms are applied on top of it.
+    void Draw(SoftwareRenderer& renderer);
+
+    // creates the GL buffers and textures of a model imported with deferUpload
+    void Upload();
+
+    // same, but the data is copied in by scheduler over the next frames. The model draws nothing until
+    // the last copy is submitted.
+    void Upload(UploadScheduler& scheduler);
+
+    // buffer or texture data still waiting in the UploadScheduler
+    bool IsUploading() const { return pendingUploads > 0; }
+
+    // frees the CPU copies of the mesh geometry, see GEOMETRY_DROP_AFTER_UPLOAD. Only for uploaded meshes.
+    void ReleaseGeometry();
+
+    // MemoryTracker handle of the model, its meshes and textures are owners under it
+    unsigned int GetMemoryOwner() const { return memoryOwner; }
+
+    // gives the GL buffers and textures of the model to the GpuResourcePool and deletes the rest
+    void Delete();
+
 private:
+    bool deferUpload;
+
+    unsigned int memoryOwner = 0;
+
+    // the GL side of textures_loaded, same indices
+    struct TextureObject {
+        GLTexture texture;
+        TextureStorage storage;
+        size_t bytes = 0;
+        unsigned int memoryOwner = 0;
+    };
+    vector<TextureObject> textureObjects;
+
+    // streamed uploads not completed yet, see Upload(UploadScheduler&)
+    UploadScheduler* uploadScheduler = nullptr;
+    int pendingUploads = 0;
+
+    // decoded texture images waiting for Upload(), indexed like textures_loaded
+    vector<TextureData> pendingTextures;
+
+    // bookkeeping of one import, only needed while loadScene runs. It lives in a monotonic arena that is
+    // dropped in one go at the end instead of being freed piece by piece.
+    struct ImportScratch {
+        // a material is converted by its first mesh, the others copy its textures
+        struct Material {
+            bool loaded = false;
+            int virtualTexture = -1;
+            // range of materialTextures
+            unsigned int firstTexture = 0;
+            unsigned int textureCount = 0;
+            // colors, shininess, opacity and refraction index, the values the material is made of
+            float values[15] = {};
+            // first material with the same values and maps, the one meshes are batched by
+            unsigned int canonical = 0;
+        };
+
+        // meshes placed once with the same canonical material, vertex format and world matrix are converted into one Mesh
+        struct BatchKey {
+            glm::mat4 world;
+            unsigned int material;
+            unsigned int format;
+
+            bool operator==(const BatchKey& other) const { return memcmp(this, &other, sizeof(BatchKey)) == 0; }
+        };
+        struct BatchKeyHash {
+            size_t operator()(const BatchKey& key) const { return (size_t)GeometryStore::Hash(&key, sizeof(BatchKey)); }
+        };
+        struct Batch {
+            // range of batchSources
+            unsigned int firstSource = 0;
+            unsigned int sourceCount = 0;
+            // index into meshes once converted
+            int mesh = -1;
+        };
+        // a material texture decoded ahead of the conversion, for the first map type it was found as
+        struct DecodedTexture {
+            const char* typeName = nullptr;
+            TextureData data;
+        };
+
+        explicit ImportScratch(std::pmr::memory_resource* arena) : arena(arena), textureIndices(arena), materials(arena), canonicalMaterials(arena), materialTextures(arena),
+            nodes(arena), firstChild(arena), meshIndices(arena), meshBatches(arena), batches(arena), batchSources(arena), decodedTextures(arena) {}
+
+        std::pmr::memory_resource* arena;
+        // textures_loaded index by path
+        std::pmr::unordered_map<std::pmr::string, unsigned int> textureIndices;
+        // indexed like aiScene::mMaterials
+        std::pmr::vector<Material> materials;
+        // indices of the canonical materials so far
+        std::pmr::vector<unsigned int> canonicalMaterials;
+        // textures_loaded indices of the maps of every material
+        std::pmr::vector<unsigned int> materialTextures;
+        // the aiNode of every scene graph node
+        std::pmr::vector<const aiNode*> nodes;
+        // scene graph index of the first child of every node, the children of a node are consecutive
+        std::pmr::vector<unsigned int> firstChild;
+        // index into meshes of every aiMesh, -1 until a node references it
+        std::pmr::vector<int> meshIndices;
+        // batch of every aiMesh, -1 for the ones placed by several nodes (instanced) or skinned
+        std::pmr::vector<int> meshBatches;
+        std::pmr::vector<Batch> batches;
+        // the aiMeshes of every batch, consecutive
+        std::pmr::vector<unsigned int> batchSources;
+        // by path, taken out by loadMaterialTextures
+        std::pmr::unordered_map<std::pmr::string, DecodedTexture> decodedTextures;
+    };
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path);
 
+    // converts all meshes of an imported scene and computes the bounds
+    void loadScene(const aiScene* scene);
+
+    // copies the aiNode hierarchy into sceneGraph breadth first, so it is in depth order
+    void loadSceneGraph(const aiScene* scene, ImportScratch& scratch);
+
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene);
+    // index is the node's place in sceneGraph.
+    void processNode(aiNode* node, unsigned int index, const aiScene* scene, ImportScratch& scratch);
+
+    // decodes the textures of every used material in parallel on JobSystem::Get() into scratch.decodedTextures
+    void decodeTextures(const aiScene* scene, ImportScratch& scratch);
+
+    // groups the aiMeshes placed by a single node into batches, see ImportScratch::BatchKey
+    void planBatches(const aiScene* scene, ImportScratch& scratch);
+
+    // converts count aiMeshes into one Mesh, their indices follow each other in the order of sources
+    Mesh processMesh(const unsigned int* sources, unsigned int count, const aiScene* scene, ImportScratch& scratch);
+
+    // loads the textures of a material on its first use, returns its entry in scratch
+    const ImportScratch::Material& loadMaterial(const aiScene* scene, unsigned int index, ImportScratch& scratch);
+
+    // instances[first] and the following ones of the same mesh
+    size_t getInstanceCount(size_t first) const;
+
+    // pushes the ObjectUniforms of node unless bound already has its world matrix
+    void bindNodeTransform(UniformRing& ring, const glm::mat4& transform, int node, const glm::mat4*& bound);
+
+    // draws count instances from instances[first] on, MAX_INSTANCES_PER_DRAW per draw call
+    void drawInstanced(Shader& shader, UniformRing& ring, const glm::mat4& transform, size_t first, size_t count);
+
+    // points the textures of every mesh at the GL textures in textures_loaded
+    void updateMeshTextureIds();
+
+    // creates the GL side of the virtual textures
+    void createVirtualTextures();
+
+    // frees the decoded images of pendingTextures once their GL textures are filled
+    void freePendingTextures();
+
+    // takes ownership of the GL texture created for textures_loaded[index] from data
+    void setTextureObject(unsigned int index, GLTexture texture, const TextureStorage& storage, const TextureData& data);
+
+    // applies geometryPolicy once every mesh is uploaded
+    void applyGeometryPolicy();
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    // opens the virtual texture of the material's diffuse map if the tiler wrote one next to it (X.png -> X.vtex).
+    // returns its index in virtualTextures or -1.
+    int loadVirtualTexture(aiMaterial* mat);
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+    // their indices in textures_loaded are appended to scratch.materialTextures.
+    void loadMaterialTextures(aiMaterial* mat, aiTextureType type, const char* typeName, ImportScratch& scratch);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,357 @@
+#include "Profiler.h"
+
+#if VIEWER_PROFILER
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <cstdio>
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::Profiler()
+{
+	// Keep the frame totals at the top of the table
+	FindHistory("Frame", false);
+	FindHistory("Frame", true);
+}
+
+void Profiler::Init()
+{
+	if (m_initialized)
+		return;
+
+	for (int i = 0; i < GPU_LATENCY; i++)
+	{
+		glGenQueries(2 + MAX_GPU_SCOPES * 2, m_gpu_slots[i].queries);
+		m_gpu_slots[i].count = 0;
+		m_gpu_slots[i].pending = false;
+	}
+	m_initialized = true;
+}
+
+void Profiler::Delete()
+{
+	if (!m_initialized)
+		return;
+
+	for (int i = 0; i < GPU_LATENCY; i++)
+	{
+		glDeleteQueries(2 + MAX_GPU_SCOPES * 2, m_gpu_slots[i].queries);
+		m_gpu_slots[i].pending = false;
+	}
+	m_initialized = false;
+}
+
+double Profiler::NowMs() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+void Profiler::BeginFrame()
+{
+	m_frame_start = NowMs();
+	m_current.cpu.clear();
+	m_depth = 0;
+
+	if (!m_initialized)
+		return;
+
+	// Resolve finished frames oldest first, the GPU completes them in submission order
+	for (int i = 1; i <= GPU_LATENCY; i++)
+	{
+		GpuSlot& slot = m_gpu_slots[(m_gpu_slot + i) % GPU_LATENCY];
+		if (!slot.pending)
+			continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		ResolveGpuSlot(slot);
+	}
+
+	m_gpu_slot = (int)(m_frame_index % GPU_LATENCY);
+	GpuSlot& slot = m_gpu_slots[m_gpu_slot];
+	if (slot.pending)
+	{
+		// Still not done after GPU_LATENCY frames, reuse the queries rather than wait
+		m_gpu_dropped++;
+		slot.pending = false;
+	}
+
+	slot.count = 0;
+	m_gpu_depth = 0;
+	glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+}
+
+void Profiler::EndFrame()
+{
+	m_current.cpuMs = NowMs() - m_frame_start;
+
+	if (m_initialized)
+	{
+		GpuSlot& slot = m_gpu_slots[m_gpu_slot];
+		glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+		slot.pending = true;
+	}
+
+	std::swap(m_last_cpu.cpu, m_current.cpu);
+	m_last_cpu.cpuMs = m_current.cpuMs;
+
+	AddSample(FindHistory("Frame", false), (float)m_last_cpu.cpuMs);
+	for (const Event& event : m_last_cpu.cpu)
+	{
+		History& history = FindHistory(event.name, false);
+		history.frameMs += (float)(event.endMs - event.startMs);
+		history.touched = true;
+	}
+	for (History& history : m_history)
+	{
+		if (history.touched)
+		{
+			AddSample(history, history.frameMs);
+			history.frameMs = 0.0f;
+			history.touched = false;
+		}
+	}
+
+	m_frame_index++;
+}
+
+int Profiler::BeginCpuScope(const char* name)
+{
+	Event event;
+	event.name = name;
+	event.depth = m_depth++;
+	event.startMs = NowMs() - m_frame_start;
+	event.endMs = event.startMs;
+	m_current.cpu.push_back(event);
+	return (int)m_current.cpu.size() - 1;
+}
+
+void Profiler::EndCpuScope(int index)
+{
+	m_current.cpu[index].endMs = NowMs() - m_frame_start;
+	m_depth--;
+}
+
+int Profiler::BeginGpuScope(const char* name)
+{
+	if (!m_initialized)
+		return -1;
+
+	GpuSlot& slot = m_gpu_slots[m_gpu_slot];
+	if (slot.count == MAX_GPU_SCOPES)
+		return -1;
+
+	int index = slot.count++;
+	slot.names[index] = name;
+	slot.depths[index] = m_gpu_depth++;
+	glQueryCounter(slot.queries[2 + index * 2], GL_TIMESTAMP);
+	return index;
+}
+
+void Profiler::EndGpuScope(int index)
+{
+	if (index < 0)
+		return;
+
+	glQueryCounter(m_gpu_slots[m_gpu_slot].queries[3 + index * 2], GL_TIMESTAMP);
+	m_gpu_depth--;
+}
+
+void Profiler::ResolveGpuSlot(GpuSlot& slot)
+{
+	GLuint64 frameBegin = 0, frameEnd = 0;
+	glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &frameBegin);
+	glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &frameEnd);
+
+	m_last_gpu.gpu.clear();
+	m_last_gpu.gpuMs = (frameEnd - frameBegin) / 1.0e6;
+	AddSample(FindHistory("Frame", true), (float)m_last_gpu.gpuMs);
+
+	for (int i = 0; i < slot.count; i++)
+	{
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(slot.queries[2 + i * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(slot.queries[3 + i * 2], GL_QUERY_RESULT, &end);
+
+		Event event;
+		event.name = slot.names[i];
+		event.depth = slot.depths[i];
+		event.startMs = (begin - frameBegin) / 1.0e6;
+		event.endMs = (end - frameBegin) / 1.0e6;
+		m_last_gpu.gpu.push_back(event);
+
+		History& history = FindHistory(event.name, true);
+		history.frameMs += (float)(event.endMs - event.startMs);
+		history.touched = true;
+	}
+
+	for (History& history : m_history)
+	{
+		if (history.gpu && history.touched)
+		{
+			AddSample(history, history.frameMs);
+			history.frameMs = 0.0f;
+			history.touched = false;
+		}
+	}
+
+	slot.pending = false;
+}
+
+Profiler::History& Profiler::FindHistory(const char* name, bool gpu)
+{
+	for (History& history : m_history)
+	{
+		if (history.gpu == gpu && history.name == name)
+			return history;
+	}
+
+	m_history.emplace_back();
+	History& history = m_history.back();
+	history.name = name;
+	history.gpu = gpu;
+	history.samples.reserve(HISTORY_FRAMES);
+	return history;
+}
+
+void Profiler::AddSample(History& history, float ms)
+{
+	if ((int)history.samples.size() < HISTORY_FRAMES)
+		history.samples.push_back(ms);
+	else
+		history.samples[history.next] = ms;
+
+	history.next = (history.next + 1) % HISTORY_FRAMES;
+	history.lastMs = ms;
+}
+
+// Stable color per scope name so a scope keeps its color across frames
+static ImU32 ScopeColor(const char* name)
+{
+	unsigned int hash = 2166136261u;
+	for (const char* c = name; *c; c++)
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+	float hue = (hash % 360) / 360.0f;
+	float r, g, b;
+	ImGui::ColorConvertHSVtoRGB(hue, 0.55f, 0.85f, r, g, b);
+	return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+}
+
+void Profiler::DrawOverlay(bool* open)
+{
+	if (open && !*open)
+		return;
+
+	ImGui::SetNextWindowSize(ImVec2(460, 420), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowPos(ImVec2(330, 30), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Profiler", open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("CPU %.2f ms  GPU %.2f ms  (%.0f FPS)", m_last_cpu.cpuMs, m_last_gpu.gpuMs, ImGui::GetIO().Framerate);
+	if (!m_initialized)
+		ImGui::TextDisabled("GPU timing not initialized");
+	else if (m_gpu_dropped > 0)
+		ImGui::TextDisabled("%d GPU frames dropped (results not ready in %d frames)", m_gpu_dropped, GPU_LATENCY);
+
+	// Frame time graph of the CPU frame history, oldest sample first
+	const History& frame = m_history[0];
+	if (!frame.samples.empty())
+	{
+		int offset = (int)frame.samples.size() < HISTORY_FRAMES ? 0 : frame.next;
+		ImGui::PlotLines("##frametimes", frame.samples.data(), (int)frame.samples.size(), offset, "CPU frame ms", 0.0f, 33.3f, ImVec2(-1, 50));
+	}
+
+	// Timeline of the last frame, scaled to at least a 60 Hz budget
+	double scaleMs = std::max(16.667, std::max(m_last_cpu.cpuMs, m_last_gpu.gpuMs));
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	float width = ImGui::GetContentRegionAvail().x;
+	const float laneHeight = ImGui::GetTextLineHeight() + 4.0f;
+
+	float y = origin.y;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const std::vector<Event>& events = pass == 0 ? m_last_cpu.cpu : m_last_gpu.gpu;
+		int lanes = 1;
+		for (const Event& event : events)
+			lanes = std::max(lanes, event.depth + 1);
+
+		drawList->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text), pass == 0 ? "CPU" : "GPU");
+		float x0 = origin.x + 36.0f;
+		float laneWidth = width - 36.0f;
+		drawList->AddRectFilled(ImVec2(x0, y), ImVec2(x0 + laneWidth, y + lanes * laneHeight), ImGui::GetColorU32(ImGuiCol_FrameBg));
+
+		for (const Event& event : events)
+		{
+			ImVec2 min(x0 + (float)(event.startMs / scaleMs) * laneWidth, y + event.depth * laneHeight);
+			ImVec2 max(x0 + (float)(event.endMs / scaleMs) * laneWidth, min.y + laneHeight - 1.0f);
+			max.x = std::max(max.x, min.x + 1.0f);
+			drawList->AddRectFilled(min, max, ScopeColor(event.name));
+
+			// Only label bars wide enough to hold the name
+			if (max.x - min.x > ImGui::CalcTextSize(event.name).x + 4.0f)
+				drawList->AddText(ImVec2(min.x + 2.0f, min.y + 2.0f), IM_COL32(0, 0, 0, 255), event.name);
+
+			if (ImGui::IsMouseHoveringRect(min, max))
+				ImGui::SetTooltip("%s\n%.3f ms", event.name, event.endMs - event.startMs);
+		}
+
+		y += lanes * laneHeight + 4.0f;
+	}
+	ImGui::Dummy(ImVec2(width, y - origin.y));
+
+	// Rolling percentiles over the last HISTORY_FRAMES frames
+	if (ImGui::BeginTable("##scopes", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV))
+	{
+		ImGui::TableSetupColumn("Scope");
+		ImGui::TableSetupColumn("");
+		ImGui::TableSetupColumn("Last");
+		ImGui::TableSetupColumn("p50");
+		ImGui::TableSetupColumn("p95");
+		ImGui::TableSetupColumn("p99");
+		ImGui::TableHeadersRow();
+
+		std::vector<float> sorted;
+		for (const History& history : m_history)
+		{
+			if (history.samples.empty())
+				continue;
+
+			sorted = history.samples;
+			std::sort(sorted.begin(), sorted.end());
+			auto percentile = [&sorted](float p) { return sorted[(size_t)(p * (sorted.size() - 1) + 0.5f)]; };
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(history.name.c_str());
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(history.gpu ? "GPU" : "CPU");
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", history.lastMs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", percentile(0.50f));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", percentile(0.95f));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", percentile(0.99f));
+		}
+		ImGui::EndTable();
+	}
+
+	ImGui::End();
+}
+
+#endif
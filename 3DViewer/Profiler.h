@@ -0,0 +1,156 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame profiler with nested CPU scopes and GL timestamp queries.
+// Build with VIEWER_PROFILER=0 to compile every PROFILE_* macro down to nothing.
+#ifndef VIEWER_PROFILER
+#define VIEWER_PROFILER 1
+#endif
+
+#if VIEWER_PROFILER
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Records CPU scopes of the render thread and GPU scopes bracketed by GL_TIMESTAMP queries.
+// GPU results are read back GPU_LATENCY frames later and only when the driver reports them
+// available, so the profiler never waits on the GPU. A frame whose queries are still pending
+// when its slot comes around again is dropped instead.
+class Profiler
+{
+public:
+	static constexpr int GPU_LATENCY = 4;
+	static constexpr int MAX_GPU_SCOPES = 16;
+	static constexpr int HISTORY_FRAMES = 240;
+
+	static Profiler& Get();
+
+	// Creates the GL query objects, needs a current context
+	void Init();
+	// Deletes the GL query objects
+	void Delete();
+
+	void BeginFrame();
+	void EndFrame();
+
+	// Scopes must be properly nested and are only tracked on the thread calling BeginFrame
+	int BeginCpuScope(const char* name);
+	void EndCpuScope(int index);
+	int BeginGpuScope(const char* name);
+	void EndGpuScope(int index);
+
+	// ImGui window with the timeline of the last complete frame and rolling percentiles
+	void DrawOverlay(bool* open);
+
+private:
+	struct Event
+	{
+		const char* name;
+		int depth;
+		double startMs;
+		double endMs;
+	};
+
+	struct Frame
+	{
+		std::vector<Event> cpu;
+		std::vector<Event> gpu;
+		double cpuMs = 0.0;
+		double gpuMs = 0.0;
+	};
+
+	// Queries of one in-flight frame: frame start and end, then a begin/end pair per scope
+	struct GpuSlot
+	{
+		GLuint queries[2 + MAX_GPU_SCOPES * 2];
+		const char* names[MAX_GPU_SCOPES];
+		int depths[MAX_GPU_SCOPES];
+		int count = 0;
+		bool pending = false;
+	};
+
+	// Rolling window of durations for one scope name
+	struct History
+	{
+		std::string name;
+		bool gpu = false;
+		std::vector<float> samples;
+		int next = 0;
+		float lastMs = 0.0f;
+		float frameMs = 0.0f;
+		bool touched = false;
+	};
+
+	Profiler();
+	double NowMs() const;
+	void ResolveGpuSlot(GpuSlot& slot);
+	History& FindHistory(const char* name, bool gpu);
+	void AddSample(History& history, float ms);
+
+	std::chrono::steady_clock::time_point m_epoch = std::chrono::steady_clock::now();
+	bool m_initialized = false;
+	unsigned long long m_frame_index = 0;
+
+	Frame m_current;
+	Frame m_last_cpu;
+	Frame m_last_gpu;
+	double m_frame_start = 0.0;
+	int m_depth = 0;
+	int m_gpu_depth = 0;
+
+	GpuSlot m_gpu_slots[GPU_LATENCY];
+	int m_gpu_slot = 0;
+	int m_gpu_dropped = 0;
+
+	// Whole frame totals come first, then scopes in order of first appearance
+	std::vector<History> m_history;
+};
+
+// Times the enclosing block on the CPU
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name) : m_index(Profiler::Get().BeginCpuScope(name)) {}
+	~ProfileScope() { Profiler::Get().EndCpuScope(m_index); }
+
+private:
+	int m_index;
+};
+
+// Times the GL commands issued in the enclosing block on the GPU
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(const char* name) : m_index(Profiler::Get().BeginGpuScope(name)) {}
+	~GpuProfileScope() { Profiler::Get().EndGpuScope(m_index); }
+
+private:
+	int m_index;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+#define PROFILE_INIT() Profiler::Get().Init()
+#define PROFILE_SHUTDOWN() Profiler::Get().Delete()
+#define PROFILE_FRAME_BEGIN() Profiler::Get().BeginFrame()
+#define PROFILE_FRAME_END() Profiler::Get().EndFrame()
+#define PROFILE_OVERLAY(open) Profiler::Get().DrawOverlay(open)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_INIT() ((void)0)
+#define PROFILE_SHUTDOWN() ((void)0)
+#define PROFILE_FRAME_BEGIN() ((void)0)
+#define PROFILE_FRAME_END() ((void)0)
+#define PROFILE_OVERLAY(open) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+#include "SceneGraph.h"
+#include "Logger.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_GRAPH_USE_SSE2 1
+#else
+#define SCENE_GRAPH_USE_SSE2 0
+#endif
+
+int SceneGraph::AddNode(int parent, const glm::mat4& local, const std::string& name)
+{
+	int depth = 0;
+	if (parent != NO_PARENT)
+	{
+		if (parent < 0 || parent >= (int)m_parent.size())
+		{
+			LOG_ERROR(LogCategory::Model, "ERROR::SCENE_GRAPH::INVALID_PARENT: %d", parent);
+			return -1;
+		}
+		depth = m_depth[parent] + 1;
+	}
+	// the parent exists, so the new node is at most one deeper than the last one
+	if (!m_depth.empty() && depth < m_depth.back())
+	{
+		LOG_ERROR(LogCategory::Model, "ERROR::SCENE_GRAPH::NODE_OUT_OF_ORDER: %s", name);
+		return -1;
+	}
+
+	int index = (int)m_parent.size();
+	if (depth == (int)m_depth_start.size())
+		m_depth_start.push_back(index);
+	m_parent.push_back(parent);
+	m_depth.push_back(depth);
+	m_local.push_back(local);
+	m_world.push_back(local);
+	m_dirty.push_back(1);
+	m_name.push_back(name);
+
+	m_first_dirty = std::min(m_first_dirty, (size_t)index);
+	m_last_dirty = index;
+	return index;
+}
+
+void SceneGraph::Reserve(size_t count)
+{
+	m_parent.reserve(count);
+	m_depth.reserve(count);
+	m_local.reserve(count);
+	m_world.reserve(count);
+	m_dirty.reserve(count);
+	m_name.reserve(count);
+}
+
+void SceneGraph::Clear()
+{
+	m_parent.clear();
+	m_depth.clear();
+	m_local.clear();
+	m_world.clear();
+	m_dirty.clear();
+	m_name.clear();
+	m_depth_start.clear();
+	m_first_dirty = 0;
+	m_last_dirty = 0;
+}
+
+void SceneGraph::SetLocal(int node, const glm::mat4& local)
+{
+	m_local[node] = local;
+	m_dirty[node] = 1;
+	m_first_dirty = std::min(m_first_dirty, (size_t)node);
+	m_last_dirty = std::max(m_last_dirty, (size_t)node);
+}
+
+size_t SceneGraph::Update()
+{
+	size_t count = m_parent.size();
+	if (m_first_dirty >= count)
+		return 0;
+
+	// 1. the nodes to recompute. Marks spread one depth at a time, a parent is always at the previous one.
+	m_batch.clear();
+	for (size_t depth = m_depth[m_first_dirty]; depth < m_depth_start.size(); depth++)
+	{
+		size_t begin = std::max(m_depth_start[depth], m_first_dirty);
+		size_t end = depth + 1 < m_depth_start.size() ? m_depth_start[depth + 1] : count;
+		bool marked = false;
+		for (size_t i = begin; i < end; i++)
+		{
+			int parent = m_parent[i];
+			if (m_dirty[i] || (parent != NO_PARENT && m_dirty[parent]))
+			{
+				m_dirty[i] = 1;
+				m_batch.push_back((unsigned int)i);
+				marked = true;
+			}
+		}
+		// nothing to pass down and no node marked by SetLocal further on
+		if (!marked && m_last_dirty < end)
+			break;
+	}
+
+	// 2. the products, in depth order so every parent is done before its children
+	for (unsigned int node : m_batch)
+	{
+		int parent = m_parent[node];
+		if (parent == NO_PARENT)
+			m_world[node] = m_local[node];
+		else
+			Multiply(m_world[parent], m_local[node], m_world[node]);
+	}
+	for (unsigned int node : m_batch)
+		m_dirty[node] = 0;
+
+	m_first_dirty = count;
+	m_last_dirty = 0;
+	return m_batch.size();
+}
+
+void SceneGraph::Multiply(const glm::mat4& parent, const glm::mat4& child, glm::mat4& out)
+{
+#if SCENE_GRAPH_USE_SSE2
+	// column c of the product is the parent's columns weighted by column c of the child
+	const float* a = &parent[0][0];
+	const float* b = &child[0][0];
+	float* result = &out[0][0];
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	for (int c = 0; c < 4; c++)
+	{
+		const float* column = b + c * 4;
+		__m128 sum = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+		_mm_storeu_ps(result + c * 4, sum);
+	}
+#else
+	out = parent * child;
+#endif
+}
@@ -1,8 +1,14 @@
 #include "Shader.h"
+#include "UniformBlocks.h"
+#include "ShaderCache.h"
+#include "Logger.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines)
 {
     const char* geometryPath = nullptr;
+    this->vertexPath = vertexPath;
+    this->fragmentPath = fragmentPath;
+    this->defines = defines;
 
     // 1. retrieve the vertex/fragment source code from filePath
     std::string vertexCode;
@@ -29,17 +35,27 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
         fShaderFile.close();
 
         // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = InjectDefines(vShaderStream.str(), defines);
+        fragmentCode = InjectDefines(fShaderStream.str(), defines);
     }
 
     catch (std::ifstream::failure& e)
     {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+        errorLog += std::string("ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: ") + e.what() + "\n";
+        LOG_ERROR(LogCategory::Render, "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: %s", e.what());
     }
     const char* vShaderCode = vertexCode.c_str();
     const char* fShaderCode = fragmentCode.c_str();
 
+    // skip compiling and linking if the driver gave us this program before
+    ShaderCache& cache = ShaderCache::Get();
+    ID = cache.Load(vertexCode, fragmentCode, defines);
+    if (ID != 0)
+    {
+        bindUniformBlocks();
+        return;
+    }
+
     // 2. compile shaders
     unsigned int vertex, fragment;
 
@@ -59,15 +75,62 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    cache.PrepareProgram(ID);
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
 
+    GLint linked = 0;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (linked)
+        cache.Store(ID, vertexCode, fragmentCode, defines);
+
     // delete the shaders as they're linked into our program now and no longer necessary
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    bindUniformBlocks();
 }
 
-void Shader::checkCompileErrors(GLuint shader, std::string type)
+void Shader::Replace(GLuint program)
+{
+    glDeleteProgram(ID);
+    ID = program;
+    errorLog.clear();
+    bindUniformBlocks();
+}
+
+void Shader::bindUniformBlocks()
+{
+    // connect the blocks of UniformBlocks.h the program uses to their fixed binding points
+    GLuint frameBlock = glGetUniformBlockIndex(ID, "FrameUniforms");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, frameBlock, FRAME_UNIFORMS_BINDING);
+
+    GLuint objectBlock = glGetUniformBlockIndex(ID, "ObjectUniforms");
+    if (objectBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, objectBlock, OBJECT_UNIFORMS_BINDING);
+
+    GLuint instanceBlock = glGetUniformBlockIndex(ID, "InstanceUniforms");
+    if (instanceBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, instanceBlock, INSTANCE_UNIFORMS_BINDING);
+}
+
+std::string Shader::InjectDefines(const std::string& source, const std::string& defines)
+{
+    if (defines.empty())
+        return source;
+
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return defines + source;
+
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos)
+        return source + "\n" + defines;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+std::string Shader::GetCompileErrors(GLuint shader, const std::string& type)
 {
     GLint success;
     GLchar infoLog[1024];
@@ -77,7 +140,7 @@ void Shader::checkCompileErrors(GLuint shader, std::string type)
         if (!success)
         {
             glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            return "ERROR::SHADER_COMPILATION_ERROR of type: " + type + "\n" + infoLog;
         }
     }
     else
@@ -86,7 +149,25 @@ void Shader::checkCompileErrors(GLuint shader, std::string type)
         if (!success)
         {
             glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            return "ERROR::PROGRAM_LINKING_ERROR of type: " + type + "\n" + infoLog;
         }
     }
+    return std::string();
+}
+
+void Shader::checkCompileErrors(GLuint shader, std::string type)
+{
+    std::string errors = GetCompileErrors(shader, type);
+    if (errors.empty())
+        return;
+
+    // kept for the shader error panel of the viewer, the log gets one line per message
+    errorLog += errors + "\n";
+    std::istringstream lines(errors);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (!line.empty())
+            LOG_ERROR(LogCategory::Render, "%s", line);
+    }
 }
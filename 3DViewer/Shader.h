@@ -13,9 +13,28 @@ class Shader
 {
 public:
     unsigned int ID;
+    // source files the program was built from
+    std::string vertexPath;
+    std::string fragmentPath;
+    // #define lines inserted after the #version line of both sources, see MaterialFeatures.h
+    std::string defines;
+    // compile and link errors of the last build, empty if it succeeded
+    std::string errorLog;
+    // empty shader, the program is given to it later with Replace
+    // ------------------------------------------------------------------------
+    Shader() : ID(0) {}
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath);
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
+    // swaps in a program linked from newer sources and deletes the current one
+    // ------------------------------------------------------------------------
+    void Replace(GLuint program);
+    // returns the compile ("VERTEX", "FRAGMENT") or link ("PROGRAM") errors of an object, empty if it succeeded
+    // ------------------------------------------------------------------------
+    static std::string GetCompileErrors(GLuint shader, const std::string& type);
+    // returns source with defines inserted after its #version line (which has to stay first)
+    // ------------------------------------------------------------------------
+    static std::string InjectDefines(const std::string& source, const std::string& defines);
     // activate the shader
     // ------------------------------------------------------------------------
     void use()
@@ -85,5 +104,7 @@ private:
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type);
+    // assigns the binding points of UniformBlocks.h to the uniform blocks of the program
+    void bindUniformBlocks();
 };
 #endif
\ No newline at end of file
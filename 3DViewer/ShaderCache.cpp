@@ -0,0 +1,225 @@
+#include "ShaderCache.h"
+#include "GLUtils.h"
+#include "Logger.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// Bump when the file layout or the key changes
+static const char CACHE_MAGIC[8] = { '3', 'D', 'V', 'P', 'R', 'G', '0', '1' };
+
+struct CacheHeader
+{
+	char magic[8];
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+// FNV-1a, the cache only needs to tell sources apart, not resist attacks
+static uint64_t HashBytes(uint64_t hash, const std::string& bytes)
+{
+	for (unsigned char c : bytes)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	// the length separates "ab"+"c" from "a"+"bc"
+	uint64_t length = bytes.size();
+	for (int i = 0; i < 8; i++)
+	{
+		hash ^= (length >> (i * 8)) & 0xff;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+ShaderCache& ShaderCache::Get()
+{
+	static ShaderCache cache;
+	return cache;
+}
+
+bool ShaderCache::Init(const std::string& directory, GLADloadproc loader)
+{
+	m_enabled = false;
+
+	bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1) || HasGLExtension("GL_ARB_get_program_binary");
+	if (!supported || !loader)
+	{
+		LOG_INFO(LogCategory::Render, "Shader cache disabled: no program binary support");
+		return false;
+	}
+
+	m_get_program_binary = (GetProgramBinaryProc)loader("glGetProgramBinary");
+	m_program_binary = (ProgramBinaryProc)loader("glProgramBinary");
+	m_program_parameteri = (ProgramParameteriProc)loader("glProgramParameteri");
+
+	// Drivers may support the extension with zero formats, e.g. Mesa without its disk cache
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (!m_get_program_binary || !m_program_binary || !m_program_parameteri || formats == 0)
+	{
+		LOG_INFO(LogCategory::Render, "Shader cache disabled: driver offers no program binary formats");
+		return false;
+	}
+
+	std::error_code error;
+	fs::create_directories(directory, error);
+	if (error)
+	{
+		LOG_ERROR(LogCategory::Render, "ERROR::SHADER_CACHE::CANNOT_CREATE_DIRECTORY: %s", directory);
+		return false;
+	}
+
+	m_directory = directory;
+	m_driver = std::string((const char*)glGetString(GL_VENDOR)) + "\n" + (const char*)glGetString(GL_RENDERER) + "\n" +
+		(const char*)glGetString(GL_VERSION);
+	m_enabled = true;
+
+	LOG_INFO(LogCategory::Render, "Shader cache: %s", directory);
+	return true;
+}
+
+unsigned long long ShaderCache::GetKey(const std::string& vertex_source, const std::string& fragment_source, const std::string& defines) const
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = HashBytes(hash, std::string(CACHE_MAGIC, sizeof(CACHE_MAGIC)));
+	hash = HashBytes(hash, m_driver);
+	hash = HashBytes(hash, defines);
+	hash = HashBytes(hash, vertex_source);
+	hash = HashBytes(hash, fragment_source);
+	return hash;
+}
+
+std::string ShaderCache::GetPath(unsigned long long key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", key);
+	return (fs::path(m_directory) / name).string();
+}
+
+GLuint ShaderCache::Load(const std::string& vertex_source, const std::string& fragment_source, const std::string& defines)
+{
+	if (!m_enabled)
+		return 0;
+
+	unsigned long long key = GetKey(vertex_source, fragment_source, defines);
+	std::string path = GetPath(key);
+
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		m_misses++;
+		return 0;
+	}
+
+	CacheHeader header;
+	std::vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+		header.key == key && header.length > 0;
+	if (valid)
+	{
+		binary.resize(header.length);
+		valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+
+	GLuint program = 0;
+	if (valid)
+	{
+		program = glCreateProgram();
+		m_program_binary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+
+	if (!program)
+	{
+		// truncated, from another driver build or otherwise rejected, rebuilt by the caller
+		LOG_WARNING(LogCategory::Render, "Shader cache entry rejected, recompiling: %s", path);
+		std::error_code error;
+		fs::remove(path, error);
+		m_misses++;
+		return 0;
+	}
+
+	LOG_DEBUG(LogCategory::Render, "Shader program loaded from cache: %s", path);
+	m_hits++;
+	return program;
+}
+
+void ShaderCache::PrepareProgram(GLuint program)
+{
+	if (m_enabled)
+		m_program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ShaderCache::Store(GLuint program, const std::string& vertex_source, const std::string& fragment_source, const std::string& defines)
+{
+	if (!m_enabled)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	m_get_program_binary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return;
+
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.key = GetKey(vertex_source, fragment_source, defines);
+	header.format = format;
+	header.length = (uint32_t)written;
+
+	// Write to a temporary name and rename, so a crash or a second instance never leaves half a file behind
+	std::string path = GetPath(header.key);
+	std::string temp_path = path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR(LogCategory::Render, "ERROR::SHADER_CACHE::CANNOT_WRITE: %s", temp_path);
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, written, file) == (size_t)written;
+	ok = fclose(file) == 0 && ok;
+
+	std::error_code error;
+	if (ok)
+		fs::rename(temp_path, path, error);
+	if (!ok || error)
+	{
+		LOG_ERROR(LogCategory::Render, "ERROR::SHADER_CACHE::CANNOT_WRITE: %s", path);
+		fs::remove(temp_path, error);
+		return;
+	}
+
+	LOG_DEBUG(LogCategory::Render, "Shader program stored in cache: %s (%d bytes)", path, (int)written);
+}
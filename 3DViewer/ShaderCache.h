@@ -0,0 +1,59 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+
+// On-disk cache of linked shader programs (glGetProgramBinary/glProgramBinary).
+// A program is stored under a hash of its sources, its defines and the GL vendor, renderer and
+// version strings, so a driver update or an edited shader simply misses the cache. Binaries the
+// driver rejects anyway are deleted and the program is compiled from source again.
+// Needs GL 4.1 or ARB_get_program_binary with at least one binary format, otherwise Init leaves
+// the cache disabled and Shader always compiles.
+class ShaderCache
+{
+public:
+	static ShaderCache& Get();
+
+	// Enables the cache in directory (created if needed). glad only loads GL 3.3, the program
+	// binary functions are resolved through loader. Needs a current context.
+	bool Init(const std::string& directory, GLADloadproc loader);
+
+	bool IsEnabled() const { return m_enabled; }
+
+	// Creates a program from the cached binary of these sources, returns 0 on a miss
+	GLuint Load(const std::string& vertex_source, const std::string& fragment_source, const std::string& defines);
+
+	// Call between glCreateProgram and glLinkProgram of programs that will be stored
+	void PrepareProgram(GLuint program);
+
+	// Writes the binary of a successfully linked program
+	void Store(GLuint program, const std::string& vertex_source, const std::string& fragment_source, const std::string& defines);
+
+	int GetHits() const { return m_hits; }
+	int GetMisses() const { return m_misses; }
+
+private:
+	ShaderCache() = default;
+
+	std::string GetPath(unsigned long long key) const;
+	unsigned long long GetKey(const std::string& vertex_source, const std::string& fragment_source, const std::string& defines) const;
+
+	typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+	typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+	typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+	GetProgramBinaryProc m_get_program_binary = nullptr;
+	ProgramBinaryProc m_program_binary = nullptr;
+	ProgramParameteriProc m_program_parameteri = nullptr;
+
+	bool m_enabled = false;
+	std::string m_directory;
+	// GL_VENDOR, GL_RENDERER and GL_VERSION, part of every key
+	std::string m_driver;
+
+	int m_hits = 0;
+	int m_misses = 0;
+};
+
+#endif
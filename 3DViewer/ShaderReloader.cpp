@@ -0,0 +1,325 @@
+#include "ShaderReloader.h"
+#include "ShaderCache.h"
+#include "GLUtils.h"
+#include "Logger.h"
+
+#include <imgui/imgui.h>
+
+#include <filesystem>
+#include <future>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Editors often save in several steps (truncate, write, rename), wait until the files are quiet
+static const std::chrono::milliseconds SETTLE_TIME(50);
+
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+static bool ReadFile(const std::string& path, std::string& contents)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	std::stringstream stream;
+	stream << file.rdbuf();
+	contents = stream.str();
+	return true;
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ShaderReloader::Init(GLADloadproc loader, std::function<bool(bool)> set_compile_context)
+{
+	MaxShaderCompilerThreadsProc max_threads = nullptr;
+	if (loader && HasGLExtension("GL_KHR_parallel_shader_compile"))
+		max_threads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsKHR");
+	else if (loader && HasGLExtension("GL_ARB_parallel_shader_compile"))
+		max_threads = (MaxShaderCompilerThreadsProc)loader("glMaxShaderCompilerThreadsARB");
+
+	if (max_threads)
+	{
+		// let the driver pick the number of compiler threads
+		max_threads(0xFFFFFFFF);
+		m_mode = PARALLEL_EXTENSION;
+	}
+	else if (set_compile_context)
+	{
+		m_set_compile_context = set_compile_context;
+		std::promise<bool> started;
+		std::future<bool> result = started.get_future();
+		m_compile_thread = std::thread([this, started = std::move(started)]() mutable {
+			bool ok = m_set_compile_context(true);
+			started.set_value(ok);
+			if (ok)
+				CompileThread();
+		});
+
+		if (result.get())
+			m_mode = SHARED_CONTEXT;
+		else
+			m_compile_thread.join();
+	}
+
+	static const char* modes[] = { "synchronous", "parallel shader compile extension", "shared context thread" };
+	LOG_INFO(LogCategory::Render, "Shader hot reload: %s", modes[m_mode]);
+}
+
+void ShaderReloader::Shutdown()
+{
+	if (m_compile_thread.joinable())
+	{
+		m_compile_queue.Close();
+		m_compile_thread.join();
+	}
+
+	for (Entry& entry : m_entries)
+	{
+		if (entry.build)
+		{
+			glDeleteShader(entry.build->vertex);
+			glDeleteShader(entry.build->fragment);
+			glDeleteProgram(entry.build->program);
+			entry.build.reset();
+		}
+	}
+	m_entries.clear();
+}
+
+void ShaderReloader::Watch(Shader& shader, const std::string& label)
+{
+	Entry entry;
+	entry.shader = &shader;
+	entry.label = label;
+	// errors of the initial build show up in the panel as well
+	entry.errors = shader.errorLog;
+	m_watcher.Watch(shader.vertexPath);
+	m_watcher.Watch(shader.fragmentPath);
+	m_entries.push_back(entry);
+}
+
+void ShaderReloader::StartCompile(Build& build)
+{
+	const char* vertex_code = build.vertexSource.c_str();
+	const char* fragment_code = build.fragmentSource.c_str();
+
+	build.vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(build.vertex, 1, &vertex_code, NULL);
+	glCompileShader(build.vertex);
+
+	build.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(build.fragment, 1, &fragment_code, NULL);
+	glCompileShader(build.fragment);
+
+	// Linking right away is fine, it fails if a stage failed and the stage logs say why
+	build.program = glCreateProgram();
+	glAttachShader(build.program, build.vertex);
+	glAttachShader(build.program, build.fragment);
+	ShaderCache::Get().PrepareProgram(build.program);
+	glLinkProgram(build.program);
+}
+
+void ShaderReloader::CollectResult(Build& build)
+{
+	build.errors = Shader::GetCompileErrors(build.vertex, "VERTEX");
+	std::string fragment_errors = Shader::GetCompileErrors(build.fragment, "FRAGMENT");
+	if (!fragment_errors.empty())
+		build.errors += (build.errors.empty() ? "" : "\n") + fragment_errors;
+	// a failed stage makes the link fail too, its message adds nothing
+	if (build.errors.empty())
+		build.errors = Shader::GetCompileErrors(build.program, "PROGRAM");
+	build.success = build.errors.empty();
+
+	glDeleteShader(build.vertex);
+	glDeleteShader(build.fragment);
+	build.vertex = build.fragment = 0;
+}
+
+void ShaderReloader::CompileThread()
+{
+	std::shared_ptr<Build> build;
+	while (m_compile_queue.Pop(build))
+	{
+		StartCompile(*build);
+		CollectResult(*build);
+		// the program is only used by the render context once the commands creating it completed
+		glFinish();
+		build->done = true;
+	}
+	m_set_compile_context(false);
+}
+
+void ShaderReloader::StartBuild(Entry& entry)
+{
+	std::shared_ptr<Build> build = std::make_shared<Build>();
+	build->start = std::chrono::steady_clock::now();
+
+	if (!ReadFile(entry.shader->vertexPath, build->vertexSource) || !ReadFile(entry.shader->fragmentPath, build->fragmentSource))
+	{
+		entry.errors = "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " + entry.shader->vertexPath + " / " + entry.shader->fragmentPath;
+		return;
+	}
+	// variants are rebuilt with the same feature defines
+	build->vertexSource = Shader::InjectDefines(build->vertexSource, entry.shader->defines);
+	build->fragmentSource = Shader::InjectDefines(build->fragmentSource, entry.shader->defines);
+
+	entry.build = build;
+	if (m_mode == SHARED_CONTEXT)
+		m_compile_queue.Push(build);
+	else
+		StartCompile(*build);
+}
+
+bool ShaderReloader::IsBuildDone(Build& build)
+{
+	if (m_mode == SHARED_CONTEXT)
+		return build.done;
+
+	if (m_mode == PARALLEL_EXTENSION)
+	{
+		GLint complete = GL_FALSE;
+		glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+		if (!complete)
+			return false;
+	}
+
+	// Synchronous builds simply block here
+	CollectResult(build);
+	return true;
+}
+
+void ShaderReloader::FinishBuild(Entry& entry)
+{
+	Build& build = *entry.build;
+	double ms = ElapsedMs(build.start);
+	std::string name = std::filesystem::path(entry.shader->vertexPath).filename().string() + " + " +
+		std::filesystem::path(entry.shader->fragmentPath).filename().string();
+
+	if (build.success)
+	{
+		entry.shader->Replace(build.program);
+		ShaderCache::Get().Store(build.program, build.vertexSource, build.fragmentSource, entry.shader->defines);
+		entry.errors.clear();
+		entry.reloads++;
+
+		char status[96];
+		snprintf(status, sizeof(status), "reloaded in %.1f ms", ms);
+		entry.status = status;
+		LOG_INFO(LogCategory::Render, "Shader reloaded: %s (%.1f ms)", name, ms);
+	}
+	else
+	{
+		glDeleteProgram(build.program);
+		entry.errors = build.errors;
+		entry.status = "build failed, still using the previous program";
+		LOG_WARNING(LogCategory::Render, "Shader reload failed: %s, see View > Shaders", name);
+	}
+
+	entry.build.reset();
+}
+
+bool ShaderReloader::Update()
+{
+	std::vector<std::string> changed = m_watcher.Poll();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	for (Entry& entry : m_entries)
+	{
+		for (const std::string& path : changed)
+		{
+			if (path == entry.shader->vertexPath || path == entry.shader->fragmentPath)
+			{
+				entry.changed = true;
+				entry.changedAt = now;
+			}
+		}
+	}
+
+	bool visible_change = false;
+	for (Entry& entry : m_entries)
+	{
+		if (entry.build && IsBuildDone(*entry.build))
+		{
+			FinishBuild(entry);
+			visible_change = true;
+		}
+
+		// Changes during a build start another one once it is done
+		if (entry.changed && !entry.build && now - entry.changedAt >= SETTLE_TIME)
+		{
+			entry.changed = false;
+			StartBuild(entry);
+			if (!entry.build)
+				visible_change = true;
+		}
+	}
+	return visible_change;
+}
+
+bool ShaderReloader::IsBusy() const
+{
+	for (const Entry& entry : m_entries)
+	{
+		if (entry.changed || entry.build)
+			return true;
+	}
+	return false;
+}
+
+bool ShaderReloader::HasErrors() const
+{
+	for (const Entry& entry : m_entries)
+	{
+		if (!entry.errors.empty())
+			return true;
+	}
+	return false;
+}
+
+void ShaderReloader::DrawPanel(bool* open)
+{
+	if (open && !*open)
+		return;
+
+	ImGui::SetNextWindowSize(ImVec2(520, 300), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowPos(ImVec2(20, 130), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Shaders", open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	static const char* modes[] = { "synchronous", "parallel compile extension", "shared context thread" };
+	ImGui::TextDisabled("Hot reload: %s", modes[m_mode]);
+
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		const Entry& entry = m_entries[i];
+		ImGui::PushID((int)i);
+		ImGui::Separator();
+		ImGui::Text("%s + %s", entry.shader->vertexPath.c_str(), entry.shader->fragmentPath.c_str());
+		if (!entry.label.empty())
+		{
+			ImGui::SameLine();
+			ImGui::TextDisabled("[%s]", entry.label.c_str());
+		}
+
+		if (entry.build || entry.changed)
+			ImGui::TextDisabled("compiling...");
+		else if (!entry.status.empty())
+			ImGui::TextDisabled("%s (%d reloads)", entry.status.c_str(), entry.reloads);
+
+		if (!entry.errors.empty())
+		{
+			ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f));
+			ImGui::TextWrapped("%s", entry.errors.c_str());
+			ImGui::PopStyleColor();
+		}
+		ImGui::PopID();
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,108 @@
+#ifndef SHADER_RELOADER_H
+#define SHADER_RELOADER_H
+
+#include <glad/glad.h>
+
+#include "BlockingQueue.h"
+#include "FileWatcher.h"
+#include "Shader.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Rebuilds watched shader programs when their source files change, without stalling the render loop.
+// Compiles are started in the background and polled every frame; the old program keeps rendering
+// until the new one linked successfully and is swapped into the Shader between two frames. Failed
+// builds leave the old program in place and show their errors in the ImGui panel.
+//
+// Background compilation uses, in order of preference:
+//   GL_KHR/ARB_parallel_shader_compile  driver compiles on its own threads, polled with GL_COMPLETION_STATUS
+//   shared context                     a thread of ours compiles on a context sharing objects with the render context
+//   synchronous                        compile on the render thread (blocks for the duration of one build)
+class ShaderReloader
+{
+public:
+	enum Mode
+	{
+		SYNCHRONOUS,
+		PARALLEL_EXTENSION,
+		SHARED_CONTEXT
+	};
+
+	// Must be called on the render thread with its context current. loader resolves glMaxShaderCompilerThreads.
+	// set_compile_context is only used without the extension: the compile thread calls it with true when it
+	// starts and with false before it exits, it has to make a context current that shares objects with the
+	// render context (e.g. a hidden GLFW window) or release it again. Returns false if it can't.
+	void Init(GLADloadproc loader, std::function<bool(bool)> set_compile_context);
+
+	// Stops the compile thread and deletes unfinished programs
+	void Shutdown();
+
+	// Rebuilds shader whenever shader.vertexPath or shader.fragmentPath change, shader must outlive the reloader.
+	// Its defines are injected again on every rebuild, label tells variants of the same files apart in the panel.
+	void Watch(Shader& shader, const std::string& label = "");
+
+	// Polls the files and the running builds and swaps in finished programs, once per frame on the render thread.
+	// Returns true when something visible changed: a program was replaced or new errors arrived.
+	bool Update();
+
+	// Changes waiting to be built or builds running
+	bool IsBusy() const;
+
+	bool HasErrors() const;
+
+	Mode GetMode() const { return m_mode; }
+
+	// ImGui window with the state of every watched program and the errors of failed builds
+	void DrawPanel(bool* open);
+
+private:
+	struct Build
+	{
+		std::string vertexSource;
+		std::string fragmentSource;
+		GLuint vertex = 0;
+		GLuint fragment = 0;
+		GLuint program = 0;
+		std::chrono::steady_clock::time_point start;
+		// set by the compile thread in SHARED_CONTEXT mode
+		std::atomic<bool> done{ false };
+		bool success = false;
+		std::string errors;
+	};
+
+	struct Entry
+	{
+		Shader* shader = nullptr;
+		std::string label;
+		bool changed = false;
+		std::chrono::steady_clock::time_point changedAt;
+		std::shared_ptr<Build> build;
+		std::string errors;
+		std::string status;
+		int reloads = 0;
+	};
+
+	static void StartCompile(Build& build);
+	static void CollectResult(Build& build);
+
+	void StartBuild(Entry& entry);
+	bool IsBuildDone(Build& build);
+	void FinishBuild(Entry& entry);
+	void CompileThread();
+
+	Mode m_mode = SYNCHRONOUS;
+	FileWatcher m_watcher;
+	std::vector<Entry> m_entries;
+
+	std::function<bool(bool)> m_set_compile_context;
+	BlockingQueue<std::shared_ptr<Build>> m_compile_queue{ 64 };
+	std::thread m_compile_thread;
+};
+
+#endif
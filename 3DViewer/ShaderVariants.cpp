@@ -0,0 +1,195 @@
+#include "ShaderVariants.h"
+#include "ShaderCache.h"
+#include "Logger.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath) : m_vertex_path(vertexPath), m_fragment_path(fragmentPath)
+{
+	std::string vertex_source, fragment_source;
+	if (!ReadSources(vertex_source, fragment_source))
+		return;
+
+	// Shaders edited later by hot reload keep the masks chosen here, a define they start testing for needs a restart
+	for (int i = 0; i < MATERIAL_FEATURE_COUNT; i++)
+	{
+		if (vertex_source.find(MATERIAL_FEATURE_DEFINES[i]) != std::string::npos ||
+			fragment_source.find(MATERIAL_FEATURE_DEFINES[i]) != std::string::npos)
+			m_used_features |= 1u << i;
+	}
+}
+
+bool ShaderVariants::ReadSources(std::string& vertex_source, std::string& fragment_source) const
+{
+	std::ifstream vertex_file(m_vertex_path, std::ios::binary);
+	std::ifstream fragment_file(m_fragment_path, std::ios::binary);
+	if (!vertex_file || !fragment_file)
+	{
+		LOG_ERROR(LogCategory::Render, "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: %s / %s", m_vertex_path, m_fragment_path);
+		return false;
+	}
+
+	std::stringstream vertex_stream, fragment_stream;
+	vertex_stream << vertex_file.rdbuf();
+	fragment_stream << fragment_file.rdbuf();
+	vertex_source = vertex_stream.str();
+	fragment_source = fragment_stream.str();
+	return true;
+}
+
+void ShaderVariants::Prepare(const std::vector<unsigned int>& features)
+{
+	struct Build
+	{
+		unsigned int features;
+		std::string defines;
+		std::string vertexSource;
+		std::string fragmentSource;
+		GLuint vertex = 0;
+		GLuint fragment = 0;
+		GLuint program = 0;
+		bool cached = false;
+	};
+
+	std::vector<Build> builds;
+	for (unsigned int mask : features)
+	{
+		mask &= m_used_features;
+		bool known = m_variants.count(mask) != 0;
+		for (const Build& build : builds)
+			known = known || build.features == mask;
+		if (!known)
+		{
+			Build build;
+			build.features = mask;
+			builds.push_back(build);
+		}
+	}
+	if (builds.empty())
+		return;
+
+	std::string vertex_source, fragment_source;
+	if (!ReadSources(vertex_source, fragment_source))
+		return;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	ShaderCache& cache = ShaderCache::Get();
+
+	// 1. start compiling every stage of every variant that isn't cached
+	for (Build& build : builds)
+	{
+		build.defines = MakeFeatureDefines(build.features);
+		build.vertexSource = Shader::InjectDefines(vertex_source, build.defines);
+		build.fragmentSource = Shader::InjectDefines(fragment_source, build.defines);
+
+		build.program = cache.Load(build.vertexSource, build.fragmentSource, build.defines);
+		build.cached = build.program != 0;
+		if (build.cached)
+			continue;
+
+		const char* vertex_code = build.vertexSource.c_str();
+		const char* fragment_code = build.fragmentSource.c_str();
+		build.vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(build.vertex, 1, &vertex_code, NULL);
+		glCompileShader(build.vertex);
+		build.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(build.fragment, 1, &fragment_code, NULL);
+		glCompileShader(build.fragment);
+	}
+
+	// 2. link them, a failed stage makes the link fail and its log says why
+	for (Build& build : builds)
+	{
+		if (build.cached)
+			continue;
+		build.program = glCreateProgram();
+		glAttachShader(build.program, build.vertex);
+		glAttachShader(build.program, build.fragment);
+		cache.PrepareProgram(build.program);
+		glLinkProgram(build.program);
+	}
+
+	// 3. only now wait for the results
+	int cached = 0;
+	for (Build& build : builds)
+	{
+		std::string errors;
+		if (build.cached)
+			cached++;
+		else
+		{
+			errors = Shader::GetCompileErrors(build.vertex, "VERTEX");
+			std::string fragment_errors = Shader::GetCompileErrors(build.fragment, "FRAGMENT");
+			if (!fragment_errors.empty())
+				errors += (errors.empty() ? "" : "\n") + fragment_errors;
+			if (errors.empty())
+				errors = Shader::GetCompileErrors(build.program, "PROGRAM");
+			if (errors.empty())
+				cache.Store(build.program, build.vertexSource, build.fragmentSource, build.defines);
+			glDeleteShader(build.vertex);
+			glDeleteShader(build.fragment);
+		}
+
+		Shader& variant = m_variants[build.features];
+		variant.vertexPath = m_vertex_path;
+		variant.fragmentPath = m_fragment_path;
+		variant.defines = build.defines;
+		variant.Replace(build.program);
+		variant.errorLog = errors;
+
+		if (!errors.empty())
+		{
+			LOG_ERROR(LogCategory::Render, "ERROR::SHADER::VARIANT_FAILED: %s", DescribeFeatures(build.features));
+			std::istringstream lines(errors);
+			std::string line;
+			while (std::getline(lines, line))
+			{
+				if (!line.empty())
+					LOG_ERROR(LogCategory::Render, "%s", line);
+			}
+		}
+
+		for (const auto& uniform : m_vec3_uniforms)
+		{
+			variant.use();
+			variant.setVec3(uniform.first, uniform.second);
+		}
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	LOG_INFO(LogCategory::Render, "Shader variants: built %d (%d from cache) in %.1f ms", (int)builds.size(), cached, ms);
+	for (const Build& build : builds)
+		LOG_DEBUG(LogCategory::Render, "  variant %s", DescribeFeatures(build.features));
+}
+
+Shader& ShaderVariants::Get(unsigned int features)
+{
+	features &= m_used_features;
+	auto found = m_variants.find(features);
+	if (found != m_variants.end())
+		return found->second;
+
+	LOG_WARNING(LogCategory::Render, "Shader variant %s was not prepared, compiling it now", DescribeFeatures(features));
+	Prepare({ features });
+	// reading the sources failed, draw with an empty program rather than crash
+	return m_variants[features];
+}
+
+void ShaderVariants::setVec3(const std::string& name, const glm::vec3& value)
+{
+	m_vec3_uniforms[name] = value;
+	for (auto& variant : m_variants)
+	{
+		variant.second.use();
+		variant.second.setVec3(name, value);
+	}
+}
+
+void ShaderVariants::Delete()
+{
+	for (auto& variant : m_variants)
+		glDeleteProgram(variant.second.ID);
+	m_variants.clear();
+}
@@ -0,0 +1,54 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "MaterialFeatures.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// One vertex/fragment source pair compiled into a program per material feature mask (see MaterialFeatures.h).
+// The features are injected as #defines, so every mesh runs a program without the work its material doesn't
+// need. Features the sources never test for are dropped from the mask, meshes differing only in those share
+// a program instead of compiling identical ones.
+class ShaderVariants
+{
+public:
+	ShaderVariants(const char* vertexPath, const char* fragmentPath);
+
+	// Builds the variants of all masks that aren't built yet. Every stage is compiled before the first program
+	// is linked and no status is queried until all are linked, so drivers that compile in the background
+	// (GL_KHR_parallel_shader_compile, Mesa's shader threads) build them in parallel. Programs are loaded from
+	// ShaderCache when possible.
+	void Prepare(const std::vector<unsigned int>& features);
+
+	// The variant for a mesh, compiled on the spot if Prepare didn't build it
+	Shader& Get(unsigned int features);
+
+	// Only these bits of a feature mask select a variant, the rest is ignored
+	unsigned int GetUsedFeatures() const { return m_used_features; }
+
+	// Built variants by their feature mask, the Shader objects stay valid until Delete
+	std::map<unsigned int, Shader>& GetVariants() { return m_variants; }
+
+	// Sets the uniform in every variant, variants built later get it as well. Leaves the last variant in use.
+	void setVec3(const std::string& name, const glm::vec3& value);
+
+	// Deletes all programs
+	void Delete();
+
+private:
+	std::string m_vertex_path;
+	std::string m_fragment_path;
+	unsigned int m_used_features = 0;
+	std::map<unsigned int, Shader> m_variants;
+	std::map<std::string, glm::vec3> m_vec3_uniforms;
+
+	bool ReadSources(std::string& vertex_source, std::string& fragment_source) const;
+};
+
+#endif
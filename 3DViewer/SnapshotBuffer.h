@@ -0,0 +1,56 @@
+#ifndef SNAPSHOT_BUFFER_H
+#define SNAPSHOT_BUFFER_H
+
+#include <atomic>
+
+// Hands the latest T from one writer thread to one reader thread without locks or waiting. The writer
+// fills its back slot and publishes it, the reader picks up the newest published one, snapshots the
+// reader was too slow for are overwritten. A third slot sits between the two, so neither side ever
+// touches the slot the other one is using: the writer never waits for a frame to finish and the reader
+// never sees a half written snapshot.
+//
+// The slots are reused, so T may keep its allocations (vectors) from one snapshot to the next.
+template <typename T>
+class SnapshotBuffer
+{
+public:
+	// The slot the writer fills, it holds whatever it held two or more publishes ago
+	T& GetBack() { return m_slots[m_back]; }
+
+	// Makes the back slot the newest snapshot
+	void Publish()
+	{
+		unsigned int previous = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+		m_back = previous & INDEX_MASK;
+	}
+
+	// Whether a snapshot was published since the last Acquire, for a reader deciding whether to sleep
+	bool HasNew() const { return (m_middle.load(std::memory_order_relaxed) & FRESH) != 0; }
+
+	// Swaps in the newest snapshot if one was published since the last call, returns whether it did
+	bool Acquire()
+	{
+		if (!HasNew())
+			return false;
+		unsigned int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = previous & INDEX_MASK;
+		return true;
+	}
+
+	// The snapshot the reader works with, valid until its next Acquire
+	const T& GetFront() const { return m_slots[m_front]; }
+
+private:
+	static const unsigned int INDEX_MASK = 3;
+	static const unsigned int FRESH = 4;
+
+	T m_slots[3];
+	// index of the slot between writer and reader, FRESH until the reader takes it
+	std::atomic<unsigned int> m_middle{ 1 };
+	// only touched by the writer
+	unsigned int m_back = 0;
+	// only touched by the reader
+	unsigned int m_front = 2;
+};
+
+#endif
@@ -0,0 +1,502 @@
+#include "SoftwareRenderer.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RENDERER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const int TILE_SIZE = 64;
+	const int SUBPIXEL_BITS = 4;
+	const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+	const int MAX_SIZE = 2048;
+	// floats after the last depth row, for the 4 wide loads of its last pixels
+	const int DEPTH_TAIL_PADDING = 3;
+	const int SETUP_CHUNK_TRIANGLES = 4096;
+	const int VERTEX_GRAIN = 4096;
+
+	// Clip space planes as dot(plane, position) >= 0, same volume as GL: -w <= x, y, z <= w
+	const glm::vec4 CLIP_PLANES[6] = {
+		glm::vec4(1.0f, 0.0f, 0.0f, 1.0f),
+		glm::vec4(-1.0f, 0.0f, 0.0f, 1.0f),
+		glm::vec4(0.0f, 1.0f, 0.0f, 1.0f),
+		glm::vec4(0.0f, -1.0f, 0.0f, 1.0f),
+		glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+		glm::vec4(0.0f, 0.0f, -1.0f, 1.0f)
+	};
+
+	int OutCode(const glm::vec4& p)
+	{
+		int code = 0;
+		for (int i = 0; i < 6; i++)
+		{
+			if (glm::dot(CLIP_PLANES[i], p) < 0.0f)
+				code |= 1 << i;
+		}
+		return code;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// SoftwareRenderer
+// ----------------------------------------------------------------------------
+
+SoftwareRenderer::SoftwareRenderer(int width, int height, int threads)
+	: m_width(std::min(std::max(width, 1), MAX_SIZE)), m_height(std::min(std::max(height, 1), MAX_SIZE)), m_jobs(threads)
+{
+	// Depth is tested 4 pixels at a time from the first pixel of a span, so a load may read up to 3
+	// floats past the span's last pixel: the next tile, row padding or the next row. Those lanes are
+	// masked off and never stored, the tail padding keeps the loads of the last row inside the buffer.
+	m_depth_stride = (m_width + 3) & ~3;
+	m_tiles_x = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+	m_tiles_y = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+	m_color.resize((size_t)m_width * m_height * 4);
+	m_depth.resize((size_t)m_depth_stride * m_height + DEPTH_TAIL_PADDING);
+	Clear(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+void SoftwareRenderer::Clear(const glm::vec4& color)
+{
+	unsigned char rgba[4];
+	for (int i = 0; i < 4; i++)
+		rgba[i] = (unsigned char)(glm::clamp(color[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+
+	for (size_t i = 0; i < m_color.size(); i += 4)
+		memcpy(&m_color[i], rgba, 4);
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+}
+
+void SoftwareRenderer::ClearTextureCache()
+{
+	m_textures.clear();
+}
+
+const SoftwareRenderer::SoftwareTexture* SoftwareRenderer::GetTexture(const Mesh& mesh)
+{
+	// like the frag.glsl variants, only meshes with a diffuse map and texture coordinates sample texture_diffuse1
+	const unsigned int textured = FEATURE_DIFFUSE_MAP | FEATURE_TEXCOORDS;
+	if ((mesh.features & textured) != textured)
+		return nullptr;
+
+	// Model puts the diffuse maps first
+	string key = m_texture_directory + '/' + mesh.textures[0].path;
+	auto found = m_textures.find(key);
+	if (found != m_textures.end())
+		return found->second.get();
+
+	std::unique_ptr<SoftwareTexture> texture = std::make_unique<SoftwareTexture>();
+	TextureData data;
+	if (LoadTextureData(mesh.textures[0].path.c_str(), m_texture_directory, data))
+	{
+		texture->width = data.width;
+		texture->height = data.height;
+		texture->components = data.components;
+		texture->pixels.assign(data.pixels, data.pixels + (size_t)data.width * data.height * data.components);
+	}
+	FreeTextureData(data);
+
+	const SoftwareTexture* result = texture->pixels.empty() ? nullptr : texture.get();
+	m_textures[key] = std::move(texture);
+	return result;
+}
+
+void SoftwareRenderer::DrawMesh(const Mesh& mesh)
+{
+	if (mesh.vertices.empty() || mesh.indices.size() < 3)
+		return;
+
+	DrawCall draw;
+	draw.mesh = &mesh;
+	draw.mvp = m_projection * m_view * m_model;
+	draw.materialColor = m_material_color;
+	draw.texture = GetTexture(mesh);
+	draw.firstVertex = 0;
+	m_draws.push_back(draw);
+}
+
+void SoftwareRenderer::Finish()
+{
+	// 1. vertex stage, the equivalent of vert.glsl
+	size_t vertex_count = 0;
+	for (DrawCall& draw : m_draws)
+	{
+		draw.firstVertex = vertex_count;
+		vertex_count += draw.mesh->vertices.size();
+	}
+	m_clip_vertices.resize(vertex_count);
+
+	for (const DrawCall& draw : m_draws)
+	{
+		const vector<Vertex>& vertices = draw.mesh->vertices;
+		ClipVertex* out = &m_clip_vertices[draw.firstVertex];
+		m_jobs.ParallelFor((int)vertices.size(), VERTEX_GRAIN, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				out[i].position = draw.mvp * glm::vec4(vertices[i].Position, 1.0f);
+				out[i].uv = vertices[i].TexCoords;
+			}
+		});
+	}
+
+	// 2. triangle setup and binning, chunks keep the submission order for the tiles
+	size_t chunk_count = 0;
+	for (unsigned int d = 0; d < m_draws.size(); d++)
+	{
+		size_t triangles = m_draws[d].mesh->indices.size() / 3;
+		for (size_t first = 0; first < triangles; first += SETUP_CHUNK_TRIANGLES)
+		{
+			if (chunk_count == m_chunks.size())
+				m_chunks.emplace_back();
+			SetupChunk& chunk = m_chunks[chunk_count++];
+			chunk.draw = d;
+			chunk.firstTriangle = first;
+			chunk.triangleCount = std::min((size_t)SETUP_CHUNK_TRIANGLES, triangles - first);
+		}
+	}
+
+	m_jobs.ParallelFor((int)chunk_count, 1, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			SetupTriangles(m_chunks[i]);
+	});
+
+	// 3. rasterization, one tile per task
+	m_chunks.resize(chunk_count);
+	m_triangle_count = 0;
+	for (const SetupChunk& chunk : m_chunks)
+		m_triangle_count += chunk.triangles.size();
+
+	m_jobs.ParallelFor(m_tiles_x * m_tiles_y, 1, [&](int begin, int end) {
+		for (int tile = begin; tile < end; tile++)
+			RasterizeTile(tile);
+	});
+
+	m_draws.clear();
+}
+
+void SoftwareRenderer::SetupTriangles(SetupChunk& chunk)
+{
+	chunk.triangles.clear();
+	chunk.bins.resize((size_t)m_tiles_x * m_tiles_y);
+	for (std::vector<unsigned int>& bin : chunk.bins)
+		bin.clear();
+
+	const DrawCall& draw = m_draws[chunk.draw];
+	const vector<unsigned int>& indices = draw.mesh->indices;
+	const ClipVertex* vertices = &m_clip_vertices[draw.firstVertex];
+	const size_t vertex_count = draw.mesh->vertices.size();
+
+	for (size_t t = chunk.firstTriangle; t < chunk.firstTriangle + chunk.triangleCount; t++)
+	{
+		ClipVertex v[3];
+		bool valid = true;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int index = indices[t * 3 + k];
+			valid = valid && index < vertex_count;
+			v[k] = valid ? vertices[index] : ClipVertex();
+		}
+		if (!valid)
+			continue;
+
+		int code0 = OutCode(v[0].position);
+		int code1 = OutCode(v[1].position);
+		int code2 = OutCode(v[2].position);
+
+		// completely outside one plane
+		if (code0 & code1 & code2)
+			continue;
+
+		// completely inside
+		if ((code0 | code1 | code2) == 0)
+		{
+			EmitTriangle(chunk, v);
+			continue;
+		}
+
+		// Sutherland-Hodgman against the planes the triangle crosses, a triangle grows to at most 9 vertices
+		ClipVertex polygon[2][9];
+		int count = 3;
+		int current = 0;
+		for (int k = 0; k < 3; k++)
+			polygon[0][k] = v[k];
+
+		int crossed = code0 | code1 | code2;
+		for (int p = 0; p < 6 && count >= 3; p++)
+		{
+			if (!(crossed & (1 << p)))
+				continue;
+
+			const ClipVertex* in = polygon[current];
+			ClipVertex* out = polygon[current ^ 1];
+			int out_count = 0;
+			for (int k = 0; k < count; k++)
+			{
+				const ClipVertex& a = in[k];
+				const ClipVertex& b = in[(k + 1) % count];
+				float da = glm::dot(CLIP_PLANES[p], a.position);
+				float db = glm::dot(CLIP_PLANES[p], b.position);
+				if (da >= 0.0f)
+					out[out_count++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					float s = da / (da - db);
+					out[out_count].position = glm::mix(a.position, b.position, s);
+					out[out_count].uv = glm::mix(a.uv, b.uv, s);
+					out_count++;
+				}
+			}
+			count = out_count;
+			current ^= 1;
+		}
+
+		for (int k = 1; k + 1 < count; k++)
+		{
+			ClipVertex fan[3] = { polygon[current][0], polygon[current][k], polygon[current][k + 1] };
+			EmitTriangle(chunk, fan);
+		}
+	}
+}
+
+void SoftwareRenderer::EmitTriangle(SetupChunk& chunk, const ClipVertex* v)
+{
+	RasterTriangle triangle;
+	triangle.draw = chunk.draw;
+
+	for (int k = 0; k < 3; k++)
+	{
+		float w = v[k].position.w;
+		if (w <= 0.0f)
+			return;
+		float inv_w = 1.0f / w;
+		glm::vec3 ndc = glm::vec3(v[k].position) * inv_w;
+
+		// viewport transform with row 0 at the bottom like GL, snapped to sub pixels
+		float sx = (ndc.x * 0.5f + 0.5f) * m_width * SUBPIXEL_ONE;
+		float sy = (ndc.y * 0.5f + 0.5f) * m_height * SUBPIXEL_ONE;
+		triangle.x[k] = std::min(std::max((int)std::lround(sx), 0), m_width * SUBPIXEL_ONE);
+		triangle.y[k] = std::min(std::max((int)std::lround(sy), 0), m_height * SUBPIXEL_ONE);
+		triangle.z[k] = ndc.z * 0.5f + 0.5f;
+		triangle.invW[k] = inv_w;
+		triangle.uvOverW[k] = v[k].uv * inv_w;
+	}
+
+	long long area = (long long)(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (long long)(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+	if (area == 0)
+		return;
+
+	// GL draws both windings by default, flip clockwise triangles so the inside is always positive
+	if (area < 0)
+	{
+		std::swap(triangle.x[1], triangle.x[2]);
+		std::swap(triangle.y[1], triangle.y[2]);
+		std::swap(triangle.z[1], triangle.z[2]);
+		std::swap(triangle.invW[1], triangle.invW[2]);
+		std::swap(triangle.uvOverW[1], triangle.uvOverW[2]);
+		area = -area;
+	}
+	triangle.invArea = 1.0f / (float)area;
+
+	// pixel centers sit at +0.5, so pixel i is covered from i * 16 + 8
+	const int half = SUBPIXEL_ONE / 2;
+	int min_x = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+	int max_x = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+	int min_y = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+	int max_y = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+	triangle.minX = std::max(0, (min_x - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+	triangle.maxX = std::min(m_width - 1, (max_x - half) >> SUBPIXEL_BITS);
+	triangle.minY = std::max(0, (min_y - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+	triangle.maxY = std::min(m_height - 1, (max_y - half) >> SUBPIXEL_BITS);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	unsigned int index = (unsigned int)chunk.triangles.size();
+	chunk.triangles.push_back(triangle);
+
+	for (int ty = triangle.minY / TILE_SIZE; ty <= triangle.maxY / TILE_SIZE; ty++)
+	{
+		for (int tx = triangle.minX / TILE_SIZE; tx <= triangle.maxX / TILE_SIZE; tx++)
+			chunk.bins[(size_t)ty * m_tiles_x + tx].push_back(index);
+	}
+}
+
+void SoftwareRenderer::RasterizeTile(int tile)
+{
+	int tile_x0 = (tile % m_tiles_x) * TILE_SIZE;
+	int tile_y0 = (tile / m_tiles_x) * TILE_SIZE;
+	int tile_x1 = std::min(tile_x0 + TILE_SIZE, m_width) - 1;
+	int tile_y1 = std::min(tile_y0 + TILE_SIZE, m_height) - 1;
+
+	for (const SetupChunk& chunk : m_chunks)
+	{
+		for (unsigned int index : chunk.bins[tile])
+			RasterizeTriangle(chunk.triangles[index], tile_x0, tile_y0, tile_x1, tile_y1);
+	}
+}
+
+void SoftwareRenderer::RasterizeTriangle(const RasterTriangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1)
+{
+	int x0 = std::max(triangle.minX, tileX0);
+	int x1 = std::min(triangle.maxX, tileX1);
+	int y0 = std::max(triangle.minY, tileY0);
+	int y1 = std::min(triangle.maxY, tileY1);
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	const DrawCall& draw = m_draws[triangle.draw];
+
+	// Edge function of the edge opposite to vertex k, positive inside: weight of vertex k
+	int step_x[3], step_y[3], row_start[3], bias[3];
+	const int sample_x = (x0 << SUBPIXEL_BITS) + SUBPIXEL_ONE / 2;
+	const int sample_y = (y0 << SUBPIXEL_BITS) + SUBPIXEL_ONE / 2;
+	for (int k = 0; k < 3; k++)
+	{
+		int a = (k + 1) % 3;
+		int b = (k + 2) % 3;
+		int dx = triangle.x[b] - triangle.x[a];
+		int dy = triangle.y[b] - triangle.y[a];
+
+		// top-left rule: pixels exactly on a right or bottom edge belong to the neighbour,
+		// the bias is subtracted again wherever the value is used as a weight
+		bool top_left = dy < 0 || (dy == 0 && dx < 0);
+		bias[k] = top_left ? 0 : -1;
+		long long value = (long long)dx * (sample_y - triangle.y[a]) - (long long)dy * (sample_x - triangle.x[a]);
+		row_start[k] = (int)value + bias[k];
+		step_x[k] = -dy * SUBPIXEL_ONE;
+		step_y[k] = dx * SUBPIXEL_ONE;
+	}
+
+	// depth is linear in screen space: z = z0 + (w1 * (z1 - z0) + w2 * (z2 - z0)) / area
+	const float dz1 = (triangle.z[1] - triangle.z[0]) * triangle.invArea;
+	const float dz2 = (triangle.z[2] - triangle.z[0]) * triangle.invArea;
+
+#ifdef SOFTWARE_RENDERER_SSE2
+	const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i offset0 = _mm_setr_epi32(0, step_x[0], step_x[0] * 2, step_x[0] * 3);
+	const __m128i offset1 = _mm_setr_epi32(0, step_x[1], step_x[1] * 2, step_x[1] * 3);
+	const __m128i offset2 = _mm_setr_epi32(0, step_x[2], step_x[2] * 2, step_x[2] * 3);
+	const __m128 z0 = _mm_set1_ps(triangle.z[0]);
+	const __m128 vdz1 = _mm_set1_ps(dz1);
+	const __m128 vdz2 = _mm_set1_ps(dz2);
+	const __m128 bias1 = _mm_set1_ps((float)bias[1]);
+	const __m128 bias2 = _mm_set1_ps((float)bias[2]);
+#endif
+
+	for (int y = y0; y <= y1; y++)
+	{
+		int e0 = row_start[0];
+		int e1 = row_start[1];
+		int e2 = row_start[2];
+		float* depth_row = &m_depth[(size_t)y * m_depth_stride];
+
+		for (int x = x0; x <= x1; x += 4)
+		{
+			int mask;
+			float z_lanes[4];
+
+#ifdef SOFTWARE_RENDERER_SSE2
+			__m128i w0 = _mm_add_epi32(_mm_set1_epi32(e0), offset0);
+			__m128i w1 = _mm_add_epi32(_mm_set1_epi32(e1), offset1);
+			__m128i w2 = _mm_add_epi32(_mm_set1_epi32(e2), offset2);
+
+			// inside where no edge value is negative, and inside the tile span
+			__m128i outside = _mm_or_si128(_mm_or_si128(w0, w1), w2);
+			__m128i in_span = _mm_cmplt_epi32(lane, _mm_set1_epi32(x1 - x + 1));
+			mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(outside, in_span)));
+
+			if (mask)
+			{
+				__m128 f1 = _mm_sub_ps(_mm_cvtepi32_ps(w1), bias1);
+				__m128 f2 = _mm_sub_ps(_mm_cvtepi32_ps(w2), bias2);
+				__m128 z = _mm_add_ps(z0, _mm_add_ps(_mm_mul_ps(f1, vdz1), _mm_mul_ps(f2, vdz2)));
+				__m128 stored = _mm_loadu_ps(depth_row + x);
+				mask &= _mm_movemask_ps(_mm_cmplt_ps(z, stored));
+				_mm_storeu_ps(z_lanes, z);
+			}
+#else
+			mask = 0;
+			for (int i = 0; i < 4 && x + i <= x1; i++)
+			{
+				int l0 = e0 + step_x[0] * i;
+				int l1 = e1 + step_x[1] * i;
+				int l2 = e2 + step_x[2] * i;
+				if ((l0 | l1 | l2) < 0)
+					continue;
+				float z = triangle.z[0] + (float)(l1 - bias[1]) * dz1 + (float)(l2 - bias[2]) * dz2;
+				if (z < depth_row[x + i])
+				{
+					z_lanes[i] = z;
+					mask |= 1 << i;
+				}
+			}
+#endif
+
+			for (int i = 0; mask; i++, mask >>= 1)
+			{
+				if (!(mask & 1))
+					continue;
+
+				// perspective correct texture coordinates from the barycentric weights
+				float b0 = (float)(e0 + step_x[0] * i - bias[0]);
+				float b1 = (float)(e1 + step_x[1] * i - bias[1]);
+				float b2 = (float)(e2 + step_x[2] * i - bias[2]);
+				float inv_w = b0 * triangle.invW[0] + b1 * triangle.invW[1] + b2 * triangle.invW[2];
+				glm::vec2 uv = (b0 * triangle.uvOverW[0] + b1 * triangle.uvOverW[1] + b2 * triangle.uvOverW[2]) / inv_w;
+
+				glm::vec4 color = Shade(draw, uv);
+				unsigned char* pixel = &m_color[((size_t)y * m_width + x + i) * 4];
+				for (int c = 0; c < 4; c++)
+					pixel[c] = (unsigned char)(glm::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+				depth_row[x + i] = z_lanes[i];
+			}
+
+			e0 += step_x[0] * 4;
+			e1 += step_x[1] * 4;
+			e2 += step_x[2] * 4;
+		}
+
+		row_start[0] += step_y[0];
+		row_start[1] += step_y[1];
+		row_start[2] += step_y[2];
+	}
+}
+
+glm::vec4 SoftwareRenderer::Shade(const DrawCall& draw, glm::vec2 uv) const
+{
+	// port of frag.glsl, variants without a diffuse map output the material color
+	const SoftwareTexture* texture = draw.texture;
+	if (!texture)
+		return glm::vec4(draw.materialColor, 1.0f);
+
+	// bilinear filtering with GL_REPEAT wrapping, rows are stored bottom up like the GL upload
+	float fx = (uv.x - std::floor(uv.x)) * texture->width - 0.5f;
+	float fy = (uv.y - std::floor(uv.y)) * texture->height - 0.5f;
+	int ix = (int)std::floor(fx);
+	int iy = (int)std::floor(fy);
+	float tx = fx - ix;
+	float ty = fy - iy;
+
+	glm::vec4 texels[4];
+	for (int j = 0; j < 4; j++)
+	{
+		int sx = ((ix + (j & 1)) % texture->width + texture->width) % texture->width;
+		int sy = ((iy + (j >> 1)) % texture->height + texture->height) % texture->height;
+		const unsigned char* p = &texture->pixels[((size_t)sy * texture->width + sx) * texture->components];
+
+		// channels expand like GL_RED / GL_RG / GL_RGB / GL_RGBA uploads
+		glm::vec4 texel = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		for (int c = 0; c < texture->components && c < 4; c++)
+			texel[c] = p[c] / 255.0f;
+		texels[j] = texel;
+	}
+	glm::vec4 tex_color = glm::mix(glm::mix(texels[0], texels[1], tx), glm::mix(texels[2], texels[3], tx), ty);
+
+	if (tex_color.a < 0.1f)
+		return glm::vec4(draw.materialColor, 1.0f);
+	return glm::vec4(glm::vec3(tex_color) * draw.materialColor, 1.0f);
+}
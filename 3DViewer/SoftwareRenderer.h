@@ -0,0 +1,142 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Mesh.h"
+
+// CPU rendering backend for machines without a usable GPU (CI, render farm nodes, golden images).
+// Mirrors the GL path of Model::Draw: meshes are transformed with the model/view/projection
+// matrices of vert.glsl and shaded with a port of frag.glsl (diffuse texture tinted by materialColor).
+//
+// Draws are only recorded by DrawMesh, Finish() then runs the frame in three parallel passes:
+// vertex transform, triangle setup with clipping and binning into 64x64 screen tiles, and tile
+// rasterization with SIMD edge functions and a depth test (GL_LESS). Each tile is owned by a
+// single worker and walks its bins in submission order, so the result does not depend on the
+// thread count. Meshes passed to DrawMesh must stay alive until Finish() returns.
+class SoftwareRenderer
+{
+public:
+	// Size is limited to 2048x2048 so fixed point edge functions fit in 32 bits
+	SoftwareRenderer(int width, int height, int threads = 0);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	int GetThreadCount() const { return m_jobs.GetThreadCount(); }
+
+	// Fills the color buffer and resets the depth buffer to 1.0
+	void Clear(const glm::vec4& color);
+
+	// Equivalent of the model/view/projection uniforms of vert.glsl, apply to the following draws
+	void SetModelMatrix(const glm::mat4& matrix) { m_model = matrix; }
+	void SetViewMatrix(const glm::mat4& matrix) { m_view = matrix; }
+	void SetProjectionMatrix(const glm::mat4& matrix) { m_projection = matrix; }
+	const glm::mat4& GetModelMatrix() const { return m_model; }
+
+	// Equivalent of the materialColor uniform of frag.glsl
+	void SetMaterialColor(const glm::vec3& color) { m_material_color = color; }
+
+	// Directory that mesh texture paths are relative to, set by Model::Draw
+	void SetTextureDirectory(const string& directory) { m_texture_directory = directory; }
+
+	// Records a draw of the mesh with the current state
+	void DrawMesh(const Mesh& mesh);
+
+	// Renders all recorded draws
+	void Finish();
+
+	// Drops decoded textures, e.g. after a model is done
+	void ClearTextureCache();
+
+	// RGBA8 color buffer, bottom row first like glReadPixels
+	const unsigned char* GetPixels() const { return m_color.data(); }
+
+	// Triangles that reached the rasterizer in the last Finish(), after clipping and culling of empty ones
+	size_t GetTriangleCount() const { return m_triangle_count; }
+
+private:
+	struct SoftwareTexture
+	{
+		std::vector<unsigned char> pixels;
+		int width = 0;
+		int height = 0;
+		int components = 0;
+	};
+
+	struct DrawCall
+	{
+		const Mesh* mesh;
+		glm::mat4 mvp;
+		glm::vec3 materialColor;
+		const SoftwareTexture* texture;
+		size_t firstVertex;
+	};
+
+	struct ClipVertex
+	{
+		glm::vec4 position;
+		glm::vec2 uv;
+	};
+
+	// Screen space triangle ready for rasterization, positions in 28.4 fixed point
+	struct RasterTriangle
+	{
+		int x[3], y[3];
+		float z[3];
+		float invW[3];
+		glm::vec2 uvOverW[3];
+		int minX, minY, maxX, maxY;
+		float invArea;
+		unsigned int draw;
+	};
+
+	// Triangles of a contiguous index range of one draw and their tile bins
+	struct SetupChunk
+	{
+		unsigned int draw;
+		size_t firstTriangle;
+		size_t triangleCount;
+		std::vector<RasterTriangle> triangles;
+		std::vector<std::vector<unsigned int>> bins;
+	};
+
+	const SoftwareTexture* GetTexture(const Mesh& mesh);
+	void SetupTriangles(SetupChunk& chunk);
+	void EmitTriangle(SetupChunk& chunk, const ClipVertex* v);
+	void RasterizeTile(int tile);
+	void RasterizeTriangle(const RasterTriangle& triangle, int tileX0, int tileY0, int tileX1, int tileY1);
+	glm::vec4 Shade(const DrawCall& draw, glm::vec2 uv) const;
+
+	int m_width;
+	int m_height;
+	int m_depth_stride;
+	int m_tiles_x;
+	int m_tiles_y;
+
+	std::vector<unsigned char> m_color;
+	std::vector<float> m_depth;
+
+	glm::mat4 m_model = glm::mat4(1.0f);
+	glm::mat4 m_view = glm::mat4(1.0f);
+	glm::mat4 m_projection = glm::mat4(1.0f);
+	glm::vec3 m_material_color = glm::vec3(0.0f);
+	string m_texture_directory = ".";
+
+	std::vector<DrawCall> m_draws;
+	std::vector<ClipVertex> m_clip_vertices;
+	std::vector<SetupChunk> m_chunks;
+	size_t m_triangle_count = 0;
+
+	std::unordered_map<string, std::unique_ptr<SoftwareTexture>> m_textures;
+
+	JobSystem m_jobs;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "SyntheticScene.h"
+
+#include <cmath>
+#include <cstdio>
+
+// Integer hash with good avalanche (lowbias32), the only source of randomness
+static unsigned int Hash(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Uniform float in [0, 1) from the top 24 bits, exact in single precision
+static float HashToFloat(unsigned int x)
+{
+	return (Hash(x) >> 8) * (1.0f / 16777216.0f);
+}
+
+static const float GRID_SPACING = 0.01f;
+static const float GRID_HEIGHT = 0.05f;
+
+static float GridHeight(unsigned int seed, unsigned int x, unsigned int z)
+{
+	return HashToFloat(seed ^ Hash(x * 0x9e3779b9u + Hash(z))) * GRID_HEIGHT;
+}
+
+static aiMesh* GenerateGrid(size_t triangles, unsigned int seed, float offsetX, unsigned int& columnsOut)
+{
+	size_t cells = (triangles + 1) / 2;
+	unsigned int columns = (unsigned int)std::sqrt((double)cells);
+	if (columns == 0)
+		columns = 1;
+	unsigned int rows = (unsigned int)((cells + columns - 1) / columns);
+	columnsOut = columns;
+
+	aiMesh* mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumVertices = (columns + 1) * (rows + 1);
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+	mesh->mTangents = new aiVector3D[mesh->mNumVertices];
+	mesh->mBitangents = new aiVector3D[mesh->mNumVertices];
+	mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+	mesh->mNumUVComponents[0] = 2;
+
+	for (unsigned int z = 0; z <= rows; z++)
+	{
+		for (unsigned int x = 0; x <= columns; x++)
+		{
+			unsigned int i = z * (columns + 1) + x;
+			mesh->mVertices[i] = aiVector3D(offsetX + x * GRID_SPACING, GridHeight(seed, x, z), z * GRID_SPACING);
+
+			// Central differences of the height field, clamped at the border
+			float left = GridHeight(seed, x > 0 ? x - 1 : x, z);
+			float right = GridHeight(seed, x < columns ? x + 1 : x, z);
+			float down = GridHeight(seed, x, z > 0 ? z - 1 : z);
+			float up = GridHeight(seed, x, z < rows ? z + 1 : z);
+			glm::vec3 normal = glm::normalize(glm::vec3(left - right, 2.0f * GRID_SPACING, down - up));
+			mesh->mNormals[i] = aiVector3D(normal.x, normal.y, normal.z);
+			mesh->mTangents[i] = aiVector3D(1.0f, 0.0f, 0.0f);
+			mesh->mBitangents[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+			mesh->mTextureCoords[0][i] = aiVector3D((float)x / columns, (float)z / rows, 0.0f);
+		}
+	}
+
+	mesh->mNumFaces = (unsigned int)triangles;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for (size_t t = 0; t < triangles; t++)
+	{
+		unsigned int cell = (unsigned int)(t / 2);
+		unsigned int x = cell % columns;
+		unsigned int z = cell / columns;
+		unsigned int v00 = z * (columns + 1) + x;
+		unsigned int v01 = v00 + 1;
+		unsigned int v10 = v00 + columns + 1;
+		unsigned int v11 = v10 + 1;
+
+		aiFace& face = mesh->mFaces[t];
+		face.mNumIndices = 3;
+		face.mIndices = new unsigned int[3];
+		if (t % 2 == 0)
+		{
+			face.mIndices[0] = v00;
+			face.mIndices[1] = v10;
+			face.mIndices[2] = v01;
+		}
+		else
+		{
+			face.mIndices[0] = v01;
+			face.mIndices[1] = v10;
+			face.mIndices[2] = v11;
+		}
+	}
+
+	return mesh;
+}
+
+aiScene* GenerateSyntheticScene(const SyntheticSceneDesc& desc)
+{
+	unsigned int meshCount = desc.meshes > 0 ? desc.meshes : 1;
+	unsigned int instanceCount = desc.instances > 0 ? desc.instances : 1;
+	unsigned int nodeCount = meshCount * instanceCount;
+
+	aiScene* scene = new aiScene();
+	unsigned int materialCount = desc.materials > 0 ? desc.materials : 1;
+	scene->mNumMaterials = materialCount;
+	scene->mMaterials = new aiMaterial*[materialCount];
+	for (unsigned int i = 0; i < materialCount; i++)
+		scene->mMaterials[i] = new aiMaterial();
+
+	scene->mNumMeshes = meshCount;
+	scene->mMeshes = new aiMesh*[meshCount];
+
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mName = aiString(std::string("synthetic"));
+	scene->mRootNode->mNumChildren = nodeCount;
+	scene->mRootNode->mChildren = new aiNode*[nodeCount];
+
+	float offsetX = 0.0f;
+	for (unsigned int i = 0; i < meshCount; i++)
+	{
+		// Spread the remainder over the first meshes so the total is exact
+		size_t triangles = desc.triangles / meshCount + (i < desc.triangles % meshCount ? 1 : 0);
+		unsigned int columns = 0;
+		aiMesh* mesh = GenerateGrid(triangles, Hash(desc.seed + i), offsetX, columns);
+		mesh->mName = aiString(std::string("grid") + std::to_string(i));
+		mesh->mMaterialIndex = i % materialCount;
+		scene->mMeshes[i] = mesh;
+		float width = (columns + 1) * GRID_SPACING;
+		offsetX += width;
+
+		for (unsigned int n = 0; n < instanceCount; n++)
+		{
+			aiNode* node = new aiNode();
+			node->mName = mesh->mName;
+			node->mParent = scene->mRootNode;
+			node->mNumMeshes = 1;
+			node->mMeshes = new unsigned int[1];
+			node->mMeshes[0] = i;
+			// the copies go one grid width apart along z
+			node->mTransformation.c4 = n * width;
+			scene->mRootNode->mChildren[i * instanceCount + n] = node;
+		}
+	}
+
+	return scene;
+}
+
+bool WriteSyntheticObj(const aiScene* scene, const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	fprintf(file, "# synthetic scene, %u meshes\n", scene->mNumMeshes);
+
+	// OBJ indices are global and 1-based
+	size_t firstVertex = 1;
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		fprintf(file, "o %s\n", mesh->mName.C_Str());
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+			fprintf(file, "v %.6f %.6f %.6f\n", mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+			fprintf(file, "vt %.6f %.6f\n", mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+			fprintf(file, "vn %.6f %.6f %.6f\n", mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+
+		for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+		{
+			const aiFace& face = mesh->mFaces[f];
+			fputc('f', file);
+			for (unsigned int j = 0; j < face.mNumIndices; j++)
+			{
+				size_t index = firstVertex + face.mIndices[j];
+				fprintf(file, " %zu/%zu/%zu", index, index, index);
+			}
+			fputc('\n', file);
+		}
+		firstVertex += mesh->mNumVertices;
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
+
+void GenerateSyntheticBoxes(size_t count, unsigned int seed, float halfSize, std::vector<glm::vec3>& boundsMin, std::vector<glm::vec3>& boundsMax)
+{
+	boundsMin.resize(count);
+	boundsMax.resize(count);
+
+	unsigned int base = Hash(seed);
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int key = base + (unsigned int)i * 4;
+		glm::vec3 center((HashToFloat(key) * 2.0f - 1.0f) * halfSize, (HashToFloat(key + 1) * 2.0f - 1.0f) * halfSize, (HashToFloat(key + 2) * 2.0f - 1.0f) * halfSize);
+		float extent = halfSize * (0.001f + 0.019f * HashToFloat(key + 3));
+		boundsMin[i] = center - glm::vec3(extent);
+		boundsMax[i] = center + glm::vec3(extent);
+	}
+}
+
+std::vector<unsigned char> GenerateSyntheticImage(int width, int height, int components, unsigned int seed)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * components);
+	unsigned int base = Hash(seed);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			bool checker = ((x / 32) + (y / 32)) % 2 == 0;
+			unsigned int noise = Hash(base + (unsigned int)(y * width + x));
+			unsigned char* pixel = &pixels[((size_t)y * width + x) * components];
+			for (int c = 0; c < components; c++)
+				pixel[c] = c == 3 ? 255 : (unsigned char)((checker ? 160 : 64) + ((noise >> (c * 8)) & 0x1f));
+		}
+	}
+
+	return pixels;
+}
@@ -0,0 +1,38 @@
+#ifndef SYNTHETIC_SCENE_H
+#define SYNTHETIC_SCENE_H
+
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Deterministic test content for benchmarks. The same description always produces the same data,
+// all randomness comes from an integer hash of the seed instead of rand() or std distributions.
+struct SyntheticSceneDesc
+{
+	// Total triangles over all meshes
+	size_t triangles = 1000000;
+	// Meshes the triangles are split into, each one a separate grid under the root node
+	unsigned int meshes = 1;
+	// Nodes placing every mesh, copies side by side like the repeated parts of an assembly
+	unsigned int instances = 1;
+	// Materials the meshes take in turn, all with the same values like the duplicates of a fragmented export
+	unsigned int materials = 1;
+	unsigned int seed = 1;
+};
+
+// Builds a scene of heightfield grid meshes with normals, texture coordinates and tangents, the
+// layout Assimp produces for an OBJ with aiProcess_CalcTangentSpace. Free it with delete.
+aiScene* GenerateSyntheticScene(const SyntheticSceneDesc& desc);
+
+// Writes the meshes of a generated scene as a Wavefront OBJ file for importer benchmarks
+bool WriteSyntheticObj(const aiScene* scene, const std::string& path);
+
+// Random axis aligned boxes in a cube of the given half size, sizes from 0.1% to 2% of the cube
+void GenerateSyntheticBoxes(size_t count, unsigned int seed, float halfSize, std::vector<glm::vec3>& boundsMin, std::vector<glm::vec3>& boundsMax);
+
+// RGB(A) image with a checker pattern and hashed noise, so compression and decoding are not trivial
+std::vector<unsigned char> GenerateSyntheticImage(int width, int height, int components, unsigned int seed);
+
+#endif
@@ -0,0 +1,345 @@
+#include "TextureCache.h"
+#include "GLUtils.h"
+#include "Logger.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Bump when the encoders change their output, old entries then simply miss
+static const uint32_t ENCODER_VERSION = 2;
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// VkFormat values and Khronos data format color models of the codecs
+enum
+{
+	VK_FORMAT_BC4_UNORM_BLOCK = 139,
+	VK_FORMAT_BC5_UNORM_BLOCK = 141,
+	VK_FORMAT_BC7_UNORM_BLOCK = 145,
+	VK_FORMAT_BC7_SRGB_BLOCK = 146,
+	KHR_DF_MODEL_BC4 = 131,
+	KHR_DF_MODEL_BC5 = 132,
+	KHR_DF_MODEL_BC7 = 134
+};
+
+// Follows the 12 byte identifier, the 64 bit fields sit at file offset 64 but only 4 byte aligned in the struct
+#pragma pack(push, 4)
+struct Ktx2Header
+{
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+#pragma pack(pop)
+static_assert(sizeof(Ktx2Header) == 68, "KTX2 header layout");
+
+struct Ktx2Level
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+static uint32_t GetVkFormat(const CompressedTexture& texture)
+{
+	switch (texture.codec)
+	{
+	case TEXTURE_CODEC_BC7:
+		return texture.srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+	case TEXTURE_CODEC_BC5:
+		return VK_FORMAT_BC5_UNORM_BLOCK;
+	case TEXTURE_CODEC_BC4:
+		return VK_FORMAT_BC4_UNORM_BLOCK;
+	default:
+		return 0;
+	}
+}
+
+static TextureCodec GetCodec(uint32_t vk_format)
+{
+	switch (vk_format)
+	{
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+		return TEXTURE_CODEC_BC7;
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+		return TEXTURE_CODEC_BC5;
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+		return TEXTURE_CODEC_BC4;
+	default:
+		return TEXTURE_CODEC_NONE;
+	}
+}
+
+static size_t GetLevelSize(TextureCodec codec, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(codec);
+}
+
+// Basic data format descriptor: one sample per stored channel covering the whole 4x4 block
+static std::vector<uint32_t> MakeDataFormatDescriptor(TextureCodec codec, bool srgb)
+{
+	struct Sample
+	{
+		uint32_t bitOffset;
+		uint32_t bitLength;
+		uint32_t channel;
+	};
+	std::vector<Sample> samples;
+	uint32_t model = 0;
+	if (codec == TEXTURE_CODEC_BC7)
+	{
+		model = KHR_DF_MODEL_BC7;
+		samples.push_back({ 0, 128, 0 });
+	}
+	else if (codec == TEXTURE_CODEC_BC5)
+	{
+		model = KHR_DF_MODEL_BC5;
+		samples.push_back({ 0, 64, 0 });
+		samples.push_back({ 64, 64, 1 });
+	}
+	else
+	{
+		model = KHR_DF_MODEL_BC4;
+		samples.push_back({ 0, 64, 0 });
+	}
+
+	uint32_t block_size = 24 + 16 * (uint32_t)samples.size();
+	std::vector<uint32_t> words;
+	words.push_back(4 + block_size);
+	// vendor 0 (Khronos), descriptor type 0 (basic)
+	words.push_back(0);
+	// version 2, block size
+	words.push_back(2 | (block_size << 16));
+	// color model, BT.709 primaries, linear or sRGB transfer, straight alpha
+	words.push_back(model | (1 << 8) | ((srgb ? 2 : 1) << 16));
+	// texel block 4x4x1x1, stored as dimension - 1
+	words.push_back(3 | (3 << 8));
+	// bytes per plane
+	words.push_back(GetBlockBytes(codec));
+	words.push_back(0);
+	for (const Sample& sample : samples)
+	{
+		words.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+		words.push_back(0);
+		words.push_back(0);
+		words.push_back(0xFFFFFFFF);
+	}
+	return words;
+}
+
+TextureCache& TextureCache::Get()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+void TextureCache::Init(bool enabled)
+{
+	m_bptc = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2) || HasGLExtension("GL_ARB_texture_compression_bptc");
+	m_enabled = enabled;
+
+	if (m_enabled)
+		LOG_INFO(LogCategory::Render, "Texture compression: BC4/BC5%s", m_bptc ? "/BC7" : ", color textures uncompressed (no BPTC)");
+}
+
+TextureCodec TextureCache::ChooseCodec(int components, bool normalMap) const
+{
+	TextureCodec codec = ChooseTextureCodec(components, normalMap);
+	if (!m_enabled || (codec == TEXTURE_CODEC_BC7 && !m_bptc))
+		return TEXTURE_CODEC_NONE;
+	return codec;
+}
+
+std::string TextureCache::GetPath(const std::string& path, const MipOptions& mipOptions) const
+{
+	std::error_code error;
+	uintmax_t size = fs::file_size(path, error);
+	if (error)
+		return std::string();
+	long long time = (long long)fs::last_write_time(path, error).time_since_epoch().count();
+
+	// FNV-1a over everything that changes the encoded result
+	char key_source[96];
+	snprintf(key_source, sizeof(key_source), "%u|%d|%d|%d|%llu|%lld|", ENCODER_VERSION, mipOptions.normalMap ? 1 : 0, mipOptions.srgb ? 1 : 0,
+		(int)mipOptions.filter, (unsigned long long)size, time);
+	uint64_t hash = 14695981039346656037ull;
+	for (const char* c = key_source; *c; c++)
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+	for (unsigned char c : fs::absolute(path, error).lexically_normal().string())
+		hash = (hash ^ c) * 1099511628211ull;
+
+	fs::path source(path);
+	char name[32];
+	snprintf(name, sizeof(name), "_%016llx.ktx2", (unsigned long long)hash);
+	return (source.parent_path() / "texcache" / (source.stem().string() + name)).string();
+}
+
+bool TextureCache::Load(const std::string& path, const MipOptions& mipOptions, CompressedTexture& texture)
+{
+	if (!m_enabled)
+		return false;
+
+	std::string cache_path = GetPath(path, mipOptions);
+	if (cache_path.empty() || !fs::exists(cache_path))
+	{
+		m_misses++;
+		return false;
+	}
+
+	if (!ReadKtx2(cache_path, texture) || (texture.codec == TEXTURE_CODEC_BC7 && !m_bptc))
+	{
+		LOG_WARNING(LogCategory::Model, "Texture cache entry rejected, encoding again: %s", cache_path);
+		std::error_code error;
+		fs::remove(cache_path, error);
+		m_misses++;
+		return false;
+	}
+
+	m_hits++;
+	return true;
+}
+
+void TextureCache::Store(const std::string& path, const MipOptions& mipOptions, const CompressedTexture& texture)
+{
+	std::string cache_path = GetPath(path, mipOptions);
+	if (!m_enabled || cache_path.empty() || texture.levels.empty())
+		return;
+
+	std::error_code error;
+	fs::create_directories(fs::path(cache_path).parent_path(), error);
+
+	// Written under a temporary name and renamed, loader threads never see half a file
+	std::string temp_path = cache_path + ".tmp";
+	if (!WriteKtx2(temp_path, texture))
+	{
+		LOG_WARNING(LogCategory::Model, "Texture cache not writable: %s", cache_path);
+		fs::remove(temp_path, error);
+		return;
+	}
+	fs::rename(temp_path, cache_path, error);
+	if (error)
+		fs::remove(temp_path, error);
+}
+
+bool TextureCache::WriteKtx2(const std::string& path, const CompressedTexture& texture)
+{
+	uint32_t vk_format = GetVkFormat(texture);
+	if (vk_format == 0 || texture.levels.empty())
+		return false;
+
+	std::vector<uint32_t> dfd = MakeDataFormatDescriptor(texture.codec, texture.srgb);
+	uint32_t level_count = (uint32_t)texture.levels.size();
+
+	Ktx2Header header = {};
+	header.vkFormat = vk_format;
+	header.typeSize = 1;
+	header.pixelWidth = texture.levels[0].width;
+	header.pixelHeight = texture.levels[0].height;
+	header.faceCount = 1;
+	header.levelCount = level_count;
+	header.dfdByteOffset = (uint32_t)(sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header) + level_count * sizeof(Ktx2Level));
+	header.dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t));
+
+	// Mip data follows the descriptor, smallest level first, every level aligned to the block size
+	uint64_t alignment = GetBlockBytes(texture.codec);
+	uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+	std::vector<Ktx2Level> levels(level_count);
+	for (int i = (int)level_count - 1; i >= 0; i--)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		levels[i].byteOffset = offset;
+		levels[i].byteLength = texture.levels[i].data.size();
+		levels[i].uncompressedByteLength = levels[i].byteLength;
+		offset += levels[i].byteLength;
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool ok = fwrite(KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER), 1, file) == 1 && fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(levels.data(), sizeof(Ktx2Level), level_count, file) == level_count &&
+		fwrite(dfd.data(), sizeof(uint32_t), dfd.size(), file) == dfd.size();
+
+	static const unsigned char padding[16] = {};
+	long position = ftell(file);
+	for (int i = (int)level_count - 1; i >= 0 && ok; i--)
+	{
+		long pad = (long)levels[i].byteOffset - position;
+		ok = (pad == 0 || fwrite(padding, 1, pad, file) == (size_t)pad) &&
+			fwrite(texture.levels[i].data.data(), 1, texture.levels[i].data.size(), file) == texture.levels[i].data.size();
+		position = (long)(levels[i].byteOffset + levels[i].byteLength);
+	}
+	return fclose(file) == 0 && ok;
+}
+
+bool TextureCache::ReadKtx2(const std::string& path, CompressedTexture& texture)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file)
+		return false;
+
+	unsigned char identifier[sizeof(KTX2_IDENTIFIER)];
+	Ktx2Header header;
+	bool ok = fread(identifier, sizeof(identifier), 1, file) == 1 && memcmp(identifier, KTX2_IDENTIFIER, sizeof(identifier)) == 0 &&
+		fread(&header, sizeof(header), 1, file) == 1;
+
+	// Only what WriteKtx2 produces: one 2D image, no supercompression
+	texture.codec = ok ? GetCodec(header.vkFormat) : TEXTURE_CODEC_NONE;
+	texture.srgb = ok && header.vkFormat == VK_FORMAT_BC7_SRGB_BLOCK;
+	ok = ok && texture.codec != TEXTURE_CODEC_NONE && header.pixelDepth == 0 && header.layerCount == 0 && header.faceCount == 1 &&
+		header.supercompressionScheme == 0 && header.levelCount > 0 && header.levelCount <= 32 && header.pixelWidth > 0 && header.pixelHeight > 0;
+
+	std::vector<Ktx2Level> levels;
+	if (ok)
+	{
+		levels.resize(header.levelCount);
+		ok = fread(levels.data(), sizeof(Ktx2Level), levels.size(), file) == levels.size();
+	}
+
+	texture.levels.clear();
+	int width = (int)header.pixelWidth;
+	int height = (int)header.pixelHeight;
+	for (size_t i = 0; ok && i < levels.size(); i++)
+	{
+		CompressedLevel level;
+		level.width = width;
+		level.height = height;
+		size_t size = GetLevelSize(texture.codec, width, height);
+		ok = levels[i].byteLength == size && fseek(file, (long)levels[i].byteOffset, SEEK_SET) == 0;
+		if (ok)
+		{
+			level.data.resize(size);
+			ok = fread(level.data.data(), 1, size, file) == size;
+		}
+		texture.levels.push_back(std::move(level));
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	fclose(file);
+
+	if (!ok)
+		texture.levels.clear();
+	return ok;
+}
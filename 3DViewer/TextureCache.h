@@ -0,0 +1,58 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "TextureCompressor.h"
+
+#include <atomic>
+#include <string>
+
+// Block compressed textures stored as KTX2 files in a texcache/ folder next to the model, so the
+// encoder runs once per texture instead of on every load. An entry is named after a hash of the
+// source path, its size and modification time, the mip options and the encoder version, an edited
+// image misses the cache and is encoded again.
+// Textures are only compressed when the GL context can sample the codec: BC4/BC5 (RGTC) are core
+// in GL 3.0, BC7 (BPTC) needs GL 4.2 or ARB_texture_compression_bptc. Others stay uncompressed.
+class TextureCache
+{
+public:
+	static TextureCache& Get();
+
+	// Checks which codecs the current context supports, needs to run on the GL thread
+	void Init(bool enabled = true);
+
+	bool IsEnabled() const { return m_enabled; }
+
+	// Whether the context samples BC7, known after Init even with compression disabled
+	bool SupportsBptc() const { return m_bptc; }
+
+	// Codec for a texture with this many channels, NONE if the context can't sample it
+	TextureCodec ChooseCodec(int components, bool normalMap) const;
+
+	// Looks up the compressed version of image file path with its mips generated with mipOptions,
+	// safe to call from loader threads
+	bool Load(const std::string& path, const MipOptions& mipOptions, CompressedTexture& texture);
+
+	// Writes texture for image file path
+	void Store(const std::string& path, const MipOptions& mipOptions, const CompressedTexture& texture);
+
+	int GetHits() const { return m_hits; }
+	int GetMisses() const { return m_misses; }
+
+	// KTX2 with the Khronos data format descriptor of the codec, no supercompression
+	static bool WriteKtx2(const std::string& path, const CompressedTexture& texture);
+	static bool ReadKtx2(const std::string& path, CompressedTexture& texture);
+
+private:
+	TextureCache() = default;
+
+	// empty if the source file doesn't exist
+	std::string GetPath(const std::string& path, const MipOptions& mipOptions) const;
+
+	bool m_enabled = false;
+	bool m_bptc = false;
+
+	std::atomic<int> m_hits{ 0 };
+	std::atomic<int> m_misses{ 0 };
+};
+
+#endif
@@ -0,0 +1,551 @@
+#include "TextureCompressor.h"
+#include "MipGenerator.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Interpolation weights of 4 bit BC7 indices, out of 64
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+size_t CompressedTexture::GetSize() const
+{
+	size_t size = 0;
+	for (const CompressedLevel& level : levels)
+		size += level.data.size();
+	return size;
+}
+
+int GetBlockBytes(TextureCodec codec)
+{
+	switch (codec)
+	{
+	case TEXTURE_CODEC_BC7:
+	case TEXTURE_CODEC_BC5:
+		return 16;
+	case TEXTURE_CODEC_BC4:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+TextureCodec ChooseTextureCodec(int components, bool normalMap)
+{
+	if (components == 1)
+		return TEXTURE_CODEC_BC4;
+	if (components == 2 || normalMap)
+		return TEXTURE_CODEC_BC5;
+	return TEXTURE_CODEC_BC7;
+}
+
+// Writes values LSB first into a block, the bit order of all BC formats
+struct BlockWriter
+{
+	unsigned char* bytes;
+	int position = 0;
+
+	void Write(unsigned int value, int bits)
+	{
+		for (int i = 0; i < bits; i++, position++)
+		{
+			if (value & (1u << i))
+				bytes[position >> 3] |= (unsigned char)(1 << (position & 7));
+		}
+	}
+};
+
+struct BlockReader
+{
+	const unsigned char* bytes;
+	int position = 0;
+
+	unsigned int Read(int bits)
+	{
+		unsigned int value = 0;
+		for (int i = 0; i < bits; i++, position++)
+			value |= ((bytes[position >> 3] >> (position & 7)) & 1u) << i;
+		return value;
+	}
+};
+
+// 7 bit endpoint plus the shared p-bit, expands to 8 bits as (value << 1) | p
+struct Bc7Endpoints
+{
+	int color[2][4];
+	int pbit[2];
+};
+
+static void QuantizeEndpoint(const float color[4], int quantized[4], int& pbit)
+{
+	float best_error = 1e30f;
+	for (int p = 0; p < 2; p++)
+	{
+		int candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			candidate[c] = std::min(127, std::max(0, (int)std::lround((color[c] - p) * 0.5f)));
+			float difference = (float)((candidate[c] << 1) | p) - color[c];
+			error += difference * difference;
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			pbit = p;
+			memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+// Picks the best index for every texel, returns the squared error of the block
+static int FitBc7Indices(const unsigned char rgba[64], const Bc7Endpoints& endpoints, int indices[16])
+{
+	int palette[16][4];
+	for (int c = 0; c < 4; c++)
+	{
+		int e0 = (endpoints.color[0][c] << 1) | endpoints.pbit[0];
+		int e1 = (endpoints.color[1][c] << 1) | endpoints.pbit[1];
+		for (int i = 0; i < 16; i++)
+			palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * e0 + BC7_WEIGHTS4[i] * e1 + 32) >> 6;
+	}
+
+	// Projecting onto the endpoint line gives the index to within one step, only its neighbours are compared
+	float direction[4];
+	float length_squared = 0.0f;
+	for (int c = 0; c < 4; c++)
+	{
+		direction[c] = (float)(palette[15][c] - palette[0][c]);
+		length_squared += direction[c] * direction[c];
+	}
+	float scale = length_squared > 0.0f ? 15.0f / length_squared : 0.0f;
+
+	int total = 0;
+	for (int t = 0; t < 16; t++)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < 4; c++)
+			projection += (rgba[t * 4 + c] - palette[0][c]) * direction[c];
+		int estimate = std::min(15, std::max(0, (int)std::lround(projection * scale)));
+
+		int best = 0;
+		int best_error = 1 << 30;
+		for (int i = std::max(0, estimate - 1); i <= std::min(15, estimate + 1); i++)
+		{
+			int error = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				int difference = palette[i][c] - rgba[t * 4 + c];
+				error += difference * difference;
+			}
+			if (error < best_error)
+			{
+				best_error = error;
+				best = i;
+			}
+		}
+		indices[t] = best;
+		total += best_error;
+	}
+	return total;
+}
+
+static void MakeBc7Endpoints(const float e0[4], const float e1[4], Bc7Endpoints& endpoints)
+{
+	float clamped[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		clamped[0][c] = std::min(255.0f, std::max(0.0f, e0[c]));
+		clamped[1][c] = std::min(255.0f, std::max(0.0f, e1[c]));
+	}
+	QuantizeEndpoint(clamped[0], endpoints.color[0], endpoints.pbit[0]);
+	QuantizeEndpoint(clamped[1], endpoints.color[1], endpoints.pbit[1]);
+}
+
+void EncodeBlockBC7(const unsigned char rgba[64], unsigned char out[16])
+{
+	// Endpoints on the principal axis of the colors, through their extremes
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int t = 0; t < 16; t++)
+		for (int c = 0; c < 4; c++)
+			mean[c] += rgba[t * 4 + c] / 16.0f;
+
+	float covariance[4][4] = {};
+	for (int t = 0; t < 16; t++)
+	{
+		float d[4];
+		for (int c = 0; c < 4; c++)
+			d[c] = rgba[t * 4 + c] - mean[c];
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				covariance[i][j] += d[i] * d[j];
+	}
+
+	// power iteration, a few steps are plenty for 16 points
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				next[i] += covariance[i][j] * axis[j];
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f)
+			break;
+		for (int i = 0; i < 4; i++)
+			axis[i] = next[i] / length;
+	}
+
+	float min_t = 0.0f, max_t = 0.0f;
+	for (int t = 0; t < 16; t++)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < 4; c++)
+			projection += (rgba[t * 4 + c] - mean[c]) * axis[c];
+		min_t = std::min(min_t, projection);
+		max_t = std::max(max_t, projection);
+	}
+
+	float e0[4], e1[4];
+	for (int c = 0; c < 4; c++)
+	{
+		e0[c] = mean[c] + axis[c] * min_t;
+		e1[c] = mean[c] + axis[c] * max_t;
+	}
+
+	Bc7Endpoints best;
+	int best_indices[16];
+	MakeBc7Endpoints(e0, e1, best);
+	int best_error = FitBc7Indices(rgba, best, best_indices);
+
+	// Least squares refit of the endpoints to the chosen indices, kept when it lowers the error
+	for (int iteration = 0; iteration < 2 && best_error > 0; iteration++)
+	{
+		float a = 0.0f, b = 0.0f, d = 0.0f;
+		float x0[4] = {}, x1[4] = {};
+		for (int t = 0; t < 16; t++)
+		{
+			float w = BC7_WEIGHTS4[best_indices[t]] / 64.0f;
+			a += (1.0f - w) * (1.0f - w);
+			b += (1.0f - w) * w;
+			d += w * w;
+			for (int c = 0; c < 4; c++)
+			{
+				x0[c] += (1.0f - w) * rgba[t * 4 + c];
+				x1[c] += w * rgba[t * 4 + c];
+			}
+		}
+		float determinant = a * d - b * b;
+		if (std::fabs(determinant) < 1e-6f)
+			break;
+		for (int c = 0; c < 4; c++)
+		{
+			e0[c] = (d * x0[c] - b * x1[c]) / determinant;
+			e1[c] = (a * x1[c] - b * x0[c]) / determinant;
+		}
+
+		Bc7Endpoints refit;
+		int indices[16];
+		MakeBc7Endpoints(e0, e1, refit);
+		int error = FitBc7Indices(rgba, refit, indices);
+		if (error >= best_error)
+			break;
+		best = refit;
+		best_error = error;
+		memcpy(best_indices, indices, sizeof(indices));
+	}
+
+	// The first index is stored with 3 bits, its top bit has to be 0: swap the endpoints if it isn't
+	if (best_indices[0] >= 8)
+	{
+		for (int c = 0; c < 4; c++)
+			std::swap(best.color[0][c], best.color[1][c]);
+		std::swap(best.pbit[0], best.pbit[1]);
+		for (int t = 0; t < 16; t++)
+			best_indices[t] = 15 - best_indices[t];
+	}
+
+	memset(out, 0, 16);
+	BlockWriter writer = { out };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writer.Write(best.color[0][c], 7);
+		writer.Write(best.color[1][c], 7);
+	}
+	writer.Write(best.pbit[0], 1);
+	writer.Write(best.pbit[1], 1);
+	writer.Write(best_indices[0], 3);
+	for (int t = 1; t < 16; t++)
+		writer.Write(best_indices[t], 4);
+}
+
+void DecodeBlockBC7(const unsigned char block[16], unsigned char rgba[64])
+{
+	BlockReader reader = { block };
+	if (reader.Read(7) != (1 << 6))
+	{
+		for (int t = 0; t < 16; t++)
+		{
+			rgba[t * 4 + 0] = 255;
+			rgba[t * 4 + 1] = 0;
+			rgba[t * 4 + 2] = 255;
+			rgba[t * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	int color[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		color[0][c] = reader.Read(7);
+		color[1][c] = reader.Read(7);
+	}
+	int pbit0 = reader.Read(1);
+	int pbit1 = reader.Read(1);
+	for (int t = 0; t < 16; t++)
+	{
+		int index = reader.Read(t == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = (color[0][c] << 1) | pbit0;
+			int e1 = (color[1][c] << 1) | pbit1;
+			rgba[t * 4 + c] = (unsigned char)(((64 - BC7_WEIGHTS4[index]) * e0 + BC7_WEIGHTS4[index] * e1 + 32) >> 6);
+		}
+	}
+}
+
+// The 8 value palette of a BC4 block with r0 > r1, or the 6 value one with 0 and 255 otherwise
+static void Bc4Palette(int r0, int r1, int palette[8])
+{
+	palette[0] = r0;
+	palette[1] = r1;
+	if (r0 > r1)
+	{
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+void EncodeBlockBC4(const unsigned char values[16], unsigned char out[8])
+{
+	int low = 255, high = 0;
+	for (int t = 0; t < 16; t++)
+	{
+		low = std::min(low, (int)values[t]);
+		high = std::max(high, (int)values[t]);
+	}
+
+	memset(out, 0, 8);
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+	// a flat block decodes from the first endpoint with all indices 0
+	if (high == low)
+		return;
+
+	int palette[8];
+	Bc4Palette(high, low, palette);
+	BlockWriter writer = { out, 16 };
+	for (int t = 0; t < 16; t++)
+	{
+		int best = 0;
+		int best_error = 1 << 30;
+		for (int i = 0; i < 8; i++)
+		{
+			int error = std::abs(palette[i] - values[t]);
+			if (error < best_error)
+			{
+				best_error = error;
+				best = i;
+			}
+		}
+		writer.Write(best, 3);
+	}
+}
+
+static void DecodeBc4Channel(const unsigned char block[8], unsigned char* rgba, int channel)
+{
+	int palette[8];
+	Bc4Palette(block[0], block[1], palette);
+	BlockReader reader = { block, 16 };
+	for (int t = 0; t < 16; t++)
+		rgba[t * 4 + channel] = (unsigned char)palette[reader.Read(3)];
+}
+
+void DecodeBlockBC4(const unsigned char block[8], unsigned char rgba[64])
+{
+	memset(rgba, 0, 64);
+	for (int t = 0; t < 16; t++)
+		rgba[t * 4 + 3] = 255;
+	DecodeBc4Channel(block, rgba, 0);
+}
+
+void EncodeBlockBC5(const unsigned char rg[32], unsigned char out[16])
+{
+	unsigned char red[16], green[16];
+	for (int t = 0; t < 16; t++)
+	{
+		red[t] = rg[t * 2];
+		green[t] = rg[t * 2 + 1];
+	}
+	EncodeBlockBC4(red, out);
+	EncodeBlockBC4(green, out + 8);
+}
+
+void DecodeBlockBC5(const unsigned char block[16], unsigned char rgba[64])
+{
+	memset(rgba, 0, 64);
+	for (int t = 0; t < 16; t++)
+		rgba[t * 4 + 3] = 255;
+	DecodeBc4Channel(block, rgba, 0);
+	DecodeBc4Channel(block + 8, rgba, 1);
+}
+
+void DownsampleImage(const std::vector<unsigned char>& source, int width, int height, std::vector<unsigned char>& target, int target_width, int target_height)
+{
+	target.resize((size_t)target_width * target_height * 4);
+	for (int y = 0; y < target_height; y++)
+	{
+		int y0 = std::min(y * 2, height - 1);
+		int y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < target_width; x++)
+		{
+			int x0 = std::min(x * 2, width - 1);
+			int x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = source[((size_t)y0 * width + x0) * 4 + c] + source[((size_t)y0 * width + x1) * 4 + c] +
+					source[((size_t)y1 * width + x0) * 4 + c] + source[((size_t)y1 * width + x1) * 4 + c];
+				target[((size_t)y * target_width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+static void EncodeLevel(const std::vector<unsigned char>& rgba, int width, int height, TextureCodec codec, CompressedLevel& level, JobSystem& jobs)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	int block_bytes = GetBlockBytes(codec);
+	level.width = width;
+	level.height = height;
+	level.data.resize((size_t)blocks_x * blocks_y * block_bytes);
+
+	jobs.ParallelFor(blocks_y, 4, [&](int begin, int end) {
+		unsigned char texels[64];
+		unsigned char channels[32];
+		for (int by = begin; by < end; by++)
+		{
+			for (int bx = 0; bx < blocks_x; bx++)
+			{
+				// blocks over the edge of small levels repeat the last texels
+				for (int t = 0; t < 16; t++)
+				{
+					int x = std::min(bx * 4 + (t & 3), width - 1);
+					int y = std::min(by * 4 + (t >> 2), height - 1);
+					memcpy(&texels[t * 4], &rgba[((size_t)y * width + x) * 4], 4);
+				}
+
+				unsigned char* out = &level.data[((size_t)by * blocks_x + bx) * block_bytes];
+				if (codec == TEXTURE_CODEC_BC7)
+					EncodeBlockBC7(texels, out);
+				else if (codec == TEXTURE_CODEC_BC5)
+				{
+					for (int t = 0; t < 16; t++)
+					{
+						channels[t * 2] = texels[t * 4];
+						channels[t * 2 + 1] = texels[t * 4 + 1];
+					}
+					EncodeBlockBC5(channels, out);
+				}
+				else
+				{
+					for (int t = 0; t < 16; t++)
+						channels[t] = texels[t * 4];
+					EncodeBlockBC4(channels, out);
+				}
+			}
+		}
+	});
+}
+
+void ExpandToRgba(const unsigned char* pixels, int width, int height, int components, std::vector<unsigned char>& rgba)
+{
+	rgba.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < (size_t)width * height; i++)
+	{
+		unsigned char texel[4] = { 0, 0, 0, 255 };
+		for (int c = 0; c < components && c < 4; c++)
+			texel[c] = pixels[i * components + c];
+		memcpy(&rgba[i * 4], texel, 4);
+	}
+}
+
+void CompressImage(const unsigned char* pixels, int width, int height, int components, TextureCodec codec, CompressedTexture& out, int threads,
+	const MipOptions& mipOptions)
+{
+	out.codec = codec;
+	out.srgb = codec == TEXTURE_CODEC_BC7 && mipOptions.srgb && components >= 3;
+	out.levels.clear();
+	if (!pixels || width <= 0 || height <= 0 || codec == TEXTURE_CODEC_NONE)
+		return;
+
+	std::vector<MipLevel> mips;
+	GenerateMipChain(pixels, width, height, components, mipOptions, mips, threads);
+
+	std::unique_ptr<JobSystem> own_jobs;
+	if (threads > 0)
+		own_jobs = std::make_unique<JobSystem>(threads);
+	JobSystem& jobs = own_jobs ? *own_jobs : JobSystem::Get();
+	std::vector<unsigned char> rgba;
+	for (size_t level = 0; level <= mips.size(); level++)
+	{
+		const unsigned char* source = level == 0 ? pixels : mips[level - 1].data.data();
+		int level_width = level == 0 ? width : mips[level - 1].width;
+		int level_height = level == 0 ? height : mips[level - 1].height;
+		ExpandToRgba(source, level_width, level_height, components, rgba);
+
+		out.levels.emplace_back();
+		EncodeLevel(rgba, level_width, level_height, codec, out.levels.back(), jobs);
+	}
+}
+
+void DecompressLevel(const CompressedTexture& texture, int level, std::vector<unsigned char>& rgba)
+{
+	const CompressedLevel& source = texture.levels[level];
+	int blocks_x = (source.width + 3) / 4;
+	int blocks_y = (source.height + 3) / 4;
+	int block_bytes = GetBlockBytes(texture.codec);
+	rgba.resize((size_t)source.width * source.height * 4);
+
+	unsigned char texels[64];
+	for (int by = 0; by < blocks_y; by++)
+	{
+		for (int bx = 0; bx < blocks_x; bx++)
+		{
+			const unsigned char* block = &source.data[((size_t)by * blocks_x + bx) * block_bytes];
+			if (texture.codec == TEXTURE_CODEC_BC7)
+				DecodeBlockBC7(block, texels);
+			else if (texture.codec == TEXTURE_CODEC_BC5)
+				DecodeBlockBC5(block, texels);
+			else
+				DecodeBlockBC4(block, texels);
+
+			for (int t = 0; t < 16; t++)
+			{
+				int x = bx * 4 + (t & 3);
+				int y = by * 4 + (t >> 2);
+				if (x < source.width && y < source.height)
+					memcpy(&rgba[((size_t)y * source.width + x) * 4], &texels[t * 4], 4);
+			}
+		}
+	}
+}
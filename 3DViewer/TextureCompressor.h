@@ -0,0 +1,72 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include "MipGenerator.h"
+
+#include <cstddef>
+#include <vector>
+
+// CPU block compression of textures, so they stay compressed in VRAM.
+//   BC7  color textures, 1 byte per pixel instead of 3-4. Only mode 6 (one subset, RGBA endpoints,
+//        4 bit indices) is produced, a fraction of the search of a full encoder at a small quality cost.
+//   BC5  two channel data like tangent space normal maps (X and Y, Z is reconstructed), 1 byte per pixel
+//   BC4  single channel data like height or specular maps, half a byte per pixel
+// Nothing here needs GL, the encoders and the reference decoders run and can be measured without a context.
+enum TextureCodec
+{
+	TEXTURE_CODEC_NONE,
+	TEXTURE_CODEC_BC7,
+	TEXTURE_CODEC_BC5,
+	TEXTURE_CODEC_BC4
+};
+
+struct CompressedLevel
+{
+	int width = 0;
+	int height = 0;
+	std::vector<unsigned char> data;
+};
+
+// A compressed texture with its whole mip chain, level 0 first
+struct CompressedTexture
+{
+	TextureCodec codec = TEXTURE_CODEC_NONE;
+	// BC7 of sRGB encoded color, uploaded as GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+	bool srgb = false;
+	std::vector<CompressedLevel> levels;
+
+	size_t GetSize() const;
+};
+
+// Bytes of one 4x4 block
+int GetBlockBytes(TextureCodec codec);
+
+// Codec for an image with this many channels. normalMap keeps only X and Y of 3-4 channel images.
+TextureCodec ChooseTextureCodec(int components, bool normalMap);
+
+// Block encoders, the input is the 4x4 block in rows. BC7 takes RGBA, BC5 takes the two channels interleaved.
+void EncodeBlockBC7(const unsigned char rgba[64], unsigned char out[16]);
+void EncodeBlockBC5(const unsigned char rg[32], unsigned char out[16]);
+void EncodeBlockBC4(const unsigned char values[16], unsigned char out[8]);
+
+// Block decoders writing RGBA, channels the codec doesn't store are 0 (alpha 255) like the GL formats.
+// Only decodes what the encoders produce: BC7 blocks of other modes than 6 come out magenta.
+void DecodeBlockBC7(const unsigned char block[16], unsigned char rgba[64]);
+void DecodeBlockBC5(const unsigned char block[16], unsigned char rgba[64]);
+void DecodeBlockBC4(const unsigned char block[8], unsigned char rgba[64]);
+
+// Halves an RGBA8 image with a 2x2 box filter, odd edges repeat their last row/column
+void DownsampleImage(const std::vector<unsigned char>& source, int width, int height, std::vector<unsigned char>& target, int target_width, int target_height);
+
+// Expands 8 bit pixels with 1-4 components to RGBA like the GL upload of GL_RED/GL_RG/GL_RGB data
+void ExpandToRgba(const unsigned char* pixels, int width, int height, int components, std::vector<unsigned char>& rgba);
+
+// Generates the mip chain of an 8 bit image with 1-4 components with GenerateMipChain and encodes every
+// level with codec. threads counts the calling thread, 0 runs on the shared JobSystem::Get().
+void CompressImage(const unsigned char* pixels, int width, int height, int components, TextureCodec codec, CompressedTexture& out, int threads = 0,
+	const MipOptions& mipOptions = MipOptions());
+
+// Decodes one level back to RGBA8, to check the encoders
+void DecompressLevel(const CompressedTexture& texture, int level, std::vector<unsigned char>& rgba);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// C++ mirrors of the std140 uniform blocks declared in vert.glsl. Members are ordered so the
+// natural C++ layout equals the std140 one (mat4 and vec4 are 16 byte aligned in std140),
+// the static_asserts below catch any member that breaks this.
+
+// Binding points, assigned to the blocks by Shader after linking (GLSL 330 has no layout(binding))
+enum UniformBinding
+{
+	FRAME_UNIFORMS_BINDING = 0,
+	OBJECT_UNIFORMS_BINDING = 1,
+	INSTANCE_UNIFORMS_BINDING = 2
+};
+
+// Instances of one instanced draw, the array size of InstanceUniforms in vert.glsl. 4 KB, well within
+// the 16 KB every GL 3.3 driver allows per block.
+static const int MAX_INSTANCES_PER_DRAW = 64;
+
+// Written once per frame
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	// xyz = camera position, w unused (a vec3 would be padded to 16 bytes anyway)
+	glm::vec4 cameraPosition;
+};
+
+// Written once per drawn object
+struct ObjectUniforms
+{
+	glm::mat4 model;
+};
+
+// Written once per instanced draw, entry gl_InstanceID is the model matrix of an instance. Always
+// pushed whole: the bound range has to cover the block even when fewer instances are drawn.
+struct InstanceUniforms
+{
+	glm::mat4 models[MAX_INSTANCES_PER_DRAW];
+};
+
+inline FrameUniforms MakeFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& camera_position)
+{
+	FrameUniforms uniforms;
+	uniforms.view = view;
+	uniforms.projection = projection;
+	uniforms.viewProjection = projection * view;
+	uniforms.cameraPosition = glm::vec4(camera_position, 1.0f);
+	return uniforms;
+}
+
+static_assert(offsetof(FrameUniforms, view) == 0, "FrameUniforms does not match the std140 layout");
+static_assert(offsetof(FrameUniforms, projection) == 64, "FrameUniforms does not match the std140 layout");
+static_assert(offsetof(FrameUniforms, viewProjection) == 128, "FrameUniforms does not match the std140 layout");
+static_assert(offsetof(FrameUniforms, cameraPosition) == 192, "FrameUniforms does not match the std140 layout");
+static_assert(sizeof(FrameUniforms) == 208, "FrameUniforms does not match the std140 layout");
+
+static_assert(offsetof(ObjectUniforms, model) == 0, "ObjectUniforms does not match the std140 layout");
+static_assert(sizeof(ObjectUniforms) == 64, "ObjectUniforms does not match the std140 layout");
+
+static_assert(sizeof(InstanceUniforms) == 64 * MAX_INSTANCES_PER_DRAW, "InstanceUniforms does not match the std140 layout");
+
+#endif
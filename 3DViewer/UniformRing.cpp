@@ -0,0 +1,142 @@
+#include "UniformRing.h"
+#include "GLUtils.h"
+#include "Logger.h"
+#include "MemoryTracker.h"
+
+#include <chrono>
+#include <cstring>
+
+bool UniformRing::Create(GLsizeiptr frame_capacity, GLADloadproc loader)
+{
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment > 0)
+		m_alignment = alignment;
+
+	m_buffer_storage = LoadBufferStorage(loader);
+
+	m_memory_owner = MemoryTracker::Get().AddOwner("Uniform ring");
+	Allocate(frame_capacity);
+
+	LOG_INFO(LogCategory::Render, "Uniform ring: %lld bytes x %d frames, %s", (long long)m_capacity, FRAMES_IN_FLIGHT,
+		IsPersistent() ? "persistently mapped" : "glBufferSubData");
+	return m_buffer != 0;
+}
+
+void UniformRing::Allocate(GLsizeiptr frame_capacity)
+{
+	m_capacity = (frame_capacity + m_alignment - 1) / m_alignment * m_alignment;
+	GLsizeiptr size = m_capacity * FRAMES_IN_FLIGHT;
+
+	m_buffer = CreateMappedBuffer(GL_UNIFORM_BUFFER, size, m_buffer_storage, GL_DYNAMIC_DRAW, &m_mapped);
+	if (m_buffer_storage && !m_mapped)
+	{
+		// later reallocations don't try again
+		LOG_WARNING(LogCategory::Render, "ERROR::UNIFORM_RING::PERSISTENT_MAP_FAILED");
+		m_buffer_storage = nullptr;
+	}
+	MemoryTracker::Get().Set(m_memory_owner, MEMORY_GPU_BUFFER, (size_t)size);
+}
+
+void UniformRing::Release(bool retire)
+{
+	if (m_mapped)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		m_mapped = nullptr;
+	}
+
+	if (m_buffer && retire)
+		m_retired.push_back(m_buffer);
+	else if (m_buffer)
+		glDeleteBuffers(1, &m_buffer);
+	m_buffer = 0;
+
+	for (GLsync& fence : m_fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+void UniformRing::BeginFrame()
+{
+	m_frame = (m_frame + 1) % FRAMES_IN_FLIGHT;
+	m_offset = 0;
+
+	// the blocks of the new frame are bound from the current buffer, the old ones aren't needed anymore
+	DeleteRetired();
+
+	GLsync& fence = m_fences[m_frame];
+	if (!fence)
+		return;
+
+	if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		m_stall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+void UniformRing::EndFrame()
+{
+	if (m_fences[m_frame])
+		glDeleteSync(m_fences[m_frame]);
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr UniformRing::Push(const void* data, GLsizeiptr size)
+{
+	GLintptr aligned = (m_offset + m_alignment - 1) / m_alignment * m_alignment;
+	if (aligned + size > m_capacity)
+	{
+		// Out of space: continue in a bigger buffer. Draws already submitted keep using the old one,
+		// the driver defers its deletion until they are done. It is only deleted when the next frame
+		// starts, deleting it now would also unbind the blocks pushed earlier in this frame.
+		GLsizeiptr capacity = m_capacity * 2;
+		while (capacity < size)
+			capacity *= 2;
+		LOG_WARNING(LogCategory::Render, "Uniform ring grown to %lld bytes per frame", (long long)capacity);
+
+		Release(true);
+		Allocate(capacity);
+		aligned = 0;
+	}
+
+	GLintptr offset = m_frame * m_capacity + aligned;
+	if (m_mapped)
+		memcpy(m_mapped + offset, data, size);
+	else
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	}
+
+	m_offset = aligned + size;
+	return offset;
+}
+
+void UniformRing::DeleteRetired()
+{
+	if (!m_retired.empty())
+		glDeleteBuffers((GLsizei)m_retired.size(), m_retired.data());
+	m_retired.clear();
+}
+
+void UniformRing::Delete()
+{
+	Release();
+	DeleteRetired();
+	m_capacity = 0;
+	m_offset = 0;
+	MemoryTracker::Get().RemoveOwner(m_memory_owner);
+	m_memory_owner = 0;
+}
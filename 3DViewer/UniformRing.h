@@ -0,0 +1,82 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <glad/glad.h>
+
+#include "GLUtils.h"
+
+#include <vector>
+
+// Uniform buffer split into one segment per frame in flight. Blocks are copied into the segment of
+// the current frame and bound with glBindBufferRange, so a draw costs a memcpy and one bind instead
+// of a glGetUniformLocation + glUniform* call per value. A fence at the end of every frame guards
+// its segment, BeginFrame only waits when the GPU is FRAMES_IN_FLIGHT frames behind.
+//
+// With GL 4.4 or ARB_buffer_storage the buffer is persistently and coherently mapped. Older drivers
+// get the same interface on top of glBufferSubData, still without implicit synchronization since
+// the fences keep the CPU from writing a segment the GPU is reading.
+class UniformRing
+{
+public:
+	static constexpr int FRAMES_IN_FLIGHT = 3;
+
+	// frame_capacity is the initial size of each segment, it doubles when a frame runs out of space.
+	// loader resolves glBufferStorage, which is newer than the GL 3.3 functions glad loads.
+	bool Create(GLsizeiptr frame_capacity, GLADloadproc loader);
+
+	// Waits for the GPU to release the next segment and starts writing into it
+	void BeginFrame();
+
+	// Fences the segment of the current frame
+	void EndFrame();
+
+	// Copies a block into the current segment and returns its offset
+	GLintptr Push(const void* data, GLsizeiptr size);
+
+	template <typename T>
+	GLintptr Push(const T& block)
+	{
+		return Push(&block, sizeof(T));
+	}
+
+	// Pushes a block and binds it to a uniform buffer binding point
+	template <typename T>
+	void PushAndBind(GLuint binding, const T& block)
+	{
+		GLintptr offset = Push(&block, sizeof(T));
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset, sizeof(T));
+	}
+
+	void Delete();
+
+	bool IsPersistent() const { return m_mapped != nullptr; }
+
+	// Total time BeginFrame spent waiting on fences
+	double GetStallMs() const { return m_stall_ms; }
+
+private:
+	void Allocate(GLsizeiptr frame_capacity);
+	// retire keeps the buffer until the next frame instead of deleting it
+	void Release(bool retire = false);
+	void DeleteRetired();
+
+	BufferStorageProc m_buffer_storage = nullptr;
+
+	GLuint m_buffer = 0;
+	unsigned char* m_mapped = nullptr;
+	// buffers outgrown during the current frame
+	std::vector<GLuint> m_retired;
+	GLsync m_fences[FRAMES_IN_FLIGHT] = {};
+
+	GLsizeiptr m_capacity = 0;
+	GLintptr m_alignment = 256;
+	int m_frame = 0;
+	GLintptr m_offset = 0;
+
+	double m_stall_ms = 0.0;
+
+	// MemoryTracker handle of the buffer
+	unsigned int m_memory_owner = 0;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "UploadScheduler.h"
+#include "GLUtils.h"
+#include "Logger.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+// Largest piece copied at once, small enough that the time budget is checked often
+static const size_t MAX_CHUNK_BYTES = 1024 * 1024;
+// Offsets of the chunks in a segment
+static const size_t CHUNK_ALIGNMENT = 16;
+
+bool UploadScheduler::Create(size_t segment_size, GLADloadproc loader)
+{
+	m_segment_size = std::max(segment_size, MAX_CHUNK_BYTES);
+	m_budget_bytes = m_segment_size;
+	GLsizeiptr size = (GLsizeiptr)(m_segment_size * FRAMES_IN_FLIGHT);
+
+	BufferStorageProc buffer_storage = LoadBufferStorage(loader);
+	m_staging = CreateMappedBuffer(GL_COPY_READ_BUFFER, size, buffer_storage, GL_STREAM_DRAW, &m_mapped);
+	if (buffer_storage && !m_mapped)
+		LOG_WARNING(LogCategory::Render, "ERROR::UPLOAD_SCHEDULER::PERSISTENT_MAP_FAILED");
+
+	MemoryTracker& tracker = MemoryTracker::Get();
+	m_memory_owner = tracker.AddOwner("Upload staging");
+	tracker.Set(m_memory_owner, MEMORY_GPU_BUFFER, (size_t)size);
+
+	LOG_INFO(LogCategory::Render, "Upload scheduler: %.1f MB x %d frames, %s", m_segment_size / 1048576.0, FRAMES_IN_FLIGHT,
+		IsPersistent() ? "persistently mapped" : "glBufferSubData");
+	return m_staging != 0;
+}
+
+void UploadScheduler::Delete()
+{
+	TakeSubmitted();
+	for (Upload* upload : m_active)
+		delete upload;
+	m_active.clear();
+	m_queued_bytes = 0;
+
+	if (m_mapped)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, m_staging);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		m_mapped = nullptr;
+	}
+	if (m_staging)
+		glDeleteBuffers(1, &m_staging);
+	m_staging = 0;
+	MemoryTracker::Get().RemoveOwner(m_memory_owner);
+	m_memory_owner = 0;
+
+	for (GLsync& fence : m_fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+}
+
+void UploadScheduler::SetBudget(double milliseconds, size_t bytes)
+{
+	m_budget_ms = milliseconds;
+	m_budget_bytes = bytes;
+}
+
+void UploadScheduler::UploadBuffer(const void* owner, GLuint buffer, const void* data, size_t size, std::function<void()> done)
+{
+	Upload* upload = new Upload();
+	upload->kind = UPLOAD_BUFFER;
+	upload->owner = owner;
+	upload->object = buffer;
+	upload->data = (const unsigned char*)data;
+	upload->size = size;
+	upload->done = std::move(done);
+	Submit(upload);
+}
+
+void UploadScheduler::UploadTexture(const void* owner, GLuint texture, int level, int width, int height, GLenum format, int components,
+	const void* data, std::function<void()> done)
+{
+	Upload* upload = new Upload();
+	upload->kind = UPLOAD_TEXTURE;
+	upload->owner = owner;
+	upload->object = texture;
+	upload->data = (const unsigned char*)data;
+	upload->level = level;
+	upload->width = width;
+	upload->height = height;
+	upload->format = format;
+	upload->rowBytes = (size_t)width * components;
+	upload->rowHeight = 1;
+	upload->size = upload->rowBytes * height;
+	upload->done = std::move(done);
+	Submit(upload);
+}
+
+void UploadScheduler::UploadCompressedTexture(const void* owner, GLuint texture, int level, int width, int height, GLenum format, int block_bytes,
+	const void* data, std::function<void()> done)
+{
+	Upload* upload = new Upload();
+	upload->kind = UPLOAD_COMPRESSED_TEXTURE;
+	upload->owner = owner;
+	upload->object = texture;
+	upload->data = (const unsigned char*)data;
+	upload->level = level;
+	upload->width = width;
+	upload->height = height;
+	upload->format = format;
+	upload->rowBytes = (size_t)((width + 3) / 4) * block_bytes;
+	upload->rowHeight = 4;
+	upload->size = upload->rowBytes * ((height + 3) / 4);
+	upload->done = std::move(done);
+	Submit(upload);
+}
+
+void UploadScheduler::Submit(Upload* upload)
+{
+	m_queued_bytes += upload->size;
+	upload->next = m_submitted.load(std::memory_order_relaxed);
+	while (!m_submitted.compare_exchange_weak(upload->next, upload, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+}
+
+void UploadScheduler::TakeSubmitted()
+{
+	Upload* list = m_submitted.exchange(nullptr, std::memory_order_acquire);
+
+	// the list is newest first
+	size_t position = m_active.size();
+	for (Upload* upload = list; upload; upload = upload->next)
+		m_active.insert(m_active.begin() + position, upload);
+}
+
+size_t UploadScheduler::CopyChunk(Upload& upload, size_t offset, size_t space)
+{
+	size_t bytes = std::min(std::min(space, MAX_CHUNK_BYTES), upload.size - upload.offset);
+	int y = 0;
+	int rows = 0;
+	if (upload.kind != UPLOAD_BUFFER)
+	{
+		// whole rows only, the last one of a level may be shorter than rowHeight
+		size_t row_count = bytes / upload.rowBytes;
+		if (row_count == 0)
+			return 0;
+		bytes = row_count * upload.rowBytes;
+		y = (int)(upload.offset / upload.rowBytes) * upload.rowHeight;
+		rows = std::min((int)row_count * upload.rowHeight, upload.height - y);
+	}
+
+	size_t staging_offset = (size_t)m_segment * m_segment_size + offset;
+	if (m_mapped)
+		memcpy(m_mapped + staging_offset, upload.data + upload.offset, bytes);
+	else
+		glBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)staging_offset, (GLsizeiptr)bytes, upload.data + upload.offset);
+
+	if (upload.kind == UPLOAD_BUFFER)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, upload.object);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)staging_offset, (GLintptr)upload.offset, (GLsizeiptr)bytes);
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_2D, upload.object);
+		if (upload.kind == UPLOAD_TEXTURE)
+			glTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, upload.width, rows, upload.format, GL_UNSIGNED_BYTE, (const void*)staging_offset);
+		else
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, y, upload.width, rows, upload.format, (GLsizei)bytes, (const void*)staging_offset);
+	}
+
+	upload.offset += bytes;
+	return bytes;
+}
+
+void UploadScheduler::Process()
+{
+	Clock::time_point start = Clock::now();
+	m_stats.lastMs = 0.0;
+	m_stats.lastBytes = 0;
+
+	TakeSubmitted();
+	if (m_active.empty() || !m_staging)
+		return;
+
+	// the segment of this frame may still be read by copies from FRAMES_IN_FLIGHT frames ago
+	GLsync& fence = m_fences[m_segment];
+	if (fence)
+	{
+		if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			m_stats.fenceSkips++;
+			return;
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_staging);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_staging);
+
+	size_t budget = std::min(m_budget_bytes, m_segment_size);
+	size_t used = 0;
+	while (!m_active.empty())
+	{
+		Upload& upload = *m_active.front();
+		size_t offset = (used + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+		// a budget smaller than a row still lets one row through each frame
+		size_t space = offset < budget ? budget - offset : 0;
+		if (used == 0 && upload.rowBytes > space)
+			space = std::min(upload.rowBytes, m_segment_size);
+
+		size_t bytes = CopyChunk(upload, offset, space);
+		if (bytes == 0)
+			break;
+		used = offset + bytes;
+		m_queued_bytes -= bytes;
+		m_stats.lastBytes += bytes;
+
+		if (upload.offset == upload.size)
+		{
+			// later draws see the data, the GL orders them after the copies
+			m_active.pop_front();
+			if (upload.done)
+				upload.done();
+			delete &upload;
+			m_stats.completedUploads++;
+		}
+
+		if (std::chrono::duration<double, std::milli>(Clock::now() - start).count() >= m_budget_ms)
+			break;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+	if (used > 0)
+	{
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_segment = (m_segment + 1) % FRAMES_IN_FLIGHT;
+		m_stats.frames++;
+	}
+
+	m_stats.lastMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	m_stats.maxMs = std::max(m_stats.maxMs, m_stats.lastMs);
+	m_stats.totalBytes += m_stats.lastBytes;
+}
+
+void UploadScheduler::Cancel(const void* owner)
+{
+	TakeSubmitted();
+	for (size_t i = 0; i < m_active.size();)
+	{
+		Upload* upload = m_active[i];
+		if (upload->owner != owner)
+		{
+			i++;
+			continue;
+		}
+		m_queued_bytes -= upload->size - upload->offset;
+		delete upload;
+		m_active.erase(m_active.begin() + i);
+	}
+}
@@ -0,0 +1,135 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+
+struct UploadStats
+{
+	// the last Process call
+	double lastMs = 0.0;
+	size_t lastBytes = 0;
+	// worst Process call so far
+	double maxMs = 0.0;
+	unsigned long long totalBytes = 0;
+	unsigned long long completedUploads = 0;
+	// Process calls that copied something, and the ones that found the next staging segment still in use
+	unsigned long long frames = 0;
+	unsigned long long fenceSkips = 0;
+};
+
+// Streams buffer and texture data to the GPU a little every frame, so loading a model doesn't freeze
+// the window for the length of its glBufferData/glTexImage2D calls.
+//   - Upload* only records the request, any thread can call it: the requests go into a lock-free list
+//     the GL thread takes over as a whole. The GL object must already exist with its storage allocated.
+//   - Process, once per frame on the GL thread, copies pending data until the time or byte budget of
+//     the frame runs out. Large resources are cut into chunks (whole rows for textures) and continue
+//     the next frame, requests complete in the order they were made.
+//   - Chunks go through a staging buffer split into one segment per frame in flight, persistently
+//     mapped with GL 4.4 or ARB_buffer_storage (glBufferSubData otherwise), and are copied on the GPU
+//     with glCopyBufferSubData or glTex(Compressed)SubImage2D from the bound pixel unpack buffer.
+//     Segments are fenced like UniformRing, but a frame whose segment is still in use skips the
+//     uploads instead of waiting.
+class UploadScheduler
+{
+public:
+	static constexpr int FRAMES_IN_FLIGHT = 3;
+
+	// segment_size bytes per frame in flight, at least 1 MB so a row of the largest texture fits.
+	// loader resolves glBufferStorage, which is newer than the GL 3.3 functions glad loads.
+	bool Create(size_t segment_size, GLADloadproc loader);
+	void Delete();
+
+	// Limits of one Process call. The byte budget is capped by the segment size and lets at least one
+	// row through; the time is checked after every chunk, so a call overshoots by at most one chunk.
+	void SetBudget(double milliseconds, size_t bytes);
+
+	// data has to stay valid until done runs (on the GL thread, after the last chunk is submitted) or
+	// the owner is cancelled
+	void UploadBuffer(const void* owner, GLuint buffer, const void* data, size_t size, std::function<void()> done = nullptr);
+
+	// level of a GL_TEXTURE_2D, tightly packed GL_UNSIGNED_BYTE rows in format (GL_RED ... GL_RGBA)
+	void UploadTexture(const void* owner, GLuint texture, int level, int width, int height, GLenum format, int components,
+		const void* data, std::function<void()> done = nullptr);
+
+	// level of a block compressed GL_TEXTURE_2D, rows of 4x4 blocks of block_bytes each
+	void UploadCompressedTexture(const void* owner, GLuint texture, int level, int width, int height, GLenum format, int block_bytes,
+		const void* data, std::function<void()> done = nullptr);
+
+	// GL thread, once per frame
+	void Process();
+
+	// GL thread. Drops the requests of owner that haven't completed, their callbacks don't run.
+	void Cancel(const void* owner);
+
+	// Requests not completed yet
+	bool IsBusy() const { return m_queued_bytes > 0; }
+	size_t GetQueuedBytes() const { return m_queued_bytes; }
+
+	bool IsPersistent() const { return m_mapped != nullptr; }
+	size_t GetSegmentSize() const { return m_segment_size; }
+	double GetBudgetMs() const { return m_budget_ms; }
+	size_t GetBudgetBytes() const { return m_budget_bytes; }
+	const UploadStats& GetStats() const { return m_stats; }
+
+private:
+	enum UploadKind
+	{
+		UPLOAD_BUFFER,
+		UPLOAD_TEXTURE,
+		UPLOAD_COMPRESSED_TEXTURE
+	};
+
+	struct Upload
+	{
+		UploadKind kind = UPLOAD_BUFFER;
+		const void* owner = nullptr;
+		GLuint object = 0;
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+		// bytes already copied
+		size_t offset = 0;
+
+		int level = 0;
+		int width = 0;
+		int height = 0;
+		GLenum format = 0;
+		// textures are copied in whole rows: bytes and texels of one row (of blocks)
+		size_t rowBytes = 0;
+		int rowHeight = 1;
+
+		std::function<void()> done;
+		Upload* next = nullptr;
+	};
+
+	void Submit(Upload* upload);
+	// moves the submitted requests to m_active in submission order
+	void TakeSubmitted();
+	// copies the next chunk of upload into the segment at offset, 0 when not even one row fits into space
+	size_t CopyChunk(Upload& upload, size_t offset, size_t space);
+
+	// newest first, pushed with a compare and swap and taken as a whole by the GL thread
+	std::atomic<Upload*> m_submitted{ nullptr };
+	std::atomic<size_t> m_queued_bytes{ 0 };
+	std::deque<Upload*> m_active;
+
+	GLuint m_staging = 0;
+	unsigned char* m_mapped = nullptr;
+	GLsync m_fences[FRAMES_IN_FLIGHT] = {};
+	size_t m_segment_size = 0;
+	int m_segment = 0;
+
+	double m_budget_ms = 2.0;
+	size_t m_budget_bytes = 0;
+
+	UploadStats m_stats;
+
+	// MemoryTracker handle of the staging buffer
+	unsigned int m_memory_owner = 0;
+};
+
+#endif
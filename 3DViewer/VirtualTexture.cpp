@@ -0,0 +1,335 @@
+#include "VirtualTexture.h"
+#include "Logger.h"
+#include "TextureCache.h"
+#include "MemoryTracker.h"
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// The feedback target is a quarter of the viewport per side, the level is biased to match
+static const int FEEDBACK_DIVISOR = 4;
+static const float FEEDBACK_LOD_BIAS = -2.0f;
+// Reads in flight, the GPU is usually done with the oldest one when it is needed
+static const int FEEDBACK_SLOTS = 3;
+// Requests and uploads per Update, a camera cut spreads its pages over a few frames instead of one long one
+static const size_t MAX_REQUESTS_PER_UPDATE = 64;
+static const size_t MAX_PENDING_PAGES = 256;
+static const int MAX_UPLOADS_PER_UPDATE = 16;
+
+bool VirtualTexture::Open(const std::string& path)
+{
+	m_path = path;
+	return m_file.Open(path);
+}
+
+bool VirtualTexture::Create(int slots)
+{
+	const VirtualTextureLayout& layout = m_file.GetLayout();
+	if (layout.levels == 0)
+		return false;
+
+	// BC7 pages stay compressed in the physical cache when the context can sample them
+	m_compressed = layout.codec == TEXTURE_CODEC_BC7 && TextureCache::Get().SupportsBptc();
+	m_physical_size = slots * layout.GetPageSize();
+	m_cache.Init(layout, slots, slots);
+
+	glGenTextures(1, &m_physical);
+	glBindTexture(GL_TEXTURE_2D, m_physical);
+	if (m_compressed)
+	{
+		GLsizei size = (GLsizei)((size_t)slots * slots * layout.GetPageBytes());
+		glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_BPTC_UNORM, m_physical_size, m_physical_size, 0, size, NULL);
+		m_texture_bytes = size;
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_physical_size, m_physical_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		m_texture_bytes = (size_t)m_physical_size * m_physical_size * 4;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// One mip of the page table per level, read with texelFetch
+	glGenTextures(1, &m_page_table);
+	glBindTexture(GL_TEXTURE_2D, m_page_table);
+	for (int level = 0; level < layout.levels; level++)
+	{
+		int size = layout.GetTableSize(level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		m_texture_bytes += (size_t)size * size * 4;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, layout.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// The coarsest page is loaded right away and never evicted, there is always something to draw
+	std::vector<unsigned char> data;
+	uint32_t root = layout.GetRoot();
+	if (!m_file.ReadPage(root, data, !m_compressed))
+	{
+		LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::PAGE_READ_FAILED: %s", m_path);
+		return false;
+	}
+	UploadPage(m_cache.Insert(root, true), data);
+	m_cache.UpdatePageTable();
+	UploadPageTable();
+
+	m_feedback_slots.resize(FEEDBACK_SLOTS);
+	for (FeedbackSlot& slot : m_feedback_slots)
+		glGenBuffers(1, &slot.pbo);
+	ReportMemory();
+
+	if (!m_loader.Start(m_path, !m_compressed))
+		return false;
+
+	LOG_INFO(LogCategory::Model, "Virtual texture %s: %dx%d, %d levels, %d pages of %dx%d cached%s", m_path, layout.width, layout.height,
+		layout.levels, slots * slots, layout.GetPageSize(), layout.GetPageSize(), m_compressed ? " as BC7" : "");
+	return true;
+}
+
+void VirtualTexture::Bind(Shader& shader)
+{
+	const VirtualTextureLayout& layout = m_file.GetLayout();
+	glActiveTexture(GL_TEXTURE0 + VIRTUAL_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, m_page_table);
+	glActiveTexture(GL_TEXTURE0 + VIRTUAL_TEXTURE_UNIT + 1);
+	glBindTexture(GL_TEXTURE_2D, m_physical);
+	glActiveTexture(GL_TEXTURE0);
+
+	shader.setInt("vt_pagetable", VIRTUAL_TEXTURE_UNIT);
+	shader.setInt("vt_physical", VIRTUAL_TEXTURE_UNIT + 1);
+	shader.setVec2("vt_image_size", (float)layout.width, (float)layout.height);
+	shader.setFloat("vt_page_content", (float)layout.pageContent);
+	shader.setFloat("vt_page_border", (float)layout.pageBorder);
+	shader.setFloat("vt_physical_size", (float)m_physical_size);
+	shader.setFloat("vt_max_level", (float)(layout.levels - 1));
+}
+
+void VirtualTexture::ResizeFeedback(int width, int height)
+{
+	if (m_feedback_fbo && width == m_feedback_width && height == m_feedback_height)
+		return;
+
+	// reads of the old size are dropped, their buffers are about to be reallocated
+	for (FeedbackSlot& slot : m_feedback_slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		slot.fence = 0;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * sizeof(uint32_t), NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (!m_feedback_fbo)
+	{
+		glGenFramebuffers(1, &m_feedback_fbo);
+		glGenRenderbuffers(1, &m_feedback_color);
+		glGenRenderbuffers(1, &m_feedback_depth);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, m_feedback_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_R32UI, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_feedback_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_feedback_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_feedback_color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_feedback_depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LOG_ERROR(LogCategory::Render, "ERROR::VIRTUAL_TEXTURE::FEEDBACK_FRAMEBUFFER_INCOMPLETE");
+
+	m_feedback_width = width;
+	m_feedback_height = height;
+	ReportMemory();
+}
+
+void VirtualTexture::SetMemoryOwner(unsigned int owner)
+{
+	m_memory_owner = owner;
+	ReportMemory();
+}
+
+void VirtualTexture::ReportMemory()
+{
+	// R32UI color and 24 bit depth (usually padded to 32) per feedback pixel, one read back buffer per slot
+	size_t feedback_pixels = (size_t)m_feedback_width * m_feedback_height;
+	MemoryTracker& tracker = MemoryTracker::Get();
+	tracker.Set(m_memory_owner, MEMORY_GPU_TEXTURE, m_texture_bytes + feedback_pixels * 8);
+	tracker.Set(m_memory_owner, MEMORY_GPU_BUFFER, m_feedback_slots.size() * feedback_pixels * sizeof(uint32_t));
+}
+
+void VirtualTexture::BeginFeedback(Shader& shader, int viewportWidth, int viewportHeight)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_saved_draw_fbo);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &m_saved_read_fbo);
+	glGetIntegerv(GL_VIEWPORT, m_saved_viewport);
+
+	ResizeFeedback(std::max(1, viewportWidth / FEEDBACK_DIVISOR), std::max(1, viewportHeight / FEEDBACK_DIVISOR));
+	glBindFramebuffer(GL_FRAMEBUFFER, m_feedback_fbo);
+	glViewport(0, 0, m_feedback_width, m_feedback_height);
+
+	const GLuint nothing[4] = { VT_NO_PAGE, 0, 0, 0 };
+	const GLfloat far_depth = 1.0f;
+	glClearBufferuiv(GL_COLOR, 0, nothing);
+	glClearBufferfv(GL_DEPTH, 0, &far_depth);
+
+	const VirtualTextureLayout& layout = m_file.GetLayout();
+	shader.use();
+	shader.setVec2("vt_image_size", (float)layout.width, (float)layout.height);
+	shader.setFloat("vt_page_content", (float)layout.pageContent);
+	shader.setFloat("vt_max_level", (float)(layout.levels - 1));
+	shader.setFloat("vt_feedback_bias", FEEDBACK_LOD_BIAS);
+}
+
+void VirtualTexture::EndFeedback()
+{
+	// With every read still in flight this frame's feedback is skipped, the next one asks again
+	FeedbackSlot& slot = m_feedback_slots[m_feedback_next];
+	if (!slot.fence)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glReadPixels(0, 0, m_feedback_width, m_feedback_height, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.width = m_feedback_width;
+		slot.height = m_feedback_height;
+		m_feedback_next = (m_feedback_next + 1) % m_feedback_slots.size();
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_saved_draw_fbo);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_saved_read_fbo);
+	glViewport(m_saved_viewport[0], m_saved_viewport[1], m_saved_viewport[2], m_saved_viewport[3]);
+}
+
+bool VirtualTexture::Update()
+{
+	// Finished feedback in submission order, the first one still running ends the loop
+	for (size_t i = 0; i < m_feedback_slots.size(); i++)
+	{
+		FeedbackSlot& slot = m_feedback_slots[(m_feedback_next + i) % m_feedback_slots.size()];
+		if (!slot.fence)
+			continue;
+		if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			break;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		size_t count = (size_t)slot.width * slot.height;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		const uint32_t* feedback = (const uint32_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * sizeof(uint32_t), GL_MAP_READ_BIT);
+		if (feedback)
+		{
+			size_t pending = m_cache.GetPendingCount();
+			size_t budget = pending < MAX_PENDING_PAGES ? std::min(MAX_REQUESTS_PER_UPDATE, MAX_PENDING_PAGES - pending) : 0;
+			m_cache.EndFrame();
+			m_requests.clear();
+			m_cache.ProcessFeedback(feedback, count, m_requests, budget);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+			for (uint32_t page : m_requests)
+			{
+				if (!m_loader.Request(page))
+					m_cache.CancelPending(page);
+			}
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// Pages read by the loader, a few per frame
+	std::vector<VirtualPageLoader::LoadedPage> loaded;
+	m_loader.TakeLoaded(loaded);
+	for (VirtualPageLoader::LoadedPage& page : loaded)
+		m_arrived.push_back(std::move(page));
+
+	for (int uploads = 0; uploads < MAX_UPLOADS_PER_UPDATE && !m_arrived.empty(); uploads++)
+	{
+		VirtualPageLoader::LoadedPage page = std::move(m_arrived.front());
+		m_arrived.pop_front();
+		if (page.data.empty())
+		{
+			m_cache.CancelPending(page.page);
+			continue;
+		}
+		// -1 when every slot is needed by the last frame, the page is asked for again later
+		int slot = m_cache.Insert(page.page);
+		if (slot >= 0)
+			UploadPage(slot, page.data);
+	}
+
+	if (!m_cache.UpdatePageTable())
+		return false;
+	UploadPageTable();
+	return true;
+}
+
+bool VirtualTexture::IsBusy() const
+{
+	for (const FeedbackSlot& slot : m_feedback_slots)
+	{
+		if (slot.fence)
+			return true;
+	}
+	return m_cache.GetPendingCount() > 0 || !m_arrived.empty();
+}
+
+void VirtualTexture::UploadPage(int slot, const std::vector<unsigned char>& data)
+{
+	int size = m_file.GetLayout().GetPageSize();
+	int x = m_cache.GetSlotX(slot) * size;
+	int y = m_cache.GetSlotY(slot) * size;
+	glBindTexture(GL_TEXTURE_2D, m_physical);
+	if (m_compressed)
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, size, size, GL_COMPRESSED_RGBA_BPTC_UNORM, (GLsizei)data.size(), data.data());
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, size, size, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VirtualTexture::UploadPageTable()
+{
+	const VirtualTextureLayout& layout = m_file.GetLayout();
+	glBindTexture(GL_TEXTURE_2D, m_page_table);
+	for (int level = 0; level < layout.levels; level++)
+	{
+		int size = layout.GetTableSize(level);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, m_cache.GetPageTable(level).data());
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VirtualTexture::Delete()
+{
+	m_loader.Stop();
+	m_arrived.clear();
+
+	for (FeedbackSlot& slot : m_feedback_slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.pbo);
+	}
+	m_feedback_slots.clear();
+
+	if (m_feedback_fbo)
+	{
+		glDeleteFramebuffers(1, &m_feedback_fbo);
+		glDeleteRenderbuffers(1, &m_feedback_color);
+		glDeleteRenderbuffers(1, &m_feedback_depth);
+	}
+	m_feedback_fbo = 0;
+
+	glDeleteTextures(1, &m_page_table);
+	glDeleteTextures(1, &m_physical);
+	m_page_table = 0;
+	m_physical = 0;
+	m_texture_bytes = 0;
+	m_feedback_width = 0;
+	m_feedback_height = 0;
+	ReportMemory();
+}
@@ -0,0 +1,102 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+#include "VirtualTextureCache.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// Texture units of the page table and the physical cache, above the ones Mesh::Draw hands out
+static const int VIRTUAL_TEXTURE_UNIT = 8;
+
+// Sparse virtual texture streamed from a page file written by 3DViewerTiler, for atlases far larger
+// than VRAM. Only the pages the camera needs are resident:
+//   1. the meshes using it are drawn with vt_feedback.glsl into a small R32UI target, every pixel
+//      writes the page and level it samples
+//   2. the target is read back through a ring of pixel buffers, Update picks up finished reads
+//      without waiting on the GPU
+//   3. VirtualPageCache turns the feedback into requests, VirtualPageLoader reads them from disk
+//   4. loaded pages are copied into a slot of the physical texture and the page table is rebuilt
+// Until a page arrives frag.glsl samples the closest resident ancestor, so the image sharpens over a
+// few frames instead of waiting for the disk.
+class VirtualTexture
+{
+public:
+	// Reads the layout of a page file, safe to call off the GL thread
+	bool Open(const std::string& path);
+
+	// Creates the textures and the feedback target, loads the coarsest page and starts the loader.
+	// slots is the side of the physical cache in pages, 16 holds 256 pages of 128x128.
+	bool Create(int slots = 16);
+
+	// Binds the page table and the physical cache to VIRTUAL_TEXTURE_UNIT and the next unit
+	void Bind(Shader& shader);
+
+	// Draw the meshes using the texture with the feedback shader between these two. The framebuffer
+	// and viewport bound before are restored.
+	void BeginFeedback(Shader& shader, int viewportWidth, int viewportHeight);
+	void EndFeedback();
+
+	// Takes finished feedback, requests missing pages and uploads arrived ones. True when the page
+	// table changed and the next frame looks different.
+	bool Update();
+
+	// Feedback being read back or pages on their way
+	bool IsBusy() const;
+
+	const std::string& GetPath() const { return m_path; }
+	const VirtualTextureLayout& GetLayout() const { return m_file.GetLayout(); }
+	const VirtualPageCache& GetCache() const { return m_cache; }
+
+	// Registers the textures and feedback buffers with the MemoryTracker under owner
+	void SetMemoryOwner(unsigned int owner);
+
+	void Delete();
+
+private:
+	struct FeedbackSlot
+	{
+		GLuint pbo = 0;
+		GLsync fence = 0;
+		int width = 0;
+		int height = 0;
+	};
+
+	void ResizeFeedback(int width, int height);
+	void UploadPage(int slot, const std::vector<unsigned char>& data);
+	void UploadPageTable();
+	// Reports the current GL sizes to the MemoryTracker
+	void ReportMemory();
+
+	std::string m_path;
+	VirtualTextureFile m_file;
+	VirtualPageCache m_cache;
+	VirtualPageLoader m_loader;
+	std::deque<VirtualPageLoader::LoadedPage> m_arrived;
+	std::vector<uint32_t> m_requests;
+	bool m_compressed = false;
+
+	GLuint m_page_table = 0;
+	GLuint m_physical = 0;
+	int m_physical_size = 0;
+	// physical cache and page table
+	size_t m_texture_bytes = 0;
+	unsigned int m_memory_owner = 0;
+
+	GLuint m_feedback_fbo = 0;
+	GLuint m_feedback_color = 0;
+	GLuint m_feedback_depth = 0;
+	int m_feedback_width = 0;
+	int m_feedback_height = 0;
+	std::vector<FeedbackSlot> m_feedback_slots;
+	size_t m_feedback_next = 0;
+	GLint m_saved_draw_fbo = 0;
+	GLint m_saved_read_fbo = 0;
+	GLint m_saved_viewport[4] = {};
+};
+
+#endif
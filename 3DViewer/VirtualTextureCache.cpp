@@ -0,0 +1,475 @@
+#include "VirtualTextureCache.h"
+#include "Logger.h"
+#include "JobSystem.h"
+
+#include <cstring>
+
+static const char VTEX_MAGIC[8] = { '3', 'D', 'V', 'V', 'T', 'E', 'X', '1' };
+
+// Followed by a 64 bit file offset for every page and the pages, level 0 first, every level in rows
+struct VirtualTextureHeader
+{
+	char magic[8];
+	uint32_t width;
+	uint32_t height;
+	uint32_t pageContent;
+	uint32_t pageBorder;
+	uint32_t levels;
+	uint32_t codec;
+	uint32_t tableSize;
+	uint32_t pageCount;
+};
+
+// The page files of large atlases pass 2 GB, further than fseek can go with a 32 bit long
+static bool SeekTo(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+void VirtualTextureLayout::Init(int width, int height, int pageContent, int pageBorder, TextureCodec codec)
+{
+	this->width = width;
+	this->height = height;
+	this->pageContent = pageContent;
+	this->pageBorder = pageBorder;
+	this->codec = codec;
+
+	int pages = std::max((width + pageContent - 1) / pageContent, (height + pageContent - 1) / pageContent);
+	tableSize = 1;
+	levels = 1;
+	while (tableSize < pages)
+	{
+		tableSize *= 2;
+		levels++;
+	}
+}
+
+size_t VirtualTextureLayout::GetPageBytes() const
+{
+	int size = GetPageSize();
+	if (codec == TEXTURE_CODEC_BC7)
+		return (size_t)((size + 3) / 4) * ((size + 3) / 4) * GetBlockBytes(codec);
+	return (size_t)size * size * 4;
+}
+
+bool VirtualTextureLayout::IsValid(uint32_t page) const
+{
+	int level = GetPageLevel(page);
+	return level < levels && GetPageX(page) < GetPagesX(level) && GetPageY(page) < GetPagesY(level);
+}
+
+uint32_t VirtualTextureLayout::GetParent(uint32_t page) const
+{
+	return MakePageId(GetPageLevel(page) + 1, GetPageX(page) >> 1, GetPageY(page) >> 1);
+}
+
+// Cuts page x, y out of a level with its border, texels outside the level repeat the edge
+static void ExtractPage(const std::vector<unsigned char>& rgba, int width, int height, const VirtualTextureLayout& layout, int page_x, int page_y, unsigned char* out)
+{
+	int size = layout.GetPageSize();
+	int origin_x = page_x * layout.pageContent - layout.pageBorder;
+	int origin_y = page_y * layout.pageContent - layout.pageBorder;
+	for (int y = 0; y < size; y++)
+	{
+		int source_y = std::min(std::max(origin_y + y, 0), height - 1);
+		for (int x = 0; x < size; x++)
+		{
+			int source_x = std::min(std::max(origin_x + x, 0), width - 1);
+			memcpy(&out[((size_t)y * size + x) * 4], &rgba[((size_t)source_y * width + source_x) * 4], 4);
+		}
+	}
+}
+
+static void EncodePageBC7(const unsigned char* rgba, int size, unsigned char* out)
+{
+	unsigned char texels[64];
+	int blocks = size / 4;
+	for (int by = 0; by < blocks; by++)
+	{
+		for (int bx = 0; bx < blocks; bx++)
+		{
+			for (int row = 0; row < 4; row++)
+				memcpy(&texels[row * 16], &rgba[((size_t)(by * 4 + row) * size + bx * 4) * 4], 16);
+			EncodeBlockBC7(texels, out + ((size_t)by * blocks + bx) * 16);
+		}
+	}
+}
+
+static void DecodePageBC7(const std::vector<unsigned char>& blocks, int size, std::vector<unsigned char>& rgba)
+{
+	unsigned char texels[64];
+	int count = size / 4;
+	rgba.resize((size_t)size * size * 4);
+	for (int by = 0; by < count; by++)
+	{
+		for (int bx = 0; bx < count; bx++)
+		{
+			DecodeBlockBC7(&blocks[((size_t)by * count + bx) * 16], texels);
+			for (int row = 0; row < 4; row++)
+				memcpy(&rgba[((size_t)(by * 4 + row) * size + bx * 4) * 4], &texels[row * 16], 16);
+		}
+	}
+}
+
+bool VirtualTextureFile::Build(const unsigned char* pixels, int width, int height, int components, const std::string& path, TextureCodec codec, int threads)
+{
+	if (!pixels || width <= 0 || height <= 0 || components < 1 || components > 4)
+		return false;
+	if (codec != TEXTURE_CODEC_NONE && codec != TEXTURE_CODEC_BC7)
+	{
+		LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::UNSUPPORTED_CODEC: %s", path);
+		return false;
+	}
+
+	VirtualTextureLayout layout;
+	layout.Init(width, height, 120, 4, codec);
+	// 4 bits of level and 14 bits per coordinate in the page ids
+	if (layout.levels > 15)
+	{
+		LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::IMAGE_TOO_LARGE: %dx%d", width, height);
+		return false;
+	}
+
+	VirtualTextureHeader header = {};
+	memcpy(header.magic, VTEX_MAGIC, sizeof(VTEX_MAGIC));
+	header.width = width;
+	header.height = height;
+	header.pageContent = layout.pageContent;
+	header.pageBorder = layout.pageBorder;
+	header.levels = layout.levels;
+	header.codec = codec;
+	header.tableSize = layout.tableSize;
+	for (int level = 0; level < layout.levels; level++)
+		header.pageCount += layout.GetPagesX(level) * layout.GetPagesY(level);
+
+	// Pages are all the same size and written in order, their offsets are known up front
+	size_t page_bytes = layout.GetPageBytes();
+	std::vector<uint64_t> offsets(header.pageCount);
+	uint64_t data_start = sizeof(header) + offsets.size() * sizeof(uint64_t);
+	for (size_t i = 0; i < offsets.size(); i++)
+		offsets[i] = data_start + i * page_bytes;
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::CANNOT_WRITE: %s", path);
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+
+	std::vector<unsigned char> rgba;
+	ExpandToRgba(pixels, width, height, components, rgba);
+
+	// One row of pages at a time, encoded in parallel and written in order
+	std::unique_ptr<JobSystem> own_jobs;
+	if (threads > 0)
+		own_jobs = std::make_unique<JobSystem>(threads);
+	JobSystem& jobs = own_jobs ? *own_jobs : JobSystem::Get();
+	std::vector<unsigned char> row, next;
+	int level_width = width;
+	int level_height = height;
+	for (int level = 0; level < layout.levels && ok; level++)
+	{
+		int pages_x = layout.GetPagesX(level);
+		int pages_y = layout.GetPagesY(level);
+		row.resize(pages_x * page_bytes);
+		for (int page_y = 0; page_y < pages_y && ok; page_y++)
+		{
+			jobs.ParallelFor(pages_x, 1, [&](int begin, int end) {
+				std::vector<unsigned char> texels((size_t)layout.GetPageSize() * layout.GetPageSize() * 4);
+				for (int page_x = begin; page_x < end; page_x++)
+				{
+					unsigned char* out = &row[page_x * page_bytes];
+					ExtractPage(rgba, level_width, level_height, layout, page_x, page_y, codec == TEXTURE_CODEC_BC7 ? texels.data() : out);
+					if (codec == TEXTURE_CODEC_BC7)
+						EncodePageBC7(texels.data(), layout.GetPageSize(), out);
+				}
+			});
+			ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+		}
+
+		// level l + 1 rounds up, so the edge texels of odd sizes keep their own coarser texel
+		int next_width = (level_width + 1) / 2;
+		int next_height = (level_height + 1) / 2;
+		if (level + 1 < layout.levels)
+		{
+			DownsampleImage(rgba, level_width, level_height, next, next_width, next_height);
+			rgba.swap(next);
+			level_width = next_width;
+			level_height = next_height;
+		}
+	}
+
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::CANNOT_WRITE: %s", path);
+	return ok;
+}
+
+bool VirtualTextureFile::Open(const std::string& path)
+{
+	Close();
+	m_file = fopen(path.c_str(), "rb");
+	if (!m_file)
+		return false;
+
+	VirtualTextureHeader header;
+	bool ok = fread(&header, sizeof(header), 1, m_file) == 1 && memcmp(header.magic, VTEX_MAGIC, sizeof(VTEX_MAGIC)) == 0 &&
+		(header.codec == TEXTURE_CODEC_NONE || header.codec == TEXTURE_CODEC_BC7) && header.width > 0 && header.height > 0 &&
+		header.pageContent > 0 && header.pageContent % 4 == 0 && header.pageBorder % 2 == 0;
+	if (ok)
+	{
+		m_layout.Init(header.width, header.height, header.pageContent, header.pageBorder, (TextureCodec)header.codec);
+		ok = m_layout.levels == (int)header.levels && m_layout.tableSize == (int)header.tableSize && m_layout.levels <= 15;
+	}
+
+	size_t page_count = 0;
+	m_level_start.clear();
+	for (int level = 0; ok && level < m_layout.levels; level++)
+	{
+		m_level_start.push_back(page_count);
+		page_count += m_layout.GetPagesX(level) * m_layout.GetPagesY(level);
+	}
+	ok = ok && page_count == header.pageCount;
+
+	if (ok)
+	{
+		m_offsets.resize(page_count);
+		ok = fread(m_offsets.data(), sizeof(uint64_t), page_count, m_file) == page_count;
+	}
+
+	if (!ok)
+	{
+		LOG_ERROR(LogCategory::Model, "ERROR::VIRTUAL_TEXTURE::INVALID_FILE: %s", path);
+		Close();
+	}
+	return ok;
+}
+
+void VirtualTextureFile::Close()
+{
+	if (m_file)
+		fclose(m_file);
+	m_file = nullptr;
+	m_offsets.clear();
+	m_level_start.clear();
+}
+
+bool VirtualTextureFile::ReadPage(uint32_t page, std::vector<unsigned char>& data, bool decompress)
+{
+	if (!m_file || !m_layout.IsValid(page))
+		return false;
+
+	int level = GetPageLevel(page);
+	size_t index = m_level_start[level] + (size_t)GetPageY(page) * m_layout.GetPagesX(level) + GetPageX(page);
+	data.resize(m_layout.GetPageBytes());
+	if (!SeekTo(m_file, m_offsets[index]) || fread(data.data(), 1, data.size(), m_file) != data.size())
+		return false;
+
+	if (decompress && m_layout.codec == TEXTURE_CODEC_BC7)
+	{
+		std::vector<unsigned char> blocks;
+		blocks.swap(data);
+		DecodePageBC7(blocks, m_layout.GetPageSize(), data);
+	}
+	return true;
+}
+
+void VirtualPageCache::Init(const VirtualTextureLayout& layout, int slotsX, int slotsY)
+{
+	m_layout = layout;
+	m_slots_x = std::min(std::max(slotsX, 1), 256);
+	m_slots.assign((size_t)m_slots_x * std::min(std::max(slotsY, 1), 256), Slot());
+	m_resident.clear();
+	m_pending.clear();
+	m_frame = 1;
+	m_evictions = 0;
+	m_table_dirty = true;
+	m_table.assign(layout.levels, std::vector<PageTableEntry>());
+}
+
+void VirtualPageCache::ProcessFeedback(const uint32_t* feedback, size_t count, std::vector<uint32_t>& requests, size_t maxRequests)
+{
+	// The feedback has a page for every pixel, most of them repeat
+	m_scratch.assign(feedback, feedback + count);
+	std::sort(m_scratch.begin(), m_scratch.end());
+
+	struct Missing
+	{
+		uint32_t page;
+		size_t count;
+	};
+	std::vector<Missing> missing;
+	std::unordered_map<uint32_t, size_t> missing_index;
+
+	for (size_t i = 0; i < m_scratch.size();)
+	{
+		uint32_t page = m_scratch[i];
+		size_t end = i;
+		while (end < m_scratch.size() && m_scratch[end] == page)
+			end++;
+		size_t uses = end - i;
+		i = end;
+		if (page == VT_NO_PAGE || !m_layout.IsValid(page))
+			continue;
+
+		// The ancestors are what is drawn until the page arrives, they are in use as well
+		for (;;)
+		{
+			auto resident = m_resident.find(page);
+			if (resident != m_resident.end())
+				m_slots[resident->second].lastUsed = m_frame;
+			else if (!m_pending.count(page))
+			{
+				auto known = missing_index.find(page);
+				if (known == missing_index.end())
+				{
+					missing_index[page] = missing.size();
+					missing.push_back({ page, uses });
+				}
+				else
+					missing[known->second].count += uses;
+			}
+			if (GetPageLevel(page) >= m_layout.levels - 1)
+				break;
+			page = m_layout.GetParent(page);
+		}
+	}
+
+	// Coarse pages first, they cover more of the screen and make the finer ones useful
+	std::sort(missing.begin(), missing.end(), [](const Missing& a, const Missing& b) {
+		if (GetPageLevel(a.page) != GetPageLevel(b.page))
+			return GetPageLevel(a.page) > GetPageLevel(b.page);
+		if (a.count != b.count)
+			return a.count > b.count;
+		return a.page < b.page;
+	});
+	for (size_t i = 0; i < missing.size() && i < maxRequests; i++)
+	{
+		m_pending.insert(missing[i].page);
+		requests.push_back(missing[i].page);
+	}
+}
+
+int VirtualPageCache::Insert(uint32_t page, bool pinned)
+{
+	m_pending.erase(page);
+	auto resident = m_resident.find(page);
+	if (resident != m_resident.end())
+		return resident->second;
+
+	// A free slot, or the least recently used page not needed by the current frame
+	int slot = -1;
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		const Slot& candidate = m_slots[i];
+		if (candidate.page == VT_NO_PAGE)
+		{
+			slot = (int)i;
+			break;
+		}
+		if (!candidate.pinned && candidate.lastUsed < m_frame && (slot < 0 || candidate.lastUsed < m_slots[slot].lastUsed))
+			slot = (int)i;
+	}
+	if (slot < 0)
+		return -1;
+
+	Slot& target = m_slots[slot];
+	if (target.page != VT_NO_PAGE)
+	{
+		m_resident.erase(target.page);
+		m_evictions++;
+	}
+	target.page = page;
+	target.lastUsed = m_frame;
+	target.pinned = pinned;
+	m_resident[page] = slot;
+	m_table_dirty = true;
+	return slot;
+}
+
+bool VirtualPageCache::UpdatePageTable()
+{
+	if (!m_table_dirty)
+		return false;
+	m_table_dirty = false;
+
+	// Coarse to fine: every entry starts as its parent and resident pages write themselves over it
+	for (int level = m_layout.levels - 1; level >= 0; level--)
+	{
+		int size = m_layout.GetTableSize(level);
+		std::vector<PageTableEntry>& table = m_table[level];
+		table.resize((size_t)size * size);
+		if (level == m_layout.levels - 1)
+			std::fill(table.begin(), table.end(), PageTableEntry{ 0, 0, (unsigned char)level, 0 });
+		else
+		{
+			const std::vector<PageTableEntry>& parent = m_table[level + 1];
+			int parent_size = m_layout.GetTableSize(level + 1);
+			for (int y = 0; y < size; y++)
+				for (int x = 0; x < size; x++)
+					table[(size_t)y * size + x] = parent[(size_t)(y >> 1) * parent_size + (x >> 1)];
+		}
+
+		for (size_t i = 0; i < m_slots.size(); i++)
+		{
+			uint32_t page = m_slots[i].page;
+			if (page == VT_NO_PAGE || GetPageLevel(page) != level)
+				continue;
+			table[(size_t)GetPageY(page) * size + GetPageX(page)] = PageTableEntry{ (unsigned char)GetSlotX((int)i), (unsigned char)GetSlotY((int)i), (unsigned char)level, 0 };
+		}
+	}
+	return true;
+}
+
+bool VirtualPageLoader::Start(const std::string& path, bool decompress)
+{
+	if (!m_file.Open(path))
+		return false;
+	m_decompress = decompress;
+
+	m_thread = std::thread([this]() {
+		uint32_t page;
+		while (m_requests.Pop(page))
+		{
+			LoadedPage loaded;
+			loaded.page = page;
+			// an empty page tells the cache to give up on it
+			if (!m_file.ReadPage(page, loaded.data, m_decompress))
+			{
+				LOG_WARNING(LogCategory::Model, "Virtual texture page %u failed to load", page);
+				loaded.data.clear();
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_loaded.push_back(std::move(loaded));
+		}
+	});
+	return true;
+}
+
+void VirtualPageLoader::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+	m_requests.Close();
+	m_thread.join();
+	m_file.Close();
+}
+
+bool VirtualPageLoader::Request(uint32_t page)
+{
+	return m_thread.joinable() && m_requests.Push(page);
+}
+
+void VirtualPageLoader::TakeLoaded(std::vector<LoadedPage>& pages)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (LoadedPage& loaded : m_loaded)
+		pages.push_back(std::move(loaded));
+	m_loaded.clear();
+}
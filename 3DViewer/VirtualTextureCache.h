@@ -0,0 +1,197 @@
+#ifndef VIRTUAL_TEXTURE_CACHE_H
+#define VIRTUAL_TEXTURE_CACHE_H
+
+#include "BlockingQueue.h"
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// CPU side of the virtual texturing: the mip-tiled page file, the choice of resident pages and the
+// page table. Nothing here touches GL, VirtualTexture feeds it the feedback buffer and uploads what it
+// decides, the bench drives it with synthetic feedback instead.
+//
+// The virtual texture is a mip chain cut into pages of pageContent texels plus a pageBorder texel
+// border copied from the neighbours, so bilinear filtering inside a page never reads another page.
+// The image sits in the corner of a square of tableSize * pageContent texels with tableSize a power of
+// two, so every page of level l covers exactly four pages of level l - 1 and the last level is a single
+// page, which stays resident as the fallback for everything.
+
+// Pages are identified as level << 28 | y << 14 | x, up to 16384 pages per side and 16 levels
+inline uint32_t MakePageId(int level, int x, int y) { return ((uint32_t)level << 28) | ((uint32_t)y << 14) | (uint32_t)x; }
+inline int GetPageLevel(uint32_t page) { return (int)(page >> 28); }
+inline int GetPageX(uint32_t page) { return (int)(page & 0x3FFF); }
+inline int GetPageY(uint32_t page) { return (int)((page >> 14) & 0x3FFF); }
+
+// Written by the feedback pass where no virtual textured surface is
+static const uint32_t VT_NO_PAGE = 0xFFFFFFFF;
+
+struct VirtualTextureLayout
+{
+	int width = 0;
+	int height = 0;
+	int pageContent = 120;
+	int pageBorder = 4;
+	int levels = 0;
+	// page table side in pages at level 0, halved per level
+	int tableSize = 0;
+	// NONE stores RGBA8 pages
+	TextureCodec codec = TEXTURE_CODEC_NONE;
+
+	void Init(int width, int height, int pageContent, int pageBorder, TextureCodec codec);
+
+	// side of a stored page including the borders
+	int GetPageSize() const { return pageContent + 2 * pageBorder; }
+	size_t GetPageBytes() const;
+
+	int GetLevelWidth(int level) const { return std::max(1, (width + (1 << level) - 1) >> level); }
+	int GetLevelHeight(int level) const { return std::max(1, (height + (1 << level) - 1) >> level); }
+	int GetPagesX(int level) const { return (GetLevelWidth(level) + pageContent - 1) / pageContent; }
+	int GetPagesY(int level) const { return (GetLevelHeight(level) + pageContent - 1) / pageContent; }
+	int GetTableSize(int level) const { return std::max(1, tableSize >> level); }
+
+	bool IsValid(uint32_t page) const;
+	uint32_t GetParent(uint32_t page) const;
+	uint32_t GetRoot() const { return MakePageId(levels - 1, 0, 0); }
+};
+
+// The page file written by the tiler: a header, an offset for every page and the page data
+class VirtualTextureFile
+{
+public:
+	~VirtualTextureFile() { Close(); }
+
+	// Tiles an 8 bit image with 1-4 components into path. codec BC7 compresses every page.
+	// threads counts the calling thread, 0 runs on the shared JobSystem::Get().
+	static bool Build(const unsigned char* pixels, int width, int height, int components, const std::string& path,
+		TextureCodec codec = TEXTURE_CODEC_NONE, int threads = 0);
+
+	bool Open(const std::string& path);
+	void Close();
+
+	const VirtualTextureLayout& GetLayout() const { return m_layout; }
+
+	// Reads one page, a file must only be read by one thread at a time. decompress turns BC7 pages into
+	// RGBA8 for contexts that can't sample BC7.
+	bool ReadPage(uint32_t page, std::vector<unsigned char>& data, bool decompress = false);
+
+private:
+	FILE* m_file = nullptr;
+	VirtualTextureLayout m_layout;
+	// offsets of the pages, level after level in rows
+	std::vector<uint64_t> m_offsets;
+	std::vector<size_t> m_level_start;
+};
+
+// One RGBA8 texel of the page table texture: the slot of the physical cache and the level of the page
+// in it, which is a coarser one than asked for while the page itself isn't resident
+struct PageTableEntry
+{
+	unsigned char x;
+	unsigned char y;
+	unsigned char level;
+	unsigned char unused;
+};
+
+// Physical page slots with LRU eviction and the page table pointing into them
+class VirtualPageCache
+{
+public:
+	// slotsX * slotsY pages fit into the physical texture, at most 256 per side
+	void Init(const VirtualTextureLayout& layout, int slotsX, int slotsY);
+
+	// Takes the page ids written by a feedback pass. Pages in it and their coarser ancestors count as used
+	// this frame, the missing ones (coarse levels first, then by how often they were asked for) are
+	// appended to requests, at most maxRequests, and stay pending until Insert or CancelPending.
+	void ProcessFeedback(const uint32_t* feedback, size_t count, std::vector<uint32_t>& requests, size_t maxRequests);
+
+	// Puts a loaded page into a free slot or the least recently used one, returns the slot or -1 when
+	// every slot holds a page used this frame. Pinned pages are never evicted.
+	int Insert(uint32_t page, bool pinned = false);
+
+	// For requests that were dropped, they can be requested again
+	void CancelPending(uint32_t page) { m_pending.erase(page); }
+
+	bool IsResident(uint32_t page) const { return m_resident.count(page) != 0; }
+	// slot holding page, -1 if it isn't resident
+	int GetSlot(uint32_t page) const
+	{
+		auto resident = m_resident.find(page);
+		return resident != m_resident.end() ? resident->second : -1;
+	}
+	size_t GetPendingCount() const { return m_pending.size(); }
+	size_t GetResidentCount() const { return m_resident.size(); }
+	size_t GetSlotCount() const { return m_slots.size(); }
+	int GetSlotsX() const { return m_slots_x; }
+	int GetSlotX(int slot) const { return slot % m_slots_x; }
+	int GetSlotY(int slot) const { return slot / m_slots_x; }
+	unsigned long long GetEvictions() const { return m_evictions; }
+
+	// Pages used in the next feedback are compared against this frame
+	void EndFrame() { m_frame++; }
+
+	// Rebuilds the page table after pages came or went, returns false if nothing changed
+	bool UpdatePageTable();
+
+	// Level of the page table, GetTableSize(level)^2 entries in rows
+	const std::vector<PageTableEntry>& GetPageTable(int level) const { return m_table[level]; }
+
+private:
+	struct Slot
+	{
+		uint32_t page = VT_NO_PAGE;
+		unsigned long long lastUsed = 0;
+		bool pinned = false;
+	};
+
+	VirtualTextureLayout m_layout;
+	int m_slots_x = 0;
+	std::vector<Slot> m_slots;
+	std::unordered_map<uint32_t, int> m_resident;
+	std::unordered_set<uint32_t> m_pending;
+	unsigned long long m_frame = 1;
+	unsigned long long m_evictions = 0;
+	bool m_table_dirty = true;
+	std::vector<std::vector<PageTableEntry>> m_table;
+	std::vector<uint32_t> m_scratch;
+};
+
+// Reads requested pages on a thread of its own, so the render thread never waits for the disk
+class VirtualPageLoader
+{
+public:
+	struct LoadedPage
+	{
+		uint32_t page;
+		std::vector<unsigned char> data;
+	};
+
+	~VirtualPageLoader() { Stop(); }
+
+	// decompress is passed on to VirtualTextureFile::ReadPage
+	bool Start(const std::string& path, bool decompress = false);
+	void Stop();
+
+	// Queues a page, false if the loader isn't running
+	bool Request(uint32_t page);
+
+	// Moves the pages read since the last call into pages
+	void TakeLoaded(std::vector<LoadedPage>& pages);
+
+private:
+	VirtualTextureFile m_file;
+	bool m_decompress = false;
+	BlockingQueue<uint32_t> m_requests{ 4096 };
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::vector<LoadedPage> m_loaded;
+};
+
+#endif
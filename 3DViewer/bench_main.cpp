@@ -0,0 +1,1320 @@
+/*
+* Benchmarks of the CPU side subsystems, meant to run per commit on headless machines.
+* Needs no GL context or window: models are imported with deferUpload so nothing touches GL.
+*
+* Every case runs a fixed number of repetitions and reports min/median/mean wall time. Synthetic
+* inputs come from SyntheticScene and are identical from run to run, their checksums are part of
+* the JSON output so a change to the generator shows up as a different input rather than a regression.
+*
+* Run from the 3DViewer directory so models/pen.obj is found, or pass --models DIR.
+*/
+
+#include "Model.h"
+#include "MemoryTracker.h"
+#include "Camera.h"
+#include "Culling.h"
+#include "GeometryStore.h"
+#include "ImageWriter.h"
+#include "JobSystem.h"
+#include "MipGenerator.h"
+#include "SceneGraph.h"
+#include "SyntheticScene.h"
+#include "TextureCache.h"
+#include "TextureCompressor.h"
+#include "VirtualTextureCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+// Calls to operator new of the whole process (Assimp included), the replacements below count them so
+// every case reports its allocator calls next to its time
+static std::atomic<unsigned long long> g_allocations{ 0 };
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = malloc(size > 0 ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+struct Options
+{
+	int repetitions = 5;
+	vector<size_t> triangleCounts = { 1000000 };
+	size_t boxes = 1000000;
+	int imageSize = 2048;
+	string modelsDir = "models";
+	string workDir;
+	string jsonPath;
+	string tag;
+	string filter;
+	bool list = false;
+};
+
+struct BenchResult
+{
+	string name;
+	string unit;
+	double items = 0.0;
+	unsigned long long checksum = 0;
+	vector<double> samplesMs;
+	// fewest operator new calls of one repetition
+	unsigned long long allocations = 0;
+};
+
+void PrintUsage()
+{
+	printf("Usage: 3DViewerBench [options]\n");
+	printf("  --repetitions N    runs per case (default: 5)\n");
+	printf("  --triangles LIST   synthetic mesh sizes, e.g. 1M,10M,50M (default: 1M)\n");
+	printf("  --boxes N          boxes for the culling and sorting cases (default: 1M)\n");
+	printf("  --image-size N     side of the texture decode image (default: 2048)\n");
+	printf("  --models DIR       directory containing pen.obj (default: models)\n");
+	printf("  --work-dir DIR     where synthetic OBJ files are written (default: system temp)\n");
+	printf("  --filter TEXT      only run cases whose name contains TEXT\n");
+	printf("  --json FILE        write results as JSON, - for stdout\n");
+	printf("  --tag TEXT         stored in the JSON, e.g. the commit hash\n");
+	printf("  --list             print the case names and exit\n");
+}
+
+// Parses counts like 1500, 250K or 50M
+bool ParseCount(const char* text, size_t& count)
+{
+	char* end = nullptr;
+	double value = strtod(text, &end);
+	if (end == text || value <= 0.0)
+		return false;
+	if (*end == 'K' || *end == 'k')
+		value *= 1.0e3, end++;
+	else if (*end == 'M' || *end == 'm')
+		value *= 1.0e6, end++;
+	if (*end != '\0')
+		return false;
+	count = (size_t)value;
+	return true;
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+		else if (arg == "--repetitions" && has_value)
+			options.repetitions = atoi(argv[++i]);
+		else if (arg == "--triangles" && has_value)
+		{
+			options.triangleCounts.clear();
+			std::stringstream list(argv[++i]);
+			string item;
+			while (std::getline(list, item, ','))
+			{
+				size_t count = 0;
+				if (!ParseCount(item.c_str(), count))
+				{
+					printf("ERROR::BENCH::INVALID_COUNT: %s\n", item.c_str());
+					return false;
+				}
+				options.triangleCounts.push_back(count);
+			}
+		}
+		else if (arg == "--boxes" && has_value)
+		{
+			if (!ParseCount(argv[++i], options.boxes))
+				return false;
+		}
+		else if (arg == "--image-size" && has_value)
+			options.imageSize = atoi(argv[++i]);
+		else if (arg == "--models" && has_value)
+			options.modelsDir = argv[++i];
+		else if (arg == "--work-dir" && has_value)
+			options.workDir = argv[++i];
+		else if (arg == "--filter" && has_value)
+			options.filter = argv[++i];
+		else if (arg == "--json" && has_value)
+			options.jsonPath = argv[++i];
+		else if (arg == "--tag" && has_value)
+			options.tag = argv[++i];
+		else if (arg == "--list")
+			options.list = true;
+		else
+		{
+			printf("ERROR::BENCH::UNKNOWN_OPTION: %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	return options.repetitions > 0 && options.imageSize > 0;
+}
+
+string CountLabel(size_t count)
+{
+	if (count % 1000000 == 0)
+		return std::to_string(count / 1000000) + "M";
+	if (count % 1000 == 0)
+		return std::to_string(count / 1000) + "K";
+	return std::to_string(count);
+}
+
+// FNV-1a over raw bytes, identifies the synthetic inputs in the results
+unsigned long long Checksum(const void* data, size_t size, unsigned long long hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+unsigned long long SceneChecksum(const aiScene* scene)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		hash = Checksum(mesh->mVertices, mesh->mNumVertices * sizeof(aiVector3D), hash);
+		hash = Checksum(mesh->mNormals, mesh->mNumVertices * sizeof(aiVector3D), hash);
+	}
+	return hash;
+}
+
+class BenchRunner
+{
+public:
+	// The human readable report moves to stderr when the JSON goes to stdout
+	explicit BenchRunner(const Options& options) : m_options(options), m_report(options.jsonPath == "-" ? stderr : stdout) {}
+
+	// Whether a case should run, with --list the name is printed instead and nothing runs
+	bool Enabled(const string& name) const
+	{
+		if (!m_options.filter.empty() && name.find(m_options.filter) == string::npos)
+			return false;
+		if (m_options.list)
+		{
+			printf("%s\n", name.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Times body over the configured repetitions, setup runs untimed before every repetition
+	void Run(const string& name, const string& unit, double items, unsigned long long checksum, const std::function<void()>& body, const std::function<void()>& setup = nullptr)
+	{
+		BenchResult result;
+		result.name = name;
+		result.unit = unit;
+		result.items = items;
+		result.checksum = checksum;
+
+		for (int i = 0; i < m_options.repetitions; i++)
+		{
+			if (setup)
+				setup();
+			unsigned long long allocations = g_allocations.load();
+			Clock::time_point start = Clock::now();
+			body();
+			result.samplesMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			allocations = g_allocations.load() - allocations;
+			result.allocations = i == 0 ? allocations : std::min(result.allocations, allocations);
+		}
+
+		vector<double> sorted = result.samplesMs;
+		std::sort(sorted.begin(), sorted.end());
+		fprintf(m_report, "%-36s %10.3f ms min %10.3f ms median %14.0f %s/s %10llu allocs\n", name.c_str(), sorted.front(), sorted[sorted.size() / 2], items / (sorted.front() / 1000.0), unit.c_str(), result.allocations);
+		fflush(m_report);
+
+		m_results.push_back(result);
+	}
+
+	bool WriteJson(const string& path) const;
+
+	// Extra lines of the human readable report, e.g. quality numbers next to a timing
+	FILE* GetReport() const { return m_report; }
+
+private:
+	const Options& m_options;
+	FILE* m_report;
+	vector<BenchResult> m_results;
+};
+
+// Escapes the few characters that can appear in names and tags
+string JsonString(const string& text)
+{
+	string out = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out.push_back('\\');
+		if ((unsigned char)c >= 0x20)
+			out.push_back(c);
+	}
+	return out + "\"";
+}
+
+bool BenchRunner::WriteJson(const string& path) const
+{
+	FILE* file = path == "-" ? stdout : fopen(path.c_str(), "w");
+	if (!file)
+	{
+		printf("ERROR::BENCH::CANNOT_WRITE_JSON: %s\n", path.c_str());
+		return false;
+	}
+
+	const char* compiler =
+#if defined(__clang__)
+		"clang " __clang_version__;
+#elif defined(__GNUC__)
+		"gcc " __VERSION__;
+#elif defined(_MSC_VER)
+		"msvc";
+#else
+		"unknown";
+#endif
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"version\": 1,\n");
+	fprintf(file, "  \"tag\": %s,\n", JsonString(m_options.tag).c_str());
+	fprintf(file, "  \"compiler\": %s,\n", JsonString(compiler).c_str());
+	fprintf(file, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(file, "  \"repetitions\": %d,\n", m_options.repetitions);
+	fprintf(file, "  \"results\": [\n");
+	for (size_t r = 0; r < m_results.size(); r++)
+	{
+		const BenchResult& result = m_results[r];
+		vector<double> sorted = result.samplesMs;
+		std::sort(sorted.begin(), sorted.end());
+		double mean = 0.0;
+		for (double sample : sorted)
+			mean += sample;
+		mean /= sorted.size();
+
+		fprintf(file, "    {\"name\": %s, \"unit\": %s, \"items\": %.0f, \"checksum\": \"%016llx\", ", JsonString(result.name).c_str(), JsonString(result.unit).c_str(), result.items, result.checksum);
+		fprintf(file, "\"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, \"max_ms\": %.4f, \"items_per_second\": %.1f, \"allocations\": %llu, \"samples_ms\": [",
+			sorted.front(), sorted[sorted.size() / 2], mean, sorted.back(), result.items / (sorted.front() / 1000.0), result.allocations);
+		for (size_t i = 0; i < result.samplesMs.size(); i++)
+			fprintf(file, "%s%.4f", i > 0 ? ", " : "", result.samplesMs[i]);
+		fprintf(file, "]}%s\n", r + 1 < m_results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+
+	if (file != stdout)
+		fclose(file);
+	return true;
+}
+
+size_t CountTriangles(const Model& model)
+{
+	size_t triangles = 0;
+	for (const Mesh& mesh : model.meshes)
+		triangles += mesh.indices.size() / 3;
+	return triangles;
+}
+
+void BenchImport(BenchRunner& runner, const Options& options)
+{
+	string penPath = options.modelsDir + "/pen.obj";
+	bool import = runner.Enabled("import/pen");
+	bool load = runner.Enabled("model_load/pen");
+	if (import || load)
+	{
+		std::ifstream file(penPath, std::ios::binary);
+		string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		unsigned long long checksum = Checksum(contents.data(), contents.size());
+
+		size_t triangles = 0;
+		{
+			Assimp::Importer importer;
+			const aiScene* scene = importer.ReadFile(penPath, Model::ImportFlags);
+			if (!scene)
+			{
+				printf("ERROR::BENCH::IMPORT_FAILED: %s %s\n", penPath.c_str(), importer.GetErrorString());
+				return;
+			}
+			for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+				triangles += scene->mMeshes[m]->mNumFaces;
+		}
+
+		if (import)
+		{
+			runner.Run("import/pen", "triangles", (double)triangles, checksum, [&]() {
+				Assimp::Importer importer;
+				importer.ReadFile(penPath, Model::ImportFlags);
+			});
+		}
+
+		// Import plus conversion into Mesh data, the loader thread cost of the viewer
+		if (load)
+		{
+			runner.Run("model_load/pen", "triangles", (double)triangles, checksum, [&]() {
+				Model model(penPath, false, true);
+			});
+		}
+	}
+
+	for (size_t count : options.triangleCounts)
+	{
+		string name = "import/synthetic_" + CountLabel(count);
+		if (!runner.Enabled(name))
+			continue;
+
+		fs::path directory = options.workDir.empty() ? fs::temp_directory_path() : fs::path(options.workDir);
+		string objPath = (directory / ("viewer_bench_" + CountLabel(count) + ".obj")).string();
+
+		unsigned long long checksum = 0;
+		{
+			SyntheticSceneDesc desc;
+			desc.triangles = count;
+			unique_ptr<aiScene> scene(GenerateSyntheticScene(desc));
+			checksum = SceneChecksum(scene.get());
+			if (!WriteSyntheticObj(scene.get(), objPath))
+			{
+				printf("ERROR::BENCH::CANNOT_WRITE_OBJ: %s\n", objPath.c_str());
+				continue;
+			}
+		}
+
+		runner.Run(name, "triangles", (double)count, checksum, [&]() {
+			Assimp::Importer importer;
+			importer.ReadFile(objPath, Model::ImportFlags);
+		});
+
+		std::error_code error;
+		fs::remove(objPath, error);
+	}
+}
+
+// Meshes of the many mesh conversion case, fewer for small triangle counts
+static const size_t MANY_MESHES = 10000;
+
+// Identical materials of the many meshes case
+static const unsigned int FRAGMENTED_MATERIALS = 16;
+
+// Parts of the assembly case and the nodes placing each of them
+static const unsigned int ASSEMBLY_PARTS = 100;
+static const unsigned int ASSEMBLY_INSTANCES = 8;
+
+void BenchProcessMesh(BenchRunner& runner, const Options& options)
+{
+	for (size_t count : options.triangleCounts)
+	{
+		string name = "process_mesh/synthetic_" + CountLabel(count);
+		if (!runner.Enabled(name))
+			continue;
+
+		SyntheticSceneDesc desc;
+		desc.triangles = count;
+		desc.meshes = (unsigned int)std::max<size_t>(1, count / 1000000);
+		unique_ptr<aiScene> scene(GenerateSyntheticScene(desc));
+
+		// The Model is destroyed outside of the timed body so freeing the vertex arrays is not measured
+		unique_ptr<Model> model;
+		runner.Run(name, "triangles", (double)count, SceneChecksum(scene.get()), [&]() {
+			model.reset(new Model(scene.get(), ".", false, true));
+		}, [&]() {
+			model.reset();
+		});
+
+		if (CountTriangles(*model) != count)
+			printf("ERROR::BENCH::TRIANGLE_COUNT_MISMATCH: %s %zu\n", name.c_str(), CountTriangles(*model));
+	}
+
+	// The same triangles as thousands of small meshes, where the per mesh overhead of the conversion
+	// (allocations, material lookups, memory owners) matters more than the vertex loop. Like a fragmented
+	// export they repeat a few identical materials, static batching draws them as one mesh.
+	for (size_t count : options.triangleCounts)
+	{
+		SyntheticSceneDesc desc;
+		desc.triangles = count;
+		desc.meshes = (unsigned int)std::max<size_t>(1, std::min<size_t>(MANY_MESHES, count / 100));
+		desc.materials = FRAGMENTED_MATERIALS;
+		string name = "process_mesh/synthetic_" + CountLabel(count) + "_" + CountLabel(desc.meshes) + "_meshes";
+		if (!runner.Enabled(name))
+			continue;
+
+		unique_ptr<aiScene> scene(GenerateSyntheticScene(desc));
+		unique_ptr<Model> model;
+		runner.Run(name, "meshes", (double)desc.meshes, SceneChecksum(scene.get()), [&]() {
+			model.reset(new Model(scene.get(), ".", false, true));
+		}, [&]() {
+			model.reset();
+		});
+
+		if (model->parts.size() != desc.meshes || CountTriangles(*model) != count)
+			printf("ERROR::BENCH::TRIANGLE_COUNT_MISMATCH: %s %zu\n", name.c_str(), CountTriangles(*model));
+
+		// every triangle maps back to the grid it was generated in
+		bool mapped = true;
+		for (size_t m = 0; m < model->meshes.size(); m++)
+		{
+			const Mesh& mesh = model->meshes[m];
+			for (size_t triangle = 0; triangle < mesh.GetIndexCount() / 3; triangle += 97)
+			{
+				const MeshPart* part = model->FindPart((unsigned int)m, triangle);
+				mapped = mapped && part && triangle * 3 >= part->firstIndex && triangle * 3 < part->firstIndex + part->indexCount &&
+					part->indexCount == scene->mMeshes[part->sourceMesh]->mNumFaces * 3;
+			}
+		}
+		fprintf(runner.GetReport(), "  %u meshes with %u materials drawn as %zu, picking map %s\n", desc.meshes, desc.materials,
+			model->meshes.size(), mapped ? "ok" : "FAILED");
+	}
+
+	// An assembly of 100 parts placed 8 times each, a part is converted once however many nodes use it
+	for (size_t count : options.triangleCounts)
+	{
+		SyntheticSceneDesc desc;
+		desc.triangles = count;
+		desc.meshes = ASSEMBLY_PARTS;
+		desc.instances = ASSEMBLY_INSTANCES;
+		string name = "process_mesh/assembly_" + CountLabel(count) + "_x" + std::to_string(desc.instances);
+		if (!runner.Enabled(name))
+			continue;
+
+		unique_ptr<aiScene> scene(GenerateSyntheticScene(desc));
+		unique_ptr<Model> model;
+		runner.Run(name, "instances", (double)desc.meshes * desc.instances, SceneChecksum(scene.get()), [&]() {
+			model.reset(new Model(scene.get(), ".", false, true));
+		}, [&]() {
+			model.reset();
+		});
+
+		fprintf(runner.GetReport(), "  %zu meshes for %zu instances, %.1f MB CPU geometry\n", model->meshes.size(), model->instances.size(),
+			MemoryTracker::Get().GetOwnerBytes(model->GetMemoryOwner(), MEMORY_CPU_GEOMETRY) / 1048576.0);
+	}
+}
+
+void BenchTextureDecode(BenchRunner& runner, const Options& options)
+{
+	string name = "texture_decode/png_" + std::to_string(options.imageSize);
+	if (!runner.Enabled(name))
+		return;
+
+	int size = options.imageSize;
+	vector<unsigned char> pixels = GenerateSyntheticImage(size, size, 3, 7);
+	vector<unsigned char> png = EncodePNG(size, size, 3, pixels.data(), size * 3);
+
+	runner.Run(name, "pixels", (double)size * size, Checksum(png.data(), png.size()), [&]() {
+		int width, height, components;
+		unsigned char* decoded = stbi_load_from_memory(png.data(), (int)png.size(), &width, &height, &components, 0);
+		stbi_image_free(decoded);
+	});
+}
+
+// Peak signal to noise ratio over the first channels of two RGBA8 images
+double Psnr(const vector<unsigned char>& a, const vector<unsigned char>& b, int channels)
+{
+	double squared = 0.0;
+	size_t count = 0;
+	for (size_t i = 0; i < a.size(); i += 4)
+	{
+		for (int c = 0; c < channels; c++, count++)
+			squared += ((double)a[i + c] - b[i + c]) * ((double)a[i + c] - b[i + c]);
+	}
+	if (squared == 0.0)
+		return 99.0;
+	return 10.0 * std::log10(255.0 * 255.0 / (squared / count));
+}
+
+void BenchTextureEncode(BenchRunner& runner, const Options& options)
+{
+	struct EncodeCase
+	{
+		const char* name;
+		TextureCodec codec;
+		int components;
+		// below this the encoder is broken rather than slightly worse
+		double minPsnr;
+	};
+	static const EncodeCase cases[] = {
+		{ "bc7", TEXTURE_CODEC_BC7, 4, 30.0 },
+		{ "bc5", TEXTURE_CODEC_BC5, 2, 30.0 },
+		{ "bc4", TEXTURE_CODEC_BC4, 1, 30.0 },
+	};
+
+	int size = options.imageSize;
+	int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+	for (const EncodeCase& encode : cases)
+	{
+		// one encoder thread and all of them, the difference is the scaling of the block loop
+		string name = string("texture_encode/") + encode.name + "_" + std::to_string(size);
+		string nameSingle = name + "_1thread";
+		bool all = runner.Enabled(name);
+		bool single = runner.Enabled(nameSingle);
+		if (!all && !single)
+			continue;
+
+		vector<unsigned char> pixels = GenerateSyntheticImage(size, size, encode.components, 11);
+		unsigned long long checksum = Checksum(pixels.data(), pixels.size());
+		CompressedTexture texture;
+		if (single)
+		{
+			runner.Run(nameSingle, "pixels", (double)size * size, checksum, [&]() {
+				CompressImage(pixels.data(), size, size, encode.components, encode.codec, texture, 1);
+			});
+		}
+		if (all)
+		{
+			runner.Run(name, "pixels", (double)size * size, checksum, [&]() {
+				CompressImage(pixels.data(), size, size, encode.components, encode.codec, texture, hardware);
+			});
+		}
+
+		// Quality of the top level and a KTX2 round trip, printed next to the timings
+		vector<unsigned char> source((size_t)size * size * 4), decoded;
+		for (size_t i = 0; i < (size_t)size * size; i++)
+			for (int c = 0; c < encode.components; c++)
+				source[i * 4 + c] = pixels[i * encode.components + c];
+		DecompressLevel(texture, 0, decoded);
+		double psnr = Psnr(source, decoded, encode.components);
+
+		fs::path directory = options.workDir.empty() ? fs::temp_directory_path() : fs::path(options.workDir);
+		string ktxPath = (directory / ("viewer_bench_" + string(encode.name) + ".ktx2")).string();
+		CompressedTexture loaded;
+		bool roundTrip = TextureCache::WriteKtx2(ktxPath, texture) && TextureCache::ReadKtx2(ktxPath, loaded) &&
+			loaded.codec == texture.codec && loaded.levels.size() == texture.levels.size();
+		for (size_t i = 0; roundTrip && i < loaded.levels.size(); i++)
+			roundTrip = loaded.levels[i].data == texture.levels[i].data;
+		std::error_code error;
+		fs::remove(ktxPath, error);
+
+		size_t uncompressed = (size_t)size * size * encode.components * 4 / 3;
+		fprintf(runner.GetReport(), "  %s: %.2f dB PSNR, %zu levels, %.1f MB -> %.1f MB with mips, KTX2 round trip %s\n", encode.name, psnr,
+			texture.levels.size(), uncompressed / 1048576.0, texture.GetSize() / 1048576.0, roundTrip ? "ok" : "FAILED");
+		if (psnr < encode.minPsnr || !roundTrip)
+			printf("ERROR::BENCH::TEXTURE_ENCODE_FAILED: %s\n", name.c_str());
+	}
+}
+
+void BenchMipGenerate(BenchRunner& runner, const Options& options)
+{
+	struct MipCase
+	{
+		const char* name;
+		MipFilter filter;
+		int components;
+		bool srgb;
+		bool normalMap;
+	};
+	static const MipCase cases[] = {
+		{ "box", MIP_FILTER_BOX, 4, false, false },
+		{ "kaiser", MIP_FILTER_KAISER, 4, false, false },
+		{ "kaiser_srgb", MIP_FILTER_KAISER, 4, true, false },
+		{ "kaiser_normal", MIP_FILTER_KAISER, 3, false, true },
+	};
+
+	int size = options.imageSize;
+	int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+	for (const MipCase& mip : cases)
+	{
+		string name = string("mip_generate/") + mip.name + "_" + std::to_string(size);
+		string nameSingle = name + "_1thread";
+		bool all = runner.Enabled(name);
+		bool single = runner.Enabled(nameSingle);
+		if (!all && !single)
+			continue;
+
+		vector<unsigned char> pixels = GenerateSyntheticImage(size, size, mip.components, 17);
+		if (mip.normalMap)
+		{
+			// unit normals leaning at most 45 degrees off +Z, like a tangent space normal map
+			for (size_t i = 0; i < (size_t)size * size; i++)
+			{
+				float x = pixels[i * 3] / 255.0f - 0.5f;
+				float y = pixels[i * 3 + 1] / 255.0f - 0.5f;
+				float length = std::sqrt(x * x + y * y + 1.0f);
+				pixels[i * 3] = (unsigned char)((x / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				pixels[i * 3 + 1] = (unsigned char)((y / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				pixels[i * 3 + 2] = (unsigned char)((1.0f / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+			}
+		}
+		unsigned long long checksum = Checksum(pixels.data(), pixels.size());
+
+		MipOptions mipOptions;
+		mipOptions.filter = mip.filter;
+		mipOptions.srgb = mip.srgb;
+		mipOptions.normalMap = mip.normalMap;
+		vector<MipLevel> levels;
+		if (single)
+		{
+			runner.Run(nameSingle, "pixels", (double)size * size, checksum, [&]() {
+				GenerateMipChain(pixels.data(), size, size, mip.components, mipOptions, levels, 1);
+			});
+		}
+		if (all)
+		{
+			runner.Run(name, "pixels", (double)size * size, checksum, [&]() {
+				GenerateMipChain(pixels.data(), size, size, mip.components, mipOptions, levels, hardware);
+			});
+		}
+
+		// The chain goes down to 1x1 halving like GL
+		bool ok = (int)levels.size() == GetMipLevelCount(size, size) - 1;
+		for (size_t i = 0; ok && i < levels.size(); i++)
+		{
+			int expected = std::max(1, size >> (i + 1));
+			ok = levels[i].width == expected && levels[i].height == expected && levels[i].data.size() == (size_t)expected * expected * mip.components;
+		}
+
+		// The linear box filter is the old 2x2 average, up to rounding
+		double error = 0.0;
+		if (ok && mip.filter == MIP_FILTER_BOX && !mip.srgb)
+		{
+			vector<unsigned char> reference;
+			DownsampleImage(pixels, size, size, reference, levels[0].width, levels[0].height);
+			for (size_t i = 0; i < reference.size(); i++)
+				error = std::max(error, std::fabs((double)reference[i] - levels[0].data[i]));
+			ok = error <= 1.0;
+		}
+
+		// Normals stay unit length on every level, up to 8 bit quantization
+		if (ok && mip.normalMap)
+		{
+			for (const MipLevel& level : levels)
+			{
+				for (size_t i = 0; i < (size_t)level.width * level.height; i++)
+				{
+					double x = level.data[i * 3] / 127.5 - 1.0;
+					double y = level.data[i * 3 + 1] / 127.5 - 1.0;
+					double z = level.data[i * 3 + 2] / 127.5 - 1.0;
+					error = std::max(error, std::fabs(std::sqrt(x * x + y * y + z * z) - 1.0));
+				}
+			}
+			ok = error < 0.02;
+		}
+
+		fprintf(runner.GetReport(), "  %s: %zu levels, max error %.3f, checks %s\n", mip.name, levels.size(), error, ok ? "ok" : "FAILED");
+		if (!ok)
+			printf("ERROR::BENCH::MIP_GENERATE_FAILED: %s\n", name.c_str());
+	}
+}
+
+// Feedback of a camera looking at part of a virtual texture, what vt_feedback.glsl writes: the level
+// follows the texels per pixel, pixels off the texture are background. extent is the visible width in uv.
+void GenerateVirtualTextureFeedback(const VirtualTextureLayout& layout, float centerX, float centerY, float extent, int width, int height, vector<uint32_t>& feedback)
+{
+	float texelsPerPixel = extent * layout.width / width;
+	int level = std::min(std::max((int)std::floor(std::log2(texelsPerPixel)), 0), layout.levels - 1);
+	feedback.resize((size_t)width * height);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float u = centerX + ((x + 0.5f) / width - 0.5f) * extent;
+			float v = centerY + ((y + 0.5f) / width - 0.5f * height / width) * extent;
+			uint32_t page = VT_NO_PAGE;
+			if (u >= 0.0f && u < 1.0f && v >= 0.0f && v < 1.0f)
+			{
+				int pageX = (int)(u * layout.width / layout.pageContent) >> level;
+				int pageY = (int)(v * layout.height / layout.pageContent) >> level;
+				page = MakePageId(level, pageX, pageY);
+			}
+			feedback[(size_t)y * width + x] = page;
+		}
+	}
+}
+
+// Every page table entry has to point at the slot of a resident page covering it, at its own level or coarser
+bool CheckPageTable(const VirtualTextureLayout& layout, const VirtualPageCache& cache)
+{
+	for (int level = 0; level < layout.levels; level++)
+	{
+		int size = layout.GetTableSize(level);
+		const vector<PageTableEntry>& table = cache.GetPageTable(level);
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				const PageTableEntry& entry = table[(size_t)y * size + x];
+				int shift = entry.level - level;
+				if (shift < 0)
+					return false;
+				int slot = cache.GetSlot(MakePageId(entry.level, x >> shift, y >> shift));
+				if (slot < 0 || cache.GetSlotX(slot) != entry.x || cache.GetSlotY(slot) != entry.y)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+void BenchVirtualTexture(BenchRunner& runner, const Options& options)
+{
+	string tileName = "virtual_texture/tile_" + std::to_string(options.imageSize);
+	string feedbackName = "virtual_texture/feedback_320x180";
+	bool tile = runner.Enabled(tileName);
+	bool feedback = runner.Enabled(feedbackName);
+
+	if (tile)
+	{
+		int size = options.imageSize;
+		vector<unsigned char> pixels = GenerateSyntheticImage(size, size, 4, 13);
+		fs::path directory = options.workDir.empty() ? fs::temp_directory_path() : fs::path(options.workDir);
+		string path = (directory / "viewer_bench.vtex").string();
+		int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+		bool built = true;
+		runner.Run(tileName, "pixels", (double)size * size, Checksum(pixels.data(), pixels.size()), [&]() {
+			built = VirtualTextureFile::Build(pixels.data(), size, size, 4, path, TEXTURE_CODEC_NONE, hardware) && built;
+		});
+
+		// The second page of the second row starts one page of content in, after its border
+		VirtualTextureFile file;
+		vector<unsigned char> page;
+		bool ok = built && file.Open(path);
+		const VirtualTextureLayout& layout = file.GetLayout();
+		if (ok && layout.GetPagesX(0) > 1 && layout.GetPagesY(0) > 1)
+		{
+			ok = file.ReadPage(MakePageId(0, 1, 1), page);
+			size_t inside = ((size_t)layout.pageBorder * layout.GetPageSize() + layout.pageBorder) * 4;
+			size_t source = ((size_t)layout.pageContent * size + layout.pageContent) * 4;
+			ok = ok && memcmp(&page[inside], &pixels[source], 4) == 0;
+		}
+		ok = ok && file.ReadPage(layout.GetRoot(), page);
+		file.Close();
+		std::error_code error;
+		fs::remove(path, error);
+
+		fprintf(runner.GetReport(), "  tile: %d levels, %d pages of %dx%d at level 0, page round trip %s\n", layout.levels,
+			layout.GetPagesX(0) * layout.GetPagesY(0), layout.GetPageSize(), layout.GetPageSize(), ok ? "ok" : "FAILED");
+		if (!ok)
+			printf("ERROR::BENCH::VIRTUAL_TEXTURE_FAILED: %s\n", tileName.c_str());
+	}
+
+	if (!feedback)
+		return;
+
+	// A 16k atlas seen by a 1280x720 view, zooming from the whole texture down to level 0 while panning
+	const int frames = 240;
+	const int width = 320;
+	const int height = 180;
+	VirtualTextureLayout layout;
+	layout.Init(16384, 16384, 120, 4, TEXTURE_CODEC_BC7);
+	vector<vector<uint32_t>> frameFeedback(frames);
+	unsigned long long checksum = 14695981039346656037ull;
+	for (int f = 0; f < frames; f++)
+	{
+		float t = (float)f / (frames - 1);
+		float extent = std::pow(0.015f, t);
+		float centerX = 0.5f + 0.3f * t * std::sin(f * 0.05f);
+		float centerY = 0.5f + 0.3f * t * std::cos(f * 0.037f);
+		GenerateVirtualTextureFeedback(layout, centerX, centerY, extent, width, height, frameFeedback[f]);
+		checksum = Checksum(frameFeedback[f].data(), frameFeedback[f].size() * sizeof(uint32_t), checksum);
+	}
+
+	// Pages arrive right away, what is measured is the page selection, LRU and page table rebuild
+	VirtualPageCache cache;
+	vector<uint32_t> requests;
+	auto runFrame = [&](const vector<uint32_t>& pages) {
+		cache.EndFrame();
+		requests.clear();
+		cache.ProcessFeedback(pages.data(), pages.size(), requests, 64);
+		for (uint32_t page : requests)
+			cache.Insert(page);
+		cache.UpdatePageTable();
+	};
+	auto reset = [&]() {
+		cache.Init(layout, 16, 16);
+		cache.Insert(layout.GetRoot(), true);
+		cache.UpdatePageTable();
+	};
+
+	runner.Run(feedbackName, "frames", frames, checksum, [&]() {
+		for (int f = 0; f < frames; f++)
+			runFrame(frameFeedback[f]);
+	}, reset);
+
+	// Once more with the invariants checked after every frame
+	reset();
+	bool ok = true;
+	size_t requested = 0;
+	for (int f = 0; f < frames && ok; f++)
+	{
+		const vector<uint32_t>& pages = frameFeedback[f];
+		vector<uint32_t> usedResident;
+		for (uint32_t page : pages)
+		{
+			if (page != VT_NO_PAGE && cache.IsResident(page))
+				usedResident.push_back(page);
+		}
+		runFrame(pages);
+		requested += requests.size();
+
+		ok = cache.GetResidentCount() <= cache.GetSlotCount() && cache.IsResident(layout.GetRoot()) && CheckPageTable(layout, cache);
+		// pages the frame uses are never evicted for the ones it asks for
+		for (size_t i = 0; i < usedResident.size() && ok; i++)
+			ok = cache.IsResident(usedResident[i]);
+	}
+
+	// A camera that stops gets every page it needs and stops asking
+	for (int i = 0; i < 16 && ok; i++)
+		runFrame(frameFeedback.back());
+	for (size_t i = 0; i < frameFeedback.back().size() && ok; i++)
+		ok = frameFeedback.back()[i] == VT_NO_PAGE || cache.IsResident(frameFeedback.back()[i]);
+	ok = ok && requests.empty() && cache.GetPendingCount() == 0;
+
+	fprintf(runner.GetReport(), "  feedback: %zu pages requested, %llu evictions, %zu of %zu slots used, checks %s\n", requested,
+		cache.GetEvictions(), cache.GetResidentCount(), cache.GetSlotCount(), ok ? "ok" : "FAILED");
+	if (!ok)
+		printf("ERROR::BENCH::VIRTUAL_TEXTURE_FAILED: %s\n", feedbackName.c_str());
+}
+
+void BenchCulling(BenchRunner& runner, const Options& options)
+{
+	string cullName = "cull/boxes_" + CountLabel(options.boxes);
+	string sortName = "sort/front_to_back_" + CountLabel(options.boxes);
+	string cullJobsName = cullName + "_jobs";
+	string sortJobsName = sortName + "_jobs";
+	bool cull = runner.Enabled(cullName);
+	bool sort = runner.Enabled(sortName);
+	bool cullJobs = runner.Enabled(cullJobsName);
+	bool sortJobs = runner.Enabled(sortJobsName);
+	if (!cull && !sort && !cullJobs && !sortJobs)
+		return;
+
+	vector<glm::vec3> boundsMin, boundsMax;
+	GenerateSyntheticBoxes(options.boxes, 3, 50.0f, boundsMin, boundsMax);
+	unsigned long long checksum = Checksum(boundsMin.data(), boundsMin.size() * sizeof(glm::vec3));
+
+	vector<glm::vec3> centers(options.boxes);
+	for (size_t i = 0; i < options.boxes; i++)
+		centers[i] = (boundsMin[i] + boundsMax[i]) * 0.5f;
+
+	// The default camera looks at the origin from 10 units away and sees part of the box cloud
+	Camera camera;
+	glm::mat4 view = camera.GetViewMatrix();
+	Frustum frustum = ExtractFrustum(camera.GetProjectionMatrix() * view);
+
+	vector<unsigned int> visible(options.boxes);
+	if (cull)
+	{
+		runner.Run(cullName, "boxes", (double)options.boxes, checksum, [&]() {
+			CullBoxes(frustum, boundsMin.data(), boundsMax.data(), options.boxes, visible.data());
+		});
+	}
+
+	if (sort)
+	{
+		// Sort every box rather than the visible set, so the item count does not depend on the camera
+		vector<unsigned int> indices(options.boxes);
+		vector<unsigned long long> scratch;
+		runner.Run(sortName, "boxes", (double)options.boxes, checksum, [&]() {
+			SortFrontToBack(view, centers.data(), indices.data(), indices.size(), scratch);
+		}, [&]() {
+			for (size_t i = 0; i < indices.size(); i++)
+				indices[i] = (unsigned int)i;
+		});
+	}
+
+	if (!cullJobs && !sortJobs)
+		return;
+
+	// The same on the shared job system, checked against the serial results
+	JobSystem& jobs = JobSystem::Get();
+	size_t expectedCount = CullBoxes(frustum, boundsMin.data(), boundsMax.data(), options.boxes, visible.data());
+	vector<unsigned int> expectedVisible(visible.begin(), visible.begin() + expectedCount);
+	vector<unsigned int> parallelVisible(options.boxes);
+	size_t parallelCount = 0;
+	if (cullJobs)
+	{
+		runner.Run(cullJobsName, "boxes", (double)options.boxes, checksum, [&]() {
+			parallelCount = CullBoxes(frustum, boundsMin.data(), boundsMax.data(), options.boxes, parallelVisible.data(), jobs);
+		});
+	}
+	else
+		parallelCount = CullBoxes(frustum, boundsMin.data(), boundsMax.data(), options.boxes, parallelVisible.data(), jobs);
+	bool ok = parallelCount == expectedCount && std::equal(expectedVisible.begin(), expectedVisible.end(), parallelVisible.begin());
+
+	vector<unsigned int> expectedOrder(options.boxes), indices(options.boxes);
+	vector<unsigned long long> scratch;
+	for (size_t i = 0; i < options.boxes; i++)
+		expectedOrder[i] = (unsigned int)i;
+	SortFrontToBack(view, centers.data(), expectedOrder.data(), expectedOrder.size(), scratch);
+	auto resetIndices = [&]() {
+		for (size_t i = 0; i < indices.size(); i++)
+			indices[i] = (unsigned int)i;
+	};
+	if (sortJobs)
+	{
+		runner.Run(sortJobsName, "boxes", (double)options.boxes, checksum, [&]() {
+			SortFrontToBack(view, centers.data(), indices.data(), indices.size(), scratch, jobs);
+		}, resetIndices);
+	}
+	else
+	{
+		resetIndices();
+		SortFrontToBack(view, centers.data(), indices.data(), indices.size(), scratch, jobs);
+	}
+	ok = ok && indices == expectedOrder;
+	fprintf(runner.GetReport(), "  %d job threads, same result as serial: %s\n", jobs.GetThreadCount(), ok ? "ok" : "FAILED");
+	if (!ok)
+		printf("ERROR::BENCH::PARALLEL_CULLING_FAILED: %s\n", cullJobsName.c_str());
+}
+
+// Correctness of JobSystem under contention: more threads than cores, tiny jobs, several submitting threads
+static bool CheckJobSystem(FILE* report)
+{
+	JobSystem jobs(std::max(4, (int)std::thread::hardware_concurrency()));
+	bool ok = true;
+
+	// every index exactly once, flat and nested inside the ranges of an outer ParallelFor
+	const int flatCount = 100000;
+	vector<std::atomic<int>> visits(flatCount);
+	jobs.ParallelFor(flatCount, 7, [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			visits[i]++;
+	});
+	const int outerCount = 64, innerCount = 1000;
+	vector<std::atomic<int>> nestedVisits(outerCount * innerCount);
+	jobs.ParallelFor(outerCount, 1, [&](int outerBegin, int outerEnd) {
+		for (int outer = outerBegin; outer < outerEnd; outer++)
+		{
+			jobs.ParallelFor(innerCount, 13, [&, outer](int begin, int end) {
+				for (int i = begin; i < end; i++)
+					nestedVisits[outer * innerCount + i]++;
+			});
+		}
+	});
+	bool forOk = std::all_of(visits.begin(), visits.end(), [](const std::atomic<int>& v) { return v.load() == 1; }) &&
+		std::all_of(nestedVisits.begin(), nestedVisits.end(), [](const std::atomic<int>& v) { return v.load() == 1; });
+
+	// a random DAG: every job runs once and after all of its dependencies
+	const int dagCount = 4000;
+	vector<std::atomic<int>> runs(dagCount);
+	vector<int> stamps(dagCount, -1);
+	vector<vector<int>> dependencies(dagCount);
+	vector<JobHandle> handles(dagCount);
+	std::atomic<int> clock{ 0 };
+	unsigned int seed = 7;
+	for (int i = 0; i < dagCount; i++)
+	{
+		JobHandle waitFor[3];
+		for (int d = 0; d < 3 && i > 0; d++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			// mostly recent jobs, so many of them are still queued or running
+			int dependency = i - 1 - (int)((seed >> 8) % std::min(i, 32));
+			dependencies[i].push_back(dependency);
+			waitFor[d] = handles[dependency];
+		}
+		handles[i] = jobs.Submit([&, i]() {
+			runs[i]++;
+			stamps[i] = clock++;
+		}, waitFor, 3);
+	}
+	for (const JobHandle& handle : handles)
+		jobs.Wait(handle);
+	bool dagOk = true;
+	for (int i = 0; i < dagCount; i++)
+	{
+		dagOk = dagOk && runs[i].load() == 1;
+		for (int dependency : dependencies[i])
+			dagOk = dagOk && stamps[dependency] < stamps[i];
+	}
+
+	// threads that aren't workers submitting and waiting at the same time
+	const int submitters = 4, perSubmitter = 2000;
+	std::atomic<int> submitted{ 0 };
+	vector<std::thread> threads;
+	for (int t = 0; t < submitters; t++)
+	{
+		threads.emplace_back([&]() {
+			vector<JobHandle> own;
+			for (int i = 0; i < perSubmitter; i++)
+				own.push_back(jobs.Submit([&]() { submitted++; }));
+			for (const JobHandle& handle : own)
+				jobs.Wait(handle);
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	bool submitOk = submitted.load() == submitters * perSubmitter;
+
+	// main thread jobs queued from workers only run on this thread, the one that created the system
+	const int mainCount = 200;
+	vector<JobHandle> mainHandles(mainCount);
+	std::atomic<int> wrongThread{ 0 }, mainRuns{ 0 };
+	std::thread::id mainId = std::this_thread::get_id();
+	JobHandle spawner = jobs.Submit([&]() {
+		jobs.ParallelFor(mainCount, 8, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+			{
+				mainHandles[i] = jobs.SubmitMainThread([&]() {
+					mainRuns++;
+					if (std::this_thread::get_id() != mainId)
+						wrongThread++;
+				});
+			}
+		});
+	});
+	jobs.Wait(spawner);
+	for (const JobHandle& handle : mainHandles)
+		jobs.Wait(handle);
+	bool mainOk = mainRuns.load() == mainCount && wrongThread.load() == 0 && jobs.GetQueuedCount() == 0;
+
+	ok = forOk && dagOk && submitOk && mainOk;
+	fprintf(report, "  %d threads: parallel for %s, dag %s, external submitters %s, main thread %s, checks %s\n", jobs.GetThreadCount(),
+		forOk ? "ok" : "FAILED", dagOk ? "ok" : "FAILED", submitOk ? "ok" : "FAILED", mainOk ? "ok" : "FAILED", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// Items of the job scaling cases, each a few hundred nanoseconds of arithmetic
+static const int JOB_SCALING_ITEMS = 1 << 20;
+
+void BenchJobs(BenchRunner& runner)
+{
+	// 1, 2, 4, ... threads and all hardware threads
+	int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+	vector<int> threadCounts;
+	for (int threads = 1; threads < hardware; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(hardware);
+
+	vector<string> names;
+	bool any = false;
+	for (int threads : threadCounts)
+	{
+		names.push_back("jobs/parallel_for_" + std::to_string(threads) + "thread");
+		any = runner.Enabled(names.back()) || any;
+	}
+	string checkName = "jobs/contention_checks";
+	bool check = runner.Enabled(checkName);
+	if (!any && !check)
+		return;
+
+	vector<float> results(JOB_SCALING_ITEMS);
+	auto work = [&](int begin, int end) {
+		for (int i = begin; i < end; i++)
+		{
+			float x = (float)i * 0.001f;
+			for (int k = 0; k < 32; k++)
+				x = x * 0.999f + std::sqrt(x + 1.0f);
+			results[i] = x;
+		}
+	};
+	for (size_t t = 0; t < threadCounts.size(); t++)
+	{
+		if (!runner.Enabled(names[t]))
+			continue;
+		JobSystem jobs(threadCounts[t]);
+		runner.Run(names[t], "items", (double)JOB_SCALING_ITEMS, 0, [&]() {
+			jobs.ParallelFor(JOB_SCALING_ITEMS, 4096, work);
+		});
+	}
+
+	if (check)
+	{
+		bool ok = true;
+		// the races it looks for don't show every time
+		runner.Run(checkName, "rounds", 1.0, 0, [&]() {
+			ok = CheckJobSystem(runner.GetReport()) && ok;
+		});
+		if (!ok)
+			printf("ERROR::BENCH::JOB_SYSTEM_FAILED: %s\n", checkName.c_str());
+	}
+}
+
+// Nodes of the scene graph cases, the size of a large CAD assembly
+static const size_t SCENE_GRAPH_NODES = 100000;
+
+void BenchSceneGraph(BenchRunner& runner)
+{
+	string label = CountLabel(SCENE_GRAPH_NODES);
+	string allName = "scene_graph/update_all_" + label;
+	string subtreeName = "scene_graph/update_subtrees_" + label;
+	string glmName = "scene_graph/multiply_glm_" + label;
+	bool all = runner.Enabled(allName);
+	bool subtree = runner.Enabled(subtreeName);
+	bool plain = runner.Enabled(glmName);
+	if (!all && !subtree && !plain)
+		return;
+
+	// An 8-ary tree numbered breadth first (the parent of i is (i - 1) / 8), so it is in depth order
+	// as it is, with a small rotation and translation per node
+	SceneGraph graph;
+	graph.Reserve(SCENE_GRAPH_NODES);
+	vector<glm::mat4> locals(SCENE_GRAPH_NODES);
+	for (size_t i = 0; i < SCENE_GRAPH_NODES; i++)
+	{
+		float angle = (float)(i % 17) * 0.01f;
+		locals[i] = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 5) * 0.1f, 0.2f, -0.1f)), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+		graph.AddNode(i == 0 ? SceneGraph::NO_PARENT : (int)((i - 1) / 8), locals[i]);
+	}
+	graph.Update();
+	unsigned long long checksum = Checksum(locals.data(), locals.size() * sizeof(glm::mat4));
+
+	// The same products with glm, against which the SSE2 path of Update is checked and compared
+	vector<glm::mat4> worlds(SCENE_GRAPH_NODES);
+	auto multiplyGlm = [&]() {
+		worlds[0] = locals[0];
+		for (size_t i = 1; i < SCENE_GRAPH_NODES; i++)
+			worlds[i] = worlds[(i - 1) / 8] * locals[i];
+	};
+
+	if (all)
+	{
+		// a new root matrix moves every node
+		runner.Run(allName, "nodes", (double)SCENE_GRAPH_NODES, checksum, [&]() {
+			graph.Update();
+		}, [&]() {
+			graph.SetLocal(0, locals[0]);
+		});
+	}
+
+	if (subtree)
+	{
+		// 16 of the 512 nodes at depth 3 move, about 3% of the graph
+		size_t updated = 0;
+		runner.Run(subtreeName, "nodes", (double)SCENE_GRAPH_NODES, checksum, [&]() {
+			updated = graph.Update();
+		}, [&]() {
+			for (int i = 0; i < 16; i++)
+				graph.SetLocal(73 + i * 32, locals[73 + i * 32]);
+		});
+		fprintf(runner.GetReport(), "  %zu of %zu nodes recomputed\n", updated, SCENE_GRAPH_NODES);
+	}
+
+	if (plain)
+		runner.Run(glmName, "nodes", (double)SCENE_GRAPH_NODES, checksum, multiplyGlm);
+
+	multiplyGlm();
+	graph.SetLocal(0, locals[0]);
+	graph.Update();
+	float error = 0.0f;
+	for (size_t i = 0; i < SCENE_GRAPH_NODES; i++)
+	{
+		for (int c = 0; c < 4; c++)
+			error = std::max(error, glm::length(graph.GetWorld((int)i)[c] - worlds[i][c]));
+	}
+	fprintf(runner.GetReport(), "  max difference to glm %g, checks %s\n", error, error < 1.0e-3f ? "ok" : "FAILED");
+}
+
+// Vertices of the geometry hash cases, a large scanned mesh
+static const size_t GEOMETRY_HASH_VERTICES = 1000000;
+
+void BenchGeometryHash(BenchRunner& runner)
+{
+	string label = CountLabel(GEOMETRY_HASH_VERTICES);
+	string hashName = "geometry_store/hash_" + label;
+	string fnvName = "geometry_store/fnv1a_" + label;
+	bool hash = runner.Enabled(hashName);
+	bool fnv = runner.Enabled(fnvName);
+	if (!hash && !fnv)
+		return;
+
+	// What GeometryStore keys every mesh by, against the byte at a time FNV-1a of the checksums
+	vector<Vertex> vertices(GEOMETRY_HASH_VERTICES);
+	unsigned int seed = 1;
+	float* floats = (float*)vertices.data();
+	for (size_t i = 0; i < vertices.size() * sizeof(Vertex) / sizeof(float); i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		floats[i] = (float)(seed >> 8) / 16777216.0f;
+	}
+	size_t bytes = vertices.size() * sizeof(Vertex);
+	unsigned long long checksum = Checksum(vertices.data(), bytes);
+
+	uint64_t result = 0;
+	if (hash)
+	{
+		runner.Run(hashName, "vertices", (double)GEOMETRY_HASH_VERTICES, checksum, [&]() {
+			result = GeometryStore::Hash(vertices.data(), bytes);
+		});
+		fprintf(runner.GetReport(), "  %.2f MB hashed\n", bytes / 1048576.0);
+	}
+	if (fnv)
+	{
+		runner.Run(fnvName, "vertices", (double)GEOMETRY_HASH_VERTICES, checksum, [&]() {
+			result = Checksum(vertices.data(), bytes);
+		});
+	}
+
+	// the same bytes hash the same, one flipped bit anywhere changes the key
+	uint64_t before = GeometryStore::Hash(vertices.data(), bytes);
+	bool ok = before == GeometryStore::Hash(vertices.data(), bytes);
+	for (size_t offset : { (size_t)0, bytes / 2 + 3, bytes - 1 })
+	{
+		unsigned char* byte = (unsigned char*)vertices.data() + offset;
+		*byte ^= 1;
+		ok = ok && GeometryStore::Hash(vertices.data(), bytes) != before;
+		*byte ^= 1;
+	}
+	fprintf(runner.GetReport(), "  checks %s\n", ok && result != 0 ? "ok" : "FAILED");
+}
+
+void BenchCamera(BenchRunner& runner)
+{
+	const int iterations = 1000000;
+	if (!runner.Enabled("camera/matrices"))
+		return;
+
+	// Orbit plus view and projection matrices, what the viewer does every frame while dragging
+	Camera camera;
+	float sink = 0.0f;
+	runner.Run("camera/matrices", "frames", (double)iterations, 0, [&]() {
+		for (int i = 0; i < iterations; i++)
+		{
+			camera.Orbit(1.0f, (i & 64) ? 0.5f : -0.5f);
+			glm::mat4 view = camera.GetViewMatrix();
+			glm::mat4 projection = camera.GetProjectionMatrix();
+			sink += view[3][2] + projection[1][1];
+		}
+	});
+
+	// Keeps the loop from being optimized away
+	if (sink == 1.0f)
+		printf(" ");
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	BenchRunner runner(options);
+	BenchImport(runner, options);
+	BenchProcessMesh(runner, options);
+	BenchTextureDecode(runner, options);
+	BenchTextureEncode(runner, options);
+	BenchMipGenerate(runner, options);
+	BenchVirtualTexture(runner, options);
+	BenchCulling(runner, options);
+	BenchJobs(runner);
+	BenchSceneGraph(runner);
+	BenchGeometryHash(runner);
+	BenchCamera(runner);
+
+	if (!options.list && !options.jsonPath.empty() && !runner.WriteJson(options.jsonPath))
+		return 1;
+
+	return 0;
+}
@@ -1,14 +1,76 @@
 #version 430 core
 out vec4 FragColor;
 
+// Compiled once per material feature mask, ShaderVariants inserts a HAS_* define for every
+// feature the mesh has (see MaterialFeatures.h)
+#if defined(HAS_VIRTUAL_TEXTURE) && defined(HAS_TEXCOORDS)
+#define USE_VIRTUAL_TEXTURE
+#elif defined(HAS_DIFFUSE_MAP) && defined(HAS_TEXCOORDS)
+#define USE_DIFFUSE_MAP
+#endif
+
+#if defined(USE_DIFFUSE_MAP) || defined(USE_VIRTUAL_TEXTURE)
 in vec2 TexCoords;
+#endif
+
+#ifdef USE_DIFFUSE_MAP
+uniform sampler2D texture_diffuse1;
 
-uniform sampler2D tex;
+#ifdef HAS_SRGB_DIFFUSE
+// The texture is filtered in linear light, the framebuffer expects the encoded color like before
+vec3 EncodeSrgb(vec3 color)
+{
+    vec3 low = color * 12.92;
+    vec3 high = 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055;
+    return mix(high, low, lessThanEqual(color, vec3(0.0031308)));
+}
+#endif
+#endif
 uniform vec3 materialColor;
 
+#ifdef USE_VIRTUAL_TEXTURE
+// Set by VirtualTexture::Bind. The page table has a mip per level, every texel holds the physical
+// slot (xy) and the level (z) of the closest resident page covering it.
+uniform sampler2D vt_pagetable;
+uniform sampler2D vt_physical;
+uniform vec2 vt_image_size;
+uniform float vt_page_content;
+uniform float vt_page_border;
+uniform float vt_physical_size;
+uniform float vt_max_level;
+
+vec4 SampleVirtualTexture(vec2 uv)
+{
+    // level 0 texels, the same level selection as vt_feedback.glsl
+    vec2 texel = clamp(uv, 0.0, 1.0) * vt_image_size;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    int level = int(clamp(floor(lod), 0.0, vt_max_level));
+
+    texel = clamp(texel, vec2(0.5), vt_image_size - 0.5);
+    vec2 page = texel / vt_page_content;
+    vec4 entry = floor(texelFetch(vt_pagetable, ivec2(page) >> level, level) * 255.0 + 0.5);
+
+    // position inside the resident page, its level may be coarser than the one asked for
+    float scale = exp2(entry.z);
+    vec2 offset = texel / scale - floor(page / scale) * vt_page_content;
+    vec2 physical = entry.xy * (vt_page_content + 2.0 * vt_page_border) + vt_page_border + offset;
+    return textureLod(vt_physical, physical / vt_physical_size, 0.0);
+}
+#endif
+
 void main()
 {
-    vec4 texColor = texture(tex, TexCoords);
+#if defined(USE_DIFFUSE_MAP) || defined(USE_VIRTUAL_TEXTURE)
+#ifdef USE_VIRTUAL_TEXTURE
+    vec4 texColor = SampleVirtualTexture(TexCoords);
+#else
+    vec4 texColor = texture(texture_diffuse1, TexCoords);
+#ifdef HAS_SRGB_DIFFUSE
+    texColor.rgb = EncodeSrgb(texColor.rgb);
+#endif
+#endif
     vec3 texCol = texColor.rgb * materialColor;
 
     if (texColor.a < 0.1) {
@@ -16,4 +78,7 @@ void main()
     } else {
         FragColor = vec4(texCol, 1.0);
     }
+#else
+    FragColor = vec4(materialColor, 1.0);
+#endif
 }
@@ -0,0 +1,727 @@
+/*
+* Headless batch renderer for model thumbnails and turntables.
+* Renders every model of a list from N orbit angles into an offscreen framebuffer and writes PNGs,
+* without a window or display server (EGL surfaceless or OSMesa, runs on Mesa llvmpipe).
+*
+* The work is pipelined over three stages so the GL thread never waits on disk or compression:
+*   loader thread  -> Assimp import, mesh conversion and texture decode/compression (Model with deferUpload)
+*   GL thread      -> upload, render all angles, glReadPixels into a ring of PBOs guarded by fences
+*   encoder threads -> PNG compression and file writes of the mapped PBO contents
+*
+* With --software no GL context is created at all and the render stage uses the multithreaded
+* SoftwareRenderer instead, for machines where even llvmpipe is not available.
+*/
+
+#include "HeadlessContext.h"
+#include "Framebuffer.h"
+#include "ImageWriter.h"
+#include "BlockingQueue.h"
+#include "Model.h"
+#include "Camera.h"
+#include "SoftwareRenderer.h"
+#include "UniformBlocks.h"
+#include "UniformRing.h"
+#include "UploadScheduler.h"
+#include "GeometryStore.h"
+#include "GpuResourcePool.h"
+#include "MemoryTracker.h"
+#include "ShaderCache.h"
+#include "TextureCache.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+	int width = 256;
+	int height = 256;
+	int angles = 8;
+	float elevation = 30.0f;
+	int encoders = 0;
+	bool software = false;
+	int rasterThreads = 0;
+	string outputDir = "thumbnails";
+	string shaderDir = ".";
+	string shaderCacheDir = "shadercache";
+	bool compressTextures = false;
+	bool streamUploads = false;
+	int soakIterations = 0;
+	// GpuResourcePool capacity in MB, negative keeps the default
+	int poolMb = -1;
+	vector<string> models;
+};
+
+// A model imported on the loader thread, waiting for the GL thread
+struct ImportedModel
+{
+	size_t index = 0;
+	string path;
+	unique_ptr<Model> model;
+	double importMs = 0.0;
+};
+
+// Pixels mapped back from a PBO, waiting for an encoder thread
+struct EncodeJob
+{
+	string filename;
+	vector<unsigned char> pixels;
+	int width = 0;
+	int height = 0;
+};
+
+double ElapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Ring of pixel pack buffers. Each rendered image is read into the next PBO together with a fence,
+// and only mapped once the ring wraps around, so the GPU is never waited on right after drawing.
+class ReadbackRing
+{
+public:
+	ReadbackRing(int slots, int width, int height, BlockingQueue<EncodeJob>& encodeQueue)
+		: m_width(width), m_height(height), m_encode_queue(encodeQueue), m_slots(slots)
+	{
+		for (Slot& slot : m_slots)
+		{
+			glGenBuffers(1, &slot.pbo);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// Starts an asynchronous read of the currently bound read framebuffer
+	void Queue(const string& filename)
+	{
+		// hand off anything the GPU already finished, oldest first
+		for (size_t i = 0; i < m_slots.size(); i++)
+		{
+			Slot& oldest = m_slots[(m_next + i) % m_slots.size()];
+			if (!oldest.fence || glClientWaitSync(oldest.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				break;
+			Retire(oldest);
+		}
+
+		Slot& slot = m_slots[m_next];
+		if (slot.fence)
+			Retire(slot);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.filename = filename;
+
+		m_next = (m_next + 1) % m_slots.size();
+	}
+
+	// Retires every outstanding read in submission order
+	void Flush()
+	{
+		for (size_t i = 0; i < m_slots.size(); i++)
+		{
+			Slot& slot = m_slots[(m_next + i) % m_slots.size()];
+			if (slot.fence)
+				Retire(slot);
+		}
+	}
+
+	void Delete()
+	{
+		for (Slot& slot : m_slots)
+			glDeleteBuffers(1, &slot.pbo);
+	}
+
+	// Time the GL thread spent blocked on fences
+	double stallMs = 0.0;
+
+private:
+	struct Slot
+	{
+		GLuint pbo = 0;
+		GLsync fence = 0;
+		string filename;
+	};
+
+	void Retire(Slot& slot)
+	{
+		Clock::time_point start = Clock::now();
+		while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		stallMs += ElapsedMs(start);
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+
+		EncodeJob job;
+		job.filename = slot.filename;
+		job.width = m_width;
+		job.height = m_height;
+		job.pixels.resize((size_t)m_width * m_height * 4);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+		if (mapped)
+		{
+			memcpy(job.pixels.data(), mapped, job.pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		m_encode_queue.Push(std::move(job));
+	}
+
+	int m_width;
+	int m_height;
+	BlockingQueue<EncodeJob>& m_encode_queue;
+	vector<Slot> m_slots;
+	size_t m_next = 0;
+};
+
+void PrintUsage()
+{
+	printf("Usage: 3DViewerHeadless [options] <model>...\n");
+	printf("  --list FILE        read model paths from FILE, one per line ('#' starts a comment)\n");
+	printf("  --out DIR          output directory (default: thumbnails)\n");
+	printf("  --size WxH         image size in pixels (default: 256x256)\n");
+	printf("  --angles N         camera angles per model, evenly spaced around the orbit (default: 8)\n");
+	printf("  --elevation DEG    orbit elevation in degrees (default: 30)\n");
+	printf("  --encoders N       PNG encoder threads (default: cores - 2)\n");
+	printf("  --shader-dir DIR   directory containing vert.glsl and frag.glsl (default: .)\n");
+	printf("  --shader-cache DIR program binary cache (default: shadercache)\n");
+	printf("  --no-shader-cache  always compile the shaders\n");
+	printf("  --compress-textures block compress textures, cached as KTX2 in texcache/ next to each model\n");
+	printf("  --stream-uploads   upload through the UploadScheduler like the viewer, to check it renders the same\n");
+	printf("  --soak N           load, draw and unload the models N times in turn and check memory stays bounded\n");
+	printf("  --pool-mb N        GPU resource pool capacity in MB, 0 deletes unloaded buffers and textures (default: 256)\n");
+	printf("  --software         render on the CPU, no GL context needed\n");
+	printf("  --raster-threads N rasterizer threads for --software (default: all cores)\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+		{
+			return false;
+		}
+		else if (arg == "--list" && has_value)
+		{
+			std::ifstream list(argv[++i]);
+			if (!list)
+			{
+				printf("ERROR::HEADLESS::CANNOT_OPEN_LIST: %s\n", argv[i]);
+				return false;
+			}
+			string line;
+			while (std::getline(list, line))
+			{
+				line = line.substr(0, line.find('#'));
+				size_t first = line.find_first_not_of(" \t\r");
+				size_t last = line.find_last_not_of(" \t\r");
+				if (first != string::npos)
+					options.models.push_back(line.substr(first, last - first + 1));
+			}
+		}
+		else if (arg == "--out" && has_value)
+			options.outputDir = argv[++i];
+		else if (arg == "--size" && has_value)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+				return false;
+		}
+		else if (arg == "--angles" && has_value)
+			options.angles = atoi(argv[++i]);
+		else if (arg == "--elevation" && has_value)
+			options.elevation = (float)atof(argv[++i]);
+		else if (arg == "--encoders" && has_value)
+			options.encoders = atoi(argv[++i]);
+		else if (arg == "--shader-dir" && has_value)
+			options.shaderDir = argv[++i];
+		else if (arg == "--shader-cache" && has_value)
+			options.shaderCacheDir = argv[++i];
+		else if (arg == "--no-shader-cache")
+			options.shaderCacheDir.clear();
+		else if (arg == "--compress-textures")
+			options.compressTextures = true;
+		else if (arg == "--stream-uploads")
+			options.streamUploads = true;
+		else if (arg == "--soak" && has_value)
+			options.soakIterations = atoi(argv[++i]);
+		else if (arg == "--pool-mb" && has_value)
+			options.poolMb = atoi(argv[++i]);
+		else if (arg == "--software")
+			options.software = true;
+		else if (arg == "--raster-threads" && has_value)
+			options.rasterThreads = atoi(argv[++i]);
+		else if (arg.rfind("--", 0) == 0)
+		{
+			printf("ERROR::HEADLESS::UNKNOWN_OPTION: %s\n", arg.c_str());
+			return false;
+		}
+		else
+			options.models.push_back(arg);
+	}
+
+	// the soak test checks GL objects, there are none with the CPU renderer
+	if (options.soakIterations > 0 && options.software)
+		return false;
+	return !options.models.empty() && options.angles > 0;
+}
+
+// Scales and centers the model so its bounding sphere fills most of the camera's view
+glm::mat4 FitModelMatrix(Model& model, Camera& camera)
+{
+	glm::vec3 center = (model.boundsMin + model.boundsMax) * 0.5f;
+	float radius = glm::length(model.boundsMax - model.boundsMin) * 0.5f;
+	if (radius <= 0.0f)
+		radius = 1.0f;
+
+	float target_radius = camera.GetDistance() * glm::sin(glm::radians(camera.GetFov() * 0.5f)) * 0.9f;
+
+	glm::mat4 matrix = glm::mat4(1.0f);
+	matrix = glm::scale(matrix, glm::vec3(target_radius / radius));
+	matrix = glm::translate(matrix, -center);
+	return matrix;
+}
+
+// Repeats the feedback pass until every virtual texture page the view needs is resident, so the
+// image shows the textures at full detail instead of the coarse pages of the first frames
+void ResolveVirtualTextures(Model& model, Shader& feedbackShader, int width, int height, UniformRing& uniformRing, const glm::mat4& transform)
+{
+	Clock::time_point start = Clock::now();
+	do
+	{
+		model.DrawVirtualTextureFeedback(feedbackShader, width, height, uniformRing, transform);
+		glFlush();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		model.UpdateVirtualTextures();
+	} while (model.IsVirtualTextureBusy() && ElapsedMs(start) < 5000.0);
+}
+
+// Resident set size of the process, 0 where it can't be read
+size_t GetResidentBytes()
+{
+#ifdef __linux__
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+	unsigned long long pages = 0;
+	unsigned long long resident = 0;
+	int read = fscanf(file, "%llu %llu", &pages, &resident);
+	fclose(file);
+	return read == 2 ? (size_t)(resident * sysconf(_SC_PAGESIZE)) : 0;
+#else
+	return 0;
+#endif
+}
+
+// Growth of the resident set after the first round that still counts as bounded: allocator and
+// driver caches settle over the first few rounds
+static const size_t SOAK_RESIDENT_SLACK = 32 * 1024 * 1024;
+
+// Loads, uploads, draws and unloads the models iterations times in turn and checks nothing piles up:
+// after every unload no GL object of a model is left and the models hold no tracked memory, the free
+// objects of the GpuResourcePool stay within its capacity, and the resident set grows by at most
+// SOAK_RESIDENT_SLACK after the first round.
+int RunSoak(const Options& options, Framebuffer& framebuffer, ShaderVariants& shaderVariants, UniformRing& uniformRing)
+{
+	MemoryTracker& memory = MemoryTracker::Get();
+	GpuResourcePool& pool = GpuResourcePool::Get();
+	const long long base_buffers = GLBuffer::GetLiveCount();
+	const long long base_textures = GLTexture::GetLiveCount();
+	const long long base_arrays = GLVertexArray::GetLiveCount();
+
+	size_t first_round_resident = 0;
+	size_t peak_gpu = 0;
+	int failures = 0;
+	Clock::time_point start = Clock::now();
+	for (int iteration = 0; iteration < options.soakIterations; iteration++)
+	{
+		const string& path = options.models[iteration % options.models.size()];
+		{
+			Model model(path, true, true);
+			model.Upload();
+			shaderVariants.Prepare(model.GetMaterialFeatures());
+
+			Camera camera;
+			camera.SetViewportSize(options.width, options.height);
+			glm::mat4 transform = FitModelMatrix(model, camera);
+
+			framebuffer.Bind();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			uniformRing.BeginFrame();
+			uniformRing.PushAndBind(FRAME_UNIFORMS_BINDING, MakeFrameUniforms(camera.GetViewMatrix(), camera.GetProjectionMatrix(), camera.GetPosition()));
+			model.Draw(shaderVariants, uniformRing, transform);
+			uniformRing.EndFrame();
+
+			peak_gpu = std::max(peak_gpu, memory.GetTotal(MEMORY_GPU_BUFFER) + memory.GetTotal(MEMORY_GPU_TEXTURE));
+			model.Delete();
+		}
+		// the driver frees deleted objects once the GPU is done with them
+		glFinish();
+
+		long long buffers = GLBuffer::GetLiveCount() - base_buffers;
+		long long textures = GLTexture::GetLiveCount() - base_textures;
+		long long arrays = GLVertexArray::GetLiveCount() - base_arrays;
+		size_t cpu = memory.GetTotal(MEMORY_CPU_GEOMETRY) + memory.GetTotal(MEMORY_CPU_TEXTURE);
+		if (buffers != 0 || textures != 0 || arrays != 0 || cpu != 0)
+		{
+			printf("ERROR::HEADLESS::SOAK_LEAK: iteration %d (%s): %lld buffers, %lld textures, %lld vertex arrays, %zu bytes CPU left\n",
+				iteration, path.c_str(), buffers, textures, arrays, cpu);
+			failures++;
+		}
+		if (pool.GetStats().freeBytes > pool.GetCapacity())
+		{
+			printf("ERROR::HEADLESS::SOAK_POOL_OVER_CAPACITY: iteration %d: %zu bytes\n", iteration, pool.GetStats().freeBytes);
+			failures++;
+		}
+		if (failures > 0)
+			break;
+
+		if (iteration + 1 == (int)options.models.size())
+			first_round_resident = GetResidentBytes();
+	}
+	double seconds = ElapsedMs(start) / 1000.0;
+
+	size_t resident = GetResidentBytes();
+	const GpuPoolStats& stats = pool.GetStats();
+	printf("Soak: %d loads of %zu models in %.2f s (%.1f loads/s)\n", options.soakIterations, options.models.size(), seconds,
+		options.soakIterations / std::max(seconds, 1e-6));
+	printf("  peak GPU:        %.2f MB tracked\n", peak_gpu / 1048576.0);
+	printf("  pool:            %llu hits, %llu misses, %llu evictions, %zu objects (%.2f MB) free, capacity %.0f MB\n",
+		stats.hits, stats.misses, stats.evictions, stats.freeObjects, stats.freeBytes / 1048576.0, pool.GetCapacity() / 1048576.0);
+	if (first_round_resident > 0 && resident > 0)
+	{
+		printf("  resident:        %.1f MB after the first round, %.1f MB at the end\n", first_round_resident / 1048576.0, resident / 1048576.0);
+		if (failures == 0 && resident > first_round_resident + SOAK_RESIDENT_SLACK)
+		{
+			printf("ERROR::HEADLESS::SOAK_RESIDENT_GROWTH: %.1f MB\n", (resident - first_round_resident) / 1048576.0);
+			failures++;
+		}
+	}
+
+	printf("%s\n", failures == 0 ? "Soak passed" : "Soak FAILED");
+	return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	HeadlessContext context;
+	unique_ptr<Framebuffer> framebuffer;
+	unique_ptr<ShaderVariants> shaderVariants;
+	unique_ptr<Shader> vtFeedbackShader;
+	unique_ptr<SoftwareRenderer> software;
+	UniformRing uniformRing;
+	UploadScheduler uploadScheduler;
+
+	if (options.software)
+	{
+		software = std::make_unique<SoftwareRenderer>(options.width, options.height, options.rasterThreads);
+		printf("Renderer: software (%d threads)\n", software->GetThreadCount());
+	}
+	else
+	{
+		if (!context.Create(3, 3))
+		{
+			return -1;
+		}
+
+		if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+		{
+			printf("Failed to initialize GLAD\n");
+			context.Delete();
+			return -1;
+		}
+
+		printf("Context: %s\n", context.GetBackendName());
+		printf("OpenGL version: %s\n", glGetString(GL_VERSION));
+		printf("Renderer: %s\n", glGetString(GL_RENDERER));
+
+		framebuffer = std::make_unique<Framebuffer>(options.width, options.height);
+		if (!framebuffer->IsComplete())
+		{
+			printf("ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE\n");
+			context.Delete();
+			return -1;
+		}
+
+		if (!options.shaderCacheDir.empty())
+			ShaderCache::Get().Init(options.shaderCacheDir, (GLADloadproc)HeadlessContext::GetProcAddress);
+		// the loader thread compresses on import, decided before it starts
+		if (options.compressTextures)
+			TextureCache::Get().Init();
+		InitTextureStorage((GLADloadproc)HeadlessContext::GetProcAddress);
+
+		string vertex_path = options.shaderDir + "/vert.glsl";
+		string fragment_path = options.shaderDir + "/frag.glsl";
+		shaderVariants = std::make_unique<ShaderVariants>(vertex_path.c_str(), fragment_path.c_str());
+
+		glEnable(GL_DEPTH_TEST);
+		glViewport(0, 0, options.width, options.height);
+
+		uniformRing.Create(16 * 1024, (GLADloadproc)HeadlessContext::GetProcAddress);
+		if (options.streamUploads)
+			uploadScheduler.Create(4 * 1024 * 1024, (GLADloadproc)HeadlessContext::GetProcAddress);
+		if (options.poolMb >= 0)
+			GpuResourcePool::Get().SetCapacity((size_t)options.poolMb * 1024 * 1024);
+	}
+
+	if (options.soakIterations > 0)
+	{
+		stbi_set_flip_vertically_on_load(true);
+		shaderVariants->setVec3("materialColor", glm::vec3(1.0f));
+		int result = RunSoak(options, *framebuffer, *shaderVariants, uniformRing);
+
+		uniformRing.Delete();
+		uploadScheduler.Delete();
+		framebuffer->Delete();
+		shaderVariants->Delete();
+		GpuResourcePool::Get().Clear();
+		context.Delete();
+		return result;
+	}
+
+	// frag.glsl tints the diffuse texture by materialColor, keep the texture colors as they are
+	if (software)
+		software->SetMaterialColor(glm::vec3(1.0f));
+	else
+		shaderVariants->setVec3("materialColor", glm::vec3(1.0f));
+
+	std::error_code error;
+	fs::create_directories(options.outputDir, error);
+
+	stbi_set_flip_vertically_on_load(true);
+
+	int encoder_count = options.encoders;
+	if (encoder_count <= 0)
+		encoder_count = std::max(1, (int)std::thread::hardware_concurrency() - 2);
+
+	BlockingQueue<ImportedModel> import_queue(2);
+	BlockingQueue<EncodeJob> encode_queue(options.angles * 2 + 4);
+
+	Clock::time_point batch_start = Clock::now();
+
+	// Stage 1: import on a loader thread, at most two models ahead of the GL thread
+	std::thread loader([&]() {
+		for (size_t i = 0; i < options.models.size(); i++)
+		{
+			Clock::time_point start = Clock::now();
+			ImportedModel imported;
+			imported.index = i;
+			imported.path = options.models[i];
+			// gamma corrected like the interactive viewer, diffuse maps are filtered in linear light
+			imported.model = std::make_unique<Model>(options.models[i], true, true);
+			imported.importMs = ElapsedMs(start);
+			if (!import_queue.Push(std::move(imported)))
+				break;
+		}
+		import_queue.Close();
+	});
+
+	// Stage 3: PNG encoding on worker threads
+	std::atomic<int> images_written(0);
+	std::atomic<int> images_failed(0);
+	std::atomic<long long> encode_us(0);
+	vector<std::thread> encoders;
+	for (int i = 0; i < encoder_count; i++)
+	{
+		encoders.emplace_back([&]() {
+			EncodeJob job;
+			while (encode_queue.Pop(job))
+			{
+				Clock::time_point start = Clock::now();
+				if (WritePNG(job.filename.c_str(), job.width, job.height, 4, job.pixels.data(), job.width * 4, true))
+					images_written++;
+				else
+				{
+					printf("ERROR::HEADLESS::PNG_WRITE_FAILED: %s\n", job.filename.c_str());
+					images_failed++;
+				}
+				encode_us += (long long)(ElapsedMs(start) * 1000.0);
+			}
+		});
+	}
+
+	// Stage 2: upload, render and queue readbacks on the GL thread (or rasterize on the CPU)
+	unique_ptr<ReadbackRing> readbacks;
+	if (!software)
+		readbacks = std::make_unique<ReadbackRing>(std::max(4, options.angles), options.width, options.height, encode_queue);
+	int models_rendered = 0;
+	int models_failed = 0;
+	double import_ms = 0.0;
+	double render_ms = 0.0;
+
+	ImportedModel imported;
+	unique_ptr<Model> previous;
+	while (import_queue.Pop(imported))
+	{
+		import_ms += imported.importMs;
+		if (imported.model->meshes.empty())
+		{
+			printf("ERROR::HEADLESS::MODEL_EMPTY_OR_FAILED: %s\n", imported.path.c_str());
+			models_failed++;
+			imported.model->Delete();
+			continue;
+		}
+
+		Clock::time_point start = Clock::now();
+		Model& model = *imported.model;
+
+		Camera camera;
+		camera.SetViewportSize(options.width, options.height);
+		// the camera starts at 30 degrees of elevation, Orbit subtracts y offsets from it
+		camera.Orbit(0.0f, (30.0f - options.elevation) / camera.GetMouseSensitivity());
+
+		glm::mat4 transform = FitModelMatrix(model, camera);
+		if (software)
+		{
+			software->SetModelMatrix(transform);
+			software->SetProjectionMatrix(camera.GetProjectionMatrix());
+		}
+		else
+		{
+			if (options.streamUploads)
+			{
+				// a frame's worth of copies at a time until the model is complete
+				model.Upload(uploadScheduler);
+				while (model.IsUploading())
+					uploadScheduler.Process();
+			}
+			else
+				model.Upload();
+			// only materials no earlier model had compile anything
+			shaderVariants->Prepare(model.GetMaterialFeatures());
+			if (!model.virtualTextures.empty() && !vtFeedbackShader)
+			{
+				string vertex_path = options.shaderDir + "/vert.glsl";
+				string feedback_path = options.shaderDir + "/vt_feedback.glsl";
+				vtFeedbackShader = std::make_unique<Shader>(vertex_path.c_str(), feedback_path.c_str(), MakeFeatureDefines(FEATURE_TEXCOORDS));
+			}
+		}
+
+		char name[64];
+		string stem = fs::path(imported.path).stem().string();
+		for (int angle = 0; angle < options.angles; angle++)
+		{
+			if (angle > 0)
+				camera.Orbit(360.0f / options.angles / camera.GetMouseSensitivity(), 0.0f);
+
+			// index prefix keeps assets with the same file name apart
+			snprintf(name, sizeof(name), "%06zu_", imported.index);
+			string filename = options.outputDir + "/" + name + stem;
+			snprintf(name, sizeof(name), "_%02d.png", angle);
+			filename += name;
+
+			if (software)
+			{
+				software->Clear(glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+				software->SetViewMatrix(camera.GetViewMatrix());
+				model.Draw(*software);
+				software->Finish();
+
+				EncodeJob job;
+				job.filename = filename;
+				job.width = software->GetWidth();
+				job.height = software->GetHeight();
+				job.pixels.assign(software->GetPixels(), software->GetPixels() + (size_t)job.width * job.height * 4);
+				encode_queue.Push(std::move(job));
+				continue;
+			}
+
+			framebuffer->Bind();
+			glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			uniformRing.BeginFrame();
+			uniformRing.PushAndBind(FRAME_UNIFORMS_BINDING, MakeFrameUniforms(camera.GetViewMatrix(), camera.GetProjectionMatrix(), camera.GetPosition()));
+			if (!model.virtualTextures.empty())
+				ResolveVirtualTextures(model, *vtFeedbackShader, options.width, options.height, uniformRing, transform);
+			model.Draw(*shaderVariants, uniformRing, transform);
+			uniformRing.EndFrame();
+			readbacks->Queue(filename);
+		}
+
+		// deletion is deferred by the driver until the queued draws and reads are done. The model stays
+		// loaded until the next one is uploaded: meshes a new revision of an asset didn't change are found
+		// in the GeometryStore instead of uploaded again.
+		if (software)
+			software->ClearTextureCache();
+		if (previous)
+			previous->Delete();
+		previous = std::move(imported.model);
+		render_ms += ElapsedMs(start);
+		models_rendered++;
+	}
+	if (previous)
+		previous->Delete();
+
+	if (readbacks)
+		readbacks->Flush();
+	encode_queue.Close();
+	loader.join();
+	for (std::thread& encoder : encoders)
+		encoder.join();
+
+	double total_s = ElapsedMs(batch_start) / 1000.0;
+	int images = images_written.load();
+
+	printf("Rendered %d models (%d images) in %.2f s\n", models_rendered, images, total_s);
+	if (total_s > 0.0)
+		printf("  throughput:      %.2f models/s, %.2f images/s\n", models_rendered / total_s, images / total_s);
+	if (models_rendered + models_failed > 0)
+		printf("  import:          %.1f ms avg (loader thread)\n", import_ms / (models_rendered + models_failed));
+	if (models_rendered > 0)
+		printf("  upload+render:   %.1f ms avg (%s)\n", render_ms / models_rendered, software ? "software" : "GL thread");
+	if (readbacks)
+		printf("  readback stall:  %.1f ms total\n", readbacks->stallMs);
+	if (images > 0)
+		printf("  png encode:      %.1f ms avg per image (%d encoder threads)\n", encode_us.load() / 1000.0 / images, encoder_count);
+	printf("  failed:          %d models, %d images\n", models_failed, images_failed.load());
+	if (!software)
+	{
+		const GeometryStoreStats& geometry = GeometryStore::Get().GetStats();
+		printf("  geometry:        %llu meshes uploaded (%.2f MB), %llu shared with identical ones\n",
+			geometry.misses, geometry.uploadedBytes / 1048576.0, geometry.hits);
+	}
+
+	if (!software)
+	{
+		readbacks->Delete();
+		uniformRing.Delete();
+		uploadScheduler.Delete();
+		framebuffer->Delete();
+		shaderVariants->Delete();
+		if (vtFeedbackShader)
+			glDeleteProgram(vtFeedbackShader->ID);
+		GpuResourcePool::Get().Clear();
+		context.Delete();
+	}
+
+	return (models_failed > 0 || images_failed > 0) ? 1 : 0;
+}
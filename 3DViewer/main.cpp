@@ -12,17 +12,50 @@ namespace fs = std::filesystem;
 
 #include "Model.h"
 #include "Camera.h"
+#include "CameraController.h"
+#include "FrameCapture.h"
+#include "InputRecording.h"
+#include "FrameStats.h"
+#include "UniformBlocks.h"
+#include "UniformRing.h"
+#include "UploadScheduler.h"
+#include "GeometryStore.h"
+#include "GpuResourcePool.h"
+#include "JobSystem.h"
+#include "MemoryTracker.h"
+#include "ShaderCache.h"
+#include "TextureCache.h"
+#include "ShaderReloader.h"
+#include "SnapshotBuffer.h"
+#include "Profiler.h"
+#include "Logger.h"
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_opengl3.h>
-#include <imgui/imgui_impl_glfw.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
 #include <iostream>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 // Generally not a good idea to include the whole namespace. 
 // But it makes it simpler in examples.
 using namespace glm;
 
+// The viewer runs on two threads:
+//   - the event thread (main) owns the window, handles the GLFW events and moves the camera. It never
+//     touches GL, so input is handled at its own pace however long a frame takes.
+//   - the render thread owns the GL context, the models, the shaders and ImGui. It draws from the
+//     latest ViewSnapshot the event thread published and never waits for input.
+// The snapshots go through a lock free SnapshotBuffer. During a replay the render thread drives the
+// camera from the recording instead, one recorded frame per drawn frame.
+
 // Window Size
 const unsigned int width = 800;
 const unsigned int height = 800;
@@ -30,142 +63,463 @@ const unsigned int height = 800;
 // Create Camera Object
 Camera camera;
 
-double lastX = width / 2.0f;
-double lastY = height / 2.0f;
-bool firstMouse = true;
+// Mouse and keyboard handling of the camera
+CameraController cameraController(camera, width / 2.0f, height / 2.0f);
 
-float deltaTime = 0.0f;	// time between current frame and last frame
+float deltaTime = 0.0f;	// time between the current and the last batch of events
 float lastFrame = 0.0f;
 
-// Interactions
-bool mouseLeftButtonDown = false;
-bool mouseRightButtonDown = false;
-bool isDragging = false;
+// Input recording (--record) and deterministic replay (--replay)
+InputRecorder inputRecorder;
+bool replaying = false;
+
+// Overlays
+bool showProfiler = false;
+bool showShaders = false;
+bool showUploads = false;
+bool showMemory = false;
+bool showCapture = false;
+
+// Screenshots (F12) and image sequences go to captureDir, --capture DIR records a sequence from the first frame
+string captureDir = "captures";
+CaptureFormat captureFormat = CAPTURE_FORMAT_PNG;
+bool captureOnStart = false;
 
-void processInput(GLFWwindow* window)
+// Rebuilds the shaders when their files are saved
+ShaderReloader shaderReloader;
+
+// A model drawn every frame with its own transform
+struct SceneObject
 {
-	// Exit the program
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+	Model* model;
+	glm::mat4 transform;
+};
+
+// Input for ImGui, queued by the event thread and fed to ImGui by the render thread in the same order
+struct UiEvent
+{
+	enum Type
 	{
-		glfwSetWindowShouldClose(window, true);
+		MOUSE_POSITION,
+		MOUSE_BUTTON,
+		MOUSE_WHEEL,
+		KEY,
+		CHARACTER,
+		FOCUS
+	};
+
+	Type type;
+	// increasing, the render thread reports the last one it applied
+	unsigned long long id = 0;
+	// button, GLFW key or character
+	int code = 0;
+	int mods = 0;
+	bool down = false;
+	float x = 0.0f;
+	float y = 0.0f;
+};
+
+// What the render thread needs from the event thread to draw a frame
+struct ViewSnapshot
+{
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::vec3 position = glm::vec3(0.0f);
+	int windowWidth = 0;
+	int windowHeight = 0;
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	// the UI events the render thread hasn't applied yet, oldest first. A snapshot the render thread
+	// skips doesn't lose its events, the next one carries them again.
+	vector<UiEvent> uiEvents;
+};
+
+SnapshotBuffer<ViewSnapshot> viewSnapshots;
+// id of the last UiEvent the render thread gave to ImGui
+std::atomic<unsigned long long> uiEventsApplied{ 0 };
+
+// Wakes the render thread while it sleeps with nothing to draw. Only the sleep uses the mutex, the
+// snapshots themselves never wait.
+std::mutex renderWakeMutex;
+std::condition_variable renderWake;
+
+// Input of the event thread since the last published snapshot
+struct PendingInput
+{
+	bool changed = true;
+	// cursor movement is coalesced, the camera and ImGui get the last position of every batch of events
+	bool cursorMoved = false;
+	double cursorX = 0.0;
+	double cursorY = 0.0;
+	// scrolling is summed up the same way
+	double scrollX = 0.0;
+	double scrollY = 0.0;
+	// UI events not yet applied by the render thread
+	std::deque<UiEvent> uiEvents;
+	unsigned long long nextUiEvent = 1;
+};
+
+PendingInput pendingInput;
+
+// Held movement keys move the camera without events, the event thread wakes up at this rate while one is down
+const double INPUT_TICK_SECONDS = 1.0 / 120.0;
+// Longest time step of the movement keys, the first press after a long wait moves a frame's worth
+const float MAX_INPUT_DELTA = 1.0f / 30.0f;
+
+// Render on demand: frames are only drawn when something on screen can have changed.
+// Input events request a few frames because ImGui needs more than one frame to settle (hover, popups, window sizes).
+const int REDRAW_FRAMES_AFTER_INPUT = 3;
+// Upper bound of the time the render thread sleeps without input
+const double IDLE_WAIT_SECONDS = 0.5;
+bool continuousRendering = false;
+int redrawFrames = REDRAW_FRAMES_AFTER_INPUT;
+unsigned long long renderedFrames = 0;
+unsigned long long skippedFrames = 0;
+
+// Render thread only, input arrives as new snapshots
+void requestRedraw(int frames = REDRAW_FRAMES_AFTER_INPUT)
+{
+	if (redrawFrames < frames)
+		redrawFrames = frames;
+}
+
+// Returns true when the next iteration of the render loop has to draw a frame
+bool needsRedraw()
+{
+	return continuousRendering || replaying || redrawFrames > 0;
+}
+
+// Wakes the render thread, after a snapshot was published or the window is closing
+void wakeRenderThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(renderWakeMutex);
 	}
+	renderWake.notify_one();
+}
 
-	// Process WASD Movements of the camera
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+// The render thread stops on its own (end of a replay, no GL): closes the window from there
+void stopViewer(GLFWwindow* window)
+{
+	glfwSetWindowShouldClose(window, GLFW_TRUE);
+	glfwPostEmptyEvent();
+}
+
+void queueUiEvent(UiEvent event)
+{
+	event.id = pendingInput.nextUiEvent++;
+	pendingInput.uiEvents.push_back(event);
+	pendingInput.changed = true;
+}
+
+// The coalesced cursor position goes to the camera and ImGui before anything that depends on it
+void flushCursor()
+{
+	if (!pendingInput.cursorMoved)
+		return;
+	pendingInput.cursorMoved = false;
+
+	UiEvent event = { UiEvent::MOUSE_POSITION };
+	event.x = (float)pendingInput.cursorX;
+	event.y = (float)pendingInput.cursorY;
+	queueUiEvent(event);
+
+	if (replaying)
+		return;
+	inputRecorder.CursorPosition(pendingInput.cursorX, pendingInput.cursorY);
+	cameraController.CursorPosition(pendingInput.cursorX, pendingInput.cursorY);
+}
+
+void flushScroll()
+{
+	if (pendingInput.scrollX == 0.0 && pendingInput.scrollY == 0.0)
+		return;
+	if (!replaying)
 	{
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-		printf("FORWARD PRESSED \n");
+		inputRecorder.Scroll(pendingInput.scrollX, pendingInput.scrollY);
+		cameraController.Scroll(pendingInput.scrollX, pendingInput.scrollY);
 	}
+	pendingInput.scrollX = 0.0;
+	pendingInput.scrollY = 0.0;
+}
 
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+// Hands the camera, the window size and the unapplied UI events to the render thread
+void publishView(GLFWwindow* window)
+{
+	ViewSnapshot& snapshot = viewSnapshots.GetBack();
+	// the render thread moves the camera during a replay
+	if (!replaying)
 	{
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
-		printf("BACKWARD PRESSED \n");
+		snapshot.view = camera.GetViewMatrix();
+		snapshot.projection = camera.GetProjectionMatrix();
+		snapshot.position = camera.GetPosition();
+		camera.ClearDirty();
 	}
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+	glfwGetWindowSize(window, &snapshot.windowWidth, &snapshot.windowHeight);
+	glfwGetFramebufferSize(window, &snapshot.framebufferWidth, &snapshot.framebufferHeight);
+
+	unsigned long long applied = uiEventsApplied.load(std::memory_order_acquire);
+	while (!pendingInput.uiEvents.empty() && pendingInput.uiEvents.front().id <= applied)
+		pendingInput.uiEvents.pop_front();
+	snapshot.uiEvents.assign(pendingInput.uiEvents.begin(), pendingInput.uiEvents.end());
+
+	viewSnapshots.Publish();
+	pendingInput.changed = false;
+	wakeRenderThread();
+}
+
+// Samples the movement keys, returns a combination of InputKeys
+unsigned int processInput(GLFWwindow* window)
+{
+	// Exit the program
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(LEFT, deltaTime);
-		printf("LEFT PRESSED \n");
+		glfwSetWindowShouldClose(window, true);
 	}
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+
+	// Ignore the keyboard while a recording drives the camera
+	if (replaying)
 	{
-		camera.ProcessKeyboard(RIGHT, deltaTime);
-		printf("RIGHT PRESSED \n");
+		return 0;
 	}
+
+	// Process WASD Movements of the camera
+	unsigned int keys = 0;
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		keys |= KEY_FORWARD;
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		keys |= KEY_BACKWARD;
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		keys |= KEY_LEFT;
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		keys |= KEY_RIGHT;
+	return keys;
 }
 
-// Updates resizing of the window
+// Window size changes reach the render thread with the next snapshot, it sets the viewport
 void resizeWindowCallback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	pendingInput.changed = true;
+}
+
+// The window system lost the contents of the window (uncovered, restored), draw it again
+void windowRefreshCallback(GLFWwindow* window)
+{
+	pendingInput.changed = true;
+}
+
+// Keys, characters and focus changes only matter to ImGui
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action != GLFW_PRESS && action != GLFW_RELEASE)
+		return;
+	UiEvent event = { UiEvent::KEY };
+	event.code = key;
+	event.mods = mods;
+	event.down = action == GLFW_PRESS;
+	queueUiEvent(event);
+}
+
+void charCallback(GLFWwindow* window, unsigned int character)
+{
+	UiEvent event = { UiEvent::CHARACTER };
+	event.code = (int)character;
+	queueUiEvent(event);
+}
+
+void windowFocusCallback(GLFWwindow* window, int focused)
+{
+	UiEvent event = { UiEvent::FOCUS };
+	event.down = focused != 0;
+	queueUiEvent(event);
 }
 
 // Update mouse button handler callbacks (Clicking/Pressing)
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
-	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
-	{
-		isDragging = true;
-		mouseLeftButtonDown = true;
-		glfwGetCursorPos(window, &lastX, &lastY);
-		printf("Left Button Down Pressed");
-	}
+	// the click happens where the cursor is now, not where the last coalesced position left it
+	flushCursor();
 
-	else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
-	{
-		mouseRightButtonDown = true;
-		glfwGetCursorPos(window, &lastX, &lastY);
-		printf("Right Button Down Pressed");
-	}
+	UiEvent event = { UiEvent::MOUSE_BUTTON };
+	event.code = button;
+	event.mods = mods;
+	event.down = action == GLFW_PRESS;
+	queueUiEvent(event);
 
-	else if (button == GLFW_MOUSE_BUTTON_LEFT || button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE)
-	{
-		isDragging = false;
-		mouseLeftButtonDown = false;
-		mouseRightButtonDown = false;
-	}
+	if (replaying)
+		return;
+
+	double cursor_x, cursor_y;
+	glfwGetCursorPos(window, &cursor_x, &cursor_y);
+	inputRecorder.MouseButton(button, action, mods, cursor_x, cursor_y);
+	cameraController.MouseButton(button, action, cursor_x, cursor_y);
 }
 
 // Update mouse handler callbacks (physical movement of the mouse)
 void cursorPositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
-	float xoffset = xpos - lastX;
-	float yoffset = lastY - ypos; // reversed since y-coordinates go from bottom to top
-	std::cout << xoffset << " : " << yoffset << std::endl;
+	// applied once per batch of events in flushCursor
+	pendingInput.cursorMoved = true;
+	pendingInput.cursorX = xpos;
+	pendingInput.cursorY = ypos;
+	pendingInput.changed = true;
+}
 
-	lastX = xpos;
-	lastY = ypos;
+// Update scrolling callback on the physical mouse
+void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+{
+	UiEvent event = { UiEvent::MOUSE_WHEEL };
+	event.x = (float)xoffset;
+	event.y = (float)yoffset;
+	queueUiEvent(event);
 
-	if (isDragging && mouseLeftButtonDown)
-	{
-		camera.Orbit(xoffset, yoffset);
-	} 
+	pendingInput.scrollX += xoffset;
+	pendingInput.scrollY += yoffset;
+}
+
+// ImGui's name of a GLFW key, ImGuiKey_None for keys ImGui doesn't use
+ImGuiKey toImGuiKey(int key)
+{
+	if (key >= GLFW_KEY_A && key <= GLFW_KEY_Z)
+		return (ImGuiKey)(ImGuiKey_A + (key - GLFW_KEY_A));
+	if (key >= GLFW_KEY_0 && key <= GLFW_KEY_9)
+		return (ImGuiKey)(ImGuiKey_0 + (key - GLFW_KEY_0));
+	if (key >= GLFW_KEY_F1 && key <= GLFW_KEY_F12)
+		return (ImGuiKey)(ImGuiKey_F1 + (key - GLFW_KEY_F1));
+	if (key >= GLFW_KEY_KP_0 && key <= GLFW_KEY_KP_9)
+		return (ImGuiKey)(ImGuiKey_Keypad0 + (key - GLFW_KEY_KP_0));
 
-	if (firstMouse)
+	switch (key)
 	{
-		lastX = xpos;
-		lastY = ypos;
-		firstMouse = false;
+	case GLFW_KEY_TAB: return ImGuiKey_Tab;
+	case GLFW_KEY_LEFT: return ImGuiKey_LeftArrow;
+	case GLFW_KEY_RIGHT: return ImGuiKey_RightArrow;
+	case GLFW_KEY_UP: return ImGuiKey_UpArrow;
+	case GLFW_KEY_DOWN: return ImGuiKey_DownArrow;
+	case GLFW_KEY_PAGE_UP: return ImGuiKey_PageUp;
+	case GLFW_KEY_PAGE_DOWN: return ImGuiKey_PageDown;
+	case GLFW_KEY_HOME: return ImGuiKey_Home;
+	case GLFW_KEY_END: return ImGuiKey_End;
+	case GLFW_KEY_INSERT: return ImGuiKey_Insert;
+	case GLFW_KEY_DELETE: return ImGuiKey_Delete;
+	case GLFW_KEY_BACKSPACE: return ImGuiKey_Backspace;
+	case GLFW_KEY_SPACE: return ImGuiKey_Space;
+	case GLFW_KEY_ENTER: return ImGuiKey_Enter;
+	case GLFW_KEY_ESCAPE: return ImGuiKey_Escape;
+	case GLFW_KEY_KP_ENTER: return ImGuiKey_KeypadEnter;
+	case GLFW_KEY_LEFT_SHIFT: return ImGuiKey_LeftShift;
+	case GLFW_KEY_LEFT_CONTROL: return ImGuiKey_LeftCtrl;
+	case GLFW_KEY_LEFT_ALT: return ImGuiKey_LeftAlt;
+	case GLFW_KEY_LEFT_SUPER: return ImGuiKey_LeftSuper;
+	case GLFW_KEY_RIGHT_SHIFT: return ImGuiKey_RightShift;
+	case GLFW_KEY_RIGHT_CONTROL: return ImGuiKey_RightCtrl;
+	case GLFW_KEY_RIGHT_ALT: return ImGuiKey_RightAlt;
+	case GLFW_KEY_RIGHT_SUPER: return ImGuiKey_RightSuper;
+	default: return ImGuiKey_None;
 	}
 }
 
-// Update scrolling callback on the physical mouse
-void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+// Feeds the UI events of view that ImGui hasn't seen yet to it, render thread only
+void applyUiEvents(const ViewSnapshot& view, unsigned long long& applied)
 {
-	camera.Zoom(yoffset);
-	printf("SCROLLING MOUSE \n");
+	ImGuiIO& io = ImGui::GetIO();
+	for (const UiEvent& event : view.uiEvents)
+	{
+		if (event.id <= applied)
+			continue;
+		applied = event.id;
+
+		if (event.type == UiEvent::MOUSE_BUTTON || event.type == UiEvent::KEY)
+		{
+			io.AddKeyEvent(ImGuiMod_Ctrl, (event.mods & GLFW_MOD_CONTROL) != 0);
+			io.AddKeyEvent(ImGuiMod_Shift, (event.mods & GLFW_MOD_SHIFT) != 0);
+			io.AddKeyEvent(ImGuiMod_Alt, (event.mods & GLFW_MOD_ALT) != 0);
+			io.AddKeyEvent(ImGuiMod_Super, (event.mods & GLFW_MOD_SUPER) != 0);
+		}
+
+		switch (event.type)
+		{
+		case UiEvent::MOUSE_POSITION:
+			io.AddMousePosEvent(event.x, event.y);
+			break;
+		case UiEvent::MOUSE_BUTTON:
+			if (event.code >= 0 && event.code < ImGuiMouseButton_COUNT)
+				io.AddMouseButtonEvent(event.code, event.down);
+			break;
+		case UiEvent::MOUSE_WHEEL:
+			io.AddMouseWheelEvent(event.x, event.y);
+			break;
+		case UiEvent::KEY:
+			if (toImGuiKey(event.code) != ImGuiKey_None)
+				io.AddKeyEvent(toImGuiKey(event.code), event.down);
+			break;
+		case UiEvent::CHARACTER:
+			io.AddInputCharacter((unsigned int)event.code);
+			break;
+		case UiEvent::FOCUS:
+			io.AddFocusEvent(event.down);
+			break;
+		}
+	}
+	uiEventsApplied.store(applied, std::memory_order_release);
 }
 
-int main()
+// Rows of the Memory panel for the owners under parent, every row shows its whole subtree
+void drawMemoryOwners(const vector<MemoryOwnerInfo>& owners, unsigned int parent)
 {
-	// Initialize GLFW
-	glfwInit();
+	for (const MemoryOwnerInfo& owner : owners)
+	{
+		if (owner.parent != parent)
+			continue;
+		bool leaf = std::none_of(owners.begin(), owners.end(), [&](const MemoryOwnerInfo& other) { return other.parent == owner.id; });
 
-	// Tell GLFW what version of OpenGL we are using 
-	// In this case we are using OpenGL 3.3
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanFullWidth;
+		if (leaf)
+			flags |= ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+		bool open = ImGui::TreeNodeEx((void*)(intptr_t)owner.id, flags, "%s", owner.name.c_str());
+		for (int category = 0; category < MEMORY_CATEGORY_COUNT; category++)
+		{
+			ImGui::TableNextColumn();
+			ImGui::Text("%.2f", MemoryTracker::Get().GetOwnerBytes(owner.id, (MemoryCategory)category) / 1048576.0);
+		}
+		if (open && !leaf)
+		{
+			drawMemoryOwners(owners, owner.id);
+			ImGui::TreePop();
+		}
+	}
+}
 
-	// Tell GLFW we are using the CORE profile
-	// So that means we only have the modern functions
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+// captureDir/name_YYYYMMDD_HHMMSS, so screenshots and sequences of earlier sessions are kept
+string makeCapturePath(const char* name)
+{
+	time_t now = time(NULL);
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+	return (fs::path(captureDir) / (string(name) + "_" + stamp)).string();
+}
 
-	// Create a GLFWwindow object of 800 by 800 pixels, naming it "3D Model Viewer"
-	GLFWwindow* window = glfwCreateWindow(width, height, "3D Model Viewer", NULL, NULL);
-	// Error check if the window fails to create
-	if (window == NULL)
-	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
-	}
+// Writes the next frame, without the UI
+void takeScreenshot(FrameCapture& capture)
+{
+	std::error_code error;
+	fs::create_directories(captureDir, error);
+	// two in the same second get a counter
+	string path = makeCapturePath("screenshot");
+	string file = path + FrameCapture::GetExtension(captureFormat);
+	for (int i = 2; fs::exists(file); i++)
+		file = path + "_" + std::to_string(i) + FrameCapture::GetExtension(captureFormat);
+	capture.RequestScreenshot(file, captureFormat);
+	LOG_INFO(LogCategory::Render, "Screenshot: %s", file);
+}
 
-	// Introduce the window into the current context
+// Everything that touches GL: runs on its own thread until the window closes or the replay ends
+void renderLoop(GLFWwindow* window, GLFWwindow* compileContext, const InputRecording& recording, float replayTimestep, const char* replayPath)
+{
+	// Introduce the window into the context of this thread
 	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, resizeWindowCallback);
-	glfwSetMouseButtonCallback(window, mouseButtonCallback);
-	glfwSetCursorPosCallback(window, cursorPositionCallback);
-	glfwSetScrollCallback(window, scrollCallback);
 
 	//Load GLAD so it configures OpenGL
 	gladLoadGL();
@@ -173,32 +527,79 @@ int main()
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
 		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		stopViewer(window);
+		return;
 	}
 
-	// Initialize ImGUI
+	// Initialize ImGUI. Its input comes from the snapshots (applyUiEvents), not from GLFW callbacks.
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
-	ImGuiIO& io = ImGui::GetIO(); (void)io;
+	ImGuiIO& io = ImGui::GetIO();
+	io.BackendPlatformName = "3dviewer_snapshots";
 	ImGui::StyleColorsDark();
-	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init("#version 430");
 
-	stbi_set_flip_vertically_on_load(true);
+	// Create the GPU timer queries of the profiler
+	PROFILE_INIT();
 
 	// Specify the viewport of OpenGL in the Window
 	// In this case the viewport goes from x = 0, y = 0, to x = 800, y = 800
-	glViewport(0, 0, width, height);
+	viewSnapshots.Acquire();
+	int viewportWidth = viewSnapshots.GetFront().framebufferWidth;
+	int viewportHeight = viewSnapshots.GetFront().framebufferHeight;
+	glViewport(0, 0, viewportWidth, viewportHeight);
 
 	// Enables the Depth Buffer
 	glEnable(GL_DEPTH_TEST);
 
-	// Load the shaders
-	Shader shaderProgram("vert.glsl", "frag.glsl");
-	shaderProgram.use();
+	// Linked programs are kept on disk, later runs skip compiling unchanged shaders
+	ShaderCache::Get().Init("shadercache", (GLADloadproc)glfwGetProcAddress);
+
+	// Material textures are block compressed once and kept as KTX2 next to the model
+	TextureCache::Get().Init();
+	InitTextureStorage((GLADloadproc)glfwGetProcAddress);
+
+	// The shaders are built per material feature mask once the model is loaded
+	ShaderVariants shaderVariants("vert.glsl", "frag.glsl");
+
+	// Without a parallel compile extension reloads are built on the hidden window sharing our context.
+	// The event thread destroys it at exit whether it is used or not.
+	std::function<bool(bool)> setCompileContext;
+	if (compileContext)
+	{
+		setCompileContext = [compileContext](bool current) {
+			glfwMakeContextCurrent(current ? compileContext : NULL);
+			return !current || glfwGetCurrentContext() == compileContext;
+		};
+	}
+	shaderReloader.Init((GLADloadproc)glfwGetProcAddress, setCompileContext);
+	// Per-frame and per-object uniform blocks, see UniformBlocks.h
+	UniformRing uniformRing;
+	uniformRing.Create(64 * 1024, (GLADloadproc)glfwGetProcAddress);
+
+	// Model buffers and textures are copied in a few milliseconds per frame instead of all at once
+	UploadScheduler uploadScheduler;
+	uploadScheduler.Create(8 * 1024 * 1024, (GLADloadproc)glfwGetProcAddress);
+
+	// Screenshots and sequences are read back through a ring of PBOs and encoded on the job system
+	FrameCapture capture;
+	capture.Create();
+	if (captureOnStart)
+		capture.StartSequence(captureDir, "frame", captureFormat);
 
-	// Load in model
-	Model pen("models/pen.obj", true);
+	// Created here so its main thread jobs run on the GL thread, see RunMainThreadJobs in the loop
+	JobSystem& jobs = JobSystem::Get();
+
+	// Load in model on a worker, the window keeps drawing while it imports and streams in
+	std::unique_ptr<Model> pen;
+	std::shared_ptr<std::unique_ptr<Model>> penImported = std::make_shared<std::unique_ptr<Model>>();
+	JobHandle penImport = jobs.Submit([penImported]() {
+		*penImported = std::make_unique<Model>("models/pen.obj", true, true);
+	});
+
+	// Virtual textures report the pages they need from a low resolution pass before the scene
+	Shader vtFeedbackShader;
+	showShaders = shaderReloader.HasErrors();
 
 	// Build model matrix
 	glm::mat4 model = glm::mat4(1.0f);
@@ -212,100 +613,514 @@ int main()
 	model = glm::scale(model, model_scale);
 	model = glm::rotate(model, model_rotate_angle, model_rotate_axis);
 
-	// Send model matrix to vertex shader as it remains constant
-	shaderProgram.use();
-	shaderProgram.setMat4("model", model);
+	// Every object gets its model matrix through the ObjectUniforms block when it is drawn
+	vector<SceneObject> sceneObjects;
+
+	// The import finished: compile the variants its materials need together, hot reload each of
+	// them and hand the data to the upload scheduler. Needs the context, so it runs on this thread.
+	JobHandle penReady = jobs.SubmitMainThread([&, penImported]() {
+		pen = std::move(*penImported);
+		shaderVariants.Prepare(pen->GetMaterialFeatures());
+		for (auto& variant : shaderVariants.GetVariants())
+			shaderReloader.Watch(variant.second, DescribeFeatures(variant.first));
+		if (!pen->virtualTextures.empty())
+		{
+			vtFeedbackShader = Shader("vert.glsl", "vt_feedback.glsl", MakeFeatureDefines(FEATURE_TEXCOORDS));
+			shaderReloader.Watch(vtFeedbackShader, "virtual texture feedback");
+		}
+		showShaders = showShaders || shaderReloader.HasErrors();
+
+		// nothing in the viewer reads the vertices after the upload (no CPU picking or BVH)
+		pen->geometryPolicy = GEOMETRY_DROP_AFTER_UPLOAD;
+		pen->Upload(uploadScheduler);
+		sceneObjects.push_back({ pen.get(), model });
+		requestRedraw();
+	}, { penImport });
+
+	// Replays collect the frame time of every frame, the profiler overlay only keeps the last few seconds
+	FrameStats replayStats(replaying);
+	size_t replayFrame = 0;
 
 	// Log some messages
-	printf("OpenGL version: %s\n", glGetString(GL_VERSION));
-	printf("Renderer: %s\n", glGetString(GL_RENDERER));
+	LOG_INFO(LogCategory::Render, "OpenGL version: %s", glGetString(GL_VERSION));
+	LOG_INFO(LogCategory::Render, "Renderer: %s", glGetString(GL_RENDERER));
 
-	// Main while loop
+	float lastRender = static_cast<float>(glfwGetTime());
+	unsigned long long appliedUiEvent = 0;
+
+	// Render loop
 	while (!glfwWindowShouldClose(window))
 	{
+		// Swap in shaders rebuilt since the last frame, open the panel when a build failed
+		if (shaderReloader.Update())
+		{
+			requestRedraw();
+			showShaders = showShaders || shaderReloader.HasErrors();
+		}
+
+		// GL work that jobs finished since the last frame handed back, the pen's upload among it
+		jobs.RunMainThreadJobs();
+
+		// Every frame copies more of the model until it is complete
+		if (uploadScheduler.IsBusy())
+			requestRedraw();
+
+		// Captured frames the GPU finished go to the encoders. A sequence records every frame, so it draws continuously.
+		capture.Update();
+		if (capture.HasRequest())
+			requestRedraw();
+
+		// Virtual texture pages that arrived since the last frame sharpen the image
+		if (pen && pen->UpdateVirtualTextures())
+			requestRedraw();
+
+		// Input since the last frame: a new camera, window size or UI events
+		if (viewSnapshots.Acquire())
+			requestRedraw();
+		const ViewSnapshot& view = viewSnapshots.GetFront();
+
+		// Nothing changed since the last frame: sleep until the event thread publishes something instead of drawing the same image again
+		if (!needsRedraw())
+		{
+			skippedFrames++;
+			// shader builds and page loads don't publish snapshots, check on them more often
+			bool busy = shaderReloader.IsBusy() || !penReady.IsDone() || (pen && pen->IsVirtualTextureBusy()) || capture.IsBusy();
+			{
+				std::unique_lock<std::mutex> lock(renderWakeMutex);
+				renderWake.wait_for(lock, std::chrono::duration<double>(busy ? 0.01 : IDLE_WAIT_SECONDS),
+					[&]() { return viewSnapshots.HasNew() || glfwWindowShouldClose(window); });
+			}
+
+			// The time spent waiting is not part of the next frame
+			lastRender = static_cast<float>(glfwGetTime());
+			continue;
+		}
+
+		// Requests made by the snapshots taken during this frame are counted from the next one
+		if (redrawFrames > 0)
+			redrawFrames--;
+
 		// per-frame time logic
 		// --------------------
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		float currentRender = static_cast<float>(glfwGetTime());
+		float renderDelta = currentRender - lastRender;
+		lastRender = currentRender;
 
-		// GLFW Input Control
-		processInput(window);
+		// The replay ends with the recording
+		if (replaying && replayFrame == recording.frames.size())
+			break;
 
-		// Render
-		// Specify the color of the background
-		glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+		PROFILE_FRAME_BEGIN();
 
-		// Clean the back buffer and depth buffer
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (replaying)
+		{
+			replayStats.BeginFrame();
+			Mesh::drawStats = DrawStats();
+			ReplayInputFrame(recording.frames[replayFrame++], cameraController, replayTimestep);
+		}
+
+		// The window was resized since the last frame
+		if (view.framebufferWidth != viewportWidth || view.framebufferHeight != viewportHeight)
+		{
+			viewportWidth = view.framebufferWidth;
+			viewportHeight = view.framebufferHeight;
+			glViewport(0, 0, viewportWidth, viewportHeight);
+		}
+
+		// Waits only if the GPU is several frames behind
+		uniformRing.BeginFrame();
+
+		// Pending model data, within the time and byte budget of the frame
+		{
+			PROFILE_SCOPE("Uploads");
+			PROFILE_GPU_SCOPE("Uploads");
+			uploadScheduler.Process();
+		}
 
-		// Set the view and projection matrices
-		shaderProgram.setMat4("view", camera.GetViewMatrix());
-		shaderProgram.setMat4("projection", camera.GetProjectionMatrix());
+		// Render
+		{
+			PROFILE_SCOPE("Clear");
+			PROFILE_GPU_SCOPE("Clear");
 
-		shaderProgram.use();
+			// Specify the color of the background
+			glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
 
-		pen.Draw(shaderProgram);
+			// Clean the back buffer and depth buffer
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
 
-		// Tell OpenGL a new frame is about to begin
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
+		// Set the view and projection matrices, from the snapshot or, during a replay, the camera the recording moves
+		{
+			PROFILE_SCOPE("Update");
+			if (replaying)
+			{
+				uniformRing.PushAndBind(FRAME_UNIFORMS_BINDING, MakeFrameUniforms(camera.GetViewMatrix(), camera.GetProjectionMatrix(), camera.GetPosition()));
+				camera.ClearDirty();
+			}
+			else
+				uniformRing.PushAndBind(FRAME_UNIFORMS_BINDING, MakeFrameUniforms(view.view, view.projection, view.position));
+		}
 
-		// ImGUI window creation
-		if (ImGui::BeginMainMenuBar())
 		{
-			if (ImGui::BeginMenu("File"))
+			PROFILE_SCOPE("Draw submit");
+			PROFILE_GPU_SCOPE("Scene");
+			for (SceneObject& object : sceneObjects)
 			{
-				ImGui::MenuItem("Import...");
-				ImGui::EndMenu();
+				if (!object.model->virtualTextures.empty())
+					object.model->DrawVirtualTextureFeedback(vtFeedbackShader, view.framebufferWidth, view.framebufferHeight, uniformRing, object.transform);
+				object.model->Draw(shaderVariants, uniformRing, object.transform);
 			}
 		}
-		ImGui::EndMainMenuBar();
-
-		ImGui::SetNextWindowSizeConstraints(ImVec2(width, 100), ImVec2(FLT_MAX, 100));
-		ImGui::SetNextWindowPos(ImVec2(0, 18));
-		ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f);
-		ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 0.0f, 0.0f, 1.0f)); // set text color to black
-		ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.0f, 0.0f, 0.0f, 0.0f)); // set window background color to transparent
-		ImGui::Begin("Instructions", nullptr, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoBringToFrontOnFocus);
+
+		uniformRing.EndFrame();
+
+		// The scene without the UI, read back a few frames later
+		{
+			PROFILE_SCOPE("Capture");
+			PROFILE_GPU_SCOPE("Capture");
+			capture.CaptureFrame(viewportWidth, viewportHeight);
+		}
+
+		if (replaying)
+			replayStats.EndFrame(Mesh::drawStats);
+
+		{
+			PROFILE_SCOPE("ImGui");
+			PROFILE_GPU_SCOPE("ImGui");
+
+			// Tell OpenGL a new frame is about to begin, with the input and window size of the snapshot
+			applyUiEvents(view, appliedUiEvent);
+			io.DisplaySize = ImVec2((float)view.windowWidth, (float)view.windowHeight);
+			if (view.windowWidth > 0 && view.windowHeight > 0)
+				io.DisplayFramebufferScale = ImVec2((float)view.framebufferWidth / view.windowWidth, (float)view.framebufferHeight / view.windowHeight);
+			io.DeltaTime = renderDelta > 0.0f ? renderDelta : 1.0f / 60.0f;
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui::NewFrame();
+
+			// ImGUI window creation
+			if (ImGui::BeginMainMenuBar())
+			{
+				if (ImGui::BeginMenu("File"))
+				{
+					ImGui::MenuItem("Import...");
+					ImGui::Separator();
+					if (ImGui::MenuItem("Screenshot", "F12"))
+						takeScreenshot(capture);
+					if (!capture.IsRecording() && ImGui::MenuItem("Record Sequence"))
+						capture.StartSequence(makeCapturePath("sequence"), "frame", captureFormat);
+					else if (capture.IsRecording() && ImGui::MenuItem("Stop Sequence"))
+						capture.StopSequence();
+					if (ImGui::MenuItem("Capture as EXR", NULL, captureFormat == CAPTURE_FORMAT_EXR))
+						captureFormat = captureFormat == CAPTURE_FORMAT_EXR ? CAPTURE_FORMAT_PNG : CAPTURE_FORMAT_EXR;
+					ImGui::EndMenu();
+				}
+				if (ImGui::BeginMenu("View"))
+				{
+#if VIEWER_PROFILER
+					ImGui::MenuItem("Profiler", NULL, &showProfiler);
+#endif
+					ImGui::MenuItem("Shaders", NULL, &showShaders);
+					ImGui::MenuItem("Uploads", NULL, &showUploads);
+					ImGui::MenuItem("Memory", NULL, &showMemory);
+					ImGui::MenuItem("Capture", NULL, &showCapture);
+					// Draws every frame like a game loop, for benchmarking
+					ImGui::MenuItem("Continuous Rendering", NULL, &continuousRendering);
+					ImGui::EndMenu();
+				}
+
+				// Render mode indicator, skipped frames are wakeups that found nothing to draw
+				char renderMode[64];
+				if (continuousRendering || replaying)
+					snprintf(renderMode, sizeof(renderMode), "Continuous");
+				else
+					snprintf(renderMode, sizeof(renderMode), "On demand  drawn %llu  skipped %llu", renderedFrames, skippedFrames);
+				ImGui::SameLine(ImGui::GetWindowWidth() - ImGui::CalcTextSize(renderMode).x - 10.0f);
+				ImGui::TextDisabled("%s", renderMode);
+			}
+			ImGui::EndMainMenuBar();
+
+			ImGui::SetNextWindowSizeConstraints(ImVec2(width, 100), ImVec2(FLT_MAX, 100));
+			ImGui::SetNextWindowPos(ImVec2(0, 18));
+			ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0.0f);
+			ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 0.0f, 0.0f, 1.0f)); // set text color to black
+			ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.0f, 0.0f, 0.0f, 0.0f)); // set window background color to transparent
+			ImGui::Begin("Instructions", nullptr, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoBringToFrontOnFocus);
 		
-		ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(30, 30)); // Set equal padding on left and top
+			ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(30, 30)); // Set equal padding on left and top
 		
-		ImGui::SetWindowFontScale(1.2f);
-		ImGui::Text("Controls");
-		ImGui::PopStyleVar();
+			ImGui::SetWindowFontScale(1.2f);
+			ImGui::Text("Controls");
+			ImGui::PopStyleVar();
+
+			ImGui::Indent(); // Add bullet points
+			ImGui::BulletText("Scroll to Zoom");
+			ImGui::BulletText("Left Click to spin model");
+			ImGui::Unindent();
+
+			ImGui::End();
+			ImGui::PopStyleVar(1);
+			ImGui::PopStyleColor(2);
+
+			// Frame timings of the previous frame
+			PROFILE_OVERLAY(&showProfiler);
+
+			// Hot reload state and compile errors
+			shaderReloader.DrawPanel(&showShaders);
+
+			// What the upload scheduler costs per frame
+			if (showUploads)
+			{
+				if (ImGui::Begin("Uploads", &showUploads, ImGuiWindowFlags_AlwaysAutoResize))
+				{
+					const UploadStats& uploadStats = uploadScheduler.GetStats();
+					ImGui::Text("Budget: %.1f ms, %.1f MB per frame (%s)", uploadScheduler.GetBudgetMs(), uploadScheduler.GetBudgetBytes() / 1048576.0,
+						uploadScheduler.IsPersistent() ? "persistent staging" : "glBufferSubData staging");
+					ImGui::Text("Queued: %.1f MB", uploadScheduler.GetQueuedBytes() / 1048576.0);
+					ImGui::Text("Last frame: %.2f ms, %.2f MB", uploadStats.lastMs, uploadStats.lastBytes / 1048576.0);
+					ImGui::Text("Worst frame: %.2f ms", uploadStats.maxMs);
+					ImGui::Text("Total: %.1f MB, %llu uploads in %llu frames", uploadStats.totalBytes / 1048576.0, uploadStats.completedUploads, uploadStats.frames);
+					ImGui::Text("Frames skipped on fences: %llu", uploadStats.fenceSkips);
+				}
+				ImGui::End();
+			}
 
-		ImGui::Indent(); // Add bullet points
-		ImGui::BulletText("Scroll to Zoom");
-		ImGui::BulletText("Left Click to spin model");
-		ImGui::Unindent();
+			if (ImGui::IsKeyPressed(ImGuiKey_F12, false))
+				takeScreenshot(capture);
 
-		ImGui::End();
-		ImGui::PopStyleVar(1);
-		ImGui::PopStyleColor(2);
+			// Capture latency, dropped sequence frames and what the readbacks cost this thread
+			if (showCapture)
+			{
+				if (ImGui::Begin("Capture", &showCapture, ImGuiWindowFlags_AlwaysAutoResize))
+				{
+					CaptureStats captureStats = capture.GetStats();
+					if (capture.IsRecording())
+						ImGui::Text("Recording to %s", capture.GetSequenceDirectory().c_str());
+					else
+						ImGui::TextDisabled("Not recording");
+					ImGui::Text("Frames: %llu captured, %llu written, %llu dropped, %llu failed", captureStats.captured, captureStats.written, captureStats.dropped, captureStats.failed);
+					ImGui::Text("Latency: %.1f ms last, %.1f ms avg, %.1f ms max", captureStats.lastLatencyMs, captureStats.GetAverageLatencyMs(), captureStats.maxLatencyMs);
+					ImGui::Text("Render thread: %.3f ms last, %.3f ms avg, %.3f ms max per frame", captureStats.lastFrameMs, captureStats.GetAverageFrameMs(), captureStats.maxFrameMs);
+					ImGui::Text("In flight: %zu readbacks, %zu images encoding", captureStats.pendingReadbacks, captureStats.encodeBacklog);
+				}
+				ImGui::End();
+			}
 
-		// Renders the ImGUI elements
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			// What the models, their meshes and textures and the GL rings hold, in MB
+			if (showMemory)
+			{
+				ImGui::SetNextWindowSize(ImVec2(560, 300), ImGuiCond_FirstUseEver);
+				if (ImGui::Begin("Memory", &showMemory))
+				{
+					MemoryTracker& memory = MemoryTracker::Get();
+					ImGui::Text("CPU: %.1f MB   GPU: %.1f MB",
+						(memory.GetTotal(MEMORY_CPU_GEOMETRY) + memory.GetTotal(MEMORY_CPU_TEXTURE)) / 1048576.0,
+						(memory.GetTotal(MEMORY_GPU_BUFFER) + memory.GetTotal(MEMORY_GPU_TEXTURE)) / 1048576.0);
+					const GeometryStoreStats& geometry = GeometryStore::Get().GetStats();
+					ImGui::Text("Geometry store: %zu meshes in %zu buffers, sharing ratio %.2f",
+						geometry.references, geometry.entries, geometry.GetSharingRatio());
+					if (ImGui::BeginTable("MemoryOwners", MEMORY_CATEGORY_COUNT + 1, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_ScrollY))
+					{
+						ImGui::TableSetupScrollFreeze(0, 1);
+						ImGui::TableSetupColumn("Owner", ImGuiTableColumnFlags_WidthStretch);
+						for (int category = 0; category < MEMORY_CATEGORY_COUNT; category++)
+							ImGui::TableSetupColumn(MemoryTracker::GetCategoryName((MemoryCategory)category), ImGuiTableColumnFlags_WidthFixed);
+						ImGui::TableHeadersRow();
+						drawMemoryOwners(memory.GetOwners(), 0);
+						ImGui::EndTable();
+					}
+				}
+				ImGui::End();
+			}
 
-		// Take care of all GLFW events
-		glfwPollEvents();
+			// Renders the ImGUI elements
+			ImGui::Render();
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+			// Pressed buttons and dragged widgets keep animating without new events
+			if (ImGui::IsAnyItemActive())
+				requestRedraw(1);
+		}
 
 		// Swap the back buffer with the front buffer
-		glfwSwapBuffers(window);
+		{
+			PROFILE_SCOPE("Swap");
+			glfwSwapBuffers(window);
+		}
+
+		PROFILE_FRAME_END();
+
+		renderedFrames++;
+	}
+
+	// The window may close mid-import, the model must not outlive the context it is deleted with
+	jobs.Wait(penReady);
+
+	// The last frames of a sequence are still being read back and written
+	capture.Delete();
+
+	PROFILE_SHUTDOWN();
+	uniformRing.Delete();
+
+	shaderReloader.Shutdown();
+	shaderVariants.Delete();
+	if (vtFeedbackShader.ID)
+		glDeleteProgram(vtFeedbackShader.ID);
+	if (pen)
+		pen->Delete();
+	uploadScheduler.Delete();
+	GpuResourcePool::Get().Clear();
+
+	if (replaying)
+	{
+		replayStats.Finish();
+		printf("Replayed %s: %zu of %zu frames\n", replayPath, replayFrame, recording.frames.size());
+		replayStats.PrintSummary(stdout);
+		replayStats.Delete();
 	}
 
 	// Deletes all ImGUI instances
 	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 
+	glfwMakeContextCurrent(NULL);
+
+	// The replay may have ended first, the event thread stops too
+	stopViewer(window);
+}
+
+int main(int argc, char** argv)
+{
+	// Command line: --continuous | --record FILE | --replay FILE [--timestep SECONDS] | --capture DIR | --capture-format png|exr
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	float replayTimestep = 1.0f / 60.0f;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--continuous") == 0)
+			continuousRendering = true;
+		else if (i + 1 == argc)
+			break;
+		else if (strcmp(argv[i], "--record") == 0)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "--timestep") == 0)
+			replayTimestep = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--capture") == 0)
+		{
+			captureDir = argv[++i];
+			captureOnStart = true;
+		}
+		else if (strcmp(argv[i], "--capture-format") == 0)
+			captureFormat = strcmp(argv[++i], "exr") == 0 ? CAPTURE_FORMAT_EXR : CAPTURE_FORMAT_PNG;
+	}
+
+	InputRecording recording;
+	if (replayPath)
+	{
+		if (!LoadInputRecording(replayPath, recording))
+			return -1;
+		replaying = true;
+	}
+
+	// Initialize GLFW
+	glfwInit();
+
+	// Tell GLFW what version of OpenGL we are using 
+	// In this case we are using OpenGL 3.3
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+
+	// Tell GLFW we are using the CORE profile
+	// So that means we only have the modern functions
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	// Create a GLFWwindow object of 800 by 800 pixels, naming it "3D Model Viewer"
+	GLFWwindow* window = glfwCreateWindow(width, height, "3D Model Viewer", NULL, NULL);
+	// Error check if the window fails to create
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+
+	// Windows can only be created on this thread: the hidden one the shader reloader may compile on is made up front
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* compileContext = glfwCreateWindow(1, 1, "Shader compiler", NULL, window);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+	glfwSetFramebufferSizeCallback(window, resizeWindowCallback);
+	glfwSetMouseButtonCallback(window, mouseButtonCallback);
+	glfwSetCursorPosCallback(window, cursorPositionCallback);
+	glfwSetScrollCallback(window, scrollCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetCharCallback(window, charCallback);
+	glfwSetWindowFocusCallback(window, windowFocusCallback);
+
+	stbi_set_flip_vertically_on_load(true);
+
+	if (recordPath)
+		inputRecorder.Start(width, height);
+
+	// The render thread starts from this snapshot
+	publishView(window);
+	std::thread renderThread(renderLoop, window, compileContext, std::cref(recording), replayTimestep, replayPath);
+
+	// Event loop: only GLFW events and the camera, the render thread draws
+	lastFrame = static_cast<float>(glfwGetTime());
+	unsigned int heldKeys = 0;
+	while (!glfwWindowShouldClose(window))
+	{
+		// Sleep until an event arrives, held movement keys move the camera without them
+		if (heldKeys != 0)
+			glfwWaitEventsTimeout(INPUT_TICK_SECONDS);
+		else
+			glfwWaitEvents();
+
+		// per-batch time logic, the time spent waiting for the first key press isn't movement
+		// --------------------
+		float currentFrame = static_cast<float>(glfwGetTime());
+		deltaTime = std::min(currentFrame - lastFrame, MAX_INPUT_DELTA);
+		lastFrame = currentFrame;
+
+		// The coalesced movement of this batch of events
+		flushCursor();
+		flushScroll();
+
+		// GLFW Input Control
+		heldKeys = processInput(window);
+		if (!replaying && (pendingInput.changed || heldKeys != 0))
+		{
+			// Events of this batch and the keys held now make one recorded frame
+			inputRecorder.BeginFrame(deltaTime);
+			inputRecorder.Keys(heldKeys);
+			cameraController.Keys(heldKeys, deltaTime);
+		}
+
+		if (pendingInput.changed || (!replaying && camera.IsDirty()))
+			publishView(window);
+	}
+
+	// The render thread may be asleep waiting for input
+	wakeRenderThread();
+	renderThread.join();
+
+	if (compileContext)
+		glfwDestroyWindow(compileContext);
+
+	if (recordPath)
+		inputRecorder.Save(recordPath);
+
 	// Delete window before ending the program
 	glfwDestroyWindow(window);
 
 	// Terminate GLFW before ending the program
 	glfwTerminate();
 
+	// Write out the remaining log messages
+	Logger::Get().Shutdown();
+
 	return 0;
-}
\ No newline at end of file
+}
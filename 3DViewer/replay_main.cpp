@@ -0,0 +1,305 @@
+/*
+* Offscreen replay of an input recording made with "3DViewer --record FILE".
+* Drives the camera from the recorded mouse and keyboard events with a fixed timestep and renders
+* every frame of the session into a framebuffer, so two builds can be compared on exactly the same
+* camera path without a window or display server. Prints CPU/GPU frame time percentiles and draw
+* statistics, and optionally writes them per frame as CSV or JSON. With --capture the frames go through
+* the viewer's asynchronous FrameCapture into an image sequence, its cost is part of the frame times.
+*/
+
+#include "HeadlessContext.h"
+#include "Framebuffer.h"
+#include "FrameCapture.h"
+#include "FrameStats.h"
+#include "InputRecording.h"
+#include "UniformBlocks.h"
+#include "UniformRing.h"
+#include "UploadScheduler.h"
+#include "GeometryStore.h"
+#include "GpuResourcePool.h"
+#include "Model.h"
+#include "Camera.h"
+#include "Logger.h"
+#include "MemoryTracker.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+struct Options
+{
+	string recording;
+	int width = 0;
+	int height = 0;
+	float timestep = 1.0f / 60.0f;
+	int warmup = 10;
+	int repeat = 1;
+	bool sync = false;
+	bool streamUploads = false;
+	double uploadBudgetMs = 2.0;
+	bool dropGeometry = false;
+	string model = "models/pen.obj";
+	string shaderDir = ".";
+	string csvPath;
+	string jsonPath;
+	string label;
+	string captureDir;
+	CaptureFormat captureFormat = CAPTURE_FORMAT_PNG;
+};
+
+void PrintUsage()
+{
+	printf("Usage: 3DViewerReplay [options] <recording>\n");
+	printf("  --model FILE       model to render (default: models/pen.obj)\n");
+	printf("  --size WxH         framebuffer size (default: window size of the recording)\n");
+	printf("  --timestep S       fixed frame time used for keyboard movement (default: 1/60)\n");
+	printf("  --warmup N         frames left out of the summary (default: 10)\n");
+	printf("  --repeat N         replay the recording N times (default: 1)\n");
+	printf("  --sync             glFinish after every frame, CPU time then includes the rendering\n");
+	printf("  --stream-uploads   upload the model through the UploadScheduler during the first frames\n");
+	printf("  --upload-budget MS time budget of the uploads per frame (default: 2)\n");
+	printf("  --drop-geometry    free the CPU copies of the mesh geometry once it is uploaded\n");
+	printf("  --shader-dir DIR   directory containing vert.glsl and frag.glsl (default: .)\n");
+	printf("  --csv FILE         write per-frame timings as CSV\n");
+	printf("  --json FILE        write the summary and per-frame timings as JSON\n");
+	printf("  --label TEXT       label stored in the JSON output (default: recording path)\n");
+	printf("  --capture DIR      write the frames of the first pass to DIR as an image sequence\n");
+	printf("  --capture-format F png or exr (default: png)\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+		else if (arg == "--model" && has_value)
+			options.model = argv[++i];
+		else if (arg == "--size" && has_value)
+		{
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+				return false;
+		}
+		else if (arg == "--timestep" && has_value)
+			options.timestep = (float)atof(argv[++i]);
+		else if (arg == "--warmup" && has_value)
+			options.warmup = atoi(argv[++i]);
+		else if (arg == "--repeat" && has_value)
+			options.repeat = atoi(argv[++i]);
+		else if (arg == "--sync")
+			options.sync = true;
+		else if (arg == "--stream-uploads")
+			options.streamUploads = true;
+		else if (arg == "--upload-budget" && has_value)
+			options.uploadBudgetMs = atof(argv[++i]);
+		else if (arg == "--drop-geometry")
+			options.dropGeometry = true;
+		else if (arg == "--shader-dir" && has_value)
+			options.shaderDir = argv[++i];
+		else if (arg == "--csv" && has_value)
+			options.csvPath = argv[++i];
+		else if (arg == "--json" && has_value)
+			options.jsonPath = argv[++i];
+		else if (arg == "--label" && has_value)
+			options.label = argv[++i];
+		else if (arg == "--capture" && has_value)
+			options.captureDir = argv[++i];
+		else if (arg == "--capture-format" && has_value)
+		{
+			string format = argv[++i];
+			if (format == "exr")
+				options.captureFormat = CAPTURE_FORMAT_EXR;
+			else if (format != "png")
+				return false;
+		}
+		else if (arg.rfind("--", 0) == 0)
+		{
+			printf("ERROR::REPLAY::UNKNOWN_OPTION: %s\n", arg.c_str());
+			return false;
+		}
+		else
+			options.recording = arg;
+	}
+
+	return !options.recording.empty() && options.timestep > 0.0f && options.warmup >= 0 && options.repeat > 0;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	InputRecording recording;
+	if (!LoadInputRecording(options.recording, recording))
+		return -1;
+
+	if (options.width == 0)
+	{
+		options.width = recording.width;
+		options.height = recording.height;
+	}
+
+	HeadlessContext context;
+	if (!context.Create(3, 3))
+	{
+		return -1;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress))
+	{
+		printf("Failed to initialize GLAD\n");
+		context.Delete();
+		return -1;
+	}
+
+	printf("Renderer: %s\n", glGetString(GL_RENDERER));
+	InitTextureStorage((GLADloadproc)HeadlessContext::GetProcAddress);
+
+	Framebuffer framebuffer(options.width, options.height);
+	if (!framebuffer.IsComplete())
+	{
+		printf("ERROR::REPLAY::FRAMEBUFFER_INCOMPLETE\n");
+		context.Delete();
+		return -1;
+	}
+
+	// Reads the framebuffer back a few frames late and encodes on the job system, like the viewer
+	FrameCapture capture;
+	if (!options.captureDir.empty() && !capture.StartSequence(options.captureDir, "frame", options.captureFormat))
+	{
+		framebuffer.Delete();
+		context.Delete();
+		return -1;
+	}
+	capture.Create();
+
+	string vertex_path = options.shaderDir + "/vert.glsl";
+	string fragment_path = options.shaderDir + "/frag.glsl";
+	ShaderVariants shaderVariants(vertex_path.c_str(), fragment_path.c_str());
+
+	stbi_set_flip_vertically_on_load(true);
+	Model model(options.model, true, options.streamUploads);
+	if (options.dropGeometry)
+		model.geometryPolicy = GEOMETRY_DROP_AFTER_UPLOAD;
+	// uploaded by the constructor, the policy only applies to Upload
+	if (options.dropGeometry && !options.streamUploads)
+		model.ReleaseGeometry();
+
+	// Streamed uploads land in the frame timings of the first frames instead of before the replay
+	UploadScheduler uploadScheduler;
+	if (options.streamUploads)
+	{
+		uploadScheduler.Create(4 * 1024 * 1024, (GLADloadproc)HeadlessContext::GetProcAddress);
+		uploadScheduler.SetBudget(options.uploadBudgetMs, uploadScheduler.GetSegmentSize());
+		model.Upload(uploadScheduler);
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	glViewport(0, 0, options.width, options.height);
+
+	// Same state as the interactive viewer: untransformed model, untinted textures
+	shaderVariants.Prepare(model.GetMaterialFeatures());
+	shaderVariants.setVec3("materialColor", glm::vec3(1.0f));
+
+	UniformRing uniformRing;
+	uniformRing.Create(64 * 1024, (GLADloadproc)HeadlessContext::GetProcAddress);
+	glm::mat4 transform = glm::mat4(1.0f);
+
+	FrameStats stats(true);
+	framebuffer.Bind();
+
+	glm::vec3 final_position(0.0f);
+	for (int pass = 0; pass < options.repeat; pass++)
+	{
+		// Every pass starts from the camera state the viewer starts with
+		Camera camera;
+		camera.SetViewportSize(options.width, options.height);
+		CameraController controller(camera, recording.width / 2.0, recording.height / 2.0);
+
+		for (const InputFrame& frame : recording.frames)
+		{
+			stats.BeginFrame();
+			Mesh::drawStats = DrawStats();
+			uniformRing.BeginFrame();
+			uploadScheduler.Process();
+
+			ReplayInputFrame(frame, controller, options.timestep);
+
+			glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			uniformRing.PushAndBind(FRAME_UNIFORMS_BINDING, MakeFrameUniforms(camera.GetViewMatrix(), camera.GetProjectionMatrix(), camera.GetPosition()));
+			model.Draw(shaderVariants, uniformRing, transform);
+			uniformRing.EndFrame();
+
+			capture.CaptureFrame(options.width, options.height);
+			capture.Update();
+
+			if (options.sync)
+				glFinish();
+
+			stats.EndFrame(Mesh::drawStats);
+		}
+
+		final_position = camera.GetPosition();
+		capture.StopSequence();
+	}
+
+	stats.Finish();
+	// the last frames are still on their way to the encoders
+	capture.Flush();
+	framebuffer.Unbind();
+
+	printf("Replayed %s: %zu frames x %d, %dx%d, timestep %.4f s\n", options.recording.c_str(), recording.frames.size(),
+		options.repeat, options.width, options.height, options.timestep);
+	stats.PrintSummary(stdout, options.warmup);
+	// Identical for every build replaying the same recording, a quick check that the camera path matched
+	printf("Final camera position: %.6f %.6f %.6f\n", final_position.x, final_position.y, final_position.z);
+	if (options.streamUploads)
+	{
+		const UploadStats& upload_stats = uploadScheduler.GetStats();
+		printf("Uploads: %.1f MB, %llu requests in %llu frames, %.3f ms max per frame, %llu frames skipped on fences%s\n",
+			upload_stats.totalBytes / 1048576.0, upload_stats.completedUploads, upload_stats.frames, upload_stats.maxMs, upload_stats.fenceSkips,
+			uploadScheduler.IsBusy() ? ", NOT FINISHED" : "");
+	}
+	MemoryTracker& memory = MemoryTracker::Get();
+	printf("Memory: model %.2f MB CPU geometry, %.2f MB CPU textures, %.2f MB GPU buffers, %.2f MB GPU textures; total GPU %.2f MB\n",
+		memory.GetOwnerBytes(model.GetMemoryOwner(), MEMORY_CPU_GEOMETRY) / 1048576.0, memory.GetOwnerBytes(model.GetMemoryOwner(), MEMORY_CPU_TEXTURE) / 1048576.0,
+		memory.GetOwnerBytes(model.GetMemoryOwner(), MEMORY_GPU_BUFFER) / 1048576.0, memory.GetOwnerBytes(model.GetMemoryOwner(), MEMORY_GPU_TEXTURE) / 1048576.0,
+		(memory.GetTotal(MEMORY_GPU_BUFFER) + memory.GetTotal(MEMORY_GPU_TEXTURE)) / 1048576.0);
+	if (!options.captureDir.empty())
+	{
+		CaptureStats capture_stats = capture.GetStats();
+		printf("Capture: %llu frames written to %s, %llu dropped, %llu failed; latency %.1f ms avg, %.1f ms max; GL thread %.3f ms avg, %.3f ms max per frame\n",
+			capture_stats.written, options.captureDir.c_str(), capture_stats.dropped, capture_stats.failed, capture_stats.GetAverageLatencyMs(),
+			capture_stats.maxLatencyMs, capture_stats.GetAverageFrameMs(), capture_stats.maxFrameMs);
+	}
+	const GeometryStoreStats& geometry = GeometryStore::Get().GetStats();
+	printf("Geometry store: %zu meshes share %zu buffers, %.2f MB for %.2f MB of geometry (sharing ratio %.2f)\n",
+		geometry.references, geometry.entries, geometry.storedBytes / 1048576.0, geometry.referencedBytes / 1048576.0, geometry.GetSharingRatio());
+
+	int result = 0;
+	if (!options.csvPath.empty() && !stats.WriteCsv(options.csvPath))
+		result = -1;
+	if (!options.jsonPath.empty() && !stats.WriteJson(options.jsonPath, options.label.empty() ? options.recording : options.label, options.warmup))
+		result = -1;
+
+	stats.Delete();
+	uniformRing.Delete();
+	capture.Delete();
+	model.Delete();
+	uploadScheduler.Delete();
+	shaderVariants.Delete();
+	framebuffer.Delete();
+	GpuResourcePool::Get().Clear();
+	context.Delete();
+
+	Logger::Get().Shutdown();
+	return result;
+}
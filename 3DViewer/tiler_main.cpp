@@ -0,0 +1,117 @@
+/*
+* Offline tiler for virtual textures.
+* Cuts an image into the mip-tiled page file VirtualTexture streams from: every level of the mip chain
+* in pages of 120x120 texels with a 4 texel border, optionally BC7 compressed. Write it next to the
+* image with the same name and a .vtex extension and Model picks it up instead of the image.
+*
+* The image is decoded with stb_image, which limits the input to what fits in memory as one RGBA8
+* image (a 32k x 32k atlas needs 4 GB). The output has no such limit, pages are written row by row.
+*/
+
+#include "VirtualTextureCache.h"
+#include "Logger.h"
+
+#include <stb_image.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+	std::string input;
+	std::string output;
+	TextureCodec codec = TEXTURE_CODEC_NONE;
+	int threads = 0;
+};
+
+void PrintUsage()
+{
+	printf("Usage: 3DViewerTiler [options] <image>\n");
+	printf("  --out FILE         page file to write (default: the image path with .vtex)\n");
+	printf("  --bc7              BC7 compress the pages, a quarter of the size on disk and in VRAM\n");
+	printf("  --threads N        encoder threads (default: all cores)\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--help" || arg == "-h")
+			return false;
+		else if (arg == "--out" && has_value)
+			options.output = argv[++i];
+		else if (arg == "--bc7")
+			options.codec = TEXTURE_CODEC_BC7;
+		else if (arg == "--threads" && has_value)
+			options.threads = atoi(argv[++i]);
+		else if (arg.rfind("--", 0) == 0)
+		{
+			printf("ERROR::TILER::UNKNOWN_OPTION: %s\n", arg.c_str());
+			return false;
+		}
+		else
+			options.input = arg;
+	}
+
+	if (options.output.empty() && !options.input.empty())
+		options.output = fs::path(options.input).replace_extension(".vtex").string();
+	return !options.input.empty();
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Clock::time_point start = Clock::now();
+
+	// rows bottom up like the textures the viewer uploads
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, components;
+	unsigned char* pixels = stbi_load(options.input.c_str(), &width, &height, &components, 0);
+	if (!pixels)
+	{
+		printf("ERROR::TILER::IMAGE_LOAD_FAILED: %s (%s)\n", options.input.c_str(), stbi_failure_reason());
+		return 1;
+	}
+	double load_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+	bool ok = VirtualTextureFile::Build(pixels, width, height, components, options.output, options.codec, options.threads);
+	stbi_image_free(pixels);
+	double total_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+	VirtualTextureFile file;
+	if (!ok || !file.Open(options.output))
+	{
+		printf("ERROR::TILER::BUILD_FAILED: %s\n", options.output.c_str());
+		Logger::Get().Shutdown();
+		return 1;
+	}
+
+	const VirtualTextureLayout& layout = file.GetLayout();
+	size_t pages = 0;
+	for (int level = 0; level < layout.levels; level++)
+		pages += (size_t)layout.GetPagesX(level) * layout.GetPagesY(level);
+	std::error_code error;
+	uintmax_t size = fs::file_size(options.output, error);
+
+	printf("Tiled %s: %dx%d, %d levels, %zu pages of %dx%d%s\n", options.input.c_str(), width, height, layout.levels, pages,
+		layout.GetPageSize(), layout.GetPageSize(), options.codec == TEXTURE_CODEC_BC7 ? " (BC7)" : "");
+	printf("  wrote %s, %.1f MB in %.2f s (%.2f s decoding the image)\n", options.output.c_str(), size / 1048576.0, total_s, load_s);
+
+	Logger::Get().Shutdown();
+	return 0;
+}
@@ -4,14 +4,40 @@ layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 
-out vec2 TexCoord;
+#ifdef HAS_TEXCOORDS
+out vec2 TexCoords;
+#endif
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// std140 blocks mirrored by FrameUniforms/ObjectUniforms in UniformBlocks.h
+layout(std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+};
+
+layout(std140) uniform ObjectUniforms
+{
+    mat4 model;
+};
+
+#ifdef HAS_INSTANCES
+// MAX_INSTANCES_PER_DRAW in UniformBlocks.h
+layout(std140) uniform InstanceUniforms
+{
+    mat4 instanceModels[64];
+};
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPosition, 1.0);
-    TexCoord = aTexCoord;
+#ifdef HAS_INSTANCES
+    gl_Position = viewProjection * instanceModels[gl_InstanceID] * vec4(aPosition, 1.0);
+#else
+    gl_Position = viewProjection * model * vec4(aPosition, 1.0);
+#endif
+#ifdef HAS_TEXCOORDS
+    TexCoords = aTexCoord;
+#endif
 }
@@ -0,0 +1,25 @@
+#version 330 core
+// Feedback pass of VirtualTexture, drawn with vert.glsl into an R32UI target a quarter of the screen
+// size. Every pixel writes the page it would sample as level << 28 | y << 14 | x (MakePageId).
+layout(location = 0) out uint FeedbackPage;
+
+in vec2 TexCoords;
+
+uniform vec2 vt_image_size;
+uniform float vt_page_content;
+uniform float vt_max_level;
+// makes up for the smaller target, whose derivatives are larger than on screen
+uniform float vt_feedback_bias;
+
+void main()
+{
+    vec2 texel = clamp(TexCoords, 0.0, 1.0) * vt_image_size;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + vt_feedback_bias;
+    int level = int(clamp(floor(lod), 0.0, vt_max_level));
+
+    texel = clamp(texel, vec2(0.5), vt_image_size - 0.5);
+    ivec2 page = ivec2(texel / vt_page_content) >> level;
+    FeedbackPage = (uint(level) << 28) | (uint(page.y) << 14) | uint(page.x);
+}